@@ -0,0 +1,147 @@
+/* Confronto codifiche di /data: JSON (obd_json_format) e frame binario
+   (obd_frame_encode), completo e delta sull'ultimo frame confermato.
+   Sequenza di aggiornamenti con la cadenza dello scheduler: campi ad
+   alta priorità a ogni passo (100 ms), media ogni 5, bassa ogni 20.
+
+   uso: obd_codec_bench [aggiornamenti] [ripetizioni]
+*/
+#include "obd.h"
+#include "obd_json.h"
+#include "obd_frame.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+static float jitter(float amp)
+{
+    return amp * ((float)rand() / (float)RAND_MAX * 2.0f - 1.0f);
+}
+
+/* Valore fisico -> fixed-point del campo */
+static void put(obd_full_data_t *d, obd_field_t f, float x)
+{
+    d->v[f] = (int32_t)lroundf(x * (float)obd_field_div(f));
+}
+
+/* Passo k della guida simulata: aggiorna solo i campi "dovuti" */
+static void step(obd_full_data_t *d, int k)
+{
+    int rpm = (int)d->v[OBD_F_RPM] + (int)jitter(120.0f);
+    rpm = rpm < 750 ? 750 : rpm > 6500 ? 6500 : rpm;
+    d->v[OBD_F_RPM] = rpm;
+    d->v[OBD_F_SPEED] = rpm / 40;
+    put(d, OBD_F_LOAD, 20.0f + (float)(rpm % 600) / 10.0f);
+    put(d, OBD_F_THROTTLE, 12.0f + jitter(3.0f));
+
+    if (k % 5 == 0)
+    {
+        put(d, OBD_F_TIMING, 10.0f + jitter(4.0f));
+        put(d, OBD_F_MAF, (float)rpm / 200.0f + jitter(0.5f));
+        d->v[OBD_F_COOLANT] = 90 + (int)jitter(1.5f);
+        d->v[OBD_F_INTAKE_TEMP] = 31;
+        d->v[OBD_F_MAP] = 35 + rpm / 100;
+        put(d, OBD_F_BARO, 101.0f);
+        put(d, OBD_F_BATTERY, 13.8f + jitter(0.1f));
+    }
+    if (k % 20 == 0)
+    {
+        d->v[OBD_F_AMBIENT] = 22;
+        put(d, OBD_F_FUEL_LEVEL, 63.5f - (float)k * 0.001f);
+        put(d, OBD_F_FUEL_PRESS, 380.0f);
+        put(d, OBD_F_TRIM_SHORT, jitter(3.0f));
+        put(d, OBD_F_TRIM_LONG, 1.6f);
+        d->v[OBD_F_DIST_MIL] = 0;
+        d->v[OBD_F_DTC_COUNT] = 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int updates = argc > 1 ? atoi(argv[1]) : 2000;
+    int reps = argc > 2 ? atoi(argv[2]) : 50;
+
+    obd_full_data_t *seq = calloc((size_t)updates, sizeof(*seq));
+    obd_full_data_t d = {.v[OBD_F_RPM] = 900};
+    for (int k = 0; k < updates; k++)
+    {
+        step(&d, k);
+        seq[k] = d;
+    }
+
+    static obd_frame_ctx_t ctx;
+    char json[768];
+    uint8_t frame[OBD_FRAME_MAX_LEN];
+    size_t bytes_json = 0, bytes_full = 0, bytes_delta = 0;
+    int mismatches = 0;
+
+    // dimensioni e verifica del round-trip (delta su ack = frame precedente)
+    obd_frame_ctx_init(&ctx);
+    int32_t base[OBD_FIELD_COUNT] = {0}, out[OBD_FIELD_COUNT];
+    uint32_t base_seq = 0;
+
+    for (int k = 0; k < updates; k++)
+    {
+        uint32_t s = (uint32_t)(k + 1) * 2;
+        bytes_json += (size_t)obd_json_format(json, sizeof(json), &seq[k]);
+        bytes_full += (size_t)obd_frame_encode(&ctx, &seq[k], s, 0, frame, sizeof(frame));
+
+        int n = obd_frame_encode(&ctx, &seq[k], s, base_seq, frame, sizeof(frame));
+        bytes_delta += (size_t)n;
+
+        uint32_t got;
+        if (obd_frame_decode(frame, (size_t)n, base, base_seq, out, &got) != 0 || got != s)
+            mismatches++;
+        for (int f = 0; f < OBD_FIELD_COUNT; f++)
+            if (out[f] != obd_field_fixed(&seq[k], (obd_field_t)f))
+                mismatches++;
+
+        memcpy(base, out, sizeof(base));
+        base_seq = got;
+    }
+
+    // tempi di codifica
+    double t0 = now_ns();
+    for (int r = 0; r < reps; r++)
+        for (int k = 0; k < updates; k++)
+            obd_json_format(json, sizeof(json), &seq[k]);
+    double t_json = (now_ns() - t0) / ((double)reps * updates);
+
+    t0 = now_ns();
+    for (int r = 0; r < reps; r++)
+    {
+        obd_frame_ctx_init(&ctx);
+        for (int k = 0; k < updates; k++)
+            obd_frame_encode(&ctx, &seq[k], (uint32_t)(k + 1) * 2, 0, frame, sizeof(frame));
+    }
+    double t_full = (now_ns() - t0) / ((double)reps * updates);
+
+    t0 = now_ns();
+    for (int r = 0; r < reps; r++)
+    {
+        obd_frame_ctx_init(&ctx);
+        for (int k = 0; k < updates; k++)
+            obd_frame_encode(&ctx, &seq[k], (uint32_t)(k + 1) * 2, (uint32_t)k * 2, frame,
+                             sizeof(frame));
+    }
+    double t_delta = (now_ns() - t0) / ((double)reps * updates);
+
+    printf("updates=%d reps=%d\n", updates, reps);
+    printf("%-12s %10s %12s\n", "codec", "bytes/upd", "ns/encode");
+    printf("%-12s %10.1f %12.1f\n", "json", (double)bytes_json / updates, t_json);
+    printf("%-12s %10.1f %12.1f\n", "bin_full", (double)bytes_full / updates, t_full);
+    printf("%-12s %10.1f %12.1f\n", "bin_delta", (double)bytes_delta / updates, t_delta);
+    printf("roundtrip_mismatches=%d\n", mismatches);
+
+    free(seq);
+    return mismatches ? 1 : 0;
+}
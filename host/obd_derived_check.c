@@ -0,0 +1,393 @@
+/* Verifica dei segnali derivati (obd_derived.c).
+
+   1. Accelerazione: partenze ad accelerazione costante nota, velocità
+      intera (come da PID 0x0D) campionata ogni 100 ms con jitter e fase
+      casuale; 0-100 e 80-120 entro la tolleranza dal valore esatto.
+   2. Viaggio: crociera a velocità e MAF costanti; distanza, carburante,
+      consumo istantaneo e medio contro la formula chiusa, anche con i
+      trim e con un buco nei campioni di velocità (non integrato).
+   3. Marcia: ogni rapporto della tabella riconosciuto, quelli in mezzo no.
+   4. Stack completo: l'ECU simulata (rampa 0..120 km/h in 10 s) a tempo
+      accelerato; 0-100 come dalla rampa, distanza uguale all'integrale
+      in doppia precisione dei campioni pubblicati.
+   Con -r, una sequenza registrata (CSV di obd_replay -o) passa nel
+   motore e il risultato si confronta con lo stesso integrale.
+
+   uso: obd_derived_check [-r csv] [-v]
+*/
+#include "obd.h"
+#include "obd_derived.h"
+#include "can_bus.h"
+#include "sim_ecu.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int s_fail;
+static bool s_verbose;
+
+#define CHECK(cond, ...)                \
+    do                                  \
+    {                                   \
+        if (!(cond))                    \
+        {                               \
+            printf("FAIL: " __VA_ARGS__); \
+            printf("\n");               \
+            s_fail++;                   \
+        }                               \
+    } while (0)
+
+static double field(const obd_full_data_t *d, obd_field_t f)
+{
+    return (double)d->v[f] / obd_field_div(f);
+}
+
+static void feed(obd_full_data_t *d, obd_field_t f, int32_t v, uint32_t t)
+{
+    d->v[f] = v;
+    obd_derived_update(d, f, t);
+}
+
+/* Integrale a trapezi in doppia precisione, stesse regole sui buchi */
+typedef struct
+{
+    bool have;
+    double v, t, sum; // sum in (unità x ore)
+} ref_integ_t;
+
+static void ref_step(ref_integ_t *r, double v, double t_ms)
+{
+    if (r->have && t_ms - r->t <= OBD_DERIVED_MAX_GAP_MS)
+        r->sum += (r->v + v) / 2 * (t_ms - r->t) / 3600000.0;
+    r->have = true;
+    r->v = v;
+    r->t = t_ms;
+}
+
+/* ---------------------------------------------------------------
+ * 1. Accelerazione
+ * --------------------------------------------------------------- */
+static void check_accel(void)
+{
+    static const double k_accel[] = {6.0, 12.5, 25.0}; // km/h al secondo
+    double err_max[2] = {0, 0}, err_sum[2] = {0, 0};
+    int runs = 0;
+
+    srand(7);
+    for (size_t a = 0; a < sizeof(k_accel) / sizeof(k_accel[0]); a++)
+    {
+        for (int k = 0; k < 100; k++)
+        {
+            obd_full_data_t d = {0};
+            obd_derived_reset();
+
+            // fermo 1 s, poi partenza in un punto qualsiasi tra due campioni
+            double t0 = 1000.0 + rand() % 100;
+            uint32_t t = (uint32_t)(rand() % 100);
+            while (true)
+            {
+                double v = t < t0 ? 0.0 : k_accel[a] * (t - t0) / 1000.0;
+                feed(&d, OBD_F_SPEED, (int32_t)floor(v), t);
+                if (v >= 125.0)
+                    break;
+                t += 100 + (uint32_t)(rand() % 31) - 15;
+            }
+
+            double want[2] = {100.0 / k_accel[a], 40.0 / k_accel[a]};
+            double got[2] = {field(&d, OBD_F_T_0_100), field(&d, OBD_F_T_80_120)};
+            for (int i = 0; i < 2; i++)
+            {
+                double e = fabs(got[i] - want[i]);
+                err_sum[i] += e;
+                if (e > err_max[i])
+                    err_max[i] = e;
+                if (s_verbose)
+                    printf("  %.1f km/h/s: %s %.2f s (esatto %.3f)\n", k_accel[a],
+                           i ? "80-120" : "0-100", got[i], want[i]);
+            }
+            runs++;
+        }
+    }
+
+    printf("accelerazione: %d partenze, 0-100 errore medio %.3f s max %.3f s, "
+           "80-120 medio %.3f s max %.3f s\n",
+           runs, err_sum[0] / runs, err_max[0], err_sum[1] / runs, err_max[1]);
+    CHECK(err_max[0] <= 0.1 && err_max[1] <= 0.1, "errore oltre 0.1 s");
+
+    // un buco nei dati annulla la misura; fermarsi la riarma
+    obd_full_data_t d = {0};
+    obd_derived_reset();
+    feed(&d, OBD_F_SPEED, 0, 0);
+    feed(&d, OBD_F_SPEED, 0, 100);
+    feed(&d, OBD_F_SPEED, 10, 200);
+    feed(&d, OBD_F_SPEED, 110, 200 + OBD_DERIVED_MAX_GAP_MS + 100);
+    CHECK(d.v[OBD_F_T_0_100] == 0, "misura chiusa attraverso un buco: %.2f s",
+          field(&d, OBD_F_T_0_100));
+}
+
+/* ---------------------------------------------------------------
+ * 2. Viaggio
+ * --------------------------------------------------------------- */
+static void cruise(int32_t kmh, int32_t maf_c, int32_t trim, uint32_t gap_from, uint32_t gap_ms,
+                   obd_full_data_t *d)
+{
+    memset(d, 0, sizeof(*d));
+    obd_derived_reset();
+    feed(d, OBD_F_TRIM_LONG, trim, 0);
+
+    for (uint32_t t = 0; t <= 3600000; t += 100)
+    {
+        if (t < gap_from || t >= gap_from + gap_ms)
+            feed(d, OBD_F_SPEED, kmh, t);
+        if (t % 500 == 0)
+            feed(d, OBD_F_MAF, maf_c, t);
+    }
+}
+
+static void check_trip(void)
+{
+    obd_full_data_t d;
+
+    // 90 km/h e 20 g/s per un'ora
+    cruise(90, 2000, 0, UINT32_MAX, 0, &d);
+    double lph = 20.0 * 3600 / (OBD_DERIVED_AFR_X10 / 10.0) / OBD_DERIVED_FUEL_DENSITY;
+    printf("viaggio: %.2f km %.2f L (atteso %.2f), %.2f L/h, %.1f L/100km, media %.1f\n",
+           field(&d, OBD_F_TRIP_DIST), field(&d, OBD_F_TRIP_FUEL), lph,
+           field(&d, OBD_F_FUEL_RATE), field(&d, OBD_F_ECON), field(&d, OBD_F_ECON_TRIP));
+
+    CHECK(fabs(field(&d, OBD_F_TRIP_DIST) - 90.0) <= 0.01, "distanza %.2f km",
+          field(&d, OBD_F_TRIP_DIST));
+    CHECK(fabs(field(&d, OBD_F_TRIP_FUEL) - lph) <= 0.02, "carburante %.2f L",
+          field(&d, OBD_F_TRIP_FUEL));
+    CHECK(fabs(field(&d, OBD_F_FUEL_RATE) - lph) <= 0.01, "L/h %.2f", field(&d, OBD_F_FUEL_RATE));
+    CHECK(fabs(field(&d, OBD_F_ECON) - lph / 90 * 100) <= 0.1, "L/100km %.1f",
+          field(&d, OBD_F_ECON));
+    CHECK(fabs(field(&d, OBD_F_ECON_TRIP) - lph / 90 * 100) <= 0.1, "media %.1f",
+          field(&d, OBD_F_ECON_TRIP));
+
+    // trim +5%: il carburante cresce del 5%
+    cruise(90, 2000, 50, UINT32_MAX, 0, &d);
+    CHECK(fabs(field(&d, OBD_F_TRIP_FUEL) - lph * 1.05) <= 0.02, "con trim %.2f L",
+          field(&d, OBD_F_TRIP_FUEL));
+
+    // 5 s senza velocità: quei 125 m non si integrano
+    cruise(90, 2000, 0, 600000, 5000, &d);
+    CHECK(fabs(field(&d, OBD_F_TRIP_DIST) - (90.0 - 0.125)) <= 0.01, "con buco %.2f km",
+          field(&d, OBD_F_TRIP_DIST));
+
+    // fermo: consumo orario sì, per 100 km no
+    cruise(0, 250, 0, UINT32_MAX, 0, &d);
+    CHECK(d.v[OBD_F_ECON] == 0 && d.v[OBD_F_ECON_TRIP] == 0 && d.v[OBD_F_FUEL_RATE] > 0,
+          "da fermo: %.1f L/100km, media %.1f, %.2f L/h", field(&d, OBD_F_ECON),
+          field(&d, OBD_F_ECON_TRIP), field(&d, OBD_F_FUEL_RATE));
+}
+
+/* ---------------------------------------------------------------
+ * 3. Marcia
+ * --------------------------------------------------------------- */
+static void check_gear(void)
+{
+    static const uint16_t k_ratio[] = OBD_DERIVED_GEAR_RATIOS;
+    const int n = (int)(sizeof(k_ratio) / sizeof(k_ratio[0]));
+    int ok = 0, total = 0;
+    obd_full_data_t d = {0};
+
+    obd_derived_reset();
+    for (int g = 0; g < n; g++)
+    {
+        for (int32_t rpm = 1200; rpm <= 5000; rpm += 200)
+        {
+            int32_t kmh = rpm * k_ratio[g] / 10000;
+            if (kmh < OBD_DERIVED_MIN_KMH)
+                continue;
+            feed(&d, OBD_F_RPM, rpm, 0);
+            feed(&d, OBD_F_SPEED, kmh, 0);
+            total++;
+            ok += d.v[OBD_F_GEAR] == g + 1;
+            if (s_verbose && d.v[OBD_F_GEAR] != g + 1)
+                printf("  %d giri %d km/h: marcia %d, attesa %d\n", (int)rpm, (int)kmh,
+                       (int)d.v[OBD_F_GEAR], g + 1);
+        }
+
+        // a metà tra due rapporti: frizione, nessuna marcia
+        if (g + 1 < n)
+        {
+            int32_t mid = (k_ratio[g] + k_ratio[g + 1]) / 2;
+            feed(&d, OBD_F_RPM, 3000, 0);
+            feed(&d, OBD_F_SPEED, 3000 * mid / 10000, 0);
+            CHECK(d.v[OBD_F_GEAR] == 0, "rapporto %d: marcia %d", (int)mid,
+                  (int)d.v[OBD_F_GEAR]);
+        }
+    }
+
+    printf("marcia: %d/%d riconosciute\n", ok, total);
+    CHECK(ok == total, "marce sbagliate");
+}
+
+/* ---------------------------------------------------------------
+ * 4. Stack completo
+ * --------------------------------------------------------------- */
+static atomic_bool s_stop;
+static ref_integ_t s_ref_dist;
+static obd_full_data_t s_last;
+static int s_speed_samples;
+
+/* Task RT: ogni pubblicazione con una velocità nuova */
+static void on_publish(uint32_t seq, void *ctx)
+{
+    (void)ctx;
+    obd_snapshot_t snap;
+
+    if (atomic_load(&s_stop) || obd_get_snapshot(&snap) != seq)
+        return;
+    if (snap.field_seq[OBD_F_SPEED] == seq)
+    {
+        ref_step(&s_ref_dist, snap.data.v[OBD_F_SPEED], snap.field_ms[OBD_F_SPEED]);
+        s_speed_samples++;
+    }
+    s_last = snap.data;
+}
+
+static void check_stack(void)
+{
+    static sim_ecu_cfg_t ecu = {.resp_id = 0x7E8, .latency_ms = 5, .multi_pid = true};
+    static const uint8_t engine[] = {0x0C, 0x0D, 0x05, 0x42, 0x10};
+    const unsigned scale = 10, sim_s = 45;
+
+    for (size_t i = 0; i < sizeof(engine); i++)
+        sim_ecu_set_pid(&ecu, engine[i], true);
+
+    host_time_scale = scale;
+    sim_bus_init(&ecu, 1, 1);
+    can_bus_init();
+    obd_data_add_listener(on_publish, NULL);
+    obd_init();
+
+    vTaskDelay(pdMS_TO_TICKS(sim_s * 1000));
+    atomic_store(&s_stop, true);
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    // rampa dell'ECU simulata: 12 km/h al secondo
+    double t100 = field(&s_last, OBD_F_T_0_100);
+    printf("stack: %d campioni di velocità, 0-100 %.2f s (rampa %.2f), %.3f km "
+           "(integrale %.3f), %.2f L, media %.1f L/100km\n",
+           s_speed_samples, t100, 100.0 / 12.0, field(&s_last, OBD_F_TRIP_DIST), s_ref_dist.sum,
+           field(&s_last, OBD_F_TRIP_FUEL), field(&s_last, OBD_F_ECON_TRIP));
+
+    CHECK(fabs(t100 - 100.0 / 12.0) <= 0.15, "0-100 %.2f s", t100);
+    CHECK(s_ref_dist.sum > 0.1 && fabs(field(&s_last, OBD_F_TRIP_DIST) - s_ref_dist.sum) <= 0.01,
+          "distanza %.3f km, integrale %.3f", field(&s_last, OBD_F_TRIP_DIST), s_ref_dist.sum);
+    CHECK(s_last.v[OBD_F_TRIP_FUEL] > 0 && s_last.v[OBD_F_ECON_TRIP] > 0, "carburante assente");
+}
+
+/* ---------------------------------------------------------------
+ * Sequenza registrata: CSV di obd_replay -o (t_ms, poi una colonna
+ * per chiave di /data)
+ * --------------------------------------------------------------- */
+static int check_recorded(const char *path)
+{
+    static const obd_field_t k_in[] = {OBD_F_RPM, OBD_F_SPEED, OBD_F_MAF, OBD_F_TRIM_SHORT,
+                                       OBD_F_TRIM_LONG};
+    enum { NIN = sizeof(k_in) / sizeof(k_in[0]) };
+    int col[NIN];
+    char line[2048];
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+    {
+        perror(path);
+        return 1;
+    }
+    if (!fgets(line, sizeof(line), f))
+    {
+        fclose(f);
+        return 1;
+    }
+
+    const char *keys[64];
+    int nkeys = 0;
+    for (char *tok = strtok(line, ",\r\n"); tok && nkeys < 64; tok = strtok(NULL, ",\r\n"))
+        keys[nkeys++] = tok;
+
+    for (int i = 0; i < NIN; i++)
+    {
+        col[i] = -1;
+        for (int c = 0; c < nkeys; c++)
+            if (strcmp(keys[c], obd_field_key(k_in[i])) == 0)
+                col[i] = c;
+    }
+
+    obd_full_data_t d = {0};
+    ref_integ_t dist = {0};
+    int rows = 0;
+    obd_derived_reset();
+
+    while (fgets(line, sizeof(line), f))
+    {
+        double v[64];
+        int n = 0;
+        for (char *tok = strtok(line, ",\n"); tok && n < 64; tok = strtok(NULL, ",\n"))
+            v[n++] = atof(tok);
+        if (n < 2)
+            continue;
+
+        uint32_t t = (uint32_t)v[0];
+        for (int i = 0; i < NIN; i++)
+        {
+            if (col[i] < 0 || col[i] >= n)
+                continue;
+            int32_t fixed = (int32_t)lround(v[col[i]] * obd_field_div(k_in[i]));
+            feed(&d, k_in[i], fixed, t);
+            if (k_in[i] == OBD_F_SPEED)
+                ref_step(&dist, fixed, t);
+        }
+        rows++;
+    }
+    fclose(f);
+
+    printf("registrata: %d righe, %.3f km (integrale %.3f), %.2f L, media %.1f L/100km, "
+           "0-100 %.2f s, 80-120 %.2f s\n",
+           rows, field(&d, OBD_F_TRIP_DIST), dist.sum, field(&d, OBD_F_TRIP_FUEL),
+           field(&d, OBD_F_ECON_TRIP), field(&d, OBD_F_T_0_100), field(&d, OBD_F_T_80_120));
+    CHECK(col[1] >= 0, "%s: colonna speed assente", path);
+    CHECK(fabs(field(&d, OBD_F_TRIP_DIST) - dist.sum) <= 0.01, "distanza diversa dall'integrale");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *recorded = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r': recorded = optarg; break;
+        case 'v': s_verbose = true; break;
+        default:
+            fprintf(stderr, "uso: %s [-r csv] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    host_log_level = 0;
+
+    check_accel();
+    check_trip();
+    check_gear();
+    if (recorded && check_recorded(recorded) != 0)
+        return 1;
+    check_stack();
+
+    printf("%s\n", s_fail ? "FALLITO" : "ok");
+    return s_fail ? 1 : 0;
+}
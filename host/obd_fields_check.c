@@ -0,0 +1,239 @@
+/* Verifica della tabella dei PID (obd_fields.c) contro le formule
+   scritte a mano che sostituisce: per ogni campo e ogni valore grezzo
+   possibile (256 o 65536) il fixed-point di obd_field_decode deve
+   coincidere bit per bit con quello della vecchia decodifica float
+   (lroundf(valore * div)), e il numero scritto nel JSON di /data con
+   quello del vecchio snprintf. Poi il costo per decodifica.
+
+   Unica eccezione ammessa: i valori esattamente a metà tra due passi
+   (es. 0.265 V in centesimi). La tabella arrotonda lontano da zero
+   sempre; la formula float andava su o giù secondo l'errore di
+   rappresentazione (0.265f = 0.26499...) e printf arrotonda al pari.
+   Sono contati a parte; qualsiasi altra differenza fa fallire.
+
+   uso: obd_fields_check [-v]
+     -v   stampa ogni differenza (di default solo le prime per campo)
+*/
+#include "obd.h"
+#include "obd_json.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ---------------------------------------------------------------
+ * Riferimento: struct, switch e formati di /data prima della tabella
+ * --------------------------------------------------------------- */
+typedef struct
+{
+    uint16_t rpm;
+    uint8_t speed;
+    float engine_load;
+    float throttle_pos;
+    float timing_advance;
+    int16_t coolant_temp;
+    int16_t intake_air_temp;
+    int16_t ambient_temp;
+    uint8_t intake_pressure;
+    float barometric_press;
+    float maf_rate;
+    float fuel_level;
+    float fuel_pressure;
+    float fuel_trim_short;
+    float fuel_trim_long;
+    float battery_voltage;
+    uint16_t distance_with_mil;
+    uint8_t dtc_count;
+} legacy_data_t;
+
+static void legacy_apply(legacy_data_t *d, uint8_t pid, const uint8_t b[4])
+{
+    switch (pid)
+    {
+    case 0x0C: d->rpm = (uint16_t)(((uint16_t)b[0] << 8) | b[1]) / 4; break;
+    case 0x0D: d->speed = b[0]; break;
+    case 0x04: d->engine_load = (float)b[0] * 100.0f / 255.0f; break;
+    case 0x11: d->throttle_pos = (float)b[0] * 100.0f / 255.0f; break;
+    case 0x0E: d->timing_advance = ((float)b[0] / 2.0f) - 64.0f; break;
+    case 0x10: d->maf_rate = (float)(((uint16_t)b[0] << 8) | b[1]) / 100.0f; break;
+    case 0x05: d->coolant_temp = (int16_t)b[0] - 40; break;
+    case 0x0F: d->intake_air_temp = (int16_t)b[0] - 40; break;
+    case 0x0B: d->intake_pressure = b[0]; break;
+    case 0x33: d->barometric_press = (float)b[0]; break;
+    case 0x42: d->battery_voltage = (float)(((uint16_t)b[0] << 8) | b[1]) / 1000.0f; break;
+    case 0x46: d->ambient_temp = (int16_t)b[0] - 40; break;
+    case 0x2F: d->fuel_level = (float)b[0] * 100.0f / 255.0f; break;
+    case 0x0A: d->fuel_pressure = (float)b[0] * 3.0f; break;
+    case 0x06: d->fuel_trim_short = ((float)b[0] - 128.0f) * 100.0f / 128.0f; break;
+    case 0x07: d->fuel_trim_long = ((float)b[0] - 128.0f) * 100.0f / 128.0f; break;
+    case 0x21: d->distance_with_mil = (uint16_t)(((uint16_t)b[0] << 8) | b[1]); break;
+    case 0x01: d->dtc_count = (uint8_t)(b[0] & 0x7F); break;
+    }
+}
+
+static int32_t to_fixed(float x, int32_t div)
+{
+    return (int32_t)lroundf(x * (float)div);
+}
+
+/* Vecchio obd_field_fixed() e vecchio formato JSON del campo */
+static int32_t legacy_fixed(const legacy_data_t *d, obd_field_t f, char *json, size_t cap)
+{
+    int div = obd_field_div(f);
+
+    switch (f)
+    {
+    case OBD_F_RPM:         snprintf(json, cap, "%u", (unsigned)d->rpm); return d->rpm;
+    case OBD_F_SPEED:       snprintf(json, cap, "%u", (unsigned)d->speed); return d->speed;
+    case OBD_F_LOAD:        snprintf(json, cap, "%.1f", d->engine_load); return to_fixed(d->engine_load, div);
+    case OBD_F_THROTTLE:    snprintf(json, cap, "%.1f", d->throttle_pos); return to_fixed(d->throttle_pos, div);
+    case OBD_F_TIMING:      snprintf(json, cap, "%.1f", d->timing_advance); return to_fixed(d->timing_advance, div);
+    case OBD_F_COOLANT:     snprintf(json, cap, "%d", (int)d->coolant_temp); return d->coolant_temp;
+    case OBD_F_INTAKE_TEMP: snprintf(json, cap, "%d", (int)d->intake_air_temp); return d->intake_air_temp;
+    case OBD_F_AMBIENT:     snprintf(json, cap, "%d", (int)d->ambient_temp); return d->ambient_temp;
+    case OBD_F_MAP:         snprintf(json, cap, "%u", (unsigned)d->intake_pressure); return d->intake_pressure;
+    case OBD_F_BARO:        snprintf(json, cap, "%.1f", d->barometric_press); return to_fixed(d->barometric_press, div);
+    case OBD_F_MAF:         snprintf(json, cap, "%.2f", d->maf_rate); return to_fixed(d->maf_rate, div);
+    case OBD_F_FUEL_LEVEL:  snprintf(json, cap, "%.1f", d->fuel_level); return to_fixed(d->fuel_level, div);
+    case OBD_F_FUEL_PRESS:  snprintf(json, cap, "%.1f", d->fuel_pressure); return to_fixed(d->fuel_pressure, div);
+    case OBD_F_TRIM_SHORT:  snprintf(json, cap, "%.1f", d->fuel_trim_short); return to_fixed(d->fuel_trim_short, div);
+    case OBD_F_TRIM_LONG:   snprintf(json, cap, "%.1f", d->fuel_trim_long); return to_fixed(d->fuel_trim_long, div);
+    case OBD_F_BATTERY:     snprintf(json, cap, "%.2f", d->battery_voltage); return to_fixed(d->battery_voltage, div);
+    case OBD_F_DIST_MIL:    snprintf(json, cap, "%u", (unsigned)d->distance_with_mil); return d->distance_with_mil;
+    case OBD_F_DTC_COUNT:   snprintf(json, cap, "%u", (unsigned)d->dtc_count); return d->dtc_count;
+    default:                json[0] = '\0'; return 0;
+    }
+}
+
+/* raw cade esattamente a metà tra due valori fixed-point */
+static bool is_tie(const obd_pid_desc_t *d, unsigned raw)
+{
+    int32_t n = (int32_t)raw * d->mul + d->add;
+    return !d->trunc && n % d->den != 0 && (2 * n) % d->den == 0;
+}
+
+/* Valore del campo f nel JSON di /data generato dalla tabella */
+static void json_value(const obd_full_data_t *d, obd_field_t f, char *out, size_t cap)
+{
+    char json[OBD_JSON_MAX_LEN], key[32];
+
+    obd_json_format(json, sizeof(json), d);
+    snprintf(key, sizeof(key), "\"%s\":", obd_field_key(f));
+
+    const char *p = strstr(json, key) + strlen(key);
+    size_t n = strcspn(p, ",}");
+    if (n >= cap)
+        n = cap - 1;
+    memcpy(out, p, n);
+    out[n] = '\0';
+}
+
+static double now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    bool verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    unsigned fixed_bad = 0, json_bad = 0, ties_diff = 0, checked = 0;
+
+    printf("%-14s %-4s %6s %6s %6s %6s\n", "campo", "pid", "valori", "fixed", "json", "metà");
+
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+    {
+        const obd_pid_desc_t *desc = obd_field_desc((obd_field_t)f);
+        unsigned n = desc->bytes == 2 ? 65536 : 256;
+        unsigned fb = 0, jb = 0, tb = 0;
+
+        if (!desc->bytes)
+            continue; // derivato: nessuna decodifica (obd_derived.c)
+
+        if (obd_field_for_pid(desc->pid) != f)
+        {
+            printf("%s: PID 0x%02X già usato da un altro campo\n", desc->key, desc->pid);
+            fixed_bad++;
+        }
+
+        for (unsigned raw = 0; raw < n; raw++)
+        {
+            // per i campi a un byte B varia comunque: non deve contare
+            uint8_t b[4] = {desc->bytes == 2 ? (uint8_t)(raw >> 8) : (uint8_t)raw,
+                            desc->bytes == 2 ? (uint8_t)raw : (uint8_t)(raw * 7), 0x5A, 0xA5};
+            legacy_data_t old = {0};
+            obd_full_data_t cur = {0};
+            char old_json[32], new_json[32];
+
+            legacy_apply(&old, desc->pid, b);
+            int32_t want = legacy_fixed(&old, (obd_field_t)f, old_json, sizeof(old_json));
+            cur.v[f] = obd_field_decode((obd_field_t)f, b);
+            json_value(&cur, (obd_field_t)f, new_json, sizeof(new_json));
+
+            bool fdiff = cur.v[f] != want;
+            bool jdiff = strcmp(old_json, new_json) != 0;
+
+            if (is_tie(desc, raw))
+            {
+                tb += fdiff || jdiff;
+                if (verbose && (fdiff || jdiff))
+                    printf("  %s raw=%u (metà): fixed %ld/%ld json %s/%s\n", desc->key, raw,
+                           (long)cur.v[f], (long)want, new_json, old_json);
+                continue;
+            }
+
+            if (fdiff && (verbose || fb < 3))
+                printf("  %s raw=%u: fixed %ld, prima %ld\n", desc->key, raw, (long)cur.v[f],
+                       (long)want);
+            if (jdiff && (verbose || jb < 3))
+                printf("  %s raw=%u: json %s, prima %s\n", desc->key, raw, new_json, old_json);
+
+            fb += fdiff;
+            jb += jdiff;
+        }
+
+        printf("%-14s 0x%02X %6u %6u %6u %6u\n", desc->key, desc->pid, n, fb, jb, tb);
+        fixed_bad += fb;
+        json_bad += jb;
+        ties_diff += tb;
+        checked += n;
+    }
+
+    // costo per decodifica: tabella intera contro formule float
+    enum { ROUNDS = 2000000 };
+    uint8_t b[4] = {0x1A, 0xF8, 0, 0};
+    obd_full_data_t cur = {0};
+    legacy_data_t old = {0};
+    volatile int32_t sink = 0;
+    int npid = 0;
+
+    while (npid < OBD_FIELD_COUNT && obd_field_desc((obd_field_t)npid)->bytes)
+        npid++;
+
+    double t0 = now_ns();
+    for (int k = 0; k < ROUNDS; k++)
+    {
+        b[0] = (uint8_t)k;
+        int f = k % npid;
+        cur.v[f] = obd_field_decode((obd_field_t)f, b);
+    }
+    double t1 = now_ns();
+    for (int k = 0; k < ROUNDS; k++)
+    {
+        b[0] = (uint8_t)k;
+        legacy_apply(&old, obd_field_desc((obd_field_t)(k % npid))->pid, b);
+    }
+    double t2 = now_ns();
+    sink = cur.v[0] + old.rpm;
+    (void)sink;
+
+    printf("valori=%u differenze: fixed=%u json=%u (a metà, arrotondati diversamente: %u)\n",
+           checked, fixed_bad, json_bad, ties_diff);
+    printf("decodifica: tabella %.1f ns, formule float %.1f ns\n", (t1 - t0) / ROUNDS,
+           (t2 - t1) / ROUNDS);
+
+    return fixed_bad || json_bad ? 1 : 0;
+}
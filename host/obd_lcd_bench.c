@@ -0,0 +1,177 @@
+/* Display LCD alimentato dallo stack OBD simulato, come in app_main.c:
+   il task del contenuto si sveglia a ogni snapshot pubblicato (al più
+   ogni 100 ms), scrive nel framebuffer e il task di flush invia solo le
+   celle cambiate a un HD44780 simulato (sim_lcd.c) che verifica i tempi
+   di esecuzione.
+
+   Riporta celle e comandi per flush, durata del flush (attesa attiva:
+   è CPU consumata), latenza commit -> display e controlla che il display
+   mostri l'ultimo contenuto.
+
+   uso: obd_lcd_bench [-t s] [-f]
+     -t s   durata (default 10)
+     -f     riscrittura completa di entrambe le righe a ogni aggiornamento
+            (il vecchio lcd_update_task) al posto del framebuffer
+*/
+#include "obd.h"
+#include "lcd.h"
+#include "can_bus.h"
+#include "sim_ecu.h"
+#include "sim_lcd.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// come APP_LCD_MIN_MS / APP_LCD_IDLE_MS di app_main.c
+#define LCD_MIN_MS 100
+#define LCD_IDLE_MS 1000
+
+static SemaphoreHandle_t s_wake;
+static SemaphoreHandle_t s_lines_lock;
+static bool s_full;
+static char s_lines[2][LCD_COLS + 1];
+static uint32_t s_updates;
+
+// solo -f: misurati intorno alla riscrittura
+static uint64_t s_full_us, s_full_max_us;
+
+static void on_publish(uint32_t seq, void *ctx)
+{
+    (void)seq;
+    (void)ctx;
+    xSemaphoreGive(s_wake);
+}
+
+static void content_task(void *arg)
+{
+    (void)arg;
+    char line1[LCD_COLS + 1];
+    char line2[LCD_COLS + 1];
+
+    while (1)
+    {
+        xSemaphoreTake(s_wake, pdMS_TO_TICKS(LCD_IDLE_MS));
+
+        obd_full_data_t snap = obd_get_all_data();
+        float temperature = obd_field_value(&snap, OBD_F_COOLANT);
+        float battery = obd_field_value(&snap, OBD_F_BATTERY);
+        unsigned rpm = (unsigned)snap.v[OBD_F_RPM];
+
+        snprintf(line1, sizeof(line1), " AP:%d | T:%0.1f C", 1, temperature);
+        snprintf(line2, sizeof(line2), "+%0.1fV| RPM:%4u", battery, rpm);
+
+        xSemaphoreTake(s_lines_lock, portMAX_DELAY);
+        snprintf(s_lines[0], sizeof(s_lines[0]), "%-16s", line1);
+        snprintf(s_lines[1], sizeof(s_lines[1]), "%-16s", line2);
+        s_updates++;
+
+        if (s_full)
+        {
+            int64_t t0 = esp_timer_get_time();
+            lcd_gotoxy(0, 0);
+            lcd_print(s_lines[0]);
+            lcd_gotoxy(0, 1);
+            lcd_print(s_lines[1]);
+            uint64_t us = (uint64_t)(esp_timer_get_time() - t0);
+            s_full_us += us;
+            if (us > s_full_max_us)
+                s_full_max_us = us;
+        }
+        else
+        {
+            lcd_fb_line(0, line1);
+            lcd_fb_line(1, line2);
+            lcd_fb_commit();
+        }
+        xSemaphoreGive(s_lines_lock);
+
+        vTaskDelay(pdMS_TO_TICKS(LCD_MIN_MS));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int duration_s = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:f")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': duration_s = atoi(optarg); break;
+        case 'f': s_full = true; break;
+        default:
+            fprintf(stderr, "uso: %s [-t s] [-f]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    host_log_level = 0;
+
+    static sim_ecu_cfg_t ecu = {.resp_id = 0x7E8, .latency_ms = 5, .multi_pid = true};
+    static const uint8_t pids[] = {0x0C, 0x0D, 0x05, 0x42, 0x10, 0x01};
+    for (size_t i = 0; i < sizeof(pids); i++)
+        sim_ecu_set_pid(&ecu, pids[i], true);
+
+    sim_bus_init(&ecu, 1, 1);
+    can_bus_init();
+    obd_init();
+
+    lcd_init();
+    if (!s_full)
+        lcd_fb_start();
+
+    s_wake = xSemaphoreCreateBinary();
+    s_lines_lock = xSemaphoreCreateMutex();
+    obd_data_add_listener(on_publish, NULL);
+    xTaskCreate(content_task, "lcd_content", 4096, NULL, 3, NULL);
+
+    vTaskDelay(pdMS_TO_TICKS(duration_s * 1000));
+
+    // ultimo flush completato, poi il confronto
+    xSemaphoreTake(s_lines_lock, portMAX_DELAY);
+    vTaskDelay(pdMS_TO_TICKS(50));
+
+    char shown[2][17];
+    sim_lcd_read(shown);
+    bool ok = strcmp(shown[0], s_lines[0]) == 0 && strcmp(shown[1], s_lines[1]) == 0;
+
+    sim_lcd_stats_t bus;
+    sim_lcd_stats(&bus);
+
+    printf("mode=%s duration_s=%d updates=%u (%.1f/s)\n", s_full ? "full" : "framebuffer",
+           duration_s, s_updates, (double)s_updates / duration_s);
+
+    if (s_full)
+    {
+        printf("refresh: cells=%u cmds=%u per aggiornamento, us avg=%.0f max=%llu cpu=%.2f%%\n",
+               s_updates ? bus.data / s_updates : 0, s_updates ? bus.commands / s_updates : 0,
+               s_updates ? (double)s_full_us / s_updates : 0.0,
+               (unsigned long long)s_full_max_us, s_full_us / (duration_s * 1e6) * 100.0);
+    }
+    else
+    {
+        lcd_stats_t st;
+        lcd_get_stats(&st);
+        double n = st.flushes ? st.flushes : 1;
+        printf("flush: %u (%u aggiornamenti senza cambi) cells/flush=%.1f cmds/flush=%.1f\n",
+               st.flushes, s_updates - st.flushes, st.cells / n, st.commands / n);
+        printf("flush_us avg=%.0f max=%u cpu=%.2f%% latency_us avg=%.0f max=%u\n",
+               st.total_us / n, st.max_us, st.total_us / (duration_s * 1e6) * 100.0,
+               st.latency_total_us / n, st.latency_max_us);
+    }
+
+    printf("hd44780: data=%u commands=%u violations=%u\n", bus.data, bus.commands,
+           bus.violations);
+    printf("display: \"%s\" \"%s\" %s\n", shown[0], shown[1], ok ? "ok" : "DIVERSO");
+
+    return ok && bus.violations == 0 ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+/* Registro di sessione host: stack OBD reale contro l'ECU simulata,
+   obd_log.c su una partizione in RAM con tempi di flash simulati.
+   Riporta banda di scrittura, usura per ora e durata stimata, poi rilegge
+   e decodifica tutti i segmenti.
+
+   uso: obd_logger [opzioni]
+     -t s       durata simulata (default 120)
+     -x N       tempo accelerato N volte (default 10)
+     -p KB      dimensione della partizione (default 888 = partitions.csv)
+     -f file    immagine della partizione: caricata se esiste, salvata
+                alla fine (due esecuzioni = due sessioni)
+     -d file    solo decodifica di un download di /log, CSV su stdout
+     -q         solo errori sul log
+*/
+#include "obd.h"
+#include "obd_frame.h"
+#include "obd_log.h"
+#include "can_bus.h"
+#include "sim_ecu.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// cicli di erase garantiti per settore (flash SPI NOR tipica)
+#define FLASH_ENDURANCE 100000.0
+
+static const uint8_t k_pids[] = {
+    0x0C, 0x0D, 0x04, 0x11, 0x0E, 0x10, 0x05, 0x0F, 0x0B,
+    0x33, 0x42, 0x46, 0x2F, 0x06, 0x07, 0x01,
+};
+
+typedef struct
+{
+    uint32_t segments;
+    uint32_t records;
+    uint32_t errors;
+    uint32_t seq_gaps;
+} decode_stats_t;
+
+/* Decodifica un segmento valido; csv = stampa una riga per record */
+static void decode_segment(const uint8_t *buf, const obd_log_seg_hdr_t *hdr, bool csv,
+                           decode_stats_t *ds)
+{
+    const uint8_t *payload = buf + hdr->hdr_len;
+    int32_t base[OBD_FIELD_COUNT] = {0}, v[OBD_FIELD_COUNT];
+    uint32_t base_seq = 0, t = hdr->t0_ms, seq, dt;
+    const uint8_t *frame;
+    size_t off = 0, flen;
+    uint32_t n = 0;
+    int r;
+
+    while ((r = obd_log_next_record(payload, hdr->payload_len, &off, &dt, &frame, &flen)) == 1)
+    {
+        t += dt;
+        if (obd_frame_decode(frame, flen, base, base_seq, v, &seq) != 0)
+        {
+            ds->errors++;
+            return;
+        }
+        memcpy(base, v, sizeof(v));
+        base_seq = seq;
+        n++;
+
+        if (csv)
+        {
+            printf("%lu,%lu,%lu", (unsigned long)hdr->boot, (unsigned long)hdr->seq,
+                   (unsigned long)t);
+            for (int f = 0; f < OBD_FIELD_COUNT; f++)
+                printf(",%g", (double)v[f] / obd_field_div((obd_field_t)f));
+            printf("\n");
+        }
+    }
+
+    if (r < 0 || n != hdr->records || t != hdr->t1_ms)
+        ds->errors++;
+    ds->segments++;
+    ds->records += n;
+}
+
+static int dump_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return 1;
+    }
+
+    static uint8_t buf[OBD_LOG_SEGMENT];
+    decode_stats_t ds = {0};
+    obd_log_seg_hdr_t hdr;
+
+    printf("boot,segment,t_ms");
+    for (int k = 0; k < OBD_FIELD_COUNT; k++)
+        printf(",%s", obd_field_key((obd_field_t)k));
+    printf("\n");
+
+    // il download è una sequenza di segmenti (header + payload)
+    while (fread(buf, 1, sizeof(obd_log_seg_hdr_t), f) == sizeof(obd_log_seg_hdr_t))
+    {
+        memcpy(&hdr, buf, sizeof(hdr));
+        if (hdr.hdr_len != sizeof(hdr) || hdr.payload_len > sizeof(buf) - sizeof(hdr) ||
+            fread(buf + sizeof(hdr), 1, hdr.payload_len, f) != hdr.payload_len ||
+            obd_log_check_segment(buf, sizeof(hdr) + hdr.payload_len, &hdr) != 0)
+        {
+            ds.errors++;
+            break;
+        }
+        decode_segment(buf, &hdr, true, &ds);
+    }
+    fclose(f);
+
+    fprintf(stderr, "%u segmenti, %u record, %u errori\n", ds.segments, ds.records, ds.errors);
+    return ds.errors ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int duration_s = 120;
+    unsigned part_kb = 0xDE000 / 1024;
+    const char *image = NULL;
+    int opt;
+
+    host_time_scale = 10;
+
+    while ((opt = getopt(argc, argv, "t:x:p:f:d:q")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': duration_s = atoi(optarg); break;
+        case 'x': host_time_scale = (unsigned)atoi(optarg); break;
+        case 'p': part_kb = (unsigned)atoi(optarg); break;
+        case 'f': image = optarg; break;
+        case 'd': return dump_file(optarg);
+        case 'q': host_log_level = 0; break;
+        default:
+            fprintf(stderr, "uso: %s [-t s] [-x N] [-p KB] [-f immagine] [-d download] [-q]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (host_time_scale < 1)
+        host_time_scale = 1;
+
+    host_partition_setup(part_kb * 1024U);
+    if (image && host_partition_load(image))
+        printf("immagine %s caricata\n", image);
+
+    static sim_ecu_cfg_t ecu = {.resp_id = 0x7E8, .latency_ms = 5, .multi_pid = true};
+    for (size_t i = 0; i < sizeof(k_pids); i++)
+        sim_ecu_set_pid(&ecu, k_pids[i], true);
+
+    sim_bus_init(&ecu, 1, 1);
+    can_bus_init();
+    obd_init();
+    if (!obd_log_start())
+        return 1;
+
+    vTaskDelay(pdMS_TO_TICKS(duration_s * 1000));
+    obd_log_flush();
+
+    obd_log_stats_t st;
+    obd_log_get_stats(&st);
+
+    double hours = st.uptime_ms / 3600000.0;
+    double erases_h = st.segments / hours;
+    double sector_h = erases_h / st.sectors;
+    printf("session=%u duration_s=%d scale=%u sectors=%u segments=%u..%u\n",
+           st.boot, duration_s, host_time_scale, st.sectors, st.oldest_seq, st.newest_seq);
+    printf("records=%u (%.1f/s) payload=%u B (%.1f B/record) overwritten=%u errors=%u\n",
+           st.records, st.records / (st.uptime_ms / 1000.0), st.payload_bytes,
+           st.records ? (double)st.payload_bytes / st.records : 0.0, st.overwritten,
+           st.write_errors);
+    printf("bandwidth: payload %.1f B/s, flash %.1f B/s; write %.1f ms/segment (max %u)\n",
+           st.payload_bytes / (st.uptime_ms / 1000.0),
+           st.segments * (double)OBD_LOG_SEGMENT / (st.uptime_ms / 1000.0),
+           st.segments ? (double)st.write_ms_total / st.segments : 0.0, st.write_ms_max);
+
+    uint32_t wmin = UINT32_MAX, wmax = 0;
+    for (uint32_t k = 0; k < st.sectors; k++)
+    {
+        uint32_t e = host_partition_erases(k);
+        wmin = e < wmin ? e : wmin;
+        wmax = e > wmax ? e : wmax;
+    }
+    printf("wear: %.1f erase/h, %.3f erase/h per settore (min %u max %u), "
+           "durata a %.0f cicli: %.1f anni\n",
+           erases_h, sector_h, wmin, wmax, FLASH_ENDURANCE,
+           sector_h > 0 ? FLASH_ENDURANCE / sector_h / 8760.0 : 0.0);
+
+    // rilettura come farebbe /log: dal più vecchio al più recente
+    static uint8_t buf[OBD_LOG_SEGMENT];
+    decode_stats_t ds = {0};
+    uint32_t this_session = 0, prev_seq = 0;
+    int len;
+
+    for (int i = 0; (len = obd_log_read_segment(i, buf, sizeof(buf))) >= 0; i++)
+    {
+        obd_log_seg_hdr_t hdr;
+        if (len == 0 || obd_log_check_segment(buf, (size_t)len, &hdr) != 0)
+            continue;
+        if (prev_seq && hdr.seq != prev_seq + 1)
+            ds.seq_gaps++;
+        prev_seq = hdr.seq;
+
+        uint32_t before = ds.records;
+        decode_segment(buf, &hdr, false, &ds);
+        if (hdr.boot == st.boot)
+            this_session += ds.records - before;
+    }
+    printf("readback: %u segmenti, %u record (%u di questa sessione), errori=%u salti=%u\n",
+           ds.segments, ds.records, this_session, ds.errors, ds.seq_gaps);
+
+    if (image && !host_partition_save(image))
+        fprintf(stderr, "salvataggio di %s fallito\n", image);
+
+    // senza sovrascritture ogni record di questa sessione deve tornare indietro
+    bool ok = ds.errors == 0 && ds.seq_gaps == 0 && (st.overwritten || this_session == st.records);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,405 @@
+/* Verifica delle metriche (obd_metrics.c).
+
+   1. Bucket: ogni valore va nel primo bucket con limite >= valore.
+   2. Concorrenza: più thread registrano nello stesso istogramma senza
+      lock; conteggi e somma (anche oltre i 32 bit) devono tornare esatti.
+      Riporta il costo per evento, da solo e conteso.
+   3. Esportazione: lo stack OBD gira contro l'ECU simulata (lenta oltre
+      il timeout su un PID, così ci sono timeout e backoff); il testo di
+      /metrics deve essere Prometheus valido: HELP/TYPE una volta per
+      famiglia prima dei campioni, bucket cumulativi non decrescenti,
+      +Inf uguale a _count.
+
+   uso: obd_metrics_check [-t s] [-p]
+     -t s   durata della parte 3 (default 5)
+     -p     stampa il testo esportato
+*/
+#include "obd.h"
+#include "obd_metrics.h"
+#include "can_bus.h"
+#include "sim_ecu.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int s_fail;
+
+#define CHECK(cond, ...)                \
+    do                                  \
+    {                                   \
+        if (!(cond))                    \
+        {                               \
+            printf("FAIL: " __VA_ARGS__); \
+            printf("\n");               \
+            s_fail++;                   \
+        }                               \
+    } while (0)
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ---------------------------------------------------------------
+ * 1. Bucket
+ * --------------------------------------------------------------- */
+static const uint32_t k_le[OBD_HIST_BUCKETS - 1] = {1, 2, 5, 10, 20, 50, 100, 200, 500};
+
+static void check_buckets(void)
+{
+    static obd_hist_t h = OBD_HIST_INIT(k_le);
+    static const uint32_t vals[] = {0, 1, 2, 3, 5, 6, 500, 501, 4000000000U};
+    static const int expect[] = {0, 0, 1, 2, 2, 3, 8, 9, 9};
+    obd_hist_snap_t s;
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < sizeof(vals) / sizeof(vals[0]); i++)
+    {
+        obd_hist_snap_t before;
+        obd_hist_read(&h, &before);
+        obd_hist_record(&h, vals[i]);
+        obd_hist_read(&h, &s);
+        sum += vals[i];
+
+        for (int b = 0; b < OBD_HIST_BUCKETS; b++)
+        {
+            uint32_t d = s.cum[b] - before.cum[b];
+            CHECK(d == (b >= expect[i]), "valore %u: bucket cumulativo %d +%u", vals[i], b, d);
+        }
+    }
+    CHECK(s.sum_us == sum, "somma %llu attesa %llu", (unsigned long long)s.sum_us,
+          (unsigned long long)sum);
+    printf("bucket: %s\n", s_fail ? "errori" : "ok");
+}
+
+/* ---------------------------------------------------------------
+ * 2. Concorrenza e costo
+ * --------------------------------------------------------------- */
+#define HAMMER_N 2000000
+
+static obd_hist_t s_hammer = OBD_HIST_INIT(k_le);
+
+static void *hammer(void *arg)
+{
+    uint32_t x = (uint32_t)(uintptr_t)arg * 2654435761U + 1;
+    for (int i = 0; i < HAMMER_N; i++)
+    {
+        x = x * 1103515245U + 12345U;
+        // fino a ~4 ms: la somma supera i 32 bit in pochi milioni di eventi
+        obd_hist_record(&s_hammer, (x >> 8) & 0x3FFFFF);
+    }
+    return NULL;
+}
+
+static uint64_t expected_sum(int threads)
+{
+    uint64_t sum = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        uint32_t x = (uint32_t)t * 2654435761U + 1;
+        for (int i = 0; i < HAMMER_N; i++)
+        {
+            x = x * 1103515245U + 12345U;
+            sum += (x >> 8) & 0x3FFFFF;
+        }
+    }
+    return sum;
+}
+
+static void check_concurrency(void)
+{
+    pthread_t th[4];
+    obd_hist_snap_t s;
+
+    memset(&s_hammer.count, 0, sizeof(s_hammer.count));
+    atomic_store(&s_hammer.sum_lo, 0);
+    atomic_store(&s_hammer.sum_hi, 0);
+
+    double t0 = now_s();
+    hammer((void *)(uintptr_t)0);
+    double single = (now_s() - t0) * 1e9 / HAMMER_N;
+
+    obd_hist_read(&s_hammer, &s);
+    CHECK(s.count == HAMMER_N && s.sum_us == expected_sum(1), "1 thread: count=%u sum=%llu",
+          s.count, (unsigned long long)s.sum_us);
+
+    memset(&s_hammer.count, 0, sizeof(s_hammer.count));
+    atomic_store(&s_hammer.sum_lo, 0);
+    atomic_store(&s_hammer.sum_hi, 0);
+
+    t0 = now_s();
+    for (int t = 0; t < 4; t++)
+        pthread_create(&th[t], NULL, hammer, (void *)(uintptr_t)t);
+    for (int t = 0; t < 4; t++)
+        pthread_join(th[t], NULL);
+    double contended = (now_s() - t0) * 1e9 / HAMMER_N;
+
+    obd_hist_read(&s_hammer, &s);
+    uint64_t want = expected_sum(4);
+    CHECK(s.count == 4U * HAMMER_N, "4 thread: count=%u atteso %u", s.count, 4U * HAMMER_N);
+    CHECK(s.sum_us == want, "4 thread: sum=%llu attesa %llu", (unsigned long long)s.sum_us,
+          (unsigned long long)want);
+
+    printf("record: %.1f ns/evento da solo, %.1f ns/evento con 4 thread sullo stesso istogramma "
+           "(somma %s 32 bit)\n",
+           single, contended, want > 0xFFFFFFFFULL ? "oltre i" : "entro i");
+}
+
+/* ---------------------------------------------------------------
+ * 3. Esportazione dallo stack reale
+ * --------------------------------------------------------------- */
+static char *s_text;
+static size_t s_text_len, s_text_cap;
+static int s_chunks, s_max_chunk;
+
+static void collect(const char *text, int len, void *ctx)
+{
+    (void)ctx;
+    if (s_text_len + (size_t)len + 1 > s_text_cap)
+    {
+        s_text_cap = (s_text_len + (size_t)len + 1) * 2;
+        s_text = realloc(s_text, s_text_cap);
+    }
+    memcpy(s_text + s_text_len, text, (size_t)len);
+    s_text_len += (size_t)len;
+    s_text[s_text_len] = '\0';
+    s_chunks++;
+    if (len > s_max_chunk)
+        s_max_chunk = len;
+}
+
+#define MAX_FAMILIES 64
+#define MAX_SERIES 256
+
+typedef struct
+{
+    char key[128];      // nome + etichette senza le
+    unsigned long last; // ultimo bucket visto
+    unsigned long inf;
+    bool has_inf;
+} series_t;
+
+static series_t s_series[MAX_SERIES];
+static int s_nseries;
+
+static series_t *series_get(const char *key)
+{
+    for (int i = 0; i < s_nseries; i++)
+        if (strcmp(s_series[i].key, key) == 0)
+            return &s_series[i];
+    if (s_nseries >= MAX_SERIES)
+        return NULL;
+    series_t *s = &s_series[s_nseries++];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->key, sizeof(s->key), "%s", key);
+    return s;
+}
+
+/* Chiave di una serie: nome senza suffisso + etichette tranne le */
+static void series_key(const char *name, const char *suffix, const char *labels, char *out,
+                       size_t cap)
+{
+    char lab[96] = "";
+    size_t n = 0;
+
+    // copia le etichette saltando le="..."
+    for (const char *p = labels; *p && n + 1 < sizeof(lab);)
+    {
+        if (strncmp(p, "le=\"", 4) == 0)
+        {
+            const char *q = strchr(p + 4, '"');
+            p = q ? q + 1 : p + strlen(p);
+            if (*p == ',')
+                p++;
+            continue;
+        }
+        lab[n++] = *p++;
+    }
+    while (n > 0 && lab[n - 1] == ',')
+        n--;
+    lab[n] = '\0';
+
+    snprintf(out, cap, "%.*s{%s}", (int)(strlen(name) - strlen(suffix)), name, lab);
+}
+
+static int validate(const char *text)
+{
+    char families[MAX_FAMILIES][64];
+    char types[MAX_FAMILIES][16];
+    int nfam = 0, samples = 0;
+    char line[256];
+
+    for (const char *p = text; *p;)
+    {
+        const char *e = strchr(p, '\n');
+        if (!e)
+        {
+            CHECK(0, "ultima riga senza a capo");
+            break;
+        }
+        size_t len = (size_t)(e - p);
+        if (len >= sizeof(line))
+            len = sizeof(line) - 1;
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p = e + 1;
+
+        char name[64], type[16];
+        if (sscanf(line, "# TYPE %63s %15s", name, type) == 2)
+        {
+            for (int i = 0; i < nfam; i++)
+                CHECK(strcmp(families[i], name) != 0, "famiglia %s ripetuta", name);
+            if (nfam < MAX_FAMILIES)
+            {
+                snprintf(families[nfam], sizeof(families[nfam]), "%s", name);
+                snprintf(types[nfam], sizeof(types[nfam]), "%s", type);
+                nfam++;
+            }
+            continue;
+        }
+        if (line[0] == '#')
+            continue;
+
+        // campione: nome[{etichette}] valore
+        char metric[160];
+        unsigned long value;
+        double fvalue;
+        if (sscanf(line, "%159s %lf", metric, &fvalue) != 2)
+        {
+            CHECK(0, "riga non valida: %s", line);
+            continue;
+        }
+        samples++;
+        value = (unsigned long)fvalue;
+
+        char *brace = strchr(metric, '{');
+        char labels[128] = "";
+        if (brace)
+        {
+            snprintf(labels, sizeof(labels), "%.*s", (int)(strlen(brace) - 2), brace + 1);
+            *brace = '\0';
+        }
+
+        // la famiglia dichiarata più di recente deve coprire il campione
+        const char *fam = nfam ? families[nfam - 1] : "";
+        bool hist = nfam && strcmp(types[nfam - 1], "histogram") == 0;
+        size_t fl = strlen(fam);
+        CHECK(nfam && strncmp(metric, fam, fl) == 0 &&
+                  (metric[fl] == '\0' ||
+                   (hist && (strcmp(metric + fl, "_bucket") == 0 || strcmp(metric + fl, "_sum") == 0 ||
+                             strcmp(metric + fl, "_count") == 0))),
+              "campione %s fuori dalla famiglia %s", metric, fam);
+
+        if (!hist)
+            continue;
+
+        const char *suffix = strrchr(metric, '_');
+        if (!suffix)
+            continue;
+        char key[128];
+        series_key(metric, suffix, labels, key, sizeof(key));
+        series_t *s = series_get(key);
+        if (!s)
+            continue;
+
+        if (strcmp(suffix, "_bucket") == 0)
+        {
+            CHECK(value >= s->last, "%s: bucket decrescente (%lu < %lu)", key, value, s->last);
+            s->last = value;
+            if (strstr(labels, "le=\"+Inf\""))
+            {
+                s->has_inf = true;
+                s->inf = value;
+            }
+        }
+        else if (strcmp(suffix, "_count") == 0)
+        {
+            CHECK(s->has_inf && s->inf == value, "%s: _count %lu, +Inf %lu", key, value, s->inf);
+        }
+    }
+
+    printf("export: %d famiglie, %d campioni, %d serie istogramma, %zu byte in %d blocchi "
+           "(max %d)\n",
+           nfam, samples, s_nseries, s_text_len, s_chunks, s_max_chunk);
+    return samples;
+}
+
+static unsigned long sample_value(const char *prefix)
+{
+    const char *p = strstr(s_text, prefix);
+    return p ? strtoul(p + strlen(prefix), NULL, 10) : 0;
+}
+
+static void check_export(int duration_s, bool print)
+{
+    static sim_ecu_cfg_t ecu = {.resp_id = 0x7E8, .latency_ms = 5, .multi_pid = true};
+    static const uint8_t engine[] = {0x0C, 0x0D, 0x05, 0x0F, 0x42, 0x10, 0x2F, 0x01};
+
+    for (size_t i = 0; i < sizeof(engine); i++)
+        sim_ecu_set_pid(&ecu, engine[i], true);
+    // 0x2F arriva sempre oltre il timeout: timeout e backoff
+    ecu.pid_latency_ms[0x2F] = 150;
+
+    sim_bus_init(&ecu, 1, 1);
+    can_bus_init();
+    obd_init();
+
+    vTaskDelay(pdMS_TO_TICKS(duration_s * 1000));
+
+    obd_metrics_export(collect, NULL);
+    if (print)
+        fputs(s_text, stdout);
+
+    CHECK(s_max_chunk <= OBD_METRICS_CHUNK, "blocco di %d byte", s_max_chunk);
+    validate(s_text);
+
+    unsigned long rpm = sample_value("obd_pid_response_seconds_count{pid=\"0x0C\"} ");
+    unsigned long to = sample_value("obd_pid_timeouts_total{pid=\"0x2F\"} ");
+    unsigned long bo = sample_value("obd_pid_backoff_total{pid=\"0x2F\"} ");
+    unsigned long e8 = sample_value("obd_ecu_response_seconds_count{ecu=\"0x7E8\"} ");
+
+    CHECK(rpm > 0, "nessuna risposta per 0x0C");
+    CHECK(to > 0 && bo > 0, "0x2F: timeout=%lu backoff=%lu", to, bo);
+    CHECK(e8 >= rpm, "0x7E8: %lu risposte, meno di quelle di 0x0C", e8);
+    CHECK(strstr(s_text, "twai_bus_errors_total ") != NULL, "contatori TWAI assenti");
+    printf("stack: 0x0C risposte=%lu, 0x2F timeout=%lu backoff=%lu, 0x7E8 risposte=%lu\n", rpm,
+           to, bo, e8);
+}
+
+int main(int argc, char **argv)
+{
+    int duration_s = 5;
+    bool print = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:p")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': duration_s = atoi(optarg); break;
+        case 'p': print = true; break;
+        default:
+            fprintf(stderr, "uso: %s [-t s] [-p]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    host_log_level = 0;
+
+    check_buckets();
+    check_concurrency();
+    check_export(duration_s, print);
+
+    printf("%s\n", s_fail ? "FALLITO" : "ok");
+    return s_fail ? 1 : 0;
+}
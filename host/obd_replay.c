@@ -0,0 +1,348 @@
+/* Replay di una traccia CAN (candump o ASC, es. scaricata da /can?trace=)
+   attraverso lo stack reale: le richieste Mode 01 registrate vengono
+   riemesse dal motore di obd.c, i frame ricevuti iniettati sul bus
+   simulato all'istante registrato. Stesso riassemblaggio ISO-TP, stesso
+   abbinamento richiesta/risposta e stessa decodifica (apply_pid_value)
+   del firmware, N volte più veloce del tempo reale.
+
+   Serve a misurare il costo di decodifica per frame e a confrontare le
+   versioni su un corpus di tracce: il digest dei valori pubblicati
+   cambia solo se cambia la decodifica (o l'abbinamento).
+
+   uso: obd_replay [opzioni] traccia
+     -x N       tempo accelerato N volte (default 100). Oltre ~100 il tick
+                host (1 ms / N) scende sotto la latenza di risveglio dei
+                thread: timeout e abbinamenti smettono di essere riproducibili
+     -o file    CSV dei valori pubblicati (istante della richiesta)
+     -D hex     digest atteso: esce con 1 se diverso
+     -q         solo errori sul log
+*/
+#include "obd.h"
+#include "can_bus.h"
+#include "can_trace.h"
+#include "sim_ecu.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// come OBD_REQ_TIMEOUT_MS di obd_data.c
+#define REPLAY_TIMEOUT_MS 100
+#define REPLAY_CTX 64
+
+typedef struct
+{
+    uint64_t t_us;      // relativo all'inizio della traccia
+    twai_message_t msg;
+    bool tx;
+} replay_ev_t;
+
+typedef struct
+{
+    uint64_t t_us;
+} req_ctx_t;
+
+static replay_ev_t *s_ev;
+static size_t s_nev;
+
+static req_ctx_t s_ctx[REPLAY_CTX];
+static FILE *s_csv;
+static SemaphoreHandle_t s_done;
+
+// aggiornati nel task RX (callback del motore), letti alla fine
+static uint32_t s_responses, s_timeouts, s_negative, s_fields;
+static volatile uint32_t s_completed;
+static uint64_t s_decode_ns; // dentro obd_data_apply_mode01
+static uint64_t s_digest = 1469598103934665603ULL; // FNV-1a 64
+
+static double real_s(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static uint64_t mono_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+static double cpu_s(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static void digest_u32(uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        s_digest ^= (uint8_t)(v >> (8 * i));
+        s_digest *= 1099511628211ULL;
+    }
+}
+
+static void on_resp(const obd_resp_t *resp, void *arg)
+{
+    const req_ctx_t *c = (const req_ctx_t *)arg;
+
+    s_completed++;
+    if (resp->status == OBD_RESP_TIMEOUT)
+    {
+        s_timeouts++;
+        return;
+    }
+    if (resp->status != OBD_RESP_OK)
+    {
+        s_negative++;
+        return;
+    }
+
+    s_responses++;
+    uint64_t t0 = mono_ns();
+    int n = obd_data_apply_mode01(resp->data, resp->len);
+    s_decode_ns += mono_ns() - t0;
+    if (n <= 0)
+        return;
+    s_fields += (uint32_t)n;
+
+    obd_full_data_t d = obd_get_all_data();
+    digest_u32((uint32_t)n);
+    // solo i campi decodificati: i derivati integrano il tempo dell'host
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+        if (obd_field_desc((obd_field_t)f)->bytes)
+            digest_u32((uint32_t)obd_field_fixed(&d, (obd_field_t)f));
+
+    if (s_csv)
+    {
+        fprintf(s_csv, "%.3f", c->t_us / 1000.0);
+        for (int f = 0; f < OBD_FIELD_COUNT; f++)
+            fprintf(s_csv, ",%g",
+                    (double)obd_field_fixed(&d, (obd_field_t)f) / obd_field_div((obd_field_t)f));
+        fprintf(s_csv, "\n");
+    }
+}
+
+/* Tempi della traccia resi monotoni: un salto all'indietro (traccia
+   concatenata dopo un riavvio) diventa un intervallo nullo */
+static int load_trace(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    size_t cap = 4096;
+    char line[256];
+    uint64_t prev = 0, base = 0;
+    int bad = 0, lineno = 0;
+    bool first = true;
+
+    s_ev = malloc(cap * sizeof(*s_ev));
+    while (s_ev && fgets(line, sizeof(line), f))
+    {
+        can_frame_rec_t r;
+        uint64_t t;
+        int ok = can_trace_parse(line, &r, &t);
+
+        lineno++;
+        if (ok < 0 && bad++ < 5)
+            fprintf(stderr, "%s:%d: frame malformato\n", path, lineno);
+        if (ok != 1)
+            continue;
+
+        if (first)
+            base = t;
+        else if (t - base < prev)
+            base = t - prev;
+        first = false;
+        prev = t - base;
+
+        if (s_nev == cap)
+        {
+            cap *= 2;
+            replay_ev_t *p = realloc(s_ev, cap * sizeof(*s_ev));
+            if (!p)
+                break;
+            s_ev = p;
+        }
+
+        replay_ev_t *e = &s_ev[s_nev++];
+        memset(e, 0, sizeof(*e));
+        e->t_us = prev;
+        e->tx = r.flags & CAN_REC_TX;
+        e->msg.identifier = r.id;
+        e->msg.extd = (r.flags & CAN_REC_EXT) != 0;
+        e->msg.rtr = (r.flags & CAN_REC_RTR) != 0;
+        e->msg.data_length_code = r.dlc;
+        memcpy(e->msg.data, r.data, r.dlc);
+    }
+    fclose(f);
+    return bad;
+}
+
+/* Richiesta Mode 01 a singolo frame del tester (funzionale o fisica) */
+static bool is_mode01_request(const twai_message_t *m)
+{
+    if (m->extd || (m->identifier != 0x7DF && (m->identifier & 0x7F8) != 0x7E0))
+        return false;
+    int len = m->data[0];
+    return m->data_length_code >= 2 && (len >> 4) == 0 && len >= 1 && len <= 7 &&
+           m->data[1] == 0x01;
+}
+
+/* Fa scorrere la traccia: attende l'istante di ogni frame e lo riemette
+   (richiesta) o lo inietta (risposta) */
+static uint32_t s_requests, s_injected, s_skipped, s_retries;
+
+static void driver_task(void *arg)
+{
+    TickType_t t0 = xTaskGetTickCount();
+    size_t next_ctx = 0;
+
+    for (size_t i = 0; i < s_nev; i++)
+    {
+        const replay_ev_t *e = &s_ev[i];
+
+        TickType_t due = t0 + pdMS_TO_TICKS(e->t_us / 1000);
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(due - now) > 0)
+            vTaskDelay(due - now);
+
+        if (e->tx)
+        {
+            if (!is_mode01_request(&e->msg))
+            {
+                s_skipped++; // Flow Control e altri servizi: li genera lo stack
+                continue;
+            }
+
+            req_ctx_t *c = &s_ctx[next_ctx++ % REPLAY_CTX];
+            c->t_us = e->t_us;
+            int n = e->msg.data[0] - 1;
+            while (!obd_request_submit(0x01, &e->msg.data[2], n, REPLAY_TIMEOUT_MS, on_resp, c))
+            {
+                s_retries++; // slot del motore tutti in volo
+                vTaskDelay(1);
+            }
+            s_requests++;
+        }
+        else
+        {
+            while (!sim_bus_inject(&e->msg, xTaskGetTickCount()))
+            {
+                s_retries++; // coda RX piena: lascia lavorare il task RX
+                vTaskDelay(1);
+            }
+            s_injected++;
+        }
+    }
+
+    // le ultime richieste si chiudono (risposta o timeout)
+    TickType_t end = xTaskGetTickCount() + pdMS_TO_TICKS(2 * REPLAY_TIMEOUT_MS);
+    while (s_completed < s_requests && (int32_t)(xTaskGetTickCount() - end) < 0)
+        vTaskDelay(1);
+    xSemaphoreGive(s_done);
+    while (1)
+        vTaskDelay(pdMS_TO_TICKS(1000));
+}
+
+int main(int argc, char **argv)
+{
+    const char *csv = NULL;
+    const char *expect = NULL;
+    int scale = 100;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:o:D:q")) != -1)
+    {
+        switch (opt)
+        {
+        case 'x': scale = atoi(optarg); break;
+        case 'o': csv = optarg; break;
+        case 'D': expect = optarg; break;
+        case 'q': host_log_level = 0; break;
+        default:
+            fprintf(stderr, "uso: %s [-x N] [-o csv] [-D digest] [-q] traccia\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "uso: %s [-x N] [-o csv] [-D digest] [-q] traccia\n", argv[0]);
+        return 2;
+    }
+
+    int bad = load_trace(argv[optind]);
+    if (bad < 0 || s_nev == 0)
+    {
+        fprintf(stderr, "%s: nessun frame\n", argv[optind]);
+        return 1;
+    }
+
+    if (csv)
+    {
+        s_csv = fopen(csv, "w");
+        if (!s_csv)
+        {
+            perror(csv);
+            return 1;
+        }
+        fprintf(s_csv, "t_ms");
+        for (int f = 0; f < OBD_FIELD_COUNT; f++)
+            fprintf(s_csv, ",%s", obd_field_key((obd_field_t)f));
+        fprintf(s_csv, "\n");
+    }
+
+    host_time_scale = scale > 0 ? (unsigned)scale : 1;
+
+    static sim_ecu_cfg_t none;
+    sim_bus_init(&none, 0, 1); // nessuna ECU: risponde la traccia
+    can_bus_init();
+    obd_data_init();
+    obd_engine_start();
+
+    s_done = xSemaphoreCreateBinary();
+    double r0 = real_s(), c0 = cpu_s();
+    xTaskCreate(driver_task, "replay", 4096, NULL, 5, NULL);
+    xSemaphoreTake(s_done, portMAX_DELAY);
+    double real = real_s() - r0, cpu = cpu_s() - c0;
+
+    if (s_csv)
+        fclose(s_csv);
+
+    double trace_s = s_ev[s_nev - 1].t_us / 1e6;
+    obd_full_data_t d = obd_get_all_data();
+
+    printf("trace: %zu frame in %.1f s (malformati=%d) scale=%u\n", s_nev, trace_s, bad,
+           host_time_scale);
+    printf("requests=%u injected=%u skipped_tx=%u retries=%u\n", s_requests, s_injected,
+           s_skipped, s_retries);
+    printf("responses=%u unanswered=%u negative=%u fields=%u\n", s_responses, s_timeouts,
+           s_negative, s_fields);
+    printf("real_s=%.3f speedup=%.1fx cpu_ns/frame=%.0f decode_ns/response=%.0f\n", real,
+           real > 0 ? trace_s / real : 0.0, cpu * 1e9 / s_nev,
+           s_responses ? (double)s_decode_ns / s_responses : 0.0);
+    printf("last: rpm=%u speed=%u coolant=%d batt=%.2f\n", (unsigned)d.v[OBD_F_RPM],
+           (unsigned)d.v[OBD_F_SPEED], (int)d.v[OBD_F_COOLANT], obd_field_value(&d, OBD_F_BATTERY));
+    printf("digest=%016llx\n", (unsigned long long)s_digest);
+
+    if (expect && strtoull(expect, NULL, 16) != s_digest)
+    {
+        fprintf(stderr, "digest diverso dall'atteso %s\n", expect);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,610 @@
+/* Benchmark dello scheduler (obd_rt_task) contro ECU simulate scriptate.
+   Per ogni scenario, in un processo separato (obd_init una sola volta per
+   processo), misura per PID frequenza ottenuta e jitter del periodo, per
+   priorità il tempo di "fame" e sul bus l'occupazione delle richieste.
+
+   uso: obd_sched_bench [-t s] [-w s] [-x N] [-S scenario] [-j] [-l]
+     -t s         finestra di misura simulata per scenario (default 30)
+     -w s         riscaldamento dopo il primo dato, escluso (default 2)
+     -x N         tempo accelerato (default 10; stabile fino a ~30)
+     -S nome      solo questo scenario (ripetibile; default tutti)
+     -j           output JSON (uno documento, confrontabile tra versioni)
+     -l           elenca gli scenari
+
+   Tempi in ms simulati. "Fame": tempo oltre BENCH_STARVE_FACTOR periodi
+   senza aggiornamento, sommato sui PID della priorità. */
+#include "obd.h"
+#include "obd_pace.h"
+#include "can_bus.h"
+#include "sim_ecu.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef OBD_BENCH_REV
+#define OBD_BENCH_REV "unknown"
+#endif
+
+#define BENCH_SCHEMA 1
+#define BENCH_MAX_INTERVALS 4096
+#define BENCH_STARVE_FACTOR 2
+#define BENCH_MAX_PHASES 4
+
+// Bit medi di un frame standard da 8 byte (111 + stuffing + interframe)
+#define BENCH_FRAME_BITS 125
+
+/* -------------------------------------------------------
+ * Scenari
+ * ------------------------------------------------------- */
+
+/* Cambio di comportamento di un'ECU a at_s dall'inizio della finestra;
+   -1 = campo invariato */
+typedef struct
+{
+    int at_s;
+    int ecu;
+    int drop_pct;
+    int latency_ms;
+} bench_phase_t;
+
+typedef struct
+{
+    const char *name;
+    const char *desc;
+    int latency_ms;
+    int drop_pct;
+    bool single_pid;        // l'ECU risponde solo al primo PID della richiesta
+    uint8_t queue_max;      // ECU seriale (0 = risposte in parallelo)
+    int n_ecus;
+    uint8_t unsupported[4]; // 0 = fine lista
+    uint8_t slow_pid;       // 0 = nessuno
+    int slow_pid_ms;
+    bench_phase_t phases[BENCH_MAX_PHASES]; // at_s == 0 = fine lista
+    uint32_t extra_period_ms; // != 0: registra ogni altro PID Mode 01 fino a 0x5F
+    const obd_sub_item_t *watch; // sottoscrizione di un client (NULL = nessuna)
+    int n_watch;
+} bench_scenario_t;
+
+/* PID dello scheduler */
+static const uint8_t k_all_pids[] = {
+    0x0C, 0x0D, 0x04, 0x11, 0x0E, 0x10, 0x05, 0x0F, 0x0B,
+    0x33, 0x42, 0x46, 0x2F, 0x0A, 0x06, 0x07, 0x21, 0x01,
+};
+
+static const uint8_t k_secondary_pids[] = {0x01, 0x05, 0x0D};
+
+/* Una pagina grafici che segue da vicino il motore */
+static const obd_sub_item_t k_watch_engine[] = {
+    {0x0C, 50}, {0x0D, 50}, {0x11, 50}, {0x04, 100}, {0x05, 0}, {0x42, 0},
+};
+
+static const bench_scenario_t k_scenarios[] = {
+    {"full", "tutti i 18 PID supportati, 5 ms", 5, 0, false, 0, 1, {0}, 0, 0, {{0}}},
+    {"typical", "0x0A e 0x21 assenti (periodi riscalati)", 5, 0, false, 0, 1, {0x0A, 0x21}, 0, 0, {{0}}},
+    {"single_pid", "ECU che risponde solo al primo PID", 5, 0, true, 0, 1, {0x0A, 0x21}, 0, 0, {{0}}},
+    {"slow_ecu", "latenza 60 ms", 60, 0, false, 0, 1, {0x0A, 0x21}, 0, 0, {{0}}},
+    {"lossy", "10% di richieste ignorate", 5, 10, false, 0, 1, {0x0A, 0x21}, 0, 0, {{0}}},
+    {"timeout_pid", "0x42 risponde dopo il timeout", 5, 0, false, 0, 1, {0x0A, 0x21}, 0x42, 150, {{0}}},
+    {"multi_ecu", "3 ECU sul bus", 5, 0, false, 0, 1, {0x0A, 0x21}, 0, 0, {{0}}},
+    {"brownout", "ECU muta da 10 s a 14 s", 5, 0, false, 0, 1, {0x0A, 0x21}, 0, 0,
+     {{10, 0, 100, -1}, {14, 0, 0, -1}}},
+    {"crowded", "ogni PID fino a 0x5F ogni 1 s, oltre il budget", 5, 0, false, 0, 1, {0}, 0, 0, {{0}}, 1000},
+    {"fast_serial", "ECU seriale da 3 ms, coda 2", 3, 0, false, 2, 1, {0x0A, 0x21}, 0, 0, {{0}}},
+    {"slow_serial", "ECU seriale da 60 ms, coda 1", 60, 0, false, 1, 1, {0x0A, 0x21}, 0, 0, {{0}}},
+    {"slowdown", "ECU seriale da 5 ms che passa a 50 ms a 10 s", 5, 0, false, 1, 1, {0x0A, 0x21}, 0, 0,
+     {{10, 0, -1, 50}}},
+    {"watched", "client che guarda 6 PID (4 veloci), il resto in keep-alive", 5, 0, false, 0, 1,
+     {0x0A, 0x21}, 0, 0, {{0}}, 0, k_watch_engine,
+     (int)(sizeof(k_watch_engine) / sizeof(k_watch_engine[0]))},
+};
+
+#define N_SCENARIOS ((int)(sizeof(k_scenarios) / sizeof(k_scenarios[0])))
+
+static void build_ecus(const bench_scenario_t *sc, sim_ecu_cfg_t *ecus)
+{
+    for (int e = 0; e < sc->n_ecus; e++)
+    {
+        sim_ecu_cfg_t *c = &ecus[e];
+        memset(c, 0, sizeof(*c));
+        c->resp_id = 0x7E8 + (uint32_t)e;
+        c->latency_ms = (uint32_t)sc->latency_ms;
+        c->multi_pid = !sc->single_pid;
+        c->drop_pct = (uint8_t)sc->drop_pct;
+        c->queue_max = sc->queue_max;
+
+        if (e > 0)
+        {
+            for (size_t i = 0; i < sizeof(k_secondary_pids); i++)
+                sim_ecu_set_pid(c, k_secondary_pids[i], true);
+            continue;
+        }
+
+        for (size_t i = 0; i < sizeof(k_all_pids); i++)
+            sim_ecu_set_pid(c, k_all_pids[i], true);
+        for (int pid = 1; sc->extra_period_ms && pid <= 0x5F; pid++)
+            if ((pid & 0x1F) != 0)
+                sim_ecu_set_pid(c, (uint8_t)pid, true);
+        for (int i = 0; i < 4 && sc->unsupported[i]; i++)
+            sim_ecu_set_pid(c, sc->unsupported[i], false);
+        if (sc->slow_pid)
+            c->pid_latency_ms[sc->slow_pid] = (uint16_t)sc->slow_pid_ms;
+    }
+}
+
+/* -------------------------------------------------------
+ * Raccolta: ascoltatore delle pubblicazioni (gira nel task RT)
+ * ------------------------------------------------------- */
+typedef struct
+{
+    uint32_t last_ms;   // 0 = nessun aggiornamento nella finestra
+    uint32_t first_ms;
+    uint32_t updates;
+    uint32_t n;         // intervalli memorizzati
+    uint32_t iv[BENCH_MAX_INTERVALS];
+} field_rec_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static field_rec_t s_rec[OBD_FIELD_COUNT];
+static uint32_t s_first_pub_ms;
+static uint32_t s_win_start, s_win_end; // 0 = finestra non ancora fissata
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+/* Il task RT è l'unico scrittore: la copia dello snapshot non attende mai */
+static void on_publish(uint32_t seq, void *ctx)
+{
+    (void)ctx;
+    obd_snapshot_t snap;
+    obd_get_snapshot(&snap);
+
+    pthread_mutex_lock(&s_lock);
+    if (s_first_pub_ms == 0)
+        s_first_pub_ms = now_ms();
+
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+    {
+        uint32_t t = snap.field_ms[f];
+        if (snap.field_seq[f] != seq || s_win_start == 0 || t < s_win_start || t > s_win_end)
+            continue;
+
+        field_rec_t *r = &s_rec[f];
+        if (r->updates == 0)
+            r->first_ms = t;
+        else if (r->n < BENCH_MAX_INTERVALS)
+            r->iv[r->n++] = t - r->last_ms;
+        r->last_ms = t;
+        r->updates++;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+/* -------------------------------------------------------
+ * Statistiche
+ * ------------------------------------------------------- */
+typedef struct
+{
+    uint8_t pid;
+    uint8_t prio;
+    uint32_t target_ms;
+    uint32_t updates;
+    double hz, target_hz;
+    uint32_t p50, p95, p99, max;
+    uint32_t jit95, jit99;
+    uint32_t max_gap;
+    uint32_t starved;
+    uint32_t misses; // deadline mancate secondo lo scheduler
+} pid_result_t;
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Percentile nearest-rank su un vettore ordinato */
+static uint32_t pct(const uint32_t *v, uint32_t n, int p)
+{
+    if (n == 0)
+        return 0;
+    uint32_t k = (uint32_t)(((uint64_t)n * (uint64_t)p + 99) / 100);
+    return v[k ? k - 1 : 0];
+}
+
+static uint32_t starve(uint32_t gap, uint32_t target)
+{
+    uint32_t lim = target * BENCH_STARVE_FACTOR;
+    return gap > lim ? gap - lim : 0;
+}
+
+static void analyze(const obd_job_info_t *job, uint32_t window, pid_result_t *out)
+{
+    static uint32_t sorted[BENCH_MAX_INTERVALS], jit[BENCH_MAX_INTERVALS];
+    const field_rec_t *r = &s_rec[obd_field_for_pid(job->pid)];
+
+    memset(out, 0, sizeof(*out));
+    out->pid = job->pid;
+    out->prio = job->prio;
+    out->target_ms = job->period_ms;
+    out->updates = r->updates;
+    out->hz = (double)r->updates * 1000.0 / window;
+    out->target_hz = 1000.0 / job->period_ms;
+
+    for (uint32_t i = 0; i < r->n; i++)
+    {
+        sorted[i] = r->iv[i];
+        jit[i] = r->iv[i] > job->period_ms ? r->iv[i] - job->period_ms
+                                           : job->period_ms - r->iv[i];
+        out->starved += starve(r->iv[i], job->period_ms);
+    }
+    qsort(sorted, r->n, sizeof(uint32_t), cmp_u32);
+    qsort(jit, r->n, sizeof(uint32_t), cmp_u32);
+
+    out->p50 = pct(sorted, r->n, 50);
+    out->p95 = pct(sorted, r->n, 95);
+    out->p99 = pct(sorted, r->n, 99);
+    out->max = r->n ? sorted[r->n - 1] : 0;
+    out->jit95 = pct(jit, r->n, 95);
+    out->jit99 = pct(jit, r->n, 99);
+
+    // bordi della finestra: attesa del primo dato e silenzio finale
+    uint32_t head = r->updates ? r->first_ms - s_win_start : window;
+    uint32_t tail = r->updates ? s_win_end - r->last_ms : 0;
+    out->starved += starve(head, job->period_ms) + starve(tail, job->period_ms);
+
+    out->max_gap = out->max;
+    if (head > out->max_gap)
+        out->max_gap = head;
+    if (tail > out->max_gap)
+        out->max_gap = tail;
+}
+
+/* -------------------------------------------------------
+ * Esecuzione di uno scenario (processo figlio)
+ * ------------------------------------------------------- */
+static const char *k_prio_name[3] = {"high", "med", "low"};
+
+/* Contatori di un job tra due letture di obd_data_get_jobs */
+static const obd_job_info_t *job_find(const obd_job_info_t *jobs, int n, uint8_t pid)
+{
+    for (int i = 0; i < n; i++)
+        if (jobs[i].pid == pid)
+            return &jobs[i];
+    return NULL;
+}
+
+static void run_scenario(const bench_scenario_t *sc, int duration_s, int warmup_s, bool json)
+{
+    static sim_ecu_cfg_t ecus[SIM_MAX_ECUS];
+    static obd_job_info_t jobs0[OBD_MAX_JOBS], jobs[OBD_MAX_JOBS];
+    int admitted = 0, refused = 0;
+
+    build_ecus(sc, ecus);
+
+    // PID extra: l'admission control decide quanti ne entrano
+    for (int pid = 1; sc->extra_period_ms && pid <= 0x5F; pid++)
+    {
+        bool known = (pid & 0x1F) == 0 || obd_field_for_pid((uint8_t)pid) >= 0;
+        if (!known && obd_pid_data_len((uint8_t)pid) > 0)
+        {
+            if (obd_data_add_job((uint8_t)pid, 2, sc->extra_period_ms))
+                admitted++;
+            else
+                refused++;
+        }
+    }
+
+    sim_bus_init(ecus, sc->n_ecus, 1);
+    obd_data_add_listener(on_publish, NULL);
+    can_bus_init();
+    obd_init();
+    if (sc->watch)
+        obd_data_subscribe(1, sc->watch, sc->n_watch);
+
+    // la finestra parte dopo il riscaldamento dal primo dato pubblicato
+    uint32_t first;
+    do
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        pthread_mutex_lock(&s_lock);
+        first = s_first_pub_ms;
+        pthread_mutex_unlock(&s_lock);
+    } while (first == 0);
+
+    uint32_t start = first + (uint32_t)warmup_s * 1000U;
+    uint32_t end = start + (uint32_t)duration_s * 1000U;
+    uint32_t window = end - start;
+
+    pthread_mutex_lock(&s_lock);
+    s_win_start = start;
+    s_win_end = end;
+    pthread_mutex_unlock(&s_lock);
+
+    while (now_ms() < start)
+        vTaskDelay(1);
+
+    sim_stats_t st0, st1;
+    sim_bus_stats(&st0);
+    int njobs0 = obd_data_get_jobs(jobs0, OBD_MAX_JOBS);
+
+    // fasi scriptate
+    for (int p = 0; p < BENCH_MAX_PHASES && sc->phases[p].at_s; p++)
+    {
+        const bench_phase_t *ph = &sc->phases[p];
+        uint32_t at = start + (uint32_t)ph->at_s * 1000U;
+        if (at >= end)
+            break; // finestra più corta dello script
+        while (now_ms() < at)
+            vTaskDelay(1);
+
+        if (ph->drop_pct >= 0)
+            ecus[ph->ecu].drop_pct = (uint8_t)ph->drop_pct;
+        if (ph->latency_ms >= 0)
+            ecus[ph->ecu].latency_ms = (uint32_t)ph->latency_ms;
+        sim_bus_set_ecu(ph->ecu, &ecus[ph->ecu]);
+    }
+
+    while (now_ms() < end)
+        vTaskDelay(1);
+    sim_bus_stats(&st1);
+    obd_pace_info_t pace;
+    obd_pace_get(&pace);
+    vTaskDelay(pdMS_TO_TICKS(50)); // ultime pubblicazioni ancora in corso
+
+    int njobs = obd_data_get_jobs(jobs, OBD_MAX_JOBS);
+    static pid_result_t res[OBD_MAX_JOBS];
+    int nres = 0;
+    double demand = 0, achieved = 0;
+
+    // job senza campo nello snapshot (PID extra): solo contatori dello scheduler
+    struct
+    {
+        int n;
+        uint32_t updates, misses;
+        double target_hz;
+    } extra = {0};
+
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < njobs; i++)
+    {
+        const obd_job_info_t *j0 = job_find(jobs0, njobs0, jobs[i].pid);
+        uint32_t upd = jobs[i].updates - (j0 ? j0->updates : 0);
+        uint32_t miss = jobs[i].deadline_misses - (j0 ? j0->deadline_misses : 0);
+
+        if (!jobs[i].supported)
+            continue;
+
+        if (obd_field_for_pid(jobs[i].pid) < 0)
+        {
+            extra.n++;
+            extra.updates += upd;
+            extra.misses += miss;
+            extra.target_hz += 1000.0 / jobs[i].period_ms;
+            demand += 1000.0 / jobs[i].period_ms;
+            achieved += upd * 1000.0 / window;
+            continue;
+        }
+
+        analyze(&jobs[i], window, &res[nres]);
+        res[nres].misses = miss;
+        demand += res[nres].target_hz;
+        achieved += res[nres].hz;
+        nres++;
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    double secs = window / 1000.0;
+    uint32_t req = st1.req_tx - st0.req_tx;
+    uint32_t frames = (st1.frames_rx - st0.frames_rx) + (st1.frames_tx - st0.frames_tx);
+    double req_s = req / secs;
+    double budget = 1000.0 / OBD_REQ_SPACING_MS;
+    double load = 100.0 * frames * BENCH_FRAME_BITS / (can_bus_bitrate() * secs);
+
+    struct
+    {
+        int pids;
+        uint32_t starved, max_gap, misses;
+        double hz, target_hz;
+    } pr[3] = {{0}};
+
+    for (int i = 0; i < nres; i++)
+    {
+        int p = res[i].prio < 3 ? res[i].prio : 2;
+        pr[p].pids++;
+        pr[p].starved += res[i].starved;
+        pr[p].misses += res[i].misses;
+        pr[p].hz += res[i].hz;
+        pr[p].target_hz += res[i].target_hz;
+        if (res[i].max_gap > pr[p].max_gap)
+            pr[p].max_gap = res[i].max_gap;
+    }
+
+    if (json)
+    {
+        printf("{\"name\":\"%s\",\"window_ms\":%u,", sc->name, (unsigned)window);
+        printf("\"bus\":{\"req_tx\":%u,\"req_per_s\":%.2f,\"budget_per_s\":%.2f,"
+               "\"occupancy_pct\":%.1f,\"bus_load_pct\":%.2f,\"pid_demand_per_s\":%.2f,"
+               "\"pid_rate_per_s\":%.2f,\"dropped\":%u,\"overflow\":%u},",
+               (unsigned)req, req_s, budget, 100.0 * req_s / budget, load, demand, achieved,
+               (unsigned)(st1.dropped - st0.dropped), (unsigned)(st1.overflow - st0.overflow));
+        printf("\"pace\":{\"spacing_ms\":%u,\"inflight\":%u,\"ecus\":[",
+               (unsigned)pace.spacing_ms, (unsigned)pace.inflight);
+        for (int e = 0; e < pace.ecu_count; e++)
+        {
+            const obd_pace_ecu_t *pe = &pace.ecu[e];
+            printf("%s{\"id\":\"0x%03X\",\"srtt_us\":%u,\"rtt_min_us\":%u,\"rtt_max_us\":%u,"
+                   "\"answers\":%u,\"timeouts\":%u,\"spacing_ms\":%u,\"inflight\":%u}",
+                   e ? "," : "", (unsigned)pe->id, (unsigned)pe->srtt_us, (unsigned)pe->rtt_min_us,
+                   (unsigned)pe->rtt_max_us, (unsigned)pe->answers, (unsigned)pe->timeouts,
+                   (unsigned)pe->spacing_ms, (unsigned)pe->inflight);
+        }
+        printf("]},");
+        printf("\"prio\":[");
+        for (int p = 0; p < 3; p++)
+        {
+            double denom = (double)pr[p].pids * window;
+            printf("%s{\"prio\":\"%s\",\"pids\":%d,\"rate_ratio\":%.3f,\"starved_ms\":%u,"
+                   "\"starved_pct\":%.2f,\"max_gap_ms\":%u,\"misses\":%u}",
+                   p ? "," : "", k_prio_name[p], pr[p].pids,
+                   pr[p].target_hz > 0 ? pr[p].hz / pr[p].target_hz : 0.0,
+                   (unsigned)pr[p].starved, denom > 0 ? 100.0 * pr[p].starved / denom : 0.0,
+                   (unsigned)pr[p].max_gap, (unsigned)pr[p].misses);
+        }
+        printf("],\"extra\":{\"admitted\":%d,\"refused\":%d,\"rate_ratio\":%.3f,\"misses\":%u},",
+               admitted, refused,
+               extra.target_hz > 0 ? extra.updates * 1000.0 / window / extra.target_hz : 0.0,
+               (unsigned)extra.misses);
+        printf("\"pids\":[");
+        for (int i = 0; i < nres; i++)
+        {
+            const pid_result_t *r = &res[i];
+            printf("%s{\"pid\":\"0x%02X\",\"prio\":\"%s\",\"target_ms\":%u,\"updates\":%u,"
+                   "\"hz\":%.3f,\"target_hz\":%.3f,\"p50_ms\":%u,\"p95_ms\":%u,\"p99_ms\":%u,"
+                   "\"max_ms\":%u,\"jitter_p95_ms\":%u,\"jitter_p99_ms\":%u,"
+                   "\"max_gap_ms\":%u,\"starved_ms\":%u,\"misses\":%u}",
+                   i ? "," : "", r->pid, k_prio_name[r->prio < 3 ? r->prio : 2],
+                   (unsigned)r->target_ms, (unsigned)r->updates, r->hz, r->target_hz,
+                   (unsigned)r->p50, (unsigned)r->p95, (unsigned)r->p99, (unsigned)r->max,
+                   (unsigned)r->jit95, (unsigned)r->jit99, (unsigned)r->max_gap,
+                   (unsigned)r->starved, (unsigned)r->misses);
+        }
+        printf("]}");
+        return;
+    }
+
+    printf("\n== %s: %s (finestra %.0f s)\n", sc->name, sc->desc, secs);
+    printf("bus: %.1f req/s su %.1f (%.0f%%), carico %.1f%%, PID %.1f/s su %.1f/s richiesti, drop %u\n",
+           req_s, budget, 100.0 * req_s / budget, load, achieved, demand,
+           (unsigned)(st1.dropped - st0.dropped));
+    printf("ritmo: %u ms, %u in volo, coda ECU piena %u", (unsigned)pace.spacing_ms,
+           (unsigned)pace.inflight, (unsigned)(st1.overflow - st0.overflow));
+    for (int e = 0; e < pace.ecu_count; e++)
+        printf("; %03X rtt %.1f (min %.1f) %u ms x%u, %u timeout", (unsigned)pace.ecu[e].id,
+               pace.ecu[e].srtt_us / 1000.0, pace.ecu[e].rtt_min_us / 1000.0,
+               (unsigned)pace.ecu[e].spacing_ms, (unsigned)pace.ecu[e].inflight,
+               (unsigned)pace.ecu[e].timeouts);
+    printf("\n");
+    printf("  PID  prio target    Hz  (att.)   p50   p95   p99   max  jit99  fame_ms  miss\n");
+    for (int i = 0; i < nres; i++)
+    {
+        const pid_result_t *r = &res[i];
+        printf("  %02X   %-4s %6u %5.2f (%5.2f) %5u %5u %5u %5u  %5u  %7u  %4u\n",
+               r->pid, k_prio_name[r->prio < 3 ? r->prio : 2], (unsigned)r->target_ms,
+               r->hz, r->target_hz, (unsigned)r->p50, (unsigned)r->p95, (unsigned)r->p99,
+               (unsigned)r->max, (unsigned)r->jit99, (unsigned)r->starved, (unsigned)r->misses);
+    }
+    for (int p = 0; p < 3; p++)
+        printf("  %-4s: %d PID, %.0f%% della frequenza, fame %u ms, buco max %u ms, %u deadline mancate\n",
+               k_prio_name[p], pr[p].pids,
+               pr[p].target_hz > 0 ? 100.0 * pr[p].hz / pr[p].target_hz : 0.0,
+               (unsigned)pr[p].starved, (unsigned)pr[p].max_gap, (unsigned)pr[p].misses);
+    if (admitted || refused)
+        printf("  extra: %d ammessi, %d rifiutati, %.0f%% della frequenza, %u deadline mancate\n",
+               admitted, refused,
+               extra.target_hz > 0 ? 100.0 * extra.updates * 1000.0 / window / extra.target_hz : 0.0,
+               (unsigned)extra.misses);
+}
+
+int main(int argc, char **argv)
+{
+    int duration_s = 30;
+    int warmup_s = 2;
+    bool json = false;
+    bool selected[N_SCENARIOS] = {false};
+    bool any = false;
+    int opt;
+
+    host_time_scale = 10;
+    host_log_level = 0;
+
+    while ((opt = getopt(argc, argv, "t:w:x:S:jl")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': duration_s = atoi(optarg); break;
+        case 'w': warmup_s = atoi(optarg); break;
+        case 'x': host_time_scale = (unsigned)atoi(optarg); break;
+        case 'j': json = true; break;
+        case 'l':
+            for (int i = 0; i < N_SCENARIOS; i++)
+                printf("%-12s %s\n", k_scenarios[i].name, k_scenarios[i].desc);
+            return 0;
+        case 'S':
+        {
+            int i;
+            for (i = 0; i < N_SCENARIOS; i++)
+                if (strcmp(optarg, k_scenarios[i].name) == 0)
+                    break;
+            if (i == N_SCENARIOS)
+            {
+                fprintf(stderr, "scenario sconosciuto: %s (-l per l'elenco)\n", optarg);
+                return 2;
+            }
+            selected[i] = any = true;
+            break;
+        }
+        default:
+            fprintf(stderr, "uso: %s [-t s] [-w s] [-x N] [-S scenario] [-j] [-l]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (host_time_scale < 1)
+        host_time_scale = 1;
+    if (duration_s < 1)
+        duration_s = 1;
+
+    if (json)
+        printf("{\"bench\":\"obd_sched\",\"schema\":%d,\"rev\":\"%s\",\"spacing_ms\":%d,"
+               "\"scale\":%u,\"duration_s\":%d,\"warmup_s\":%d,\"starve_factor\":%d,\"scenarios\":[",
+               BENCH_SCHEMA, OBD_BENCH_REV, (int)OBD_REQ_SPACING_MS, host_time_scale,
+               duration_s, warmup_s, BENCH_STARVE_FACTOR);
+    else
+        printf("obd_sched_bench %s: spacing %d ms, %d s simulati per scenario, tempo x%u\n",
+               OBD_BENCH_REV, (int)OBD_REQ_SPACING_MS, duration_s, host_time_scale);
+
+    int done = 0, failed = 0;
+    for (int i = 0; i < N_SCENARIOS; i++)
+    {
+        if (any && !selected[i])
+            continue;
+
+        if (json && done)
+            printf(",");
+        fflush(stdout);
+
+        // processo nuovo per scenario: task, discovery e statistiche da zero
+        pid_t child = fork();
+        if (child == 0)
+        {
+            run_scenario(&k_scenarios[i], duration_s, warmup_s, json);
+            fflush(stdout);
+            _exit(0);
+        }
+
+        int status = 0;
+        if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "scenario %s fallito\n", k_scenarios[i].name);
+            if (json)
+                printf("null");
+            failed++;
+        }
+        done++;
+    }
+
+    if (json)
+        printf("]}\n");
+    return failed ? 1 : 0;
+}
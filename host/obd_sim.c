@@ -0,0 +1,301 @@
+/* Simulatore host: esegue lo stack OBD reale (obd.c + obd_data.c)
+   contro una o più ECU simulate e riporta il throughput ottenuto.
+
+   uso: obd_sim [opzioni] [durata_s] [latenza_ms]
+     -t s       durata simulata (default 10)
+     -x N       tempo accelerato N volte (default 1 = tempo reale)
+     -l ms      latenza di risposta di default (default 5)
+     -L pid=ms  latenza di un singolo PID (ripetibile, pid in hex)
+     -d pct     probabilità di drop di una richiesta, per ECU (default 0)
+     -Q n       ECU seriale: al massimo n risposte in coda, le richieste
+                oltre vengono ignorate (default 0 = ECU senza coda)
+     -u pid     PID non supportato dall'ECU motore (ripetibile, hex)
+     -e n       ECU sul bus (default 1): 0x7E8 motore, le altre rispondono
+                solo a 0x01/0x05/0x0D come una centralina cambio
+     -s seed    seme dei drop (default 1)
+     -w file    traccia candump della sessione (frame trasmessi e ricevuti),
+                da rigiocare con obd_replay
+     -D codici  DTC memorizzati dell'ECU motore (es. P0300,P0171)
+     -P codici  DTC in attesa dell'ECU motore
+     -N n       altri n DTC memorizzati sintetici (oltre 63: risposta troncata)
+     -A s       a s secondi l'ECU motore memorizza P0420 (il conteggio del
+                PID 0x01 cambia: la cache DTC deve rileggersi)
+     -q         solo errori sul log
+*/
+#include "obd.h"
+#include "obd_dtc.h"
+#include "obd_history.h"
+#include "obd_pace.h"
+#include "can_bus.h"
+#include "can_capture.h"
+#include "can_trace.h"
+#include "sim_ecu.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* PID della tabella dello scheduler tranne 0x0A e 0x21 (tipicamente assenti) */
+static const uint8_t k_default_pids[] = {
+    0x0C, 0x0D, 0x04, 0x11, 0x0E, 0x10, 0x05, 0x0F, 0x0B,
+    0x33, 0x42, 0x46, 0x2F, 0x06, 0x07, 0x01,
+};
+
+/* ECU secondarie: pochi PID condivisi con il motore */
+static const uint8_t k_secondary_pids[] = {0x01, 0x05, 0x0D};
+
+/* Svuota il ring di cattura nel file di traccia come farebbe un client
+   di /can?trace=candump */
+static FILE *s_trace;
+static uint32_t s_trace_cursor, s_trace_lost, s_trace_frames;
+
+static void trace_drain(void)
+{
+    can_frame_rec_t rec[64];
+    char line[CAN_TRACE_LINE_MAX];
+    int n;
+
+    while ((n = can_capture_read(&s_trace_cursor, rec, 64, &s_trace_lost)) > 0)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            int len = can_trace_format(CAN_TRACE_CANDUMP, &rec[i], rec[i].t_us, line, sizeof(line));
+            fwrite(line, 1, (size_t)len, s_trace);
+        }
+        s_trace_frames += (uint32_t)n;
+    }
+}
+
+static void trace_task(void *arg)
+{
+    while (1)
+    {
+        trace_drain();
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+}
+
+/* Lista "P0300,C1234" nei DTC di tipo kind dell'ECU */
+static void add_dtcs(sim_ecu_cfg_t *c, int kind, const char *list)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", list);
+
+    for (char *tok = strtok(buf, ","); tok; tok = strtok(NULL, ","))
+    {
+        uint16_t code = sim_dtc_code(tok);
+        if (!code)
+            fprintf(stderr, "DTC non valido: %s\n", tok);
+        else if (c->dtc_n[kind] < SIM_MAX_DTC)
+            c->dtc[kind][c->dtc_n[kind]++] = code;
+    }
+}
+
+static void print_dtcs(void)
+{
+    static const char *names[OBD_DTC_KIND_COUNT] = {"stored", "pending", "permanent"};
+    obd_dtc_info_t info;
+    obd_dtc_list_t list;
+    char code[6];
+
+    obd_dtc_get_info(&info);
+    printf("dtc: reads=%u requested=%u mil_count=%d\n", (unsigned)info.reads,
+           (unsigned)info.requested, (int)info.mil_count);
+
+    for (int k = 0; k < OBD_DTC_KIND_COUNT; k++)
+    {
+        obd_dtc_get((obd_dtc_kind_t)k, &list);
+        printf("  %-9s ecus=%u negative=%u total=%u:", names[k], (unsigned)list.ecus,
+               (unsigned)list.negative, (unsigned)list.total);
+        for (int i = 0; i < list.n; i++)
+        {
+            if (i == 8)
+            {
+                printf(" ... (%u in cache)", (unsigned)list.n);
+                break;
+            }
+            obd_dtc_format(list.code[i].code, code);
+            printf(" %s@%03X", code, (unsigned)list.code[i].ecu_id);
+        }
+        printf("\n");
+    }
+}
+
+static double real_s(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int duration_s = 10;
+    int latency_ms = 5;
+    int drop_pct = 0;
+    int queue_max = 0;
+    int n_ecus = 1;
+    unsigned seed = 1;
+    uint16_t pid_latency[256] = {0};
+    bool unsupported[256] = {false};
+    const char *trace = NULL;
+    const char *stored = NULL, *pending = NULL;
+    int synthetic = 0, add_at_s = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:x:l:L:d:Q:u:e:s:w:D:P:N:A:q")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': duration_s = atoi(optarg); break;
+        case 'x': host_time_scale = (unsigned)atoi(optarg); break;
+        case 'l': latency_ms = atoi(optarg); break;
+        case 'd': drop_pct = atoi(optarg); break;
+        case 'Q': queue_max = atoi(optarg); break;
+        case 'e': n_ecus = atoi(optarg); break;
+        case 's': seed = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'w': trace = optarg; break;
+        case 'D': stored = optarg; break;
+        case 'P': pending = optarg; break;
+        case 'N': synthetic = atoi(optarg); break;
+        case 'A': add_at_s = atoi(optarg); break;
+        case 'q': host_log_level = 0; break;
+        case 'u': unsupported[strtoul(optarg, NULL, 16) & 0xFF] = true; break;
+        case 'L':
+        {
+            char *eq;
+            unsigned long pid = strtoul(optarg, &eq, 16);
+            if (*eq == '=')
+                pid_latency[pid & 0xFF] = (uint16_t)atoi(eq + 1);
+            break;
+        }
+        default:
+            fprintf(stderr, "uso: %s [-t s] [-x N] [-l ms] [-L pid=ms] [-d pct] [-u pid] "
+                            "[-e n] [-s seed] [-w traccia] [-D dtc] [-P dtc] [-N n] [-A s] [-q] "
+                            "[durata_s] [latenza_ms]\n", argv[0]);
+            return 2;
+        }
+    }
+    // forma posizionale storica: obd_sim [durata_s] [latenza_ms]
+    if (optind < argc)
+        duration_s = atoi(argv[optind++]);
+    if (optind < argc)
+        latency_ms = atoi(argv[optind++]);
+
+    if (host_time_scale < 1)
+        host_time_scale = 1;
+    if (n_ecus < 1)
+        n_ecus = 1;
+    if (n_ecus > SIM_MAX_ECUS)
+        n_ecus = SIM_MAX_ECUS;
+
+    static sim_ecu_cfg_t ecus[SIM_MAX_ECUS];
+    for (int e = 0; e < n_ecus; e++)
+    {
+        sim_ecu_cfg_t *c = &ecus[e];
+        c->resp_id = 0x7E8 + (uint32_t)e;
+        c->latency_ms = (uint32_t)latency_ms;
+        c->multi_pid = true;
+        c->drop_pct = (uint8_t)drop_pct;
+        c->queue_max = (uint8_t)queue_max;
+
+        if (e == 0)
+        {
+            for (size_t i = 0; i < sizeof(k_default_pids); i++)
+                sim_ecu_set_pid(c, k_default_pids[i], !unsupported[k_default_pids[i]]);
+            memcpy(c->pid_latency_ms, pid_latency, sizeof(pid_latency));
+
+            if (stored)
+                add_dtcs(c, 0, stored);
+            if (pending)
+                add_dtcs(c, 1, pending);
+            for (int i = 0; i < synthetic && c->dtc_n[0] < SIM_MAX_DTC; i++)
+                c->dtc[0][c->dtc_n[0]++] = (uint16_t)(0x0100 + i); // P0100...
+            if (c->dtc_n[0])
+                c->dtc[2][c->dtc_n[2]++] = c->dtc[0][0]; // il primo è anche permanente
+        }
+        else
+        {
+            for (size_t i = 0; i < sizeof(k_secondary_pids); i++)
+                sim_ecu_set_pid(c, k_secondary_pids[i], true);
+            c->no_permanent = true; // centralina senza Mode 0A
+        }
+    }
+
+    double t0 = real_s();
+
+    if (trace && !(s_trace = fopen(trace, "w")))
+    {
+        perror(trace);
+        return 1;
+    }
+
+    sim_bus_init(ecus, n_ecus, seed);
+    can_bus_init();
+    if (s_trace)
+    {
+        can_capture_attach();
+        xTaskCreate(trace_task, "trace", 4096, NULL, 3, NULL);
+    }
+    obd_init();
+
+    if (add_at_s >= 0 && add_at_s < duration_s)
+    {
+        vTaskDelay(pdMS_TO_TICKS(add_at_s * 1000));
+        if (ecus[0].dtc_n[0] < SIM_MAX_DTC)
+            ecus[0].dtc[0][ecus[0].dtc_n[0]++] = sim_dtc_code("P0420");
+        sim_bus_set_ecu(0, &ecus[0]);
+        vTaskDelay(pdMS_TO_TICKS((duration_s - add_at_s) * 1000));
+    }
+    else
+        vTaskDelay(pdMS_TO_TICKS(duration_s * 1000));
+
+    sim_stats_t st;
+    sim_bus_stats(&st);
+    obd_full_data_t d = obd_get_all_data();
+
+    printf("duration_s=%d latency_ms=%d ecus=%d drop_pct=%d scale=%u real_s=%.2f\n",
+           duration_s, latency_ms, n_ecus, drop_pct, host_time_scale, real_s() - t0);
+    printf("requests=%u (%.1f/s) pid_answers=%u (%.1f/s) multi_frame=%u dropped=%u\n",
+           st.requests, (double)st.requests / duration_s,
+           st.pid_answers, (double)st.pid_answers / duration_s, st.multi_frame, st.dropped);
+    printf("frames tester=%u ecu=%u overflow=%u\n", st.frames_rx, st.frames_tx, st.overflow);
+
+    obd_pace_info_t pace;
+    obd_pace_get(&pace);
+    printf("pace: spacing=%ums inflight=%u", (unsigned)pace.spacing_ms, (unsigned)pace.inflight);
+    for (int e = 0; e < pace.ecu_count; e++)
+        printf(" | %03X srtt=%.1fms min=%.1fms max=%.1fms timeouts=%u", (unsigned)pace.ecu[e].id,
+               pace.ecu[e].srtt_us / 1000.0, pace.ecu[e].rtt_min_us / 1000.0,
+               pace.ecu[e].rtt_max_us / 1000.0, (unsigned)pace.ecu[e].timeouts);
+    printf("\n");
+    obd_rt_stats_t rt;
+    obd_data_get_rt_stats(&rt, false);
+    printf("rt: batches=%u rx->rt avg=%uus max=%uus\n", (unsigned)rt.batches,
+           (unsigned)rt.lat_avg_us, (unsigned)rt.lat_max_us);
+    printf("last: rpm=%u speed=%u coolant=%d batt=%.2f\n",
+           (unsigned)d.v[OBD_F_RPM], (unsigned)d.v[OBD_F_SPEED],
+           (int)d.v[OBD_F_COOLANT], obd_field_value(&d, OBD_F_BATTERY));
+
+    print_dtcs();
+
+    static obd_hist_sample_t hist[OBD_HIST_HIGH_SAMPLES];
+    if (s_trace)
+    {
+        trace_drain();
+        fclose(s_trace);
+        printf("trace: %s %u frame, persi=%u\n", trace, s_trace_frames, s_trace_lost);
+    }
+
+    printf("history: rpm=%d coolant=%d batt=%d campioni\n",
+           obd_history_read(OBD_F_RPM, 0, hist, OBD_HIST_HIGH_SAMPLES),
+           obd_history_read(OBD_F_COOLANT, 0, hist, OBD_HIST_HIGH_SAMPLES),
+           obd_history_read(OBD_F_BATTERY, 0, hist, OBD_HIST_HIGH_SAMPLES));
+    return 0;
+}
@@ -0,0 +1,183 @@
+/* Stress del seqlock di obd_data.c: uno scrittore pubblica snapshot
+   internamente coerenti il più velocemente possibile, N lettori li
+   rileggono e contano le copie "strappate" (campi di generazioni diverse).
+
+   Altri M lettori passano dal payload JSON condiviso (obd_json.c): il
+   testo deve essere quello di una sola generazione, non cambiare
+   finché è tenuto e non tornare indietro.
+
+   uso: obd_stress [durata_s] [lettori] [lettori_json]
+*/
+#include "obd.h"
+#include "obd_json.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static atomic_bool s_stop;
+static atomic_ulong s_writes;
+
+typedef struct
+{
+    unsigned long reads;
+    unsigned long torn;
+    unsigned long seq_backwards;
+} reader_stats_t;
+
+/* Tutti i campi derivano dallo stesso contatore k */
+static void fill(obd_full_data_t *d, uint32_t k)
+{
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+        d->v[f] = (int32_t)(k + (uint32_t)f);
+}
+
+static void *writer(void *arg)
+{
+    (void)arg;
+    obd_full_data_t d;
+    uint32_t k = 0;
+
+    while (!atomic_load_explicit(&s_stop, memory_order_relaxed))
+    {
+        fill(&d, ++k);
+        obd_data_set(&d);
+    }
+    atomic_store(&s_writes, k);
+    return NULL;
+}
+
+static void *reader(void *arg)
+{
+    reader_stats_t *st = (reader_stats_t *)arg;
+    obd_snapshot_t snap;
+    obd_full_data_t ref;
+    uint32_t last_seq = 0;
+
+    while (!atomic_load_explicit(&s_stop, memory_order_relaxed))
+    {
+        uint32_t seq = obd_get_snapshot(&snap);
+
+        fill(&ref, (uint32_t)snap.data.v[OBD_F_RPM]);
+        if (memcmp(&ref, &snap.data, sizeof(ref)) != 0 || snap.seq != seq)
+            st->torn++;
+        if (seq < last_seq)
+            st->seq_backwards++;
+
+        last_seq = seq;
+        st->reads++;
+    }
+    return NULL;
+}
+
+/* Valore di rpm nel testo (div 1: intero) */
+static long json_rpm(const char *text)
+{
+    const char *k = strstr(text, "\"rpm\":");
+    return k ? strtol(k + 6, NULL, 10) : -1;
+}
+
+static void *json_reader(void *arg)
+{
+    reader_stats_t *st = (reader_stats_t *)arg;
+    obd_full_data_t ref;
+    char expect[OBD_JSON_MAX_LEN];
+    uint32_t last_seq = 0;
+
+    while (!atomic_load_explicit(&s_stop, memory_order_relaxed))
+    {
+        const obd_json_payload_t *p = obd_json_payload_get();
+        if (!p)
+        {
+            st->torn++;
+            continue;
+        }
+
+        fill(&ref, (uint32_t)json_rpm(p->text));
+        int len = obd_json_format(expect, sizeof(expect), &ref);
+        if (len != p->len || memcmp(expect, p->text, (size_t)len) != 0)
+            st->torn++;
+        if (p->seq < last_seq)
+            st->seq_backwards++;
+        last_seq = p->seq;
+
+        // tenuto un po': intanto lo scrittore va avanti
+        for (volatile int i = 0; i < 2000; i++)
+            ;
+        if (memcmp(expect, p->text, (size_t)len) != 0 || p->seq != last_seq)
+            st->torn++;
+
+        obd_json_payload_put(p);
+        st->reads++;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int duration_s = argc > 1 ? atoi(argv[1]) : 5;
+    int nreaders = argc > 2 ? atoi(argv[2]) : 4;
+    int njson = argc > 3 ? atoi(argv[3]) : 2;
+
+    if (nreaders < 1 || nreaders > 64)
+        nreaders = 4;
+    if (njson < 0 || njson > 64)
+        njson = 2;
+
+    obd_data_init();
+    obd_json_payload_init();
+
+    obd_full_data_t first;
+    fill(&first, 0);
+    obd_data_set(&first);
+
+    pthread_t w;
+    pthread_t r[64], j[64];
+    reader_stats_t st[64], jst[64];
+    memset(st, 0, sizeof(st));
+    memset(jst, 0, sizeof(jst));
+
+    pthread_create(&w, NULL, writer, NULL);
+    for (int i = 0; i < nreaders; i++)
+        pthread_create(&r[i], NULL, reader, &st[i]);
+    for (int i = 0; i < njson; i++)
+        pthread_create(&j[i], NULL, json_reader, &jst[i]);
+
+    struct timespec ts = {.tv_sec = duration_s};
+    nanosleep(&ts, NULL);
+    atomic_store(&s_stop, true);
+
+    pthread_join(w, NULL);
+    unsigned long reads = 0, torn = 0, back = 0;
+    for (int i = 0; i < nreaders; i++)
+    {
+        pthread_join(r[i], NULL);
+        reads += st[i].reads;
+        torn += st[i].torn;
+        back += st[i].seq_backwards;
+    }
+    unsigned long jreads = 0, jtorn = 0, jback = 0;
+    for (int i = 0; i < njson; i++)
+    {
+        pthread_join(j[i], NULL);
+        jreads += jst[i].reads;
+        jtorn += jst[i].torn;
+        jback += jst[i].seq_backwards;
+    }
+    obd_json_stats_t js;
+    obd_json_get_stats(&js);
+
+    printf("duration_s=%d readers=%d\n", duration_s, nreaders);
+    printf("writes=%lu (%.0f/s) reads=%lu (%.0f/s)\n",
+           atomic_load(&s_writes), (double)atomic_load(&s_writes) / duration_s,
+           reads, (double)reads / duration_s);
+    printf("torn=%lu seq_backwards=%lu\n", torn, back);
+    printf("json: readers=%d reads=%lu builds=%lu stale=%lu (%.2f letture per codifica) "
+           "torn=%lu seq_backwards=%lu\n",
+           njson, jreads, (unsigned long)js.builds, (unsigned long)js.stale,
+           js.builds ? (double)js.served / js.builds : 0.0, jtorn, jback);
+    return torn == 0 && back == 0 && jtorn == 0 && jback == 0 ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <stdio.h>
+
+/* Livello minimo stampato dall'host (0=E, 1=W, 2=I, 3=D) */
+extern int host_log_level;
+
+#define HOST_LOG_(lvl, ch, tag, fmt, ...)                                     \
+    do {                                                                      \
+        if (host_log_level >= (lvl))                                          \
+            fprintf(stderr, ch " (%s) " fmt "\n", tag, ##__VA_ARGS__);        \
+    } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG_(0, "E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG_(1, "W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG_(2, "I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) HOST_LOG_(3, "D", tag, fmt, ##__VA_ARGS__)
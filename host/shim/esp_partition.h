@@ -0,0 +1,45 @@
+#pragma once
+/* Shim host di esp_partition: una partizione dati in RAM con la semantica
+   della flash NOR (erase a settori = 0xFF, la scrittura può solo azzerare
+   bit) e tempi di erase/programmazione simulati */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum
+{
+    ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct
+{
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    uint32_t erase_size;
+    char label[17];
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *p, size_t off, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *p, size_t off, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *p, size_t off, size_t size);
+
+/* Solo host: partizione "storage" di size byte (0 = nessuna partizione),
+   immagine caricata/salvata da file per simulare un riavvio */
+void host_partition_setup(uint32_t size);
+bool host_partition_load(const char *path);
+bool host_partition_save(const char *path);
+/* Erase per settore (per la verifica del wear levelling) */
+uint32_t host_partition_erases(uint32_t sector);
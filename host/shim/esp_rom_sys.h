@@ -0,0 +1,14 @@
+#pragma once
+/* Shim host di esp_rom_delay_us: attesa attiva in tempo reale (non
+   scalato), come sul chip consuma CPU per tutta la durata */
+#include <stdint.h>
+#include <time.h>
+
+static inline void esp_rom_delay_us(uint32_t us)
+{
+    struct timespec t0, t;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do
+        clock_gettime(CLOCK_MONOTONIC, &t);
+    while ((t.tv_sec - t0.tv_sec) * 1000000L + (t.tv_nsec - t0.tv_nsec) / 1000 < (long)us);
+}
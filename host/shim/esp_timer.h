@@ -0,0 +1,6 @@
+#pragma once
+/* Shim host di esp_timer: µs dall'avvio, sullo stesso orologio (scalato)
+   dei tick FreeRTOS */
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,26 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+/* Fattore di accelerazione del tempo simulato (1 = tempo reale):
+   con N, un tick dura 1/N ms reali. Da impostare prima di creare task. */
+extern unsigned host_time_scale;
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t prio, TaskHandle_t *out);
+
+/* Affinità ignorata: sull'host il core lo sceglie Linux */
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+static inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                                 uint32_t stack_depth, void *arg,
+                                                 UBaseType_t prio, TaskHandle_t *out,
+                                                 BaseType_t core)
+{
+    (void)core;
+    return xTaskCreate(fn, name, stack_depth, arg, prio, out);
+}
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
@@ -0,0 +1,278 @@
+/* Implementazione host (pthread) del sottoinsieme FreeRTOS usato da main/.
+   Un task = un thread; tick = 1 ms di orologio monotono dall'avvio,
+   diviso per host_time_scale (esecuzione più veloce del tempo reale). */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int host_log_level = 2;
+unsigned host_time_scale = 1;
+
+static struct timespec s_t0;
+static pthread_once_t s_t0_once = PTHREAD_ONCE_INIT;
+
+static void init_t0(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s_t0);
+}
+
+static uint64_t elapsed_us(void)
+{
+    pthread_once(&s_t0_once, init_t0);
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)(t.tv_sec - s_t0.tv_sec) * 1000000ULL +
+           (uint64_t)((t.tv_nsec - s_t0.tv_nsec) / 1000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(elapsed_us() * host_time_scale / (1000000ULL / configTICK_RATE_HZ));
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)(elapsed_us() * host_time_scale);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    uint64_t us = (uint64_t)ticks * (1000000ULL / configTICK_RATE_HZ) / host_time_scale;
+    struct timespec ts = {
+        .tv_sec = (time_t)(us / 1000000ULL),
+        .tv_nsec = (long)(us % 1000000ULL) * 1000L,
+    };
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+}
+
+/* Scadenza assoluta (CLOCK_REALTIME, usato da pthread_cond_timedwait) */
+static struct timespec deadline_after(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    uint64_t ns = (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ) / host_time_scale;
+    ts.tv_sec += (time_t)(ns / 1000000000ULL);
+    ts.tv_nsec += (long)(ns % 1000000000ULL);
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+/* -------------------------------------------------------
+ * Task
+ * ------------------------------------------------------- */
+struct host_task
+{
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+};
+
+static void *task_trampoline(void *p)
+{
+    struct host_task *t = (struct host_task *)p;
+    t->fn(t->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t prio, TaskHandle_t *out)
+{
+    (void)name;
+    (void)stack_depth;
+    (void)prio;
+
+    struct host_task *t = calloc(1, sizeof(*t));
+    if (!t)
+        return pdFAIL;
+
+    t->fn = fn;
+    t->arg = arg;
+
+    if (pthread_create(&t->thread, NULL, task_trampoline, t) != 0)
+    {
+        free(t);
+        return pdFAIL;
+    }
+    pthread_detach(t->thread);
+
+    if (out)
+        *out = t;
+    return pdPASS;
+}
+
+/* -------------------------------------------------------
+ * Semafori (mutex = semaforo binario inizialmente libero)
+ * ------------------------------------------------------- */
+struct host_sem
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned count;
+};
+
+static SemaphoreHandle_t sem_create(unsigned initial)
+{
+    struct host_sem *s = calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->count = initial;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return sem_create(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return sem_create(0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    struct timespec dl = deadline_after(ticks);
+    BaseType_t ok = pdTRUE;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->count == 0)
+    {
+        if (ticks == portMAX_DELAY)
+            pthread_cond_wait(&s->cond, &s->lock);
+        else if (ticks == 0 || pthread_cond_timedwait(&s->cond, &s->lock, &dl) == ETIMEDOUT)
+        {
+            ok = pdFALSE;
+            break;
+        }
+    }
+    if (ok)
+        s->count--;
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->count = 1;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t s)
+{
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s);
+}
+
+/* -------------------------------------------------------
+ * Code (FIFO a dimensione fissa, copia per valore)
+ * ------------------------------------------------------- */
+struct host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *storage;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *q = calloc(1, sizeof(*q));
+    if (!q)
+        return NULL;
+
+    q->storage = calloc(length, item_size);
+    if (!q->storage)
+    {
+        free(q);
+        return NULL;
+    }
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    q->length = length;
+    q->item_size = item_size;
+    return q;
+}
+
+static bool wait_cond(pthread_cond_t *c, pthread_mutex_t *m, TickType_t ticks,
+                      const struct timespec *dl)
+{
+    if (ticks == portMAX_DELAY)
+        return pthread_cond_wait(c, m) == 0;
+    if (ticks == 0)
+        return false;
+    return pthread_cond_timedwait(c, m, dl) != ETIMEDOUT;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    struct timespec dl = deadline_after(ticks);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->length)
+    {
+        if (!wait_cond(&q->not_full, &q->lock, ticks, &dl))
+        {
+            pthread_mutex_unlock(&q->lock);
+            return pdFALSE;
+        }
+    }
+
+    UBaseType_t tail = (q->head + q->count) % q->length;
+    memcpy(q->storage + (size_t)tail * q->item_size, item, q->item_size);
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    struct timespec dl = deadline_after(ticks);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0)
+    {
+        if (!wait_cond(&q->not_empty, &q->lock, ticks, &dl))
+        {
+            pthread_mutex_unlock(&q->lock);
+            return pdFALSE;
+        }
+    }
+
+    memcpy(item, q->storage + (size_t)q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
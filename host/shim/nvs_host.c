@@ -0,0 +1,114 @@
+/* NVS in memoria per l'host: poche voci (namespace, chiave) -> blob */
+#include "nvs.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NVS_HOST_ENTRIES 16
+#define NVS_HOST_NAME 16
+
+typedef struct
+{
+    char ns[NVS_HOST_NAME];
+    char key[NVS_HOST_NAME];
+    void *data;
+    size_t len;
+} nvs_entry_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static nvs_entry_t s_entries[NVS_HOST_ENTRIES];
+static char s_open_ns[NVS_HOST_ENTRIES][NVS_HOST_NAME]; // handle - 1 -> namespace
+
+esp_err_t nvs_open(const char *ns, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    (void)mode;
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < NVS_HOST_ENTRIES; i++)
+    {
+        if (s_open_ns[i][0] == '\0')
+        {
+            strncpy(s_open_ns[i], ns, NVS_HOST_NAME - 1);
+            *out = (nvs_handle_t)(i + 1);
+            pthread_mutex_unlock(&s_lock);
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_ERR_NO_MEM;
+}
+
+/* Col lock */
+static nvs_entry_t *find(nvs_handle_t h, const char *key, bool create)
+{
+    const char *ns = s_open_ns[h - 1];
+    nvs_entry_t *free_slot = NULL;
+
+    for (int i = 0; i < NVS_HOST_ENTRIES; i++)
+    {
+        nvs_entry_t *e = &s_entries[i];
+        if (e->ns[0] == '\0')
+        {
+            if (!free_slot)
+                free_slot = e;
+            continue;
+        }
+        if (strcmp(e->ns, ns) == 0 && strcmp(e->key, key) == 0)
+            return e;
+    }
+    if (!create || !free_slot)
+        return NULL;
+
+    strncpy(free_slot->ns, ns, NVS_HOST_NAME - 1);
+    strncpy(free_slot->key, key, NVS_HOST_NAME - 1);
+    return free_slot;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t h, const char *key, const void *value, size_t len)
+{
+    pthread_mutex_lock(&s_lock);
+    nvs_entry_t *e = find(h, key, true);
+    if (!e)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    free(e->data);
+    e->data = malloc(len ? len : 1);
+    memcpy(e->data, value, len);
+    e->len = len;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t h, const char *key, void *out, size_t *len)
+{
+    pthread_mutex_lock(&s_lock);
+    nvs_entry_t *e = find(h, key, false);
+    esp_err_t err = ESP_OK;
+
+    if (!e)
+        err = ESP_ERR_NVS_NOT_FOUND;
+    else if (out && *len < e->len)
+        err = ESP_ERR_INVALID_ARG;
+    else if (out)
+        memcpy(out, e->data, e->len);
+    if (e)
+        *len = e->len;
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_commit(nvs_handle_t h)
+{
+    (void)h;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t h)
+{
+    pthread_mutex_lock(&s_lock);
+    s_open_ns[h - 1][0] = '\0';
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,119 @@
+/* Partizione "storage" in RAM per l'host (vedi esp_partition.h) */
+#include "esp_partition.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTOR 4096
+
+// tempi tipici di una flash SPI: erase di un settore, programmazione per KB
+#define ERASE_MS 45
+#define PROGRAM_MS_PER_KB 2
+
+static esp_partition_t s_part = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = ESP_PARTITION_SUBTYPE_DATA_SPIFFS,
+    .address = 0x310000,
+    .size = 0xDE000, // come partitions.csv
+    .erase_size = SECTOR,
+    .label = "storage",
+};
+static uint8_t *s_mem;
+static uint32_t *s_erases;
+
+void host_partition_setup(uint32_t size)
+{
+    free(s_mem);
+    free(s_erases);
+    s_mem = NULL;
+    s_erases = NULL;
+    s_part.size = size - size % SECTOR;
+    if (s_part.size == 0)
+        return;
+
+    s_mem = malloc(s_part.size);
+    s_erases = calloc(s_part.size / SECTOR, sizeof(*s_erases));
+    memset(s_mem, 0xFF, s_part.size);
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    if (!s_mem && s_part.size)
+        host_partition_setup(s_part.size);
+    if (!s_mem || type != s_part.type)
+        return NULL;
+    if (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != s_part.subtype)
+        return NULL;
+    if (label && strcmp(label, s_part.label) != 0)
+        return NULL;
+    return &s_part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *p, size_t off, void *dst, size_t size)
+{
+    if (p != &s_part || off + size > s_part.size)
+        return ESP_ERR_INVALID_ARG;
+    memcpy(dst, s_mem + off, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *p, size_t off, const void *src, size_t size)
+{
+    if (p != &s_part || off + size > s_part.size)
+        return ESP_ERR_INVALID_ARG;
+
+    const uint8_t *s = src;
+    for (size_t i = 0; i < size; i++)
+        s_mem[off + i] &= s[i]; // NOR: 1 -> 0 soltanto
+
+    vTaskDelay(pdMS_TO_TICKS((size * PROGRAM_MS_PER_KB + 1023) / 1024));
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *p, size_t off, size_t size)
+{
+    if (p != &s_part || off % SECTOR || size % SECTOR || off + size > s_part.size)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(s_mem + off, 0xFF, size);
+    for (size_t k = off / SECTOR; k < (off + size) / SECTOR; k++)
+        s_erases[k]++;
+
+    vTaskDelay(pdMS_TO_TICKS(ERASE_MS * (size / SECTOR)));
+    return ESP_OK;
+}
+
+bool host_partition_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    if (!s_mem)
+        host_partition_setup(s_part.size);
+
+    size_t n = fread(s_mem, 1, s_part.size, f);
+    fclose(f);
+    return n == s_part.size;
+}
+
+bool host_partition_save(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    size_t n = s_mem ? fwrite(s_mem, 1, s_part.size, f) : 0;
+    fclose(f);
+    return n == s_part.size;
+}
+
+uint32_t host_partition_erases(uint32_t sector)
+{
+    return s_erases && sector < s_part.size / SECTOR ? s_erases[sector] : 0;
+}
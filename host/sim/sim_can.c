@@ -0,0 +1,388 @@
+/* can_bus.h per l'host: il bus è una coda di frame con istante di consegna,
+   le ECU simulate rispondono alle richieste inviate da can_bus_send(). */
+#include "can_bus.h"
+#include "sim_ecu.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define SIM_QUEUE_LEN 256
+#define SIM_ISOTP_MAX 256 // oltre il buffer del tester: prova il troncamento
+#define SIM_TX_PENDING 4
+
+typedef struct
+{
+    twai_message_t msg;
+    TickType_t due;
+} sim_frame_t;
+
+/* Risposte multi-frame in attesa del Flow Control, in ordine di First
+   Frame: con richieste in pipeline un'ECU lenta può averne più d'una */
+typedef struct
+{
+    struct
+    {
+        uint8_t buf[SIM_ISOTP_MAX];
+        int len;
+        TickType_t ff_due; // consegna del First Frame
+    } pend[SIM_TX_PENDING];
+    int n;
+} sim_tx_state_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_frame_t s_queue[SIM_QUEUE_LEN]; // ordinata per due
+static int s_count;
+
+static sim_ecu_cfg_t s_ecus[SIM_MAX_ECUS];
+static sim_tx_state_t s_tx[SIM_MAX_ECUS];
+static TickType_t s_busy[SIM_MAX_ECUS]; // ECU seriale: fine dell'ultima risposta
+static int s_necus;
+static sim_stats_t s_stats;
+static can_bus_config_t s_cfg = {.filter = CAN_FILTER_ACCEPT_ALL, .bitrate = 500000};
+static uint32_t s_rng = 1;
+static volatile can_bus_trace_cb_t s_trace;
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t period_ms;
+    TickType_t next;
+    uint8_t counter;
+} sim_broadcast_t;
+
+static sim_broadcast_t s_bcast[SIM_MAX_BROADCAST];
+static int s_nbcast;
+
+/* xorshift32: drop riproducibili a parità di seed */
+static uint32_t sim_rand(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+void sim_bus_init(const sim_ecu_cfg_t *ecus, int n, uint32_t seed)
+{
+    pthread_mutex_lock(&s_lock);
+    s_rng = seed ? seed : 1;
+    if (n > SIM_MAX_ECUS)
+        n = SIM_MAX_ECUS;
+    memcpy(s_ecus, ecus, sizeof(*ecus) * (size_t)n);
+    memset(s_tx, 0, sizeof(s_tx));
+    memset(s_busy, 0, sizeof(s_busy));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_necus = n;
+    s_count = 0;
+    s_nbcast = 0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_bus_set_ecu(int n, const sim_ecu_cfg_t *cfg)
+{
+    pthread_mutex_lock(&s_lock);
+    if (n >= 0 && n < s_necus)
+        s_ecus[n] = *cfg;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_bus_stats(sim_stats_t *out)
+{
+    pthread_mutex_lock(&s_lock);
+    *out = s_stats;
+    pthread_mutex_unlock(&s_lock);
+}
+
+/* Inserimento ordinato (a parità di due mantiene l'ordine di arrivo). Col lock. */
+static bool enqueue_msg(const twai_message_t *msg, TickType_t due)
+{
+    s_stats.frames_tx++;
+
+    // filtro di accettazione hardware emulato
+    if (s_cfg.filter == CAN_FILTER_OBD_RESP && (msg->extd || (msg->identifier & 0x7F8) != 0x7E8))
+        return true;
+    if (s_count >= SIM_QUEUE_LEN)
+        return false; // overrun: il frame è perso come su una coda TWAI piena
+
+    int pos = s_count;
+    while (pos > 0 && (int32_t)(s_queue[pos - 1].due - due) > 0)
+    {
+        s_queue[pos] = s_queue[pos - 1];
+        pos--;
+    }
+
+    s_queue[pos].msg = *msg;
+    s_queue[pos].due = due;
+    s_count++;
+    return true;
+}
+
+static void enqueue(uint32_t id, const uint8_t *data, TickType_t due)
+{
+    twai_message_t msg = {.identifier = id, .data_length_code = 8};
+    memcpy(msg.data, data, 8);
+    enqueue_msg(&msg, due);
+}
+
+bool sim_bus_inject(const twai_message_t *msg, TickType_t due)
+{
+    pthread_mutex_lock(&s_lock);
+    bool ok = enqueue_msg(msg, due);
+    if (!ok)
+        s_stats.frames_tx--; // il chiamante riproverà: non è un frame in più
+    pthread_mutex_unlock(&s_lock);
+    return ok;
+}
+
+bool sim_bus_add_broadcast(uint32_t id, uint32_t period_ms)
+{
+    bool ok = false;
+
+    pthread_mutex_lock(&s_lock);
+    if (s_nbcast < SIM_MAX_BROADCAST && period_ms > 0)
+    {
+        sim_broadcast_t *b = &s_bcast[s_nbcast++];
+        b->id = id;
+        b->period_ms = period_ms;
+        b->next = xTaskGetTickCount() + pdMS_TO_TICKS(period_ms);
+        b->counter = 0;
+        ok = true;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ok;
+}
+
+/* Frame periodici scaduti, con il loro istante nominale. Col lock. */
+static void broadcast_due(TickType_t now)
+{
+    for (int i = 0; i < s_nbcast; i++)
+    {
+        sim_broadcast_t *b = &s_bcast[i];
+        while ((int32_t)(now - b->next) >= 0)
+        {
+            uint16_t ramp = (uint16_t)(b->next / pdMS_TO_TICKS(10));
+            uint8_t data[8] = {b->counter++, (uint8_t)(ramp >> 8), (uint8_t)ramp};
+            for (int k = 3; k < 8; k++)
+                data[k] = (uint8_t)(b->id >> (8 * ((k - 3) % 2)));
+            enqueue(b->id, data, b->next);
+            b->next += pdMS_TO_TICKS(b->period_ms);
+        }
+    }
+}
+
+static void ecu_send_response(int e, const uint8_t *resp, int len, TickType_t due)
+{
+    uint8_t frame[8] = {0};
+    uint32_t id = s_ecus[e].resp_id;
+
+    if (len <= 7)
+    {
+        frame[0] = (uint8_t)len;
+        memcpy(&frame[1], resp, (size_t)len);
+        enqueue(id, frame, due);
+        return;
+    }
+
+    // First Frame: i restanti byte partono dopo il Flow Control
+    frame[0] = (uint8_t)(0x10 | ((len >> 8) & 0x0F));
+    frame[1] = (uint8_t)len;
+    memcpy(&frame[2], resp, 6);
+    enqueue(id, frame, due);
+
+    sim_tx_state_t *st = &s_tx[e];
+    if (st->n == SIM_TX_PENDING)
+        return; // ECU satura: il Flow Control non troverà i Consecutive Frame
+
+    memcpy(st->pend[st->n].buf, resp, (size_t)len);
+    st->pend[st->n].len = len;
+    st->pend[st->n].ff_due = due;
+    st->n++;
+    s_stats.multi_frame++;
+}
+
+/* Flow Control ricevuto: continua l'ultima risposta di cui è già partito
+   il First Frame. Quelle precedenti (FF ignorato dal tester, es. risposta
+   tardiva) sono abbandonate come su un'ECU reale. */
+static void ecu_send_consecutive(int e, TickType_t now)
+{
+    sim_tx_state_t *st = &s_tx[e];
+    uint8_t sn = 1;
+    int k = -1;
+
+    for (int i = 0; i < st->n; i++)
+        if ((int32_t)(now - st->pend[i].ff_due) >= 0)
+            k = i;
+    if (k < 0)
+        return; // nessun First Frame consegnato: FC spurio
+
+    const uint8_t *buf = st->pend[k].buf;
+    int len = st->pend[k].len;
+
+    for (int off = 6; off < len; off += 7)
+    {
+        uint8_t frame[8] = {0};
+        int chunk = len - off;
+        if (chunk > 7)
+            chunk = 7;
+
+        frame[0] = (uint8_t)(0x20 | sn);
+        memcpy(&frame[1], &buf[off], (size_t)chunk);
+        enqueue(s_ecus[e].resp_id, frame, now);
+        sn = (sn + 1) & 0x0F;
+    }
+
+    st->n -= k + 1;
+    memmove(&st->pend[0], &st->pend[k + 1], sizeof(st->pend[0]) * (size_t)st->n);
+}
+
+esp_err_t can_bus_send(twai_message_t *msg)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    if (s_cfg.listen_only)
+        return ESP_ERR_INVALID_STATE;
+
+    can_bus_trace_cb_t trace = s_trace;
+    if (trace)
+        trace(msg, true);
+
+    pthread_mutex_lock(&s_lock);
+    s_stats.frames_rx++;
+    if ((msg->data[0] >> 4) == 0)
+        s_stats.req_tx++;
+
+    for (int e = 0; e < s_necus; e++)
+    {
+        const sim_ecu_cfg_t *cfg = &s_ecus[e];
+        bool physical = msg->identifier == cfg->resp_id - 8;
+
+        if (physical && msg->data[0] == 0x30)
+        {
+            ecu_send_consecutive(e, now);
+            continue;
+        }
+
+        if (msg->identifier != 0x7DF && !physical)
+            continue;
+
+        int req_len = msg->data[0] & 0x0F;
+        if ((msg->data[0] >> 4) != 0 || req_len < 1 || req_len > 7)
+            continue;
+
+        if (cfg->drop_pct && sim_rand() % 100 < cfg->drop_pct)
+        {
+            s_stats.dropped++;
+            continue;
+        }
+
+        // ECU seriale: una richiesta alla volta, le altre attendono in coda
+        uint32_t lat = sim_ecu_latency(cfg, &msg->data[1], req_len);
+        TickType_t start = now;
+        if (cfg->queue_max)
+        {
+            TickType_t backlog = (int32_t)(s_busy[e] - now) > 0 ? s_busy[e] - now : 0;
+            if (backlog >= pdMS_TO_TICKS(lat) * cfg->queue_max)
+            {
+                s_stats.overflow++;
+                continue;
+            }
+            start = now + backlog;
+        }
+
+        uint8_t resp[SIM_ISOTP_MAX];
+        int answered = 0;
+        int len = sim_ecu_respond(cfg, &msg->data[1], req_len, resp, sizeof(resp),
+                                  now, &answered);
+        if (len <= 0)
+            continue;
+
+        s_stats.requests++;
+        s_stats.pid_answers += (uint32_t)answered;
+
+        s_busy[e] = start + pdMS_TO_TICKS(lat);
+        ecu_send_response(e, resp, len, s_busy[e]);
+    }
+
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t can_bus_receive(twai_message_t *msg, TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    while (1)
+    {
+        TickType_t now = xTaskGetTickCount();
+
+        pthread_mutex_lock(&s_lock);
+        broadcast_due(now);
+        if (s_count > 0 && (int32_t)(now - s_queue[0].due) >= 0)
+        {
+            *msg = s_queue[0].msg;
+            memmove(&s_queue[0], &s_queue[1], sizeof(s_queue[0]) * (size_t)(s_count - 1));
+            s_count--;
+            pthread_mutex_unlock(&s_lock);
+
+            can_bus_trace_cb_t trace = s_trace;
+            if (trace)
+                trace(msg, false);
+            return ESP_OK;
+        }
+        pthread_mutex_unlock(&s_lock);
+
+        if (timeout != portMAX_DELAY && (now - start) >= timeout)
+            return ESP_ERR_TIMEOUT;
+
+        vTaskDelay(1);
+    }
+}
+
+esp_err_t can_bus_init_config(const can_bus_config_t *cfg)
+{
+    pthread_mutex_lock(&s_lock);
+    s_cfg = *cfg;
+    if (s_cfg.bitrate == 0)
+        s_cfg.bitrate = 500000; // il bus simulato non ha un bitrate fisico
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+void can_bus_init(void)
+{
+    can_bus_config_t cfg = {
+        .filter = CAN_FILTER_OBD_RESP,
+        .bitrate = 0,
+        .listen_only = false,
+    };
+    can_bus_init_config(&cfg);
+}
+
+void can_bus_deinit(void)
+{
+}
+
+void can_bus_set_trace(can_bus_trace_cb_t cb)
+{
+    s_trace = cb;
+}
+
+/* Il bus simulato non perde frame né accumula errori: solo le code */
+esp_err_t can_bus_get_status(twai_status_info_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->state = TWAI_STATE_RUNNING;
+
+    pthread_mutex_lock(&s_lock);
+    out->msgs_to_rx = (uint32_t)s_count;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+uint32_t can_bus_bitrate(void)
+{
+    return s_cfg.bitrate;
+}
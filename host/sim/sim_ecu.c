@@ -0,0 +1,209 @@
+#include "sim_ecu.h"
+#include "obd.h"
+
+#include <string.h>
+
+void sim_ecu_set_pid(sim_ecu_cfg_t *cfg, uint8_t pid, bool supported)
+{
+    if (supported)
+        cfg->supported[pid >> 5] |= 1UL << (pid & 31);
+    else
+        cfg->supported[pid >> 5] &= ~(1UL << (pid & 31));
+}
+
+static bool pid_supported(const sim_ecu_cfg_t *cfg, uint8_t pid)
+{
+    return (cfg->supported[pid >> 5] >> (pid & 31)) & 1;
+}
+
+/* Un PID bitmap (0x00, 0x20, ...) risponde se è 0x00 o se esiste
+   almeno un PID supportato oltre la sua base */
+static bool bitmap_supported(const sim_ecu_cfg_t *cfg, uint8_t base)
+{
+    if (base == 0x00)
+        return true;
+
+    for (int pid = base + 1; pid <= 0xFF; pid++)
+        if (pid_supported(cfg, (uint8_t)pid))
+            return true;
+    return false;
+}
+
+/* Bitmap dei 32 PID successivi (bit 31 = PID base+1, bit 0 = blocco seguente) */
+static uint32_t support_bitmap(const sim_ecu_cfg_t *cfg, uint8_t base)
+{
+    uint32_t bits = 0;
+
+    for (int i = 1; i < 32; i++)
+    {
+        int pid = base + i;
+        if (pid_supported(cfg, (uint8_t)pid))
+            bits |= 1UL << (32 - i);
+    }
+
+    if (base + 32 <= 0xFF && bitmap_supported(cfg, (uint8_t)(base + 32)))
+        bits |= 1UL;
+    return bits;
+}
+
+/* Valori plausibili e variabili nel tempo (byte grezzi OBD) */
+static int pid_value(const sim_ecu_cfg_t *cfg, uint8_t pid, uint32_t t, uint8_t *out)
+{
+    uint8_t len;
+    uint32_t tri = (t / 10) % 2000; // rampa triangolare 0..1000..0 su 20 s
+    if (tri > 1000)
+        tri = 2000 - tri;
+
+    if ((pid & 0x1F) == 0)
+    {
+        uint32_t bits = support_bitmap(cfg, pid);
+        out[0] = (uint8_t)(bits >> 24);
+        out[1] = (uint8_t)(bits >> 16);
+        out[2] = (uint8_t)(bits >> 8);
+        out[3] = (uint8_t)bits;
+        return 4;
+    }
+
+    switch (pid)
+    {
+    case 0x0C: // RPM 800..4800
+    {
+        uint16_t raw = (uint16_t)((800 + tri * 4) * 4);
+        out[0] = (uint8_t)(raw >> 8);
+        out[1] = (uint8_t)raw;
+        return 2;
+    }
+    case 0x0D: // speed 0..120
+        out[0] = (uint8_t)(tri * 120 / 1000);
+        return 1;
+    case 0x05: // coolant 90 C
+        out[0] = 130;
+        return 1;
+    case 0x42: // 13.8 V
+        out[0] = 13800 >> 8;
+        out[1] = 13800 & 0xFF;
+        return 2;
+    case 0x10: // MAF 2..42 g/s
+    {
+        uint16_t raw = (uint16_t)(200 + tri * 4);
+        out[0] = (uint8_t)(raw >> 8);
+        out[1] = (uint8_t)raw;
+        return 2;
+    }
+    case 0x01: // MIL accesa se ci sono DTC memorizzati
+        out[0] = (uint8_t)(cfg->dtc_n[0] ? 0x80 | (cfg->dtc_n[0] & 0x7F) : 0);
+        out[1] = out[2] = out[3] = 0;
+        return 4;
+    default:
+        break;
+    }
+
+    // generico: byte derivati da PID e tempo, lunghezza da tabella SAE J1979
+    len = obd_pid_data_len(pid);
+    if (len == 0 || len > 4)
+        len = 2;
+    for (uint8_t i = 0; i < len; i++)
+        out[i] = (uint8_t)(pid * 7 + tri / 8 + i);
+    return len;
+}
+
+uint16_t sim_dtc_code(const char *text)
+{
+    static const char sys[] = "PCBU";
+    const char *p = text ? strchr(sys, text[0]) : NULL;
+    unsigned digits = 0;
+
+    if (!p || !*p || strlen(text) != 5 || text[1] < '0' || text[1] > '3')
+        return 0;
+    for (int i = 1; i < 5; i++)
+    {
+        char c = text[i];
+        int v = c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (v < 0)
+            return 0;
+        digits = digits << 4 | (unsigned)v;
+    }
+    return (uint16_t)((unsigned)(p - sys) << 14 | digits);
+}
+
+/* Mode 03/07/0A: conteggio poi 2 byte per codice (ISO 15765-4) */
+static int dtc_respond(const sim_ecu_cfg_t *cfg, uint8_t service, uint8_t *resp, int cap)
+{
+    int kind = service == 0x03 ? 0 : service == 0x07 ? 1 : 2;
+    int len = 0;
+
+    if (kind == 2 && cfg->no_permanent)
+    {
+        resp[len++] = 0x7F;
+        resp[len++] = service;
+        resp[len++] = 0x11; // serviceNotSupported
+        return len;
+    }
+
+    resp[len++] = (uint8_t)(service + 0x40);
+    resp[len++] = cfg->dtc_n[kind];
+    for (int i = 0; i < cfg->dtc_n[kind] && len + 2 <= cap; i++)
+    {
+        resp[len++] = (uint8_t)(cfg->dtc[kind][i] >> 8);
+        resp[len++] = (uint8_t)cfg->dtc[kind][i];
+    }
+    return len;
+}
+
+int sim_ecu_respond(const sim_ecu_cfg_t *cfg, const uint8_t *req, int req_len,
+                    uint8_t *resp, int cap, uint32_t t_ms, int *answered)
+{
+    *answered = 0;
+
+    if (req_len == 1 && (req[0] == 0x03 || req[0] == 0x07 || req[0] == 0x0A))
+        return dtc_respond(cfg, req[0], resp, cap);
+    if (req_len < 2 || req[0] != 0x01)
+        return 0; // Mode 01 e DTC
+
+    int len = 0;
+    resp[len++] = 0x41;
+
+    int npids = req_len - 1;
+    if (!cfg->multi_pid && npids > 1)
+        npids = 1;
+
+    for (int i = 0; i < npids; i++)
+    {
+        uint8_t pid = req[1 + i];
+        bool bitmap = (pid & 0x1F) == 0;
+
+        if (bitmap ? !bitmap_supported(cfg, pid) : !pid_supported(cfg, pid))
+            continue;
+
+        uint8_t val[4];
+        int vl = pid_value(cfg, pid, t_ms, val);
+
+        if (len + 1 + vl > cap)
+            break;
+        resp[len++] = pid;
+        memcpy(&resp[len], val, (size_t)vl);
+        len += vl;
+        (*answered)++;
+    }
+
+    // nessun PID supportato: una ECU reale resta in silenzio
+    return len > 1 ? len : 0;
+}
+
+uint32_t sim_ecu_latency(const sim_ecu_cfg_t *cfg, const uint8_t *req, int req_len)
+{
+    uint32_t lat = 0;
+    int npids = req_len - 1;
+
+    if (!cfg->multi_pid && npids > 1)
+        npids = 1;
+
+    for (int i = 0; i < npids; i++)
+    {
+        uint16_t l = cfg->pid_latency_ms[req[1 + i]];
+        uint32_t v = l ? l : cfg->latency_ms;
+        if (v > lat)
+            lat = v;
+    }
+    return npids > 0 ? lat : cfg->latency_ms;
+}
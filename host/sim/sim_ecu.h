@@ -0,0 +1,69 @@
+#pragma once
+/* ECU simulata sul bus CAN host: risponde alle richieste OBD-II
+   (0x7DF funzionale o 0x7E0+n fisica) con segmentazione ISO-TP. */
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/twai.h"
+
+#define SIM_MAX_ECUS 8
+#define SIM_MAX_DTC 100 // per tipo: oltre 63 la risposta supera il buffer ISO-TP del tester
+
+typedef struct
+{
+    uint32_t resp_id;      // 0x7E8..0x7EF (richiesta fisica = resp_id - 8)
+    uint32_t latency_ms;   // ritardo tra richiesta e primo frame di risposta
+    uint32_t supported[8]; // bitmap PID Mode 01 supportati (bit n = PID n)
+    bool multi_pid;        // false: risponde solo al primo PID della richiesta
+    uint16_t pid_latency_ms[256]; // per PID (0 = latency_ms); multi-PID: il più lento
+    uint8_t drop_pct;      // probabilità (%) di ignorare una richiesta
+    uint8_t queue_max;     // 0 = risposte in parallelo; n = ECU seriale che
+                           // accoda fino a n richieste e ignora le altre
+    uint16_t dtc[3][SIM_MAX_DTC]; // memorizzati (Mode 03), in attesa (07), permanenti (0A)
+    uint8_t dtc_n[3];      // il conteggio memorizzati è anche nel PID 0x01
+    bool no_permanent;     // Mode 0A non supportato: risposta negativa
+} sim_ecu_cfg_t;
+
+typedef struct
+{
+    uint32_t requests;     // richieste Mode 01 ricevute (per ECU che risponde)
+    uint32_t pid_answers;  // PID restituiti
+    uint32_t frames_tx;    // frame inviati dalle ECU
+    uint32_t frames_rx;    // frame inviati dal tester (richieste + FC)
+    uint32_t req_tx;       // richieste (single frame) inviate dal tester
+    uint32_t multi_frame;  // risposte ISO-TP multi-frame
+    uint32_t dropped;      // richieste ignorate (drop_pct)
+    uint32_t overflow;     // richieste ignorate per coda ECU piena (queue_max)
+} sim_stats_t;
+
+/* Marca un PID come supportato/non supportato nella configurazione */
+void sim_ecu_set_pid(sim_ecu_cfg_t *cfg, uint8_t pid, bool supported);
+
+/* Codice "P0300" nei 2 byte SAE J2012; 0 se malformato */
+uint16_t sim_dtc_code(const char *text);
+
+/* Costruisce la risposta (SID + payload) a una richiesta; 0 = nessuna risposta.
+   answered riceve il numero di PID inclusi. */
+int sim_ecu_respond(const sim_ecu_cfg_t *cfg, const uint8_t *req, int req_len,
+                    uint8_t *resp, int cap, uint32_t t_ms, int *answered);
+
+/* Ritardo di risposta a una richiesta Mode 01 (PID più lento richiesto) */
+uint32_t sim_ecu_latency(const sim_ecu_cfg_t *cfg, const uint8_t *req, int req_len);
+
+/* Configura le ECU presenti sul bus simulato (azzera le statistiche);
+   seed rende riproducibili i drop */
+void sim_bus_init(const sim_ecu_cfg_t *ecus, int n, uint32_t seed);
+void sim_bus_stats(sim_stats_t *out);
+
+/* Sostituisce a caldo la configurazione dell'ECU n (statistiche invariate):
+   per scenari scriptati (ECU che si zittisce, rallenta, ...) */
+void sim_bus_set_ecu(int n, const sim_ecu_cfg_t *cfg);
+
+/* Traffico periodico di altri nodi (ECU motore, ABS, cruscotto...) per la
+   cattura passiva: ogni period_ms un frame su id con byte 0 contatore,
+   byte 1-2 rampa big-endian (t_ms / 10), byte 3-7 = id (LSB, MSB, ...). */
+#define SIM_MAX_BROADCAST 16
+bool sim_bus_add_broadcast(uint32_t id, uint32_t period_ms);
+
+/* Frame arbitrario consegnato da can_bus_receive() a partire da due
+   (replay di una traccia). false se la coda RX è piena: riprovare. */
+bool sim_bus_inject(const twai_message_t *msg, TickType_t due);
@@ -0,0 +1,142 @@
+/* gpio.h per l'host: i pin di lcd.c pilotano un HD44780 simulato */
+#include "sim_lcd.h"
+#include "driver/gpio.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+// come i default di lcd.c
+#define PIN_RS 23
+#define PIN_E  22
+#define PIN_D4 21
+#define PIN_D5 19
+#define PIN_D6 18
+#define PIN_D7 17
+
+#define EXEC_US  37   // caratteri e istruzioni (270 kHz)
+#define CLEAR_US 1520 // clear e home
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t s_level[40];
+static char s_ddram[0x68];  // riga 0 da 0x00, riga 1 da 0x40
+static uint8_t s_addr;
+static int s_four_bit;      // 0 dopo il reset: interfaccia a 8 bit
+static int s_half = -1;     // nibble alto in attesa (modo 4 bit)
+static uint64_t s_busy_until;
+static sim_lcd_stats_t s_stats;
+
+static uint64_t now_us(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000ULL + (uint64_t)t.tv_nsec / 1000;
+}
+
+static void execute(uint8_t byte, int rs, uint64_t t)
+{
+    uint32_t exec = EXEC_US;
+
+    if (rs)
+    {
+        s_ddram[s_addr] = (char)byte;
+        s_addr = (uint8_t)(s_addr + 1 == 0x28 ? 0x40 : s_addr + 1 == 0x68 ? 0x00 : s_addr + 1);
+        s_stats.data++;
+    }
+    else
+    {
+        if (byte == 0x01)
+        {
+            memset(s_ddram, ' ', sizeof(s_ddram));
+            s_addr = 0;
+            exec = CLEAR_US;
+        }
+        else if ((byte & 0xFE) == 0x02)
+        {
+            s_addr = 0;
+            exec = CLEAR_US;
+        }
+        else if (byte & 0x80)
+            s_addr = (uint8_t)(byte & 0x7F);
+        s_stats.commands++;
+    }
+
+    s_busy_until = t + exec;
+    s_stats.exec_us += exec;
+}
+
+/* Fronte di discesa di E: il controller legge D4..D7 */
+static void latch(uint64_t t)
+{
+    uint8_t nibble = (uint8_t)(s_level[PIN_D4] | s_level[PIN_D5] << 1 | s_level[PIN_D6] << 2 |
+                               s_level[PIN_D7] << 3);
+    int rs = s_level[PIN_RS];
+
+    if (!s_four_bit)
+    {
+        // sequenza di reset: 0x3 (8 bit) fino a 0x2 = passa a 4 bit
+        if (nibble == 0x2)
+            s_four_bit = 1;
+        return;
+    }
+
+    if (s_half < 0)
+    {
+        if (t < s_busy_until)
+            s_stats.violations++;
+        s_half = nibble;
+        return;
+    }
+
+    execute((uint8_t)(s_half << 4 | nibble), rs, t);
+    s_half = -1;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t pin)
+{
+    (void)pin;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode)
+{
+    (void)pin;
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    if ((unsigned)pin >= sizeof(s_level))
+        return ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&s_lock);
+    uint8_t prev = s_level[pin];
+    s_level[pin] = level ? 1 : 0;
+    if (pin == PIN_E && prev && !level)
+        latch(now_us());
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+void sim_lcd_read(char out[2][17])
+{
+    pthread_mutex_lock(&s_lock);
+    for (int r = 0; r < 2; r++)
+    {
+        for (int c = 0; c < 16; c++)
+        {
+            char ch = s_ddram[r * 0x40 + c];
+            out[r][c] = ch ? ch : ' ';
+        }
+        out[r][16] = '\0';
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_lcd_stats(sim_lcd_stats_t *out)
+{
+    pthread_mutex_lock(&s_lock);
+    *out = s_stats;
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,17 @@
+#pragma once
+/* HD44780 16x2 simulato dietro i GPIO dell'host: decodifica i nibble
+   scritti da lcd.c (pin di default), tiene la DDRAM e verifica che ogni
+   istruzione arrivi dopo la fine dell'esecuzione della precedente. */
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t data;       // caratteri scritti
+    uint32_t commands;   // istruzioni (indirizzo, clear, ...)
+    uint32_t violations; // istruzioni arrivate con il controller ancora occupato
+    uint64_t exec_us;    // tempo di esecuzione dichiarato dal datasheet
+} sim_lcd_stats_t;
+
+/* Contenuto visibile: 2 righe di 16 caratteri più terminatore */
+void sim_lcd_read(char out[2][17]);
+void sim_lcd_stats(sim_lcd_stats_t *out);
@@ -3,6 +3,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "esp_wifi.h"
 #include "esp_event.h"
@@ -10,14 +11,30 @@
 #include "esp_netif.h"
 #include "esp_log.h"
 
+#include "app_tasks.h"
 #include "can_bus.h"
+#include "can_capture.h"
 #include "lcd.h"
 #include "obd.h"
+#include "obd_log.h"
 #include "web_server.h"
 
 
 static const char *TAG = "OBD_CAN_MONITOR";
 
+#ifndef APP_CAN_LISTEN_ONLY
+// 1 = cattura passiva del bus (nessun ACK, nessuna richiesta OBD) al posto
+// del polling: in listen-only il controller non può trasmettere, i due
+// modi si escludono
+#define APP_CAN_LISTEN_ONLY 0
+#endif
+
+#ifndef APP_CAN_TRACE
+// 1 = in polling i frame trasmessi e ricevuti finiscono nel ring di
+// cattura, scaricabili come traccia da /can?trace=candump|asc
+#define APP_CAN_TRACE 1
+#endif
+
 /* =======================================================
  * 1. GESTIONE WIFI E CONTROLLO CLIENT
  * ======================================================= */
@@ -32,6 +49,7 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
     } else if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
         if (s_active_clients > 0) s_active_clients--;
         ESP_LOGI(TAG, "Client disconnesso. Totale: %d", s_active_clients);
+        web_server_client_left(s_active_clients);
     }
 }
 
@@ -69,35 +87,51 @@ static void wifi_init(void)
 
 /* =======================================================
  * 2. TASK AGGIORNAMENTO DISPLAY
+ *    Svegliato da ogni nuovo snapshot OBD (al più ogni
+ *    APP_LCD_MIN_MS) o dal timeout per il numero di client;
+ *    scrive nel framebuffer, il flush invia solo le celle cambiate.
  * ======================================================= */
- 
+#ifndef APP_LCD_MIN_MS
+// Oltre ~10 Hz l'HD44780 (cristalli lenti) non si legge comunque
+#define APP_LCD_MIN_MS 100
+#endif
+
+#ifndef APP_LCD_IDLE_MS
+// Senza polling (listen-only, ECU muta) il numero di client resta aggiornato
+#define APP_LCD_IDLE_MS 1000
+#endif
+
+static SemaphoreHandle_t s_lcd_wake;
+
+/* Nel task RT subito dopo la pubblicazione: solo un segnale */
+static void lcd_on_publish(uint32_t seq, void *ctx)
+{
+    (void)seq;
+    (void)ctx;
+    xSemaphoreGive(s_lcd_wake);
+}
+
 static void lcd_update_task(void *pvParameters)
 {
-    int rpm;
-    float temperature;
-    int clients;
-    float battery;
+    char line1[LCD_COLS + 1];
+    char line2[LCD_COLS + 1];
 
-    char line1[17];
-    char line2[17];
+    while (1) {
+        xSemaphoreTake(s_lcd_wake, pdMS_TO_TICKS(APP_LCD_IDLE_MS));
 
+        obd_full_data_t snap = obd_get_all_data();
+        float temperature = obd_field_value(&snap, OBD_F_COOLANT);
+        float battery = obd_field_value(&snap, OBD_F_BATTERY);
+        unsigned rpm = (unsigned)snap.v[OBD_F_RPM];
 
-    while (1) {
-        
-        
-        rpm = get_rpm();
-        temperature = get_temp();
-        clients = s_active_clients;
-        battery = get_battery();
-        snprintf(line1, sizeof(line1), " AP:%d | T:%0.1f C", clients, temperature);
+        snprintf(line1, sizeof(line1), " AP:%d | T:%0.1f C", s_active_clients, temperature);
         snprintf(line2, sizeof(line2), "+%0.1fV| RPM:%4u", battery, rpm);
 
-        lcd_gotoxy(0, 0);
-        lcd_print(line1);
-        lcd_gotoxy(0, 1);        
-        lcd_print(line2);
+        lcd_fb_line(0, line1);
+        lcd_fb_line(1, line2);
+        lcd_fb_commit();
 
-        vTaskDelay(pdMS_TO_TICKS(400));
+        vTaskDelay(pdMS_TO_TICKS(APP_LCD_MIN_MS));
     }
 }
 
@@ -113,16 +147,31 @@ void app_main(void)
     /* Inizializzazione Rete */
 
     /* Inizializzazione Hardware */
+#if APP_CAN_LISTEN_ONLY
+    can_bus_config_t can_cfg = {
+        .filter = CAN_FILTER_ACCEPT_ALL,
+        .bitrate = 0,
+        .listen_only = true,
+    };
+    ESP_ERROR_CHECK(can_bus_init_config(&can_cfg));
+    can_capture_start();
+#else
     can_bus_init();
+#if APP_CAN_TRACE
+    can_capture_attach();
+#endif
     obd_init();
+    obd_log_start();
+#endif
 
     wifi_init();
     lcd_init();
+    lcd_fb_start();
     web_server_start();
-    
-
-
 
     /* Avvio monitoraggio su display */
-    xTaskCreate(lcd_update_task, "lcd_update_task", 2048, NULL, 5, NULL);
+    s_lcd_wake = xSemaphoreCreateBinary();
+    obd_data_add_listener(lcd_on_publish, NULL);
+    xTaskCreatePinnedToCore(lcd_update_task, "lcd_update_task", APP_LCD_UPDATE_STACK, NULL,
+                            APP_LCD_UPDATE_PRIO, NULL, APP_CORE(APP_CORE_NET));
 }
@@ -0,0 +1,106 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* =======================================================
+ * PIANO DEI TASK: priorità, core e stack in un solo posto
+ *
+ * Core 1 (APP_CPU) tiene solo CAN e OBD: RX, scheduler RT, cattura,
+ * letture DTC. Core 0 (PRO_CPU) ha già WiFi ed lwIP (vedi
+ * sdkconfig.defaults) e prende httpd, lo stream /ws, il log su flash e
+ * il display: il carico web non si mette più in mezzo allo scheduler.
+ *
+ * Riferimenti: IDLE 0, httpd di default 5, lwIP 18, WiFi 23.
+ * Ogni valore si può ridefinire da build (-D).
+ * ======================================================= */
+
+#ifndef APP_TASK_PINNING
+// 0 = nessuna affinità: il kernel sceglie il core (come prima)
+#define APP_TASK_PINNING 1
+#endif
+
+#ifndef APP_CORE_CAN
+#define APP_CORE_CAN 1
+#endif
+
+#ifndef APP_CORE_NET
+#define APP_CORE_NET 0
+#endif
+
+// Su un chip single core (o senza pinning) tutto resta libero
+#if APP_TASK_PINNING && portNUM_PROCESSORS > 1
+#define APP_CORE(c) (c)
+#else
+#define APP_CORE(c) tskNO_AFFINITY
+#endif
+
+/* ---- CAN / OBD (APP_CORE_CAN) ---- */
+
+#ifndef APP_OBD_RX_PRIO
+// Sopra tutto il resto: svuota la coda TWAI e smista le risposte
+#define APP_OBD_RX_PRIO 7
+#endif
+#ifndef APP_OBD_RX_STACK
+#define APP_OBD_RX_STACK 4096
+#endif
+
+#ifndef APP_CAN_CAP_PRIO
+// Solo in listen-only, al posto di obd_rx
+#define APP_CAN_CAP_PRIO 7
+#endif
+#ifndef APP_CAN_CAP_STACK
+#define APP_CAN_CAP_STACK 4096
+#endif
+
+#ifndef APP_OBD_RT_PRIO
+#define APP_OBD_RT_PRIO 6
+#endif
+#ifndef APP_OBD_RT_STACK
+#define APP_OBD_RT_STACK 4096
+#endif
+
+#ifndef APP_OBD_DTC_PRIO
+// Sotto obd_rt: le letture occupano il bus solo nei suoi vuoti
+#define APP_OBD_DTC_PRIO 4
+#endif
+#ifndef APP_OBD_DTC_STACK
+#define APP_OBD_DTC_STACK 3072
+#endif
+
+/* ---- Rete e interfaccia (APP_CORE_NET) ---- */
+
+#ifndef APP_HTTPD_PRIO
+#define APP_HTTPD_PRIO 5
+#endif
+#ifndef APP_HTTPD_STACK
+#define APP_HTTPD_STACK 10240
+#endif
+
+#ifndef APP_WS_PUSH_PRIO
+#define APP_WS_PUSH_PRIO 4
+#endif
+#ifndef APP_WS_PUSH_STACK
+#define APP_WS_PUSH_STACK 4096
+#endif
+
+#ifndef APP_OBD_LOG_PRIO
+#define APP_OBD_LOG_PRIO 3
+#endif
+#ifndef APP_OBD_LOG_STACK
+#define APP_OBD_LOG_STACK 4096
+#endif
+
+#ifndef APP_LCD_UPDATE_PRIO
+#define APP_LCD_UPDATE_PRIO 3
+#endif
+#ifndef APP_LCD_UPDATE_STACK
+#define APP_LCD_UPDATE_STACK 3072
+#endif
+
+#ifndef APP_LCD_FLUSH_PRIO
+// Sotto httpd e ws_push: l'attesa attiva del display non ruba tempo a nessuno
+#define APP_LCD_FLUSH_PRIO 2
+#endif
+#ifndef APP_LCD_FLUSH_STACK
+#define APP_LCD_FLUSH_STACK 2048
+#endif
@@ -3,29 +3,192 @@
 
 static const char *TAG = "CAN_BUS";
 
-void can_bus_init(void)
+#ifndef CAN_BUS_DEFAULT_FILTER
+// In polling basta ricevere le risposte diagnostiche: il resto del traffico
+// di un bus powertrain saturerebbe ISR e coda RX per nulla.
+#define CAN_BUS_DEFAULT_FILTER CAN_FILTER_OBD_RESP
+#endif
+
+#ifndef CAN_BUS_DEFAULT_BITRATE
+// Usato se l'auto-detect non vede traffico (bus silenzioso o gateway OBD)
+#define CAN_BUS_DEFAULT_BITRATE 500000
+#endif
+
+#ifndef CAN_AUTOBAUD_WINDOW_MS
+// Ascolto per ogni bitrate candidato durante l'auto-detect
+#define CAN_AUTOBAUD_WINDOW_MS 250
+#endif
+
+#ifndef CAN_RX_QUEUE_LEN
+#define CAN_RX_QUEUE_LEN 32
+#endif
+
+static uint32_t s_bitrate;
+static volatile can_bus_trace_cb_t s_trace;
+
+static bool timing_for(uint32_t bitrate, twai_timing_config_t *out)
+{
+    switch (bitrate)
+    {
+    case 250000:
+    {
+        twai_timing_config_t t = TWAI_TIMING_CONFIG_250KBITS();
+        *out = t;
+        return true;
+    }
+    case 500000:
+    {
+        twai_timing_config_t t = TWAI_TIMING_CONFIG_500KBITS();
+        *out = t;
+        return true;
+    }
+    case 1000000:
+    {
+        twai_timing_config_t t = TWAI_TIMING_CONFIG_1MBITS();
+        *out = t;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+static twai_filter_config_t filter_for(can_filter_mode_t mode)
+{
+    if (mode == CAN_FILTER_OBD_RESP)
+    {
+        // filtro singolo, ID standard nei bit 31..21: confronta solo 0x7F8
+        twai_filter_config_t f = {
+            .acceptance_code = (uint32_t)0x7E8 << 21,
+            .acceptance_mask = ~((uint32_t)0x7F8 << 21),
+            .single_filter = true,
+        };
+        return f;
+    }
+
+    twai_filter_config_t f = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    return f;
+}
+
+static esp_err_t driver_start(uint32_t bitrate, can_filter_mode_t filter, bool listen_only)
 {
     twai_general_config_t g_config =
-        TWAI_GENERAL_CONFIG_DEFAULT(GPIO_NUM_5, GPIO_NUM_4, TWAI_MODE_NORMAL);
+        TWAI_GENERAL_CONFIG_DEFAULT(GPIO_NUM_5, GPIO_NUM_4,
+                                    listen_only ? TWAI_MODE_LISTEN_ONLY : TWAI_MODE_NORMAL);
+    g_config.rx_queue_len = CAN_RX_QUEUE_LEN;
+
+    twai_timing_config_t t_config;
+    if (!timing_for(bitrate, &t_config))
+        return ESP_ERR_INVALID_ARG;
 
-    twai_timing_config_t t_config =
-        TWAI_TIMING_CONFIG_500KBITS();
+    twai_filter_config_t f_config = filter_for(filter);
 
-    twai_filter_config_t f_config =
-        TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    esp_err_t err = twai_driver_install(&g_config, &t_config, &f_config);
+    if (err != ESP_OK)
+        return err;
 
-    ESP_ERROR_CHECK(twai_driver_install(&g_config, &t_config, &f_config));
-    ESP_ERROR_CHECK(twai_start());
+    err = twai_start();
+    if (err != ESP_OK)
+    {
+        twai_driver_uninstall();
+        return err;
+    }
 
-    ESP_LOGI(TAG, "CAN init OK");
+    s_bitrate = bitrate;
+    return ESP_OK;
+}
+
+/* Auto-detect: ascolto passivo (nessun ACK, nessun error frame) a ogni
+   bitrate candidato; il primo che riceve un frame valido vince. */
+static uint32_t detect_bitrate(void)
+{
+    static const uint32_t candidates[] = {500000, 250000, 1000000};
+
+    for (int i = 0; i < (int)(sizeof(candidates) / sizeof(candidates[0])); i++)
+    {
+        if (driver_start(candidates[i], CAN_FILTER_ACCEPT_ALL, true) != ESP_OK)
+            continue;
+
+        twai_message_t rx;
+        bool seen = twai_receive(&rx, pdMS_TO_TICKS(CAN_AUTOBAUD_WINDOW_MS)) == ESP_OK;
+
+        can_bus_deinit();
+
+        if (seen)
+        {
+            ESP_LOGI(TAG, "Bitrate rilevato: %lu bit/s", (unsigned long)candidates[i]);
+            return candidates[i];
+        }
+    }
+
+    ESP_LOGW(TAG, "Nessun traffico in ascolto, uso %lu bit/s",
+             (unsigned long)CAN_BUS_DEFAULT_BITRATE);
+    return CAN_BUS_DEFAULT_BITRATE;
+}
+
+esp_err_t can_bus_init_config(const can_bus_config_t *cfg)
+{
+    uint32_t bitrate = cfg->bitrate ? cfg->bitrate : detect_bitrate();
+
+    esp_err_t err = driver_start(bitrate, cfg->filter, cfg->listen_only);
+    if (err == ESP_OK)
+        ESP_LOGI(TAG, "CAN init OK (%lu bit/s, filtro %s%s)", (unsigned long)bitrate,
+                 cfg->filter == CAN_FILTER_OBD_RESP ? "OBD" : "aperto",
+                 cfg->listen_only ? ", listen-only" : "");
+    return err;
+}
+
+void can_bus_init(void)
+{
+    can_bus_config_t cfg = {
+        .filter = CAN_BUS_DEFAULT_FILTER,
+        .bitrate = 0,
+        .listen_only = false,
+    };
+
+    ESP_ERROR_CHECK(can_bus_init_config(&cfg));
+}
+
+void can_bus_deinit(void)
+{
+    twai_stop();
+    twai_driver_uninstall();
+    s_bitrate = 0;
+}
+
+uint32_t can_bus_bitrate(void)
+{
+    return s_bitrate;
+}
+
+esp_err_t can_bus_get_status(twai_status_info_t *out)
+{
+    if (s_bitrate == 0)
+        return ESP_ERR_INVALID_STATE;
+    return twai_get_status_info(out);
 }
 
 esp_err_t can_bus_send(twai_message_t *msg)
 {
-    return twai_transmit(msg, pdMS_TO_TICKS(100));
+    esp_err_t err = twai_transmit(msg, pdMS_TO_TICKS(100));
+
+    can_bus_trace_cb_t trace = s_trace;
+    if (err == ESP_OK && trace)
+        trace(msg, true);
+    return err;
 }
 
 esp_err_t can_bus_receive(twai_message_t *msg, TickType_t timeout)
 {
-    return twai_receive(msg, timeout);
+    esp_err_t err = twai_receive(msg, timeout);
+
+    can_bus_trace_cb_t trace = s_trace;
+    if (err == ESP_OK && trace)
+        trace(msg, false);
+    return err;
+}
+
+void can_bus_set_trace(can_bus_trace_cb_t cb)
+{
+    s_trace = cb;
 }
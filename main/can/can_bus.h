@@ -1,6 +1,36 @@
 #pragma once
+#include <stdbool.h>
 #include "driver/twai.h"
 
+typedef enum
+{
+    CAN_FILTER_ACCEPT_ALL = 0, // tutto il traffico del bus
+    CAN_FILTER_OBD_RESP,       // solo risposte diagnostiche 0x7E8..0x7EF
+} can_filter_mode_t;
+
+typedef struct
+{
+    can_filter_mode_t filter;
+    uint32_t bitrate;  // bit/s (250000 / 500000 / 1000000), 0 = auto-detect
+    bool listen_only;  // nessun ACK / nessuna trasmissione
+} can_bus_config_t;
+
+/* Configurazione di default: filtro OBD + auto-detect del bitrate */
 void can_bus_init(void);
+esp_err_t can_bus_init_config(const can_bus_config_t *cfg);
+void can_bus_deinit(void);
+
+/* Bitrate in uso (0 se il driver non è installato) */
+uint32_t can_bus_bitrate(void);
+
+/* Stato e contatori d'errore del controller (ESP_ERR_INVALID_STATE se
+   il driver non è installato) */
+esp_err_t can_bus_get_status(twai_status_info_t *out);
+
 esp_err_t can_bus_send(twai_message_t *msg);
 esp_err_t can_bus_receive(twai_message_t *msg, TickType_t timeout);
+
+/* Osservatore dei frame trasmessi e ricevuti (tx = true per i nostri),
+   chiamato dal task che invia/riceve: deve essere breve. NULL = nessuno. */
+typedef void (*can_bus_trace_cb_t)(const twai_message_t *msg, bool tx);
+void can_bus_set_trace(can_bus_trace_cb_t cb);
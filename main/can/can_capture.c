@@ -0,0 +1,649 @@
+#include "can_capture.h"
+#include "can_bus.h"
+#include "app_tasks.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "CAN_CAPTURE";
+
+#if (CAN_CAPTURE_RING & (CAN_CAPTURE_RING - 1)) != 0
+#error "CAN_CAPTURE_RING deve essere una potenza di 2"
+#endif
+#if CAN_SIGNALS_MAX > 32
+#error "CAN_SIGNALS_MAX oltre 32: la maschera per ID è a 32 bit"
+#endif
+
+// indice hash degli ID: almeno il doppio delle voci, potenza di 2
+#define ID_HASH_SIZE 256
+#if ID_HASH_SIZE < 2 * CAN_CAPTURE_MAX_IDS
+#error "ID_HASH_SIZE troppo piccolo per CAN_CAPTURE_MAX_IDS"
+#endif
+
+#define NVS_NS "can_sig"
+#define NVS_KEY "defs"
+
+/* -------------------------------------------------------
+ * Ring dei frame: seqlock per slot. seq = numero del frame + 1 quando
+ * lo slot è valido, 0 durante la scrittura. Un lettore lento vede seq
+ * cambiato e conta il frame come perso, senza mai bloccare la cattura.
+ * ------------------------------------------------------- */
+typedef struct
+{
+    atomic_uint seq;
+    can_frame_rec_t rec;
+} ring_slot_t;
+
+static ring_slot_t s_ring[CAN_CAPTURE_RING];
+static atomic_uint s_head; // frame scritti dall'avvio
+
+/* -------------------------------------------------------
+ * Statistiche per ID (scrittore: cattura; seqlock per voce)
+ * ------------------------------------------------------- */
+typedef struct
+{
+    atomic_uint seq;
+    can_id_stats_t st;
+    uint32_t sig_mask; // segnali definiti su questo ID (solo cattura)
+} id_entry_t;
+
+static id_entry_t s_ids[CAN_CAPTURE_MAX_IDS];
+static uint16_t s_id_hash[ID_HASH_SIZE]; // indice + 1, 0 = vuoto
+static atomic_uint s_nids;
+static atomic_uint s_ids_dropped;
+static atomic_uint s_rx_errors;
+static bool s_running;
+
+/* -------------------------------------------------------
+ * Segnali: la definizione è scritta dall'API (serializzata da
+ * s_sig_lock), il valore dalla cattura; un seqlock per ciascuno.
+ * La cattura lavora su una copia locale delle definizioni,
+ * aggiornata quando cambia s_sig_gen.
+ * ------------------------------------------------------- */
+typedef struct
+{
+    atomic_uint dseq;
+    bool used;
+    can_signal_def_t def;
+
+    atomic_uint vseq;
+    float value;
+    uint32_t t_us;
+    uint32_t count;
+} sig_slot_t;
+
+static sig_slot_t s_sigs[CAN_SIGNALS_MAX];
+static SemaphoreHandle_t s_sig_lock;
+static SemaphoreHandle_t s_trace_lock; // più task trasmettono: scrittore unico a turno
+static atomic_uint s_sig_gen;
+
+// copia della cattura
+static uint32_t s_sig_seen_gen;
+static bool s_sig_used[CAN_SIGNALS_MAX];
+static can_signal_def_t s_sig_local[CAN_SIGNALS_MAX];
+
+static inline uint32_t id_key(uint32_t id, bool ext)
+{
+    return id | (ext ? 0x80000000UL : 0);
+}
+
+static inline uint32_t id_hash(uint32_t key)
+{
+    key ^= key >> 16;
+    key *= 0x45d9f3bU;
+    key ^= key >> 16;
+    return key & (ID_HASH_SIZE - 1);
+}
+
+/* ---------------- Decodifica campi di bit (convenzioni DBC) ---------------- */
+
+int64_t can_signal_raw(const can_signal_def_t *def, const uint8_t *data, uint8_t dlc, bool *ok)
+{
+    uint64_t raw = 0;
+    unsigned pos = def->start;
+
+    *ok = false;
+    if (def->len == 0 || def->len > 32)
+        return 0;
+
+    for (int i = 0; i < def->len; i++)
+    {
+        unsigned byte = pos / 8, bit = pos % 8;
+        if (byte >= dlc)
+            return 0;
+
+        uint64_t b = (data[byte] >> bit) & 1U;
+        if (def->big_endian)
+        {
+            // Motorola: dall'MSB verso il basso, poi MSB del byte successivo
+            raw = (raw << 1) | b;
+            pos = bit == 0 ? (byte + 1) * 8 + 7 : pos - 1;
+        }
+        else
+        {
+            raw |= b << i;
+            pos++;
+        }
+    }
+
+    *ok = true;
+    if (def->is_signed && (raw >> (def->len - 1)) & 1U)
+        return (int64_t)raw - ((int64_t)1 << def->len);
+    return (int64_t)raw;
+}
+
+/* ---------------- Scrittore (cattura) ---------------- */
+
+static bool sig_matches(const can_signal_def_t *d, const can_id_stats_t *st)
+{
+    return d->id == st->id && d->ext == ((st->flags & CAN_REC_EXT) != 0);
+}
+
+/* Nuove definizioni: copia locale e maschere per ID ricalcolate */
+static void sig_refresh(void)
+{
+    s_sig_seen_gen = atomic_load_explicit(&s_sig_gen, memory_order_acquire);
+
+    for (int k = 0; k < CAN_SIGNALS_MAX; k++)
+    {
+        sig_slot_t *sl = &s_sigs[k];
+        uint32_t s1, s2;
+        do
+        {
+            s1 = atomic_load_explicit(&sl->dseq, memory_order_acquire);
+            s_sig_used[k] = sl->used;
+            s_sig_local[k] = sl->def;
+            atomic_thread_fence(memory_order_acquire);
+            s2 = atomic_load_explicit(&sl->dseq, memory_order_relaxed);
+        } while ((s1 & 1U) || s1 != s2);
+    }
+
+    uint32_t n = atomic_load_explicit(&s_nids, memory_order_relaxed);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t mask = 0;
+        for (int k = 0; k < CAN_SIGNALS_MAX; k++)
+            if (s_sig_used[k] && sig_matches(&s_sig_local[k], &s_ids[i].st))
+                mask |= 1UL << k;
+        s_ids[i].sig_mask = mask;
+    }
+}
+
+static id_entry_t *id_lookup(uint32_t id, uint8_t flags)
+{
+    uint32_t key = id_key(id, flags & CAN_REC_EXT);
+    uint32_t h = id_hash(key);
+
+    for (int probe = 0; probe < ID_HASH_SIZE; probe++, h = (h + 1) & (ID_HASH_SIZE - 1))
+    {
+        uint16_t slot = s_id_hash[h];
+        if (slot == 0)
+            break;
+
+        id_entry_t *e = &s_ids[slot - 1];
+        if (id_key(e->st.id, e->st.flags & CAN_REC_EXT) == key)
+            return e;
+    }
+
+    uint32_t n = atomic_load_explicit(&s_nids, memory_order_relaxed);
+    if (n >= CAN_CAPTURE_MAX_IDS)
+        return NULL;
+
+    id_entry_t *e = &s_ids[n];
+    memset(&e->st, 0, sizeof(e->st));
+    e->st.id = id;
+    e->st.flags = flags;
+    e->sig_mask = 0;
+    for (int k = 0; k < CAN_SIGNALS_MAX; k++)
+        if (s_sig_used[k] && sig_matches(&s_sig_local[k], &e->st))
+            e->sig_mask |= 1UL << k;
+
+    s_id_hash[h] = (uint16_t)(n + 1);
+    atomic_store_explicit(&s_nids, n + 1, memory_order_release);
+    return e;
+}
+
+static void sig_update(int k, const can_frame_rec_t *r)
+{
+    bool ok;
+    int64_t raw = can_signal_raw(&s_sig_local[k], r->data, r->dlc, &ok);
+    if (!ok)
+        return;
+
+    sig_slot_t *sl = &s_sigs[k];
+    unsigned s = atomic_load_explicit(&sl->vseq, memory_order_relaxed);
+    atomic_store_explicit(&sl->vseq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    sl->value = (float)raw * s_sig_local[k].scale + s_sig_local[k].offset;
+    sl->t_us = r->t_us ? r->t_us : 1;
+    sl->count++;
+
+    atomic_store_explicit(&sl->vseq, s + 2, memory_order_release);
+}
+
+static void ingest(const twai_message_t *msg, uint32_t t_us, uint8_t flags)
+{
+    can_frame_rec_t r;
+    r.t_us = t_us;
+    r.id = msg->identifier;
+    r.dlc = msg->data_length_code > 8 ? 8 : msg->data_length_code;
+    r.flags = flags | (msg->extd ? CAN_REC_EXT : 0) | (msg->rtr ? CAN_REC_RTR : 0);
+    memset(r.data, 0, sizeof(r.data));
+    if (!msg->rtr)
+        memcpy(r.data, msg->data, r.dlc);
+
+    // 1. ring
+    uint32_t n = atomic_load_explicit(&s_head, memory_order_relaxed);
+    ring_slot_t *slot = &s_ring[n & (CAN_CAPTURE_RING - 1)];
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->rec = r;
+    atomic_store_explicit(&slot->seq, n + 1, memory_order_release);
+    atomic_store_explicit(&s_head, n + 1, memory_order_release);
+
+    // 2. statistiche dell'ID
+    if (atomic_load_explicit(&s_sig_gen, memory_order_relaxed) != s_sig_seen_gen)
+        sig_refresh();
+
+    id_entry_t *e = id_lookup(r.id, r.flags);
+    if (!e)
+    {
+        atomic_fetch_add_explicit(&s_ids_dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    unsigned s = atomic_load_explicit(&e->seq, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    can_id_stats_t *st = &e->st;
+    if (st->count == 0)
+    {
+        st->first_us = t_us;
+    }
+    else
+    {
+        uint32_t dt = t_us - st->last_us;
+        // EWMA 1/8 in µs; il primo intervallo inizializza
+        st->period_us = st->count == 1 ? dt : st->period_us + (uint32_t)(((int32_t)(dt - st->period_us)) / 8);
+        if (st->dlc != r.dlc || memcmp(st->data, r.data, r.dlc) != 0)
+            st->changes++;
+    }
+    st->count++;
+    st->last_us = t_us;
+    st->dlc = r.dlc;
+    memcpy(st->data, r.data, sizeof(st->data));
+
+    atomic_store_explicit(&e->seq, s + 2, memory_order_release);
+
+    // 3. segnali sull'ID
+    for (uint32_t m = e->sig_mask; m; m &= m - 1)
+        sig_update(__builtin_ctz(m), &r);
+}
+
+void can_capture_ingest(const twai_message_t *msg, uint32_t t_us)
+{
+    ingest(msg, t_us, 0);
+}
+
+/* ---------------- Lettori ---------------- */
+
+int can_capture_read(uint32_t *cursor, can_frame_rec_t *out, int max, uint32_t *lost)
+{
+    uint32_t head = atomic_load_explicit(&s_head, memory_order_acquire);
+    uint32_t n = *cursor;
+    int got = 0;
+
+    // il cursore è rimasto indietro di più di un giro: frame persi
+    if (head - n > CAN_CAPTURE_RING)
+    {
+        if (lost)
+            *lost += head - CAN_CAPTURE_RING - n;
+        n = head - CAN_CAPTURE_RING;
+    }
+
+    for (; n != head && got < max; n++)
+    {
+        const ring_slot_t *slot = &s_ring[n & (CAN_CAPTURE_RING - 1)];
+
+        unsigned s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        out[got] = slot->rec;
+        atomic_thread_fence(memory_order_acquire);
+        unsigned s2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+        if (s1 != n + 1 || s2 != s1)
+        {
+            if (lost)
+                (*lost)++; // sovrascritto durante la copia
+            continue;
+        }
+        got++;
+    }
+
+    *cursor = n;
+    return got;
+}
+
+void can_capture_status(can_capture_status_t *out)
+{
+    out->running = s_running;
+    out->frames = atomic_load_explicit(&s_head, memory_order_acquire);
+    out->ids = atomic_load_explicit(&s_nids, memory_order_acquire);
+    out->ids_dropped = atomic_load_explicit(&s_ids_dropped, memory_order_relaxed);
+    out->rx_errors = atomic_load_explicit(&s_rx_errors, memory_order_relaxed);
+}
+
+int can_capture_get_ids(can_id_stats_t *out, int max)
+{
+    int n = (int)atomic_load_explicit(&s_nids, memory_order_acquire);
+    if (n > max)
+        n = max;
+
+    for (int i = 0; i < n; i++)
+    {
+        const id_entry_t *e = &s_ids[i];
+        unsigned s1, s2;
+        do
+        {
+            s1 = atomic_load_explicit(&e->seq, memory_order_acquire);
+            out[i] = e->st;
+            atomic_thread_fence(memory_order_acquire);
+            s2 = atomic_load_explicit(&e->seq, memory_order_relaxed);
+        } while ((s1 & 1U) || s1 != s2);
+    }
+    return n;
+}
+
+int can_signal_get(can_signal_info_t *out, int max)
+{
+    int n = 0;
+
+    for (int k = 0; k < CAN_SIGNALS_MAX && n < max; k++)
+    {
+        sig_slot_t *sl = &s_sigs[k];
+        unsigned s1, s2;
+        bool used;
+
+        do
+        {
+            s1 = atomic_load_explicit(&sl->dseq, memory_order_acquire);
+            used = sl->used;
+            out[n].def = sl->def;
+            atomic_thread_fence(memory_order_acquire);
+            s2 = atomic_load_explicit(&sl->dseq, memory_order_relaxed);
+        } while ((s1 & 1U) || s1 != s2);
+
+        if (!used)
+            continue;
+
+        do
+        {
+            s1 = atomic_load_explicit(&sl->vseq, memory_order_acquire);
+            out[n].value = sl->value;
+            out[n].t_us = sl->t_us;
+            out[n].count = sl->count;
+            atomic_thread_fence(memory_order_acquire);
+            s2 = atomic_load_explicit(&sl->vseq, memory_order_relaxed);
+        } while ((s1 & 1U) || s1 != s2);
+        n++;
+    }
+    return n;
+}
+
+/* ---------------- Definizione dei segnali ---------------- */
+
+bool can_signal_parse(const char *s, can_signal_def_t *out)
+{
+    char buf[96];
+    char *f[8];
+    int nf = 0;
+
+    if (strlen(s) >= sizeof(buf))
+        return false;
+    strcpy(buf, s);
+
+    for (char *p = buf; nf < 8;)
+    {
+        f[nf++] = p;
+        p = strchr(p, ':');
+        if (!p)
+            break;
+        *p++ = '\0';
+    }
+    if (nf != 8)
+        return false;
+
+    memset(out, 0, sizeof(*out));
+    size_t nlen = strlen(f[0]);
+    if (nlen == 0 || nlen >= CAN_SIGNAL_NAME_LEN)
+        return false;
+    memcpy(out->name, f[0], nlen);
+
+    char *end;
+    unsigned long id = strtoul(f[1], &end, 16);
+    if (*end || end == f[1])
+        return false;
+    out->ext = strlen(f[1]) > 3;
+    if (id > (out->ext ? 0x1FFFFFFFUL : 0x7FFUL))
+        return false;
+    out->id = (uint32_t)id;
+
+    unsigned long start = strtoul(f[2], &end, 10);
+    if (*end || start > 63)
+        return false;
+    unsigned long len = strtoul(f[3], &end, 10);
+    if (*end || len == 0 || len > 32)
+        return false;
+    out->start = (uint8_t)start;
+    out->len = (uint8_t)len;
+
+    if (strcmp(f[4], "le") == 0)
+        out->big_endian = false;
+    else if (strcmp(f[4], "be") == 0)
+        out->big_endian = true;
+    else
+        return false;
+
+    if (strcmp(f[5], "u") == 0)
+        out->is_signed = false;
+    else if (strcmp(f[5], "s") == 0)
+        out->is_signed = true;
+    else
+        return false;
+
+    out->scale = strtof(f[6], &end);
+    if (*end || end == f[6])
+        return false;
+    out->offset = strtof(f[7], &end);
+    if (*end || end == f[7])
+        return false;
+
+    return true;
+}
+
+static void sig_write(int k, bool used, const can_signal_def_t *def)
+{
+    sig_slot_t *sl = &s_sigs[k];
+    unsigned s = atomic_load_explicit(&sl->dseq, memory_order_relaxed);
+
+    atomic_store_explicit(&sl->dseq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    sl->used = used;
+    if (def)
+        sl->def = *def;
+    atomic_store_explicit(&sl->dseq, s + 2, memory_order_release);
+
+    atomic_fetch_add_explicit(&s_sig_gen, 1, memory_order_release);
+}
+
+/* Col lock: la tabella delle definizioni è solo degli scrittori API */
+static void sig_save(void)
+{
+    can_signal_def_t defs[CAN_SIGNALS_MAX];
+    int n = 0;
+
+    for (int k = 0; k < CAN_SIGNALS_MAX; k++)
+        if (s_sigs[k].used)
+            defs[n++] = s_sigs[k].def;
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) != ESP_OK)
+        return;
+    if (nvs_set_blob(h, NVS_KEY, defs, sizeof(defs[0]) * (size_t)n) != ESP_OK || nvs_commit(h) != ESP_OK)
+        ESP_LOGW(TAG, "Salvataggio segnali fallito");
+    nvs_close(h);
+}
+
+static void sig_lock_init(void)
+{
+    // prima chiamata dal task principale (can_capture_start)
+    if (!s_sig_lock)
+        s_sig_lock = xSemaphoreCreateMutex();
+}
+
+static bool sig_set_locked(const can_signal_def_t *def)
+{
+    int slot = -1;
+
+    for (int k = 0; k < CAN_SIGNALS_MAX; k++)
+    {
+        if (s_sigs[k].used && strncmp(s_sigs[k].def.name, def->name, CAN_SIGNAL_NAME_LEN) == 0)
+        {
+            slot = k;
+            break;
+        }
+        if (!s_sigs[k].used && slot < 0)
+            slot = k;
+    }
+    if (slot < 0)
+        return false;
+
+    sig_write(slot, true, def);
+    return true;
+}
+
+bool can_signal_set(const can_signal_def_t *def)
+{
+    if (def->len == 0 || def->len > 32 || def->name[0] == '\0')
+        return false;
+
+    sig_lock_init();
+    xSemaphoreTake(s_sig_lock, portMAX_DELAY);
+    bool ok = sig_set_locked(def);
+    if (ok)
+        sig_save();
+    xSemaphoreGive(s_sig_lock);
+
+    if (ok)
+        ESP_LOGI(TAG, "Segnale %s su 0x%03lX", def->name, (unsigned long)def->id);
+    return ok;
+}
+
+bool can_signal_del(const char *name)
+{
+    bool found = false;
+
+    sig_lock_init();
+    xSemaphoreTake(s_sig_lock, portMAX_DELAY);
+    for (int k = 0; k < CAN_SIGNALS_MAX; k++)
+    {
+        if (s_sigs[k].used && strncmp(s_sigs[k].def.name, name, CAN_SIGNAL_NAME_LEN) == 0)
+        {
+            sig_write(k, false, NULL);
+            found = true;
+        }
+    }
+    if (found)
+        sig_save();
+    xSemaphoreGive(s_sig_lock);
+    return found;
+}
+
+static void sig_load(void)
+{
+    can_signal_def_t defs[CAN_SIGNALS_MAX];
+    size_t size = sizeof(defs);
+    nvs_handle_t h;
+
+    if (nvs_open(NVS_NS, NVS_READONLY, &h) != ESP_OK)
+        return;
+    esp_err_t err = nvs_get_blob(h, NVS_KEY, defs, &size);
+    nvs_close(h);
+    if (err != ESP_OK || size % sizeof(defs[0]) != 0)
+        return;
+
+    int n = (int)(size / sizeof(defs[0]));
+    xSemaphoreTake(s_sig_lock, portMAX_DELAY);
+    for (int i = 0; i < n; i++)
+        sig_set_locked(&defs[i]);
+    xSemaphoreGive(s_sig_lock);
+
+    ESP_LOGI(TAG, "%d segnali caricati da NVS", n);
+}
+
+/* ---------------- Task di cattura ---------------- */
+
+static void can_capture_task(void *arg)
+{
+    (void)arg;
+    twai_message_t msg;
+
+    while (1)
+    {
+        esp_err_t err = can_bus_receive(&msg, pdMS_TO_TICKS(1000));
+        if (err == ESP_OK)
+        {
+            can_capture_ingest(&msg, (uint32_t)esp_timer_get_time());
+        }
+        else if (err != ESP_ERR_TIMEOUT)
+        {
+            // driver in bus-off o fermo: non girare a vuoto
+            atomic_fetch_add_explicit(&s_rx_errors, 1, memory_order_relaxed);
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+}
+
+/* Osservatore di can_bus: gira nel task RX (ricezione) e in chi
+   trasmette (task RT, Flow Control dal task RX) */
+static void trace_frame(const twai_message_t *msg, bool tx)
+{
+    uint32_t t = (uint32_t)esp_timer_get_time();
+
+    xSemaphoreTake(s_trace_lock, portMAX_DELAY);
+    ingest(msg, t, tx ? CAN_REC_TX : 0);
+    xSemaphoreGive(s_trace_lock);
+}
+
+void can_capture_attach(void)
+{
+    sig_lock_init();
+    sig_load();
+
+    s_trace_lock = xSemaphoreCreateMutex();
+    s_running = true;
+    can_bus_set_trace(trace_frame);
+    ESP_LOGI(TAG, "Traccia del bus attiva (ring %d frame)", CAN_CAPTURE_RING);
+}
+
+void can_capture_start(void)
+{
+    sig_lock_init();
+    sig_load();
+
+    s_running = true;
+    // stessa priorità del task RX OBD: nessuno dei due gira insieme all'altro
+    xTaskCreatePinnedToCore(can_capture_task, "can_cap", APP_CAN_CAP_STACK, NULL, APP_CAN_CAP_PRIO,
+                            NULL, APP_CORE(APP_CORE_CAN));
+    ESP_LOGI(TAG, "Cattura passiva avviata (ring %d frame, %d ID)", CAN_CAPTURE_RING,
+             CAN_CAPTURE_MAX_IDS);
+}
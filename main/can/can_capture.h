@@ -0,0 +1,130 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/twai.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Cattura passiva del bus (listen-only): ogni frame finisce in un ring
+       lock-free e aggiorna le statistiche del suo ID. Segnali definiti
+       dall'utente (ID + campo di bit) vengono decodificati al volo.
+       Un solo scrittore: il task di cattura (o chi chiama
+       can_capture_ingest, es. un replay). Lettori senza lock. */
+
+#ifndef CAN_CAPTURE_RING
+// Frame tenuti nel ring (potenza di 2): ~60 ms di bus pieno a 1 Mbit/s
+#define CAN_CAPTURE_RING 512
+#endif
+
+#ifndef CAN_CAPTURE_MAX_IDS
+// ID distinti con statistiche; oltre, i nuovi ID sono solo contati
+#define CAN_CAPTURE_MAX_IDS 128
+#endif
+
+#ifndef CAN_SIGNALS_MAX
+#define CAN_SIGNALS_MAX 16
+#endif
+
+#define CAN_SIGNAL_NAME_LEN 16
+
+#define CAN_REC_EXT 0x01 // ID esteso (29 bit)
+#define CAN_REC_RTR 0x02
+#define CAN_REC_TX 0x04  // trasmesso da noi (traccia del polling)
+
+    typedef struct
+    {
+        uint32_t t_us; // istante di ricezione (µs dall'avvio, wrap ~71 min)
+        uint32_t id;
+        uint8_t dlc;
+        uint8_t flags; // CAN_REC_*
+        uint8_t data[8];
+    } can_frame_rec_t;
+
+    typedef struct
+    {
+        uint32_t id;
+        uint8_t flags;
+        uint8_t dlc;
+        uint8_t data[8];     // ultimo payload
+        uint32_t count;
+        uint32_t changes;    // frame con payload diverso dal precedente
+        uint32_t period_us;  // periodo medio (EWMA 1/8)
+        uint32_t first_us;
+        uint32_t last_us;
+    } can_id_stats_t;
+
+    typedef struct
+    {
+        char name[CAN_SIGNAL_NAME_LEN];
+        uint32_t id;      // ID del frame (CAN_REC_EXT in ext)
+        bool ext;
+        uint8_t start;    // bit iniziale: LSB (Intel) o MSB (Motorola), numerazione DBC
+        uint8_t len;      // 1..32 bit
+        bool big_endian;  // Motorola
+        bool is_signed;
+        float scale;      // valore = raw * scale + offset
+        float offset;
+    } can_signal_def_t;
+
+    typedef struct
+    {
+        can_signal_def_t def;
+        float value;
+        uint32_t t_us;    // ultimo aggiornamento (0 = mai)
+        uint32_t count;
+    } can_signal_info_t;
+
+    typedef struct
+    {
+        bool running;         // cattura attiva (task listen-only o traccia)
+        uint32_t frames;      // frame acquisiti
+        uint32_t ids;         // ID distinti in tabella
+        uint32_t ids_dropped; // frame di ID fuori tabella (piena)
+        uint32_t rx_errors;   // ricezioni fallite diverse dal timeout
+    } can_capture_status_t;
+
+    /* Avvia il task che legge il bus (can_bus_init_config già fatto,
+       tipicamente in listen-only con filtro aperto) */
+    void can_capture_start(void);
+
+    /* Traccia del bus in polling: registra come osservatore di can_bus
+       (can_bus_set_trace) i frame ricevuti e le nostre richieste
+       (CAN_REC_TX), nello stesso ring e nelle stesse statistiche. Al
+       posto di can_capture_start, non insieme. */
+    void can_capture_attach(void);
+
+    /* Acquisisce un frame (scrittore unico) */
+    void can_capture_ingest(const twai_message_t *msg, uint32_t t_us);
+
+    /* Frame successivi al cursore (0 = dal più vecchio disponibile).
+       Il cursore avanza; lost riceve i frame sovrascritti prima della
+       lettura. Ritorna il numero di frame copiati. */
+    int can_capture_read(uint32_t *cursor, can_frame_rec_t *out, int max, uint32_t *lost);
+
+    void can_capture_status(can_capture_status_t *out);
+
+    /* Copia coerente delle statistiche per ID; ritorna quante */
+    int can_capture_get_ids(can_id_stats_t *out, int max);
+
+    /* ---- Segnali ---- */
+
+    /* "nome:id:start:len:le|be:u|s:scale:offset", id esadecimale
+       (più di 3 cifre = esteso), es. "rpm:0C9:24:16:le:u:0.25:0" */
+    bool can_signal_parse(const char *s, can_signal_def_t *out);
+
+    /* Aggiunge o sostituisce (per nome) un segnale e salva la tabella
+       in NVS. false se la tabella è piena o la definizione non è valida. */
+    bool can_signal_set(const can_signal_def_t *def);
+    bool can_signal_del(const char *name);
+
+    int can_signal_get(can_signal_info_t *out, int max);
+
+    /* Estrae il valore grezzo di un campo di bit da un payload */
+    int64_t can_signal_raw(const can_signal_def_t *def, const uint8_t *data, uint8_t dlc, bool *ok);
+
+#ifdef __cplusplus
+}
+#endif
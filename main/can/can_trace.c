@@ -0,0 +1,237 @@
+#include "can_trace.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool can_trace_fmt_parse(const char *name, can_trace_fmt_t *out)
+{
+    if (strcmp(name, "candump") == 0)
+        *out = CAN_TRACE_CANDUMP;
+    else if (strcmp(name, "asc") == 0)
+        *out = CAN_TRACE_ASC;
+    else
+        return false;
+    return true;
+}
+
+int can_trace_header(can_trace_fmt_t fmt, char *buf, size_t cap)
+{
+    if (fmt != CAN_TRACE_ASC)
+        return 0;
+
+    int n = snprintf(buf, cap,
+                     "date Thu Jan  1 00:00:00.000 am 1970\n"
+                     "base hex  timestamps absolute\n"
+                     "no internal events logged\n");
+    return n < (int)cap ? n : (int)cap - 1;
+}
+
+/* -------------------------------------------------------
+ * Scrittura
+ * ------------------------------------------------------- */
+int can_trace_format(can_trace_fmt_t fmt, const can_frame_rec_t *r, uint64_t t_us,
+                     char *buf, size_t cap)
+{
+    unsigned long sec = (unsigned long)(t_us / 1000000ULL);
+    unsigned long usec = (unsigned long)(t_us % 1000000ULL);
+    bool ext = r->flags & CAN_REC_EXT;
+    bool rtr = r->flags & CAN_REC_RTR;
+    bool tx = r->flags & CAN_REC_TX;
+    char id[12];
+    int n;
+
+    if (fmt == CAN_TRACE_ASC)
+    {
+        snprintf(id, sizeof(id), ext ? "%lXx" : "%lX", (unsigned long)r->id);
+        n = snprintf(buf, cap, "%4lu.%06lu 1  %-15s %s   %c %u", sec, usec, id,
+                     tx ? "Tx" : "Rx", rtr ? 'r' : 'd', (unsigned)r->dlc);
+        for (int i = 0; !rtr && i < r->dlc && n < (int)cap; i++)
+            n += snprintf(buf + n, cap - (size_t)n, " %02X", r->data[i]);
+    }
+    else
+    {
+        n = snprintf(buf, cap, ext ? "(%lu.%06lu) can0 %08lX#" : "(%lu.%06lu) can0 %03lX#",
+                     sec, usec, (unsigned long)r->id);
+        if (rtr && n < (int)cap)
+            n += snprintf(buf + n, cap - (size_t)n, "R");
+        for (int i = 0; !rtr && i < r->dlc && n < (int)cap; i++)
+            n += snprintf(buf + n, cap - (size_t)n, "%02X", r->data[i]);
+        if (n < (int)cap)
+            n += snprintf(buf + n, cap - (size_t)n, " %c", tx ? 'T' : 'R');
+    }
+
+    if (n < (int)cap)
+        n += snprintf(buf + n, cap - (size_t)n, "\n");
+    return n < (int)cap ? n : (int)cap - 1;
+}
+
+/* -------------------------------------------------------
+ * Lettura
+ * ------------------------------------------------------- */
+
+/* "123.456789" -> µs (frazione di lunghezza qualsiasi) */
+static bool parse_time(const char *s, char **end, uint64_t *t_us)
+{
+    char *p;
+    unsigned long long sec = strtoull(s, &p, 10);
+    uint64_t frac = 0, scale = 1000000;
+
+    if (p == s)
+        return false;
+    if (*p == '.')
+    {
+        for (p++; isdigit((unsigned char)*p); p++)
+        {
+            if (scale > 1)
+            {
+                scale /= 10;
+                frac += (uint64_t)(*p - '0') * scale;
+            }
+        }
+    }
+    *end = p;
+    *t_us = (uint64_t)sec * 1000000ULL + frac;
+    return true;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c = (char)toupper((unsigned char)c);
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/* "(t) ifname ID#DATA [R|T]" */
+static int parse_candump(const char *line, can_frame_rec_t *r, uint64_t *t_us)
+{
+    char *p;
+
+    if (!parse_time(line + 1, &p, t_us) || *p != ')')
+        return -1;
+    p++;
+
+    while (*p == ' ')
+        p++;
+    while (*p && *p != ' ')
+        p++; // interfaccia
+    while (*p == ' ')
+        p++;
+
+    char *hash = strchr(p, '#');
+    if (!hash)
+        return -1;
+    if (hash[1] == '#')
+        return 0; // CAN FD
+
+    int id_len = (int)(hash - p);
+    char *end;
+    unsigned long id = strtoul(p, &end, 16);
+    if (end != hash || (id_len != 3 && id_len != 8))
+        return -1;
+
+    memset(r, 0, sizeof(*r));
+    r->id = (uint32_t)id;
+    if (id_len == 8)
+        r->flags |= CAN_REC_EXT;
+
+    p = hash + 1;
+    if (*p == 'R')
+    {
+        r->flags |= CAN_REC_RTR;
+        p++;
+        if (isdigit((unsigned char)*p))
+            r->dlc = (uint8_t)(*p++ - '0');
+    }
+    else
+    {
+        while (hex_digit(p[0]) >= 0 && hex_digit(p[1]) >= 0)
+        {
+            if (r->dlc == 8)
+                return -1;
+            r->data[r->dlc++] = (uint8_t)(hex_digit(p[0]) << 4 | hex_digit(p[1]));
+            p += 2;
+        }
+    }
+
+    while (*p == ' ')
+        p++;
+    if (*p == 'T')
+        r->flags |= CAN_REC_TX;
+    return 1;
+}
+
+/* "t canale ID[x] Rx|Tx d|r dlc byte..." (altri eventi ignorati) */
+static int parse_asc(const char *line, can_frame_rec_t *r, uint64_t *t_us)
+{
+    char *p;
+
+    if (!parse_time(line, &p, t_us))
+        return 0;
+
+    char ch[8], id_s[16], dir[4], kind[4];
+    int used = 0;
+    if (sscanf(p, " %7s %15s %3s %3s%n", ch, id_s, dir, kind, &used) != 4)
+        return 0;
+    if (!isdigit((unsigned char)ch[0]))
+        return 0; // es. "CANFD", "Start of measurement"
+    if (strcmp(dir, "Rx") != 0 && strcmp(dir, "Tx") != 0)
+        return 0; // ErrorFrame, statistiche, ...
+
+    char *end;
+    unsigned long id = strtoul(id_s, &end, 16);
+    if (end == id_s || (*end && !(end[0] == 'x' && end[1] == '\0')))
+        return -1;
+
+    memset(r, 0, sizeof(*r));
+    r->id = (uint32_t)id;
+    if (*end == 'x')
+        r->flags |= CAN_REC_EXT;
+    if (dir[0] == 'T')
+        r->flags |= CAN_REC_TX;
+
+    p += used;
+    unsigned long dlc = strtoul(p, &end, 16);
+    if (end == p || dlc > 8)
+        return -1;
+    r->dlc = (uint8_t)dlc;
+    p = end;
+
+    if (strcmp(kind, "r") == 0)
+    {
+        r->flags |= CAN_REC_RTR;
+        return 1;
+    }
+    if (strcmp(kind, "d") != 0)
+        return -1;
+
+    for (int i = 0; i < r->dlc; i++)
+    {
+        unsigned long b = strtoul(p, &end, 16);
+        if (end == p || b > 0xFF)
+            return -1;
+        r->data[i] = (uint8_t)b;
+        p = end;
+    }
+    return 1;
+}
+
+int can_trace_parse(const char *line, can_frame_rec_t *r, uint64_t *t_us)
+{
+    while (*line == ' ' || *line == '\t')
+        line++;
+
+    int ok = 0;
+    if (*line == '(')
+        ok = parse_candump(line, r, t_us);
+    else if (isdigit((unsigned char)*line))
+        ok = parse_asc(line, r, t_us);
+
+    if (ok == 1)
+        r->t_us = (uint32_t)*t_us;
+    return ok;
+}
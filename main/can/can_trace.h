@@ -0,0 +1,44 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "can_capture.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Tracce testuali dei frame del ring di cattura, leggibili dagli
+       strumenti comuni (can-utils, python-can, SavvyCAN, CANalyzer):
+         candump  "(1.234567) can0 7E8#0441... R"  come candump -L -x
+         asc      "   1.234567 1  7E8   Rx   d 8 04 41 ..."  Vector ASC
+       Tempi in secondi dall'avvio del dispositivo (nessun orologio reale). */
+
+    typedef enum
+    {
+        CAN_TRACE_CANDUMP = 0,
+        CAN_TRACE_ASC,
+    } can_trace_fmt_t;
+
+    // Lunghezza massima di una riga (con '\n' e terminatore)
+#define CAN_TRACE_LINE_MAX 96
+
+    /* "candump" / "asc"; false se sconosciuto */
+    bool can_trace_fmt_parse(const char *name, can_trace_fmt_t *out);
+
+    /* Intestazione del file (vuota per candump); ritorna i byte scritti */
+    int can_trace_header(can_trace_fmt_t fmt, char *buf, size_t cap);
+
+    /* Una riga per frame, t_us = istante a 64 bit (il ring tiene 32 bit) */
+    int can_trace_format(can_trace_fmt_t fmt, const can_frame_rec_t *r, uint64_t t_us,
+                         char *buf, size_t cap);
+
+    /* Riga di traccia in uno dei due formati (riconosciuto da solo).
+       1 = frame, 0 = riga da ignorare (intestazione, commento, evento,
+       CAN FD), -1 = frame malformato. */
+    int can_trace_parse(const char *line, can_frame_rec_t *r, uint64_t *t_us);
+
+#ifdef __cplusplus
+}
+#endif
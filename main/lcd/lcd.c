@@ -1,9 +1,14 @@
 #include "lcd.h"
+#include "app_tasks.h"
 
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+#include <string.h>
 
 /* =========================
  *  PIN MAPPING (EDIT HERE)
@@ -32,15 +37,28 @@
 #define LCD_D7  GPIO_NUM_17
 #endif
 
+/* =========================
+ *  TEMPI HD44780 (R/W a massa: niente busy flag)
+ * ========================= */
+#ifndef LCD_EXEC_US
+// Esecuzione di un carattere o di un comando: 37 µs a 270 kHz, 43 µs
+// con l'oscillatore al minimo (250 kHz) più margine
+#define LCD_EXEC_US 50
+#endif
+
 static inline void delay_us(uint32_t us) { esp_rom_delay_us(us); }
-static inline void delay_ms(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+static inline void delay_ms(uint32_t ms)
+{
+    TickType_t t = pdMS_TO_TICKS(ms);
+    vTaskDelay(t ? t : 1); // a 100 Hz pochi ms sarebbero 0 tick
+}
 
+/* E alto almeno 450 ns; i dati sono letti sul fronte di discesa */
 static void lcd_strobe(void)
 {
     gpio_set_level(LCD_E, 1);
-    delay_us(50);
+    delay_us(1);
     gpio_set_level(LCD_E, 0);
-    delay_us(100);
 }
 
 static void lcd_write_4bit(uint8_t nibble)
@@ -55,23 +73,21 @@ static void lcd_write_4bit(uint8_t nibble)
 static void lcd_send(uint8_t data, int rs)
 {
     gpio_set_level(LCD_RS, rs);
-    delay_us(20);
 
     lcd_write_4bit(data >> 4);
-    delay_us(100);
+    delay_us(1);
     lcd_write_4bit(data & 0x0F);
 
     if (rs == 0 && (data == 0x01 || data == 0x02)) {
-        delay_ms(10);
+        delay_ms(2); // clear / home: 1.52 ms
     } else {
-        delay_us(200);
+        delay_us(LCD_EXEC_US);
     }
 }
 
 void lcd_clear(void)
 {
     lcd_send(0x01, 0);
-    delay_ms(5);
 }
 
 void lcd_gotoxy(uint8_t col, uint8_t row)
@@ -84,7 +100,6 @@ void lcd_print(const char *str)
 {
     while (*str) {
         lcd_send((uint8_t)(*str++), 1);
-        delay_us(50);
     }
 }
 
@@ -116,3 +131,134 @@ void lcd_init(void)
 
     lcd_clear();
 }
+
+/* =========================
+ *  FRAMEBUFFER OMBRA
+ * ========================= */
+static char s_want[LCD_ROWS][LCD_COLS];  // scritto da chi produce il contenuto
+static char s_shown[LCD_ROWS][LCD_COLS]; // quello che c'è sul display (task di flush)
+static int64_t s_commit_us;              // primo commit non ancora mostrato (0 = nessuno)
+static SemaphoreHandle_t s_fb_lock;
+static SemaphoreHandle_t s_fb_wake;
+static lcd_stats_t s_stats;
+
+/* Invia le celle diverse da s_shown. Il cursore avanza da solo dopo
+   ogni carattere: l'indirizzo si reinvia solo dopo un salto. */
+static void fb_flush(const char want[LCD_ROWS][LCD_COLS], int64_t commit_us)
+{
+    int64_t t0 = esp_timer_get_time();
+    uint32_t cells = 0, commands = 0;
+
+    for (int r = 0; r < LCD_ROWS; r++) {
+        int cursor = -1; // colonna dove scriverebbe il prossimo carattere
+
+        for (int c = 0; c < LCD_COLS; c++) {
+            if (want[r][c] == s_shown[r][c])
+                continue;
+
+            if (cursor != c) {
+                lcd_gotoxy((uint8_t)c, (uint8_t)r);
+                commands++;
+            }
+            lcd_send((uint8_t)want[r][c], 1);
+            s_shown[r][c] = want[r][c];
+            cursor = c + 1;
+            cells++;
+        }
+    }
+
+    if (cells == 0)
+        return;
+
+    int64_t t1 = esp_timer_get_time();
+
+    xSemaphoreTake(s_fb_lock, portMAX_DELAY);
+    s_stats.flushes++;
+    s_stats.cells += cells;
+    s_stats.commands += commands;
+    s_stats.last_us = (uint32_t)(t1 - t0);
+    if (s_stats.last_us > s_stats.max_us)
+        s_stats.max_us = s_stats.last_us;
+    s_stats.total_us += s_stats.last_us;
+    if (commit_us) {
+        s_stats.latency_us = (uint32_t)(t1 - commit_us);
+        s_stats.latency_total_us += s_stats.latency_us;
+        if (s_stats.latency_us > s_stats.latency_max_us)
+            s_stats.latency_max_us = s_stats.latency_us;
+    }
+    xSemaphoreGive(s_fb_lock);
+}
+
+static void lcd_flush_task(void *arg)
+{
+    (void)arg;
+    char want[LCD_ROWS][LCD_COLS];
+
+    while (1) {
+        xSemaphoreTake(s_fb_wake, portMAX_DELAY);
+
+        xSemaphoreTake(s_fb_lock, portMAX_DELAY);
+        memcpy(want, s_want, sizeof(want));
+        int64_t commit_us = s_commit_us;
+        s_commit_us = 0;
+        xSemaphoreGive(s_fb_lock);
+
+        fb_flush((const char (*)[LCD_COLS])want, commit_us);
+    }
+}
+
+void lcd_fb_start(void)
+{
+    if (s_fb_wake)
+        return;
+
+    // lcd_init() ha pulito il display: tutto spazi
+    memset(s_want, ' ', sizeof(s_want));
+    memset(s_shown, ' ', sizeof(s_shown));
+
+    s_fb_lock = xSemaphoreCreateMutex();
+    s_fb_wake = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(lcd_flush_task, "lcd_flush", APP_LCD_FLUSH_STACK, NULL,
+                            APP_LCD_FLUSH_PRIO, NULL, APP_CORE(APP_CORE_NET));
+}
+
+void lcd_fb_line(uint8_t row, const char *str)
+{
+    if (row >= LCD_ROWS || !s_fb_lock)
+        return;
+
+    size_t n = strnlen(str, LCD_COLS);
+
+    xSemaphoreTake(s_fb_lock, portMAX_DELAY);
+    memcpy(s_want[row], str, n);
+    memset(s_want[row] + n, ' ', LCD_COLS - n);
+    xSemaphoreGive(s_fb_lock);
+}
+
+void lcd_fb_commit(void)
+{
+    if (!s_fb_wake)
+        return;
+
+    xSemaphoreTake(s_fb_lock, portMAX_DELAY);
+    if (s_commit_us == 0)
+        s_commit_us = esp_timer_get_time();
+    xSemaphoreGive(s_fb_lock);
+
+    xSemaphoreGive(s_fb_wake);
+}
+
+void lcd_get_stats(lcd_stats_t *out)
+{
+    if (!out)
+        return;
+
+    if (!s_fb_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+
+    xSemaphoreTake(s_fb_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_fb_lock);
+}
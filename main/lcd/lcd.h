@@ -2,6 +2,9 @@
 
 #include <stdint.h>
 
+#define LCD_COLS 16
+#define LCD_ROWS 2
+
 /**
  * Inizializza LCD HD44780 compatibile in modalità 4-bit, 2 righe.
  */
@@ -23,3 +26,42 @@ void lcd_gotoxy(uint8_t col, uint8_t row);
  * Stampa una stringa (no wrap automatico).
  */
 void lcd_print(const char *str);
+
+/* =========================
+ *  FRAMEBUFFER OMBRA
+ * =========================
+ * Chi produce il contenuto scrive in un buffer in RAM e fa commit; un
+ * task a bassa priorità confronta il buffer con ciò che il display
+ * mostra e invia solo le celle cambiate. Dopo lcd_fb_start() le
+ * funzioni dirette sopra non vanno più usate.
+ */
+
+/**
+ * Avvia il task di flush (dopo lcd_init).
+ */
+void lcd_fb_start(void);
+
+/**
+ * Scrive una riga intera nel buffer, troncata o completata con spazi.
+ */
+void lcd_fb_line(uint8_t row, const char *str);
+
+/**
+ * Rende visibile il contenuto del buffer (non blocca).
+ */
+void lcd_fb_commit(void);
+
+typedef struct
+{
+    uint32_t flushes;       // flush che hanno scritto almeno una cella
+    uint32_t cells;         // caratteri inviati
+    uint32_t commands;      // spostamenti del cursore
+    uint32_t last_us;       // durata dell'ultimo flush
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t latency_us;    // commit -> ultimo carattere inviato (ultimo flush)
+    uint32_t latency_max_us;
+    uint64_t latency_total_us;
+} lcd_stats_t;
+
+void lcd_get_stats(lcd_stats_t *out);
@@ -0,0 +1,382 @@
+#include "obd_log.h"
+#include "obd.h"
+#include "obd_frame.h"
+#include "app_tasks.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#include <string.h>
+
+static const char *TAG = "OBD_LOG";
+
+#define HDR_LEN ((int)sizeof(obd_log_seg_hdr_t))
+#define PAYLOAD_MAX (OBD_LOG_SEGMENT - HDR_LEN)
+// varint dt (al più 5 byte) + lunghezza + frame
+#define RECORD_MAX (5 + 1 + OBD_FRAME_MAX_LEN)
+
+_Static_assert(OBD_FRAME_MAX_LEN <= 255, "lunghezza del frame su un byte");
+_Static_assert(PAYLOAD_MAX <= 0xFFFF, "payload_len su 16 bit");
+
+static const esp_partition_t *s_part;
+static SemaphoreHandle_t s_wake;
+static SemaphoreHandle_t s_lock; // segmento in RAM e indice
+
+/* -------------------------------------------------------
+ * Indice: slot = settore della partizione. I segmenti validi sono
+ * consecutivi (in senso circolare) e finiscono prima di s_next_slot.
+ * ------------------------------------------------------- */
+static uint32_t s_sectors;
+static uint32_t s_next_slot;  // prossimo settore da scrivere (= il più vecchio)
+static uint32_t s_next_seq;
+static uint32_t s_oldest_seq; // 0 = log vuoto
+static uint32_t s_boot;
+
+/* Segmento in costruzione */
+static uint8_t s_seg[OBD_LOG_SEGMENT];
+static obd_log_seg_hdr_t s_hdr;
+static size_t s_len; // byte di payload
+static uint32_t s_last_ms;
+static uint32_t s_last_seq;
+static obd_frame_ctx_t s_frame_ctx;
+
+static obd_log_stats_t s_stats;
+static uint32_t s_start_ms;
+
+static inline uint32_t now_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/* CRC-32 (IEEE, riflesso): 4 KB ogni qualche secondo, la tabella non serve */
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t n)
+{
+    crc = ~crc;
+    while (n--)
+    {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1U));
+    }
+    return ~crc;
+}
+
+static uint32_t seg_crc(const obd_log_seg_hdr_t *hdr, const uint8_t *payload)
+{
+    obd_log_seg_hdr_t h = *hdr;
+    h.crc = 0;
+    uint32_t crc = crc32_update(0, (const uint8_t *)&h, sizeof(h));
+    return crc32_update(crc, payload, hdr->payload_len);
+}
+
+int obd_log_check_segment(const uint8_t *buf, size_t len, obd_log_seg_hdr_t *hdr)
+{
+    if (len < (size_t)HDR_LEN)
+        return -1;
+
+    memcpy(hdr, buf, sizeof(*hdr));
+    if (hdr->magic != OBD_LOG_MAGIC || hdr->version != OBD_LOG_VERSION || hdr->hdr_len != HDR_LEN)
+        return -1;
+    if (hdr->payload_len > PAYLOAD_MAX || (size_t)HDR_LEN + hdr->payload_len > len)
+        return -1;
+    return seg_crc(hdr, buf + HDR_LEN) == hdr->crc ? 0 : -1;
+}
+
+int obd_log_next_record(const uint8_t *payload, size_t len, size_t *off,
+                        uint32_t *dt_ms, const uint8_t **frame, size_t *frame_len)
+{
+    size_t pos = *off;
+    uint32_t v = 0;
+
+    if (pos >= len)
+        return 0;
+
+    for (int shift = 0;; shift += 7)
+    {
+        if (pos >= len || shift > 28)
+            return -1;
+        uint8_t b = payload[pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+
+    if (pos >= len || pos + 1 + payload[pos] > len)
+        return -1;
+
+    *dt_ms = v;
+    *frame_len = payload[pos];
+    *frame = &payload[pos + 1];
+    *off = pos + 1 + payload[pos];
+    return 1;
+}
+
+/* -------------------------------------------------------
+ * Flash
+ * ------------------------------------------------------- */
+
+/* Ricostruisce l'indice dalle intestazioni: il segmento con seq più alta
+   è l'ultimo scritto, quello dopo è il prossimo da sovrascrivere */
+static void index_scan(void)
+{
+    uint32_t newest = 0, newest_slot = 0, oldest = 0, boot = 0;
+    obd_log_seg_hdr_t hdr;
+
+    for (uint32_t i = 0; i < s_sectors; i++)
+    {
+        if (esp_partition_read(s_part, i * OBD_LOG_SEGMENT, s_seg, OBD_LOG_SEGMENT) != ESP_OK)
+            continue;
+        if (obd_log_check_segment(s_seg, OBD_LOG_SEGMENT, &hdr) != 0)
+            continue;
+
+        if (hdr.seq > newest)
+        {
+            newest = hdr.seq;
+            newest_slot = i;
+        }
+        if (oldest == 0 || hdr.seq < oldest)
+            oldest = hdr.seq;
+        if (hdr.boot > boot)
+            boot = hdr.boot;
+    }
+
+    s_next_slot = newest ? (newest_slot + 1) % s_sectors : 0;
+    s_next_seq = newest + 1;
+    s_oldest_seq = oldest;
+    s_boot = boot + 1;
+}
+
+/* Col lock. Erase + payload + intestazione per ultima. */
+static void seg_write(void)
+{
+    if (s_hdr.records == 0)
+        return;
+
+    s_hdr.magic = OBD_LOG_MAGIC;
+    s_hdr.version = OBD_LOG_VERSION;
+    s_hdr.hdr_len = HDR_LEN;
+    s_hdr.payload_len = (uint16_t)s_len;
+    s_hdr.seq = s_next_seq;
+    s_hdr.boot = s_boot;
+    s_hdr.crc = seg_crc(&s_hdr, s_seg + HDR_LEN);
+
+    uint32_t slot = s_next_slot;
+    size_t off = (size_t)slot * OBD_LOG_SEGMENT;
+    bool overwrite = s_oldest_seq != 0 && s_next_seq - s_oldest_seq >= s_sectors;
+    uint32_t t0 = now_ms();
+
+    // il settore da cancellare è il più vecchio: da qui non è più valido
+    if (overwrite)
+    {
+        s_oldest_seq++;
+        s_stats.overwritten++;
+    }
+
+    esp_err_t err = esp_partition_erase_range(s_part, off, OBD_LOG_SEGMENT);
+    if (err == ESP_OK && s_len > 0)
+        err = esp_partition_write(s_part, off + HDR_LEN, s_seg + HDR_LEN, s_len);
+    if (err == ESP_OK)
+        err = esp_partition_write(s_part, off, &s_hdr, sizeof(s_hdr));
+
+    uint32_t dt = now_ms() - t0;
+    s_stats.write_ms_total += dt;
+    if (dt > s_stats.write_ms_max)
+        s_stats.write_ms_max = dt;
+
+    if (err != ESP_OK)
+    {
+        // settore saltato: al giro successivo verrà riprovato
+        s_stats.write_errors++;
+        ESP_LOGW(TAG, "Scrittura segmento %lu fallita (%d)", (unsigned long)s_next_seq, err);
+    }
+    else
+    {
+        if (s_oldest_seq == 0)
+            s_oldest_seq = s_next_seq;
+        s_stats.segments++;
+        s_stats.records += s_hdr.records;
+        s_stats.payload_bytes += (uint32_t)s_len;
+    }
+
+    s_next_seq++;
+    s_next_slot = (slot + 1) % s_sectors;
+
+    memset(&s_hdr, 0, sizeof(s_hdr));
+    s_len = 0;
+    // il primo record del segmento successivo è completo: ogni segmento
+    // si decodifica da solo anche quando i precedenti sono sovrascritti
+    obd_frame_ctx_init(&s_frame_ctx);
+    s_last_seq = 0;
+}
+
+/* Col lock */
+static void seg_append(const obd_snapshot_t *snap, uint32_t seq, uint32_t t)
+{
+    uint8_t rec[RECORD_MAX];
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        uint32_t dt = s_hdr.records ? t - s_last_ms : 0;
+        size_t n = 0;
+
+        while (dt >= 0x80)
+        {
+            rec[n++] = (uint8_t)(dt | 0x80);
+            dt >>= 7;
+        }
+        rec[n++] = (uint8_t)dt;
+
+        int flen = obd_frame_encode(&s_frame_ctx, &snap->data, seq, s_last_seq, &rec[n + 1],
+                                    sizeof(rec) - n - 1);
+        if (flen < 0)
+            return;
+        rec[n++] = (uint8_t)flen;
+        n += (size_t)flen;
+
+        if (s_len + n <= PAYLOAD_MAX)
+        {
+            if (s_hdr.records == 0)
+                s_hdr.t0_ms = t;
+            memcpy(s_seg + HDR_LEN + s_len, rec, n);
+            s_len += n;
+            s_hdr.records++;
+            s_hdr.t1_ms = t;
+            s_last_ms = t;
+            s_last_seq = seq;
+            return;
+        }
+
+        // segmento pieno: si scrive e si ricodifica come frame completo
+        seg_write();
+    }
+}
+
+/* Gira nel task RT: solo segnalazione */
+static void log_on_publish(uint32_t seq, void *ctx)
+{
+    (void)seq;
+    (void)ctx;
+    xSemaphoreGive(s_wake);
+}
+
+static void obd_log_task(void *arg)
+{
+    (void)arg;
+    obd_snapshot_t snap;
+    uint32_t last_seq = 0;
+    uint32_t last_ms = 0;
+
+    while (1)
+    {
+        bool woken = xSemaphoreTake(s_wake, pdMS_TO_TICKS(1000)) == pdTRUE;
+        uint32_t t = now_ms();
+
+        if (woken && last_ms && t - last_ms < OBD_LOG_MIN_MS)
+        {
+            vTaskDelay(pdMS_TO_TICKS(OBD_LOG_MIN_MS - (t - last_ms)));
+            t = now_ms();
+        }
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+
+        uint32_t seq = obd_get_snapshot(&snap);
+        if (woken && seq != last_seq)
+        {
+            seg_append(&snap, seq, t);
+            last_seq = seq;
+            last_ms = t;
+        }
+
+        if (s_hdr.records && t - s_hdr.t0_ms >= OBD_LOG_FLUSH_MS)
+            seg_write();
+
+        xSemaphoreGive(s_lock);
+    }
+}
+
+/* -------------------------------------------------------
+ * API
+ * ------------------------------------------------------- */
+bool obd_log_start(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                      OBD_LOG_PARTITION);
+    if (!s_part)
+    {
+        ESP_LOGW(TAG, "Partizione '%s' assente: registro disattivato", OBD_LOG_PARTITION);
+        return false;
+    }
+
+    s_sectors = s_part->size / OBD_LOG_SEGMENT;
+    if (s_sectors < 2)
+    {
+        ESP_LOGW(TAG, "Partizione '%s' troppo piccola", OBD_LOG_PARTITION);
+        return false;
+    }
+
+    uint32_t t0 = now_ms();
+    index_scan();
+    ESP_LOGI(TAG, "Sessione %lu: %lu settori, segmenti %lu..%lu (scansione %lu ms)",
+             (unsigned long)s_boot, (unsigned long)s_sectors, (unsigned long)s_oldest_seq,
+             (unsigned long)(s_next_seq - 1), (unsigned long)(now_ms() - t0));
+
+    memset(&s_hdr, 0, sizeof(s_hdr));
+    s_len = 0;
+    obd_frame_ctx_init(&s_frame_ctx);
+    s_start_ms = now_ms();
+
+    s_lock = xSemaphoreCreateMutex();
+    s_wake = xSemaphoreCreateBinary();
+    s_stats.active = true;
+    obd_data_add_listener(log_on_publish, NULL);
+    // sotto web e LCD: la flash è lenta e il registro può aspettare
+    xTaskCreatePinnedToCore(obd_log_task, "obd_log", APP_OBD_LOG_STACK, NULL, APP_OBD_LOG_PRIO, NULL,
+                            APP_CORE(APP_CORE_NET));
+    return true;
+}
+
+void obd_log_flush(void)
+{
+    if (!s_lock)
+        return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    seg_write();
+    xSemaphoreGive(s_lock);
+}
+
+void obd_log_get_stats(obd_log_stats_t *out)
+{
+    if (s_lock)
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    *out = s_stats;
+    out->sectors = s_sectors;
+    out->boot = s_boot;
+    out->oldest_seq = s_oldest_seq;
+    out->newest_seq = s_oldest_seq ? s_next_seq - 1 : 0;
+    out->pending = s_hdr.records;
+    out->uptime_ms = s_stats.active ? now_ms() - s_start_ms : 0;
+
+    if (s_lock)
+        xSemaphoreGive(s_lock);
+}
+
+int obd_log_read_segment(int i, uint8_t *buf, size_t cap)
+{
+    if (!s_part || i < 0 || (uint32_t)i >= s_sectors || cap < OBD_LOG_SEGMENT)
+        return -1;
+
+    // niente lock: un settore sovrascritto durante la lettura non passa il CRC
+    uint32_t slot = (s_next_slot + (uint32_t)i) % s_sectors;
+    obd_log_seg_hdr_t hdr;
+
+    if (esp_partition_read(s_part, (size_t)slot * OBD_LOG_SEGMENT, buf, OBD_LOG_SEGMENT) != ESP_OK)
+        return 0;
+    if (obd_log_check_segment(buf, OBD_LOG_SEGMENT, &hdr) != 0)
+        return 0;
+    return HDR_LEN + hdr.payload_len;
+}
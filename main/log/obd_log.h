@@ -0,0 +1,110 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Registro di sessione in flash sulla partizione "storage" (raw, senza
+       filesystem). Un task a bassa priorità campiona lo snapshot quando il
+       task RT pubblica (la callback fa solo xSemaphoreGive), codifica ogni
+       campione come frame obd_frame (fixed-point, delta sul precedente) e
+       riempie in RAM un segmento grande quanto un settore di flash.
+
+       Segmento pieno = un erase + una scrittura, sempre allineati al
+       settore. I segmenti formano un log circolare: ogni settore viene
+       cancellato una volta per giro (wear levelling uniforme) e da pieno
+       si sovrascrive il più vecchio. L'intestazione, con numero di
+       sequenza e CRC, si scrive per ultima: un segmento interrotto da
+       un reset resta invalido e l'indice si ricostruisce all'avvio
+       leggendo le intestazioni. */
+
+#ifndef OBD_LOG_PARTITION
+#define OBD_LOG_PARTITION "storage"
+#endif
+
+#ifndef OBD_LOG_SEGMENT
+// Dimensione del segmento = settore di erase della flash SPI
+#define OBD_LOG_SEGMENT 4096
+#endif
+
+#ifndef OBD_LOG_MIN_MS
+// Al più un campione ogni OBD_LOG_MIN_MS (le pubblicazioni in mezzo
+// confluiscono nel successivo)
+#define OBD_LOG_MIN_MS 100
+#endif
+
+#ifndef OBD_LOG_FLUSH_MS
+// Un segmento parziale più vecchio di così viene scritto comunque: dati
+// persi al massimo di questa durata, al prezzo di un erase in più
+#define OBD_LOG_FLUSH_MS 60000
+#endif
+
+#define OBD_LOG_MAGIC 0x4C44424FUL // "OBDL"
+#define OBD_LOG_VERSION 1
+
+    /* Intestazione a inizio segmento. Seguono payload_len byte di record:
+         varint  dt_ms   dal record precedente (il primo: da t0_ms)
+         uint8   len
+         len     frame obd_frame (il primo completo, gli altri delta) */
+    typedef struct
+    {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t hdr_len;      // sizeof(obd_log_seg_hdr_t)
+        uint16_t payload_len;
+        uint32_t seq;         // numero del segmento, cresce tra un avvio e l'altro
+        uint32_t boot;        // sessione (avvio) che l'ha scritto
+        uint32_t t0_ms;       // istante del primo record (ms dall'avvio)
+        uint32_t t1_ms;       // istante dell'ultimo record
+        uint16_t records;
+        uint16_t reserved;
+        uint32_t crc;         // CRC-32 di intestazione (crc = 0) e payload
+    } obd_log_seg_hdr_t;
+
+    typedef struct
+    {
+        bool active;              // partizione trovata e task avviato
+        uint32_t sectors;         // segmenti nella partizione
+        uint32_t boot;            // sessione corrente
+        uint32_t oldest_seq;      // segmenti validi: oldest_seq..newest_seq
+        uint32_t newest_seq;      // 0 = nessuno
+        uint32_t records;         // record scritti in questa sessione
+        uint32_t pending;         // record nel segmento in RAM
+        uint32_t segments;        // segmenti scritti (= erase) in questa sessione
+        uint32_t overwritten;     // segmenti vecchi sovrascritti
+        uint32_t write_errors;
+        uint32_t payload_bytes;   // byte di record scritti
+        uint32_t write_ms_max;    // erase + scrittura di un segmento
+        uint32_t write_ms_total;
+        uint32_t uptime_ms;       // da obd_log_start
+    } obd_log_stats_t;
+
+    /* Trova la partizione, ricostruisce l'indice e avvia il task.
+       false se la partizione manca (il logger resta spento). */
+    bool obd_log_start(void);
+
+    /* Scrive subito il segmento in RAM (se ha record) */
+    void obd_log_flush(void);
+
+    void obd_log_get_stats(obd_log_stats_t *out);
+
+    /* Segmento i-esimo dal più vecchio (header + payload, senza il riempimento).
+       Ritorna i byte copiati, 0 se lo slot non è valido (vuoto o appena
+       sovrascritto), -1 oltre l'ultimo slot. */
+    int obd_log_read_segment(int i, uint8_t *buf, size_t cap);
+
+    /* Verifica un segmento (magic, versione, lunghezze, CRC): 0 se valido */
+    int obd_log_check_segment(const uint8_t *buf, size_t len, obd_log_seg_hdr_t *hdr);
+
+    /* Record successivo del payload a partire da *off: 1 se trovato,
+       0 a fine payload, -1 se troncato */
+    int obd_log_next_record(const uint8_t *payload, size_t len, size_t *off,
+                            uint32_t *dt_ms, const uint8_t **frame, size_t *frame_len);
+
+#ifdef __cplusplus
+}
+#endif
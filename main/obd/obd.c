@@ -1,61 +1,716 @@
 #include "obd.h"
+#include "obd_dtc.h"
+#include "obd_metrics.h"
 #include "can_bus.h"
+#include "app_tasks.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include <string.h>
 
 static const char *TAG = "OBD_HW";
 
+#define OBD_FUNC_REQ_ID   0x7DF
+#define OBD_RESP_ID_MIN   0x7E8
+#define OBD_RESP_ID_MAX   0x7EF
+#define OBD_PHYS_OFFSET   8      // 0x7E8 -> 0x7E0 (richiesta fisica / Flow Control)
+#define OBD_ECU_COUNT     (OBD_RESP_ID_MAX - OBD_RESP_ID_MIN + 1)
+
+#define OBD_RESP_TIMEOUT_MS 100
+#define OBD_RESP_PENDING_MS 1000 // estensione su NRC 0x78 (response pending)
+
+#ifndef OBD_ISOTP_MAX
+// Messaggio riassemblato per ECU: SID + conteggio + 63 DTC. Le risposte più
+// lunghe vengono consegnate troncate (Mode 01 multi-PID ne usa al più 31)
+#define OBD_ISOTP_MAX 128
+#endif
+
+#ifndef OBD_RX_POLL_MS
+// Granularità con cui il task RX controlla le richieste scadute
+#define OBD_RX_POLL_MS 10
+#endif
+
 /* -------------------------------------------------------
- * Lettura singolo PID via CAN HAL
+ * Lunghezza dati PID Mode 01 (SAE J1979), indicizzata per PID
  * ------------------------------------------------------- */
-bool obd_read_pid(uint8_t pid, uint8_t out[4])
+static const uint8_t s_pid_len[0x61] = {
+    /* 0x00 */ 4, 4, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1,
+    /* 0x10 */ 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2,
+    /* 0x20 */ 4, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1,
+    /* 0x30 */ 1, 2, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2,
+    /* 0x40 */ 4, 4, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 4,
+    /* 0x50 */ 4, 1, 1, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1,
+    /* 0x60 */ 4,
+};
+
+uint8_t obd_pid_data_len(uint8_t pid)
 {
-    if (!out)
+    if (pid < sizeof(s_pid_len))
+        return s_pid_len[pid];
+
+    // bitmap "PID supportati" (0x80, 0xA0, 0xC0, 0xE0)
+    return ((pid & 0x1F) == 0) ? 4 : 0;
+}
+
+int obd_parse_mode01(const uint8_t *data, int len, obd_pid_cb_t cb, void *ctx)
+{
+    int count = 0;
+    int pos = 0;
+
+    while (pos < len)
+    {
+        uint8_t pid = data[pos];
+        uint8_t dl = obd_pid_data_len(pid);
+
+        if (dl == 0 || pos + 1 + dl > len)
+            break; // PID sconosciuto: impossibile proseguire il parsing
+
+        if (cb)
+            cb(pid, &data[pos + 1], dl, ctx);
+        count++;
+        pos += 1 + dl;
+    }
+
+    return count;
+}
+
+/* -------------------------------------------------------
+ * Tabella richieste in volo
+ * ------------------------------------------------------- */
+typedef struct
+{
+    bool used;
+    uint8_t service;
+    uint8_t params[OBD_MAX_PIDS_PER_REQ];
+    uint8_t nparams;
+    uint32_t seq;         // ordine di invio (match del più vecchio)
+    bool collect;         // raccoglie le risposte di tutte le ECU fino al timeout
+    uint16_t ecu_id;      // risponditore atteso, 0 = qualsiasi (raccolte, prima della discovery)
+    TickType_t deadline;
+    obd_resp_cb_t cb;
+    void *ctx;
+} obd_req_slot_t;
+
+static obd_req_slot_t s_slots[OBD_ENGINE_SLOTS];
+static SemaphoreHandle_t s_slots_mutex;
+static uint32_t s_req_seq;
+
+/* Stato di riassemblaggio ISO-TP, uno per ECU (0x7E8..0x7EF) */
+typedef struct
+{
+    bool active;
+    uint16_t total;     // byte riassemblati (al più OBD_ISOTP_MAX)
+    uint16_t got;
+    uint8_t next_sn;
+    uint8_t buf[OBD_ISOTP_MAX];
+} isotp_rx_t;
+
+static isotp_rx_t s_isotp[OBD_ECU_COUNT];
+
+static inline bool tick_reached(TickType_t now, TickType_t deadline)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+/* La risposta di ecu_id può chiudere lo slot? Con risponditore qualsiasi
+   una negativa chiude solo le raccolte: alle altre può ancora rispondere
+   positivamente un'altra ECU. */
+static bool slot_accepts(const obd_req_slot_t *s, uint32_t ecu_id, bool negative)
+{
+    if (s->ecu_id)
+        return s->ecu_id == ecu_id;
+    return !negative || s->collect;
+}
+
+/* Cerca la richiesta (più vecchia) a cui appartiene una risposta di ecu_id.
+   first_param < 0: nessun parametro da verificare (es. NRC). Chiamare col lock. */
+static int find_slot(uint8_t service, int first_param, uint32_t ecu_id, bool negative)
+{
+    int best = -1;
+
+    for (int i = 0; i < OBD_ENGINE_SLOTS; i++)
+    {
+        obd_req_slot_t *s = &s_slots[i];
+        if (!s->used || s->service != service || !slot_accepts(s, ecu_id, negative))
+            continue;
+
+        if (first_param >= 0 && s->nparams > 0)
+        {
+            bool hit = false;
+            for (int k = 0; k < s->nparams; k++)
+                if (s->params[k] == (uint8_t)first_param)
+                    hit = true;
+            if (!hit)
+                continue;
+        }
+
+        if (best < 0 || (int32_t)(s->seq - s_slots[best].seq) < 0)
+            best = i;
+    }
+    return best;
+}
+
+/* Libera lo slot e chiama la callback fuori dal lock (entra col lock preso).
+   Le richieste "collect" restano aperte fino alla scadenza. */
+static void complete_slot(int idx, obd_resp_t *resp)
+{
+    obd_resp_cb_t cb = s_slots[idx].cb;
+    void *ctx = s_slots[idx].ctx;
+
+    resp->service = s_slots[idx].service;
+    if (!s_slots[idx].collect || resp->status == OBD_RESP_TIMEOUT)
+        s_slots[idx].used = false;
+    xSemaphoreGive(s_slots_mutex);
+
+    if (cb)
+        cb(resp, ctx);
+}
+
+/* Messaggio completo (SID + payload) ricevuto da una ECU */
+static void deliver_message(uint32_t ecu_id, const uint8_t *msg, int len)
+{
+    if (len < 1)
+        return;
+
+    xSemaphoreTake(s_slots_mutex, portMAX_DELAY);
+
+    if (msg[0] == 0x7F && len >= 3) // risposta negativa: 7F SID NRC
+    {
+        // 0x78 (response pending) non chiude nulla: allunga anche le richieste a chiunque
+        int idx = find_slot(msg[1], -1, ecu_id, msg[2] != 0x78);
+        if (idx < 0)
+        {
+            xSemaphoreGive(s_slots_mutex);
+            return;
+        }
+
+        if (msg[2] == 0x78)
+        {
+            s_slots[idx].deadline = xTaskGetTickCount() + pdMS_TO_TICKS(OBD_RESP_PENDING_MS);
+            xSemaphoreGive(s_slots_mutex);
+            return;
+        }
+
+        obd_resp_t resp = {
+            .status = OBD_RESP_NEGATIVE,
+            .ecu_id = ecu_id,
+            .data = &msg[2],
+            .len = 1,
+        };
+        complete_slot(idx, &resp);
+        return;
+    }
+
+    if (msg[0] < 0x40)
+    {
+        xSemaphoreGive(s_slots_mutex);
+        return;
+    }
+
+    int idx = find_slot((uint8_t)(msg[0] - 0x40), len > 1 ? msg[1] : -1, ecu_id, false);
+    if (idx < 0)
+    {
+        // risposta tardiva, di un'altra ECU o di un altro tester: scartata
+        xSemaphoreGive(s_slots_mutex);
+        return;
+    }
+
+    obd_resp_t resp = {
+        .status = OBD_RESP_OK,
+        .ecu_id = ecu_id,
+        .data = &msg[1],
+        .len = len - 1,
+    };
+    complete_slot(idx, &resp);
+}
+
+/* Una risposta multi-frame interessa solo se c'è una richiesta in attesa
+   di quella ECU */
+static bool message_expected(uint32_t ecu_id, const uint8_t *msg)
+{
+    if (msg[0] < 0x40)
+        return false;
+
+    xSemaphoreTake(s_slots_mutex, portMAX_DELAY);
+    bool hit = find_slot((uint8_t)(msg[0] - 0x40), msg[1], ecu_id, false) >= 0;
+    xSemaphoreGive(s_slots_mutex);
+    return hit;
+}
+
+static void isotp_send_flow_control(uint32_t resp_id)
+{
+    twai_message_t fc = {
+        .identifier = resp_id - OBD_PHYS_OFFSET,
+        .data_length_code = 8,
+        .data = {0x30, 0x00, 0x00, 0, 0, 0, 0, 0} // CTS, block size 0, STmin 0
+    };
+
+    if (can_bus_send(&fc) != ESP_OK)
+    {
+        obd_metrics_tx_fail();
+        ESP_LOGW(TAG, "Flow Control verso 0x%03X fallito", (unsigned)fc.identifier);
+    }
+}
+
+/* Riassemblaggio ISO-TP: Single Frame / First Frame + Consecutive Frame */
+static void handle_frame(const twai_message_t *rx)
+{
+    if (rx->identifier < OBD_RESP_ID_MIN || rx->identifier > OBD_RESP_ID_MAX)
+        return;
+    if (rx->data_length_code < 2)
+        return;
+
+    isotp_rx_t *st = &s_isotp[rx->identifier - OBD_RESP_ID_MIN];
+    uint8_t pci = rx->data[0] >> 4;
+
+    if (pci == 0x0) // Single Frame
+    {
+        int len = rx->data[0] & 0x0F;
+        if (len < 1 || len > 7 || len + 1 > rx->data_length_code)
+            return;
+
+        st->active = false;
+        deliver_message(rx->identifier, &rx->data[1], len);
+        return;
+    }
+
+    if (pci == 0x1) // First Frame
+    {
+        int total = ((rx->data[0] & 0x0F) << 8) | rx->data[1];
+        if (total < 8 || rx->data_length_code < 8)
+            return;
+        if (total > OBD_ISOTP_MAX)
+        {
+            ESP_LOGD(TAG, "0x%03X: risposta di %d byte troncata a %d", (unsigned)rx->identifier,
+                     total, OBD_ISOTP_MAX);
+            total = OBD_ISOTP_MAX; // i Consecutive Frame oltre vengono ignorati
+        }
+        if (!message_expected(rx->identifier, &rx->data[2]))
+            return;
+
+        st->active = true;
+        st->total = (uint16_t)total;
+        st->got = 6;
+        st->next_sn = 1;
+        memcpy(st->buf, &rx->data[2], 6);
+
+        isotp_send_flow_control(rx->identifier);
+        return;
+    }
+
+    if (pci == 0x2 && st->active) // Consecutive Frame
+    {
+        if ((rx->data[0] & 0x0F) != st->next_sn)
+        {
+            st->active = false; // sequenza persa: la richiesta scadrà per timeout
+            return;
+        }
+        st->next_sn = (st->next_sn + 1) & 0x0F;
+
+        int chunk = st->total - st->got;
+        if (chunk > 7)
+            chunk = 7;
+        if (chunk > rx->data_length_code - 1)
+            chunk = rx->data_length_code - 1;
+
+        memcpy(st->buf + st->got, &rx->data[1], (size_t)chunk);
+        st->got += (uint16_t)chunk;
+
+        if (st->got >= st->total)
+        {
+            st->active = false;
+            deliver_message(rx->identifier, st->buf, st->total);
+        }
+    }
+}
+
+/* Completa con timeout le richieste scadute */
+static void expire_requests(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    for (int i = 0; i < OBD_ENGINE_SLOTS; i++)
+    {
+        xSemaphoreTake(s_slots_mutex, portMAX_DELAY);
+
+        if (!s_slots[i].used || !tick_reached(now, s_slots[i].deadline))
+        {
+            xSemaphoreGive(s_slots_mutex);
+            continue;
+        }
+
+        obd_resp_t resp = {
+            .status = OBD_RESP_TIMEOUT,
+            .ecu_id = 0,
+            .data = NULL,
+            .len = 0,
+        };
+        complete_slot(i, &resp);
+    }
+}
+
+/* Task RX: unico lettore della coda TWAI */
+static void obd_rx_task(void *arg)
+{
+    (void)arg;
+    twai_message_t rx;
+
+    while (1)
+    {
+        if (can_bus_receive(&rx, pdMS_TO_TICKS(OBD_RX_POLL_MS)) == ESP_OK)
+            handle_frame(&rx);
+
+        expire_requests();
+    }
+}
+
+static uint16_t expected_responder(uint8_t service, const uint8_t *params, int n);
+
+static bool request_submit(uint8_t service, const uint8_t *params, int n, bool collect,
+                           uint32_t timeout_ms, obd_resp_cb_t cb, void *ctx)
+{
+    if (n < 0 || n > OBD_MAX_PIDS_PER_REQ || (n > 0 && !params) || !s_slots_mutex)
+        return false;
+
+    xSemaphoreTake(s_slots_mutex, portMAX_DELAY);
+
+    int idx = -1;
+    for (int i = 0; i < OBD_ENGINE_SLOTS; i++)
+    {
+        if (!s_slots[i].used)
+        {
+            idx = i;
+            break;
+        }
+    }
+
+    if (idx < 0)
+    {
+        xSemaphoreGive(s_slots_mutex);
         return false;
+    }
+
+    // registrata prima dell'invio: la risposta può arrivare subito
+    obd_req_slot_t *s = &s_slots[idx];
+    s->used = true;
+    s->service = service;
+    s->nparams = (uint8_t)n;
+    if (n > 0)
+        memcpy(s->params, params, (size_t)n);
+    s->seq = s_req_seq++;
+    s->collect = collect;
+    s->ecu_id = collect ? 0 : expected_responder(service, params, n);
+    s->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timeout_ms);
+    s->cb = cb;
+    s->ctx = ctx;
+
+    xSemaphoreGive(s_slots_mutex);
 
     twai_message_t tx = {
-        .identifier = 0x7DF,
+        .identifier = OBD_FUNC_REQ_ID,
         .data_length_code = 8,
-        .data = {0x02, 0x01, pid, 0, 0, 0, 0, 0}
+        .data = {0}
     };
 
+    tx.data[0] = (uint8_t)(n + 1);
+    tx.data[1] = service;
+    for (int i = 0; i < n; i++)
+        tx.data[2 + i] = params[i];
+
     if (can_bus_send(&tx) != ESP_OK)
+    {
+        obd_metrics_tx_fail();
+        xSemaphoreTake(s_slots_mutex, portMAX_DELAY);
+        s->used = false;
+        xSemaphoreGive(s_slots_mutex);
         return false;
+    }
 
-    twai_message_t rx;
-    TickType_t start = xTaskGetTickCount();
-    TickType_t timeout = pdMS_TO_TICKS(100);
+    return true;
+}
+
+bool obd_request_submit(uint8_t service, const uint8_t *params, int n,
+                        uint32_t timeout_ms, obd_resp_cb_t cb, void *ctx)
+{
+    return request_submit(service, params, n, false, timeout_ms, cb, ctx);
+}
+
+bool obd_request_broadcast(uint8_t service, const uint8_t *params, int n,
+                           uint32_t timeout_ms, obd_resp_cb_t cb, void *ctx)
+{
+    return request_submit(service, params, n, true, timeout_ms, cb, ctx);
+}
+
+void obd_engine_start(void)
+{
+    memset(s_slots, 0, sizeof(s_slots));
+    memset(s_isotp, 0, sizeof(s_isotp));
+    s_slots_mutex = xSemaphoreCreateMutex();
 
-    while ((xTaskGetTickCount() - start) < timeout)
+    // Sopra obd_rt: le risposte vanno smaltite prima di nuove richieste
+    xTaskCreatePinnedToCore(obd_rx_task, "obd_rx", APP_OBD_RX_STACK, NULL, APP_OBD_RX_PRIO, NULL,
+                            APP_CORE(APP_CORE_CAN));
+}
+
+/* -------------------------------------------------------
+ * Letture bloccanti (wrapper sul motore asincrono)
+ * ------------------------------------------------------- */
+typedef struct
+{
+    SemaphoreHandle_t done;
+    obd_pid_cb_t cb;
+    void *ctx;
+    int count;
+} sync_read_t;
+
+static void sync_read_done(const obd_resp_t *resp, void *arg)
+{
+    sync_read_t *r = (sync_read_t *)arg;
+
+    if (resp->status == OBD_RESP_OK)
+        r->count = obd_parse_mode01(resp->data, resp->len, r->cb, r->ctx);
+
+    xSemaphoreGive(r->done);
+}
+
+int obd_read_pids(const uint8_t *pids, int n, obd_pid_cb_t cb, void *ctx)
+{
+    if (!pids || n <= 0 || n > OBD_MAX_PIDS_PER_REQ)
+        return -1;
+
+    sync_read_t r = {
+        .done = xSemaphoreCreateBinary(),
+        .cb = cb,
+        .ctx = ctx,
+        .count = 0,
+    };
+
+    if (!r.done)
+        return -1;
+
+    if (!obd_request_submit(0x01, pids, n, OBD_RESP_TIMEOUT_MS, sync_read_done, &r))
     {
-        if (can_bus_receive(&rx, pdMS_TO_TICKS(50)) == ESP_OK)
-        {
-            if (rx.identifier >= 0x7E8 &&
-                rx.identifier <= 0x7EF &&
-                rx.data_length_code >= 3 &&
-                rx.data[2] == pid)
-            {
-                for (int i = 0; i < 4; i++)
-                    out[i] = rx.data[i + 3];
+        vSemaphoreDelete(r.done);
+        return -1;
+    }
+
+    // la callback arriva sempre (al più allo scadere del timeout)
+    xSemaphoreTake(r.done, portMAX_DELAY);
+    vSemaphoreDelete(r.done);
+    return r.count;
+}
+
+/* -------------------------------------------------------
+ * Discovery PID supportati (bitmap 0x00, 0x20, ... 0xE0)
+ * ------------------------------------------------------- */
+#ifndef OBD_DISCOVERY_RETRIES
+// Tentativi se nessuna ECU risponde (es. quadro appena acceso)
+#define OBD_DISCOVERY_RETRIES 3
+#endif
+
+#define OBD_DISCOVERY_TIMEOUT_MS 150
+
+static obd_pid_map_t s_pid_map;
+
+typedef struct
+{
+    SemaphoreHandle_t done;
+    uint8_t next_mask; // bit k: l'ECU ha dichiarato il blocco 0x20*k supportato
+} discovery_ctx_t;
+
+static void on_bitmap_pid(uint8_t pid, const uint8_t *data, uint8_t len, void *arg)
+{
+    uint32_t ecu_id = *(const uint32_t *)arg;
+
+    if ((pid & 0x1F) != 0 || len != 4)
+        return;
+
+    int e = -1;
+    for (int i = 0; i < s_pid_map.ecu_count; i++)
+        if (s_pid_map.ecu[i].id == ecu_id)
+            e = i;
+
+    if (e < 0)
+    {
+        if (s_pid_map.ecu_count >= OBD_ECU_COUNT)
+            return;
+        e = s_pid_map.ecu_count++;
+        s_pid_map.ecu[e].id = (uint16_t)ecu_id;
+    }
+
+    s_pid_map.ecu[e].bitmap[pid >> 5] = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                                        ((uint32_t)data[2] << 8) | data[3];
+}
+
+static void on_discovery_resp(const obd_resp_t *resp, void *arg)
+{
+    discovery_ctx_t *d = (discovery_ctx_t *)arg;
+
+    if (resp->status == OBD_RESP_TIMEOUT)
+    {
+        xSemaphoreGive(d->done);
+        return;
+    }
+
+    if (resp->status == OBD_RESP_OK)
+    {
+        uint32_t ecu_id = resp->ecu_id;
+        obd_parse_mode01(resp->data, resp->len, on_bitmap_pid, &ecu_id);
+    }
+}
+
+/* Un round: chiede i blocchi [first, first+n) in un'unica richiesta multi-PID */
+static bool discovery_round(uint8_t first_block, int n)
+{
+    uint8_t pids[OBD_MAX_PIDS_PER_REQ];
+    discovery_ctx_t d = {.done = xSemaphoreCreateBinary()};
+
+    if (!d.done)
+        return false;
+
+    for (int i = 0; i < n; i++)
+        pids[i] = (uint8_t)((first_block + i) << 5);
+
+    bool ok = obd_request_broadcast(0x01, pids, n, OBD_DISCOVERY_TIMEOUT_MS, on_discovery_resp, &d);
+    if (ok)
+        xSemaphoreTake(d.done, portMAX_DELAY);
+
+    vSemaphoreDelete(d.done);
+    return ok;
+}
+
+bool obd_discover_pids(void)
+{
+    memset(&s_pid_map, 0, sizeof(s_pid_map));
+
+    for (int attempt = 0; attempt < OBD_DISCOVERY_RETRIES && s_pid_map.ecu_count == 0; attempt++)
+    {
+        // 0x00..0xA0 in una richiesta, 0xC0/0xE0 solo se qualcuno li annuncia
+        discovery_round(0, OBD_MAX_PIDS_PER_REQ);
+    }
+
+    if (s_pid_map.ecu_count == 0)
+    {
+        ESP_LOGW(TAG, "Discovery PID: nessuna ECU ha risposto, polling completo");
+        return false;
+    }
+
+    for (int block = OBD_MAX_PIDS_PER_REQ; block < 8; block += OBD_MAX_PIDS_PER_REQ)
+    {
+        bool wanted = false;
+        for (int e = 0; e < s_pid_map.ecu_count; e++)
+            if (s_pid_map.ecu[e].bitmap[block - 1] & 1UL)
+                wanted = true;
+        if (!wanted)
+            break;
+
+        int n = 8 - block;
+        if (n > OBD_MAX_PIDS_PER_REQ)
+            n = OBD_MAX_PIDS_PER_REQ;
+        discovery_round((uint8_t)block, n);
+    }
+
+    s_pid_map.done = true;
 
-                return true;
-            }
+    for (int e = 0; e < s_pid_map.ecu_count; e++)
+        ESP_LOGI(TAG, "ECU 0x%03X: PID 01-20 %08lX 21-40 %08lX 41-60 %08lX",
+                 (unsigned)s_pid_map.ecu[e].id,
+                 (unsigned long)s_pid_map.ecu[e].bitmap[0],
+                 (unsigned long)s_pid_map.ecu[e].bitmap[1],
+                 (unsigned long)s_pid_map.ecu[e].bitmap[2]);
+    return true;
+}
+
+static bool ecu_supports(int e, uint8_t pid)
+{
+    if ((pid & 0x1F) == 0)
+        return true; // le bitmap stesse
+
+    // bit 31 del blocco = PID base+1
+    uint8_t block = (uint8_t)((pid - 1) >> 5);
+    uint32_t bit = 1UL << (31 - ((pid - 1) & 0x1F));
+
+    return (s_pid_map.ecu[e].bitmap[block] & bit) != 0;
+}
+
+/* Richiesta funzionale a una sola risposta: la aspetta dall'ECU che dichiara
+   più PID tra quelli chiesti (a pari merito l'id più basso, 0x7E8 = motore).
+   Le altre ECU ricevono la stessa richiesta: senza questo una loro risposta
+   tardiva chiuderebbe la richiesta più recente con gli stessi PID. */
+static uint16_t expected_responder(uint8_t service, const uint8_t *params, int n)
+{
+    if (service != 0x01 || n <= 0 || !s_pid_map.done)
+        return 0;
+
+    uint16_t best = 0;
+    int best_hits = 0;
+    for (int e = 0; e < s_pid_map.ecu_count; e++)
+    {
+        int hits = 0;
+        for (int k = 0; k < n; k++)
+            hits += ecu_supports(e, params[k]);
+        if (hits > best_hits || (hits == best_hits && hits > 0 && s_pid_map.ecu[e].id < best))
+        {
+            best = s_pid_map.ecu[e].id;
+            best_hits = hits;
         }
     }
+    return best;
+}
 
+bool obd_pid_supported(uint8_t pid)
+{
+    if (!s_pid_map.done)
+        return true; // discovery non riuscita: non escludere nulla
+
+    for (int e = 0; e < s_pid_map.ecu_count; e++)
+        if (ecu_supports(e, pid))
+            return true;
     return false;
 }
 
+void obd_get_pid_map(obd_pid_map_t *out)
+{
+    if (out)
+        *out = s_pid_map;
+}
+
+/* -------------------------------------------------------
+ * Lettura singolo PID via CAN HAL
+ * ------------------------------------------------------- */
+static void copy_single_pid(uint8_t pid, const uint8_t *data, uint8_t len, void *ctx)
+{
+    (void)pid;
+    uint8_t *out = (uint8_t *)ctx;
+    memcpy(out, data, len > 4 ? 4 : len);
+}
+
+bool obd_read_pid(uint8_t pid, uint8_t out[4])
+{
+    if (!out)
+        return false;
+
+    memset(out, 0, 4);
+    return obd_read_pids(&pid, 1, copy_single_pid, out) == 1;
+}
+
 /* -------------------------------------------------------
  * Inizializzazione OBD Layer
  * ------------------------------------------------------- */
 void obd_init(void)
 {
     obd_data_init();  // inizializza storage + mutex
+    obd_engine_start();
+    obd_dtc_start();    // letture DTC su richiesta, cache per il web
 
     ESP_LOGI(TAG, "OBD layer started. Using CAN HAL.");
 
+    // PID non supportati esclusi dal polling, slot liberati ai restanti
+    if (obd_discover_pids())
+        obd_data_apply_pid_support();
+
     // Avvia lo scheduler real-time
     obd_data_start_polling();
 }
@@ -7,41 +7,286 @@ extern "C"
 {
 #endif
 
+    /* Campi pubblicati: uno per riga della tabella dei descrittori
+       (obd_fields.c). L'indice è anche la posizione nel frame di
+       /data.bin e nel registro in flash: nuovi campi in fondo. */
+    typedef enum
+    {
+        OBD_F_RPM = 0,
+        OBD_F_SPEED,
+        OBD_F_LOAD,
+        OBD_F_THROTTLE,
+        OBD_F_TIMING,
+        OBD_F_COOLANT,
+        OBD_F_INTAKE_TEMP,
+        OBD_F_AMBIENT,
+        OBD_F_MAP,
+        OBD_F_BARO,
+        OBD_F_MAF,
+        OBD_F_FUEL_LEVEL,
+        OBD_F_FUEL_PRESS,
+        OBD_F_TRIM_SHORT,
+        OBD_F_TRIM_LONG,
+        OBD_F_BATTERY,
+        OBD_F_DIST_MIL,
+        OBD_F_DTC_COUNT,
+        // derivati (obd_derived.c): nessun PID, calcolati dai campi sopra
+        OBD_F_FUEL_RATE,
+        OBD_F_ECON,
+        OBD_F_ECON_TRIP,
+        OBD_F_TRIP_DIST,
+        OBD_F_TRIP_FUEL,
+        OBD_F_GEAR,
+        OBD_F_T_0_100,
+        OBD_F_T_80_120,
+        OBD_FIELD_COUNT
+    } obd_field_t;
+
+    /* Valori in fixed-point: valore fisico = v[f] / obd_field_div(f) */
     typedef struct
     {
-        uint16_t rpm;               // PID 0x0C
-        uint8_t speed;              // PID 0x0D
-        float engine_load;          // PID 0x04 (%)
-        float throttle_pos;         // PID 0x11 (%)
-        float timing_advance;       // PID 0x0E (deg)
-        int16_t coolant_temp;       // PID 0x05 (°C)
-        int16_t intake_air_temp;    // PID 0x0F (°C)
-        int16_t ambient_temp;       // PID 0x46 (°C)
-        uint8_t intake_pressure;    // PID 0x0B (kPa)
-        float barometric_press;     // PID 0x33 (kPa)
-        float maf_rate;             // PID 0x10 (g/s)
-        float fuel_level;           // PID 0x2F (%)
-        float fuel_pressure;        // PID 0x0A (kPa)
-        float fuel_trim_short;      // PID 0x06 (%)
-        float fuel_trim_long;       // PID 0x07 (%)
-        float battery_voltage;      // PID 0x42 (V)
-        uint16_t distance_with_mil; // PID 0x21 (km)
-        uint8_t dtc_count;          // PID 0x01 (count)
+        int32_t v[OBD_FIELD_COUNT];
     } obd_full_data_t;
 
+    /* Snapshot pubblicato dal task RT (seqlock, nessun lock per i lettori) */
+    typedef struct
+    {
+        obd_full_data_t data;
+        uint32_t seq;                        // generazione (cresce a ogni pubblicazione)
+        uint32_t field_ms[OBD_FIELD_COUNT];  // ultimo aggiornamento del campo (0 = mai)
+        uint32_t field_seq[OBD_FIELD_COUNT]; // generazione dell'ultimo aggiornamento
+    } obd_snapshot_t;
+
+    /* ---- Descrittori dei PID (obd_fields.c) ----
+       Una riga per campo: decodifica, serializzazione e job di default
+       dello scheduler derivano tutti da qui. Decodifica solo intera:
+         raw   = A (bytes 1, eventualmente & mask) oppure A*256+B (bytes 2)
+         fixed = (raw * mul + add) / den   arrotondata (o troncata)
+       dove fixed ha già la scala di div (es. load in decimi di %).
+       Campi derivati: bytes = 0, nessun PID né job, solo chiave e scala. */
+    typedef struct
+    {
+        uint8_t pid;
+        uint8_t bytes;      // 1 o 2 (0 = derivato)
+        uint8_t mask;       // su A (0 = nessuna)
+        bool trunc;         // divisione troncata come la formula SAE
+        int32_t mul;
+        int32_t add;
+        int32_t den;
+        int32_t div;        // valore fisico = fixed / div (decimali del JSON)
+        const char *key;    // chiave JSON di /data
+        const char *unit;
+        uint16_t period_ms; // periodo di default dello scheduler
+        uint8_t prio;       // 0 = alta, 1 = media, 2 = bassa
+    } obd_pid_desc_t;
+
+    const obd_pid_desc_t *obd_field_desc(obd_field_t f);
+    int32_t obd_field_decode(obd_field_t f, const uint8_t b[4]);
+    int32_t obd_field_fixed(const obd_full_data_t *d, obd_field_t f);
+    float obd_field_value(const obd_full_data_t *d, obd_field_t f); // per display
+    int obd_field_div(obd_field_t f);
+    const char *obd_field_key(obd_field_t f); // chiave JSON di /data
+    const char *obd_field_unit(obd_field_t f);
+    int obd_field_for_pid(uint8_t pid);       // -1 se nessun campo
+
     /* Inizializza il driver CAN e lo storage dati */
     void obd_init(void);
 
-    /* Legge un singolo PID (usata internamente dallo scheduler) */
+    /* Numero massimo di PID per singola richiesta Mode 01 (limite OBD-II) */
+#ifndef OBD_MAX_PIDS_PER_REQ
+#define OBD_MAX_PIDS_PER_REQ 6
+#endif
+
+    /* Callback per ogni PID presente in una risposta Mode 01 */
+    typedef void (*obd_pid_cb_t)(uint8_t pid, const uint8_t *data, uint8_t len, void *ctx);
+
+    /* ---- Motore richieste asincrono (obd.c) ---- */
+
+    /* Richieste contemporaneamente in volo gestite dal dispatcher RX */
+#ifndef OBD_ENGINE_SLOTS
+#define OBD_ENGINE_SLOTS 8
+#endif
+
+    typedef enum
+    {
+        OBD_RESP_OK = 0,
+        OBD_RESP_TIMEOUT,
+        OBD_RESP_NEGATIVE,
+    } obd_resp_status_t;
+
+    typedef struct
+    {
+        obd_resp_status_t status;
+        uint32_t ecu_id;     // 0x7E8..0x7EF (0 su timeout)
+        uint8_t service;     // servizio richiesto (0x01, 0x03, ...)
+        const uint8_t *data; // payload dopo il SID di risposta
+        int len;             // byte validi in data
+    } obd_resp_t;
+
+    /* Completamento di una richiesta: chiamata dal task RX, deve essere breve */
+    typedef void (*obd_resp_cb_t)(const obd_resp_t *resp, void *ctx);
+
+    /* Avvia il task RX che possiede la coda TWAI */
+    void obd_engine_start(void);
+
+    /* Invia una richiesta (SID + max 6 parametri) senza attendere la risposta.
+       cb viene chiamata esattamente una volta (risposta o timeout).
+       Dopo la discovery una richiesta Mode 01 accetta solo l'ECU che
+       dichiara più PID tra quelli chiesti; le risposte delle altre ECU
+       (anche negative) sono scartate.
+       Ritorna false se la tabella è piena o la trasmissione fallisce. */
+    bool obd_request_submit(uint8_t service, const uint8_t *params, int n,
+                            uint32_t timeout_ms, obd_resp_cb_t cb, void *ctx);
+
+    /* Come obd_request_submit ma raccoglie le risposte di tutte le ECU:
+       cb per ogni risposta, poi una volta con OBD_RESP_TIMEOUT alla scadenza. */
+    bool obd_request_broadcast(uint8_t service, const uint8_t *params, int n,
+                               uint32_t timeout_ms, obd_resp_cb_t cb, void *ctx);
+
+    /* Scompone un payload Mode 01 (PID, dati...) chiamando cb per ogni PID.
+       Ritorna il numero di PID trovati. */
+    int obd_parse_mode01(const uint8_t *data, int len, obd_pid_cb_t cb, void *ctx);
+
+    /* Legge un singolo PID (bloccante, per usi fuori dallo scheduler) */
     bool obd_read_pid(uint8_t pid, uint8_t out[4]);
 
+    /* Legge fino a OBD_MAX_PIDS_PER_REQ PID in un'unica richiesta (bloccante).
+       La risposta (anche multi-frame ISO-TP) viene scomposta e per ogni
+       PID ricevuto viene chiamata cb. Ritorna il numero di PID ricevuti,
+       -1 se la trasmissione fallisce. */
+    int obd_read_pids(const uint8_t *pids, int n, obd_pid_cb_t cb, void *ctx);
+
+    /* Numero di byte dati di un PID Mode 01 (0 se sconosciuto) */
+    uint8_t obd_pid_data_len(uint8_t pid);
+
+    /* ---- Discovery PID supportati (obd.c) ---- */
+
+    typedef struct
+    {
+        bool done;         // almeno una ECU ha risposto
+        uint8_t ecu_count;
+        struct
+        {
+            uint16_t id;        // 0x7E8..0x7EF
+            uint32_t bitmap[8]; // [k] = risposta al PID 0x20*k (bit 31 = PID 0x20*k+1)
+        } ecu[8];
+    } obd_pid_map_t;
+
+    /* Interroga le bitmap 0x00, 0x20, ... di tutte le ECU (bloccante) */
+    bool obd_discover_pids(void);
+
+    /* true se almeno una ECU supporta il PID (o se la discovery non è riuscita) */
+    bool obd_pid_supported(uint8_t pid);
+
+    void obd_get_pid_map(obd_pid_map_t *out);
+
     /* Funzioni di gestione dati (obd_data.c) */
     void obd_data_init(void);
     void obd_data_start_polling(void);
 
+    /* Disattiva i job non supportati e ridistribuisce i loro slot */
+    void obd_data_apply_pid_support(void);
+
+    /* Job dello scheduler (tabella statica + registrati), max 65535 */
+#ifndef OBD_MAX_JOBS
+#define OBD_MAX_JOBS 64
+#endif
+
+    /* Registra un PID Mode 01 da interrogare ogni period_ms (o cambia il
+       periodo di uno già presente). Solo prima dell'avvio del polling.
+       Ritorna false se il periodo è sotto OBD_MIN_PERIOD_MS, se la tabella
+       è piena o se l'admission control stima che il bus non lo sostenga. */
+    bool obd_data_add_job(uint8_t pid, uint8_t prio, uint32_t period_ms);
+
+    /* Stato dei job dello scheduler (per il web server) */
+    typedef struct
+    {
+        uint8_t pid;
+        uint8_t prio;            // 0 = alta, 1 = media, 2 = bassa
+        bool supported;
+        uint32_t period_ms;      // periodo effettivo
+        uint32_t base_period_ms; // periodo di tabella
+        uint32_t updates;        // risposte valide ricevute
+        uint32_t deadline_misses; // periodi chiusi senza aggiornamento
+        bool watched;            // richiesto da una sottoscrizione
+    } obd_job_info_t;
+
+    int obd_data_get_jobs(obd_job_info_t *out, int max);
+
+    /* ---- Sottoscrizioni (polling su richiesta dei client) ---- */
+
+#ifndef OBD_SUB_MAX_CLIENTS
+#define OBD_SUB_MAX_CLIENTS 6
+#endif
+#ifndef OBD_SUB_MAX_PIDS
+#define OBD_SUB_MAX_PIDS 24
+#endif
+#ifndef OBD_SUB_KEEPALIVE_MS
+// Periodo dei PID che nessuno guarda mentre c'è almeno una sottoscrizione
+#define OBD_SUB_KEEPALIVE_MS 5000
+#endif
+#define OBD_SUB_ALL (-1)
+
+    typedef struct
+    {
+        uint8_t pid;
+        uint16_t period_ms; // 0 = periodo di tabella
+    } obd_sub_item_t;
+
+    /* Sostituisce la sottoscrizione del client owner (n = 0 la ritira).
+       I periodi sono limitati a [OBD_MIN_PERIOD_MS, OBD_SUB_KEEPALIVE_MS];
+       se il bus non regge, i PID osservati rallentano in proporzione.
+       Ritorna false se la tabella dei client è piena. */
+    bool obd_data_subscribe(int owner, const obd_sub_item_t *items, int n);
+
+    /* Ritira la sottoscrizione di owner (OBD_SUB_ALL = tutte) */
+    void obd_data_unsubscribe(int owner);
+
+    /* Tutte le sottoscrizioni scadono tra grace_ms se non rinnovate
+       (un client si è disconnesso e non si sa quale) */
+    void obd_data_sub_grace(uint32_t grace_ms);
+
     /* Funzione per il Web Server */
     obd_full_data_t obd_get_all_data(void);
 
+    /* Copia coerente dell'ultimo snapshot; ritorna la sua generazione */
+    uint32_t obd_get_snapshot(obd_snapshot_t *out);
+
+    /* Generazione corrente: se non cambia, i dati non sono cambiati */
+    uint32_t obd_data_seq(void);
+
+    /* Pubblica dati completi (unico scrittore: non usare col polling attivo) */
+    void obd_data_set(const obd_full_data_t *src);
+
+    /* Applica un payload di risposta Mode 01 (PID, dati...) con la stessa
+       decodifica dello scheduler e pubblica, es. per il replay di una
+       traccia. Unico scrittore: non usare col polling attivo.
+       Ritorna il numero di campi aggiornati. */
+    int obd_data_apply_mode01(const uint8_t *data, int len);
+
+    /* Notifica di nuova pubblicazione: la callback gira nel task RT subito
+       dopo ogni snapshot, deve solo segnalare (es. xSemaphoreGive) */
+#ifndef OBD_DATA_MAX_LISTENERS
+#define OBD_DATA_MAX_LISTENERS 4
+#endif
+    typedef void (*obd_publish_cb_t)(uint32_t seq, void *ctx);
+
+    bool obd_data_add_listener(obd_publish_cb_t cb, void *ctx);
+
+    /* Latenza RX -> RT: dal completamento di una richiesta nel task RX
+       alla sua presa in carico nel task RT. Cresce se il task RT aspetta
+       la CPU (core conteso dal carico web, priorità più alte). */
+    typedef struct
+    {
+        uint32_t batches;    // risposte prese in carico dall'avvio
+        uint32_t window;     // risposte nella finestra corrente
+        uint32_t lat_avg_us; // media nella finestra
+        uint32_t lat_max_us; // massimo nella finestra
+    } obd_rt_stats_t;
+
+    /* reset = true chiude la finestra (la prossima lettura parte da qui) */
+    void obd_data_get_rt_stats(obd_rt_stats_t *out, bool reset);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
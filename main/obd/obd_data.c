@@ -1,35 +1,72 @@
 #include "obd.h"
+#include "obd_dtc.h"
+#include "obd_derived.h"
+#include "obd_history.h"
+#include "obd_metrics.h"
+#include "obd_pace.h"
+#include "app_tasks.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 static const char *TAG = "OBD_DATA";
 
 /* -------------------------------------------------------
- * Dipendenza: lettura PID da obd.c (DEVE essere visibile)
+ * Dipendenza: motore richieste da obd.c (DEVE essere visibile)
  * ------------------------------------------------------- */
-extern bool obd_read_pid(uint8_t pid, uint8_t out[4]);
+extern bool obd_request_submit(uint8_t service, const uint8_t *params, int n,
+                               uint32_t timeout_ms, obd_resp_cb_t cb, void *ctx);
 
 /* -------------------------------------------------------
- * Storage dati condivisi (come prima)
+ * Storage dati condivisi: seqlock a scrittore singolo (task RT).
+ * s_seq dispari = scrittura in corso. Lo scrittore non attende mai,
+ * i lettori ripetono la copia se s_seq è cambiato nel frattempo.
  * ------------------------------------------------------- */
-static obd_full_data_t s_obd;
-static SemaphoreHandle_t s_obd_mutex;
+static obd_snapshot_t s_obd;
+static atomic_uint s_seq;
+
+#ifndef OBD_SNAPSHOT_SPIN
+// Tentativi a vuoto prima che un lettore ceda la CPU allo scrittore
+#define OBD_SNAPSHOT_SPIN 64
+#endif
 
 /* -------------------------------------------------------
- * Scheduler a priorità
+ * Scheduler EDF (earliest deadline first)
+ *
+ * Ogni job ha un rilascio (next_due_ms) e una deadline: l'istante entro
+ * cui deve arrivare il prossimo aggiornamento (rilascio + periodo).
+ * I job in attesa stanno in un min-heap per rilascio, quelli rilasciati
+ * in un min-heap per deadline: la scelta costa O(log n) anche con
+ * centinaia di PID. A parità di deadline decide la priorità di classe.
+ * Con carico ammesso (admission control) tutte le deadline sono
+ * rispettabili; in sovraccarico il ritardo si ripartisce tra le classi
+ * invece di affamare le più basse.
  * ------------------------------------------------------- */
 
-#ifndef OBD_REQ_SPACING_MS
-// Spaziatura minima tra richieste CAN OBD.
-// 25ms ≈ 40 req/s teoriche; su molte ECU 30ms è più sicuro.
-// Se noti instabilità, porta a 30-40ms.
-#define OBD_REQ_SPACING_MS 25
+/* Spaziatura tra richieste e richieste in volo: obd_pace.h (adattive) */
+
+#ifndef OBD_BATCH_LOOKAHEAD_MS
+// Un job che scade entro questa finestra viene accorpato alla richiesta
+// multi-PID corrente invece di attendere un giro dedicato.
+// 0 = la spaziatura corrente tra richieste.
+#define OBD_BATCH_LOOKAHEAD_MS 0
+#endif
+
+#ifndef OBD_REQ_TIMEOUT_MS
+#define OBD_REQ_TIMEOUT_MS 100
+#endif
+
+#ifndef OBD_MIN_PERIOD_MS
+// Periodo minimo raggiungibile quando la discovery libera slot sul bus
+#define OBD_MIN_PERIOD_MS 50
 #endif
 
 #ifndef OBD_FAIL_BACKOFF_MS
@@ -42,6 +79,32 @@ static SemaphoreHandle_t s_obd_mutex;
 #define OBD_FAIL_THRESHOLD 5
 #endif
 
+#ifndef OBD_ISOLATE_AFTER
+// Fail consecutivi dopo cui un job viene richiesto da solo: un PID che
+// non risponde mai non deve far scadere le richieste dei vicini
+#define OBD_ISOLATE_AFTER 2
+#endif
+
+#ifndef OBD_SCHED_RM
+// 1 = rate-monotonic (periodo più breve prima) invece di EDF
+#define OBD_SCHED_RM 0
+#endif
+
+#ifndef OBD_ADMIT_PIDS_PER_REQ
+// PID medi per richiesta assunti dall'admission control (massimo 6;
+// misurati ~2.6 col carico di tabella, di più quando il bus è pieno)
+#define OBD_ADMIT_PIDS_PER_REQ 3
+#endif
+
+#ifndef OBD_ADMIT_UTIL_PCT
+// Quota del budget bus assegnabile ai job (margine per retry e discovery)
+#define OBD_ADMIT_UTIL_PCT 90
+#endif
+
+// Capacità in millesimi di PID/s: (1000 / spacing) req/s * PID/req * quota
+#define OBD_ADMIT_CAPACITY_MPPS \
+    ((uint32_t)(1000000U / OBD_REQ_SPACING_MS) * OBD_ADMIT_PIDS_PER_REQ * OBD_ADMIT_UTIL_PCT / 100U)
+
 typedef enum
 {
     PID_PRIO_HIGH = 0,
@@ -54,242 +117,823 @@ typedef struct
     uint8_t pid;
     pid_prio_t prio;
     uint32_t period_ms;     // 100 / 500 / 2000
-    uint32_t next_due_ms;   // scheduling assoluto (ms)
+    uint32_t next_due_ms;   // rilascio (scheduling assoluto, ms); include il backoff
     uint8_t fail_count;     // fail consecutivi
-    uint32_t backoff_until; // se > now, non richiedere
+    bool in_flight;         // già in una richiesta in attesa di risposta
+    bool unsupported;       // escluso dalla discovery: mai richiesto
+    uint32_t base_period_ms; // periodo di tabella (period_ms può essere ridotto)
+    uint32_t deadline_ms;   // entro quando serve il prossimo aggiornamento
+    uint32_t updates;       // aggiornamenti riusciti
+    uint32_t misses;        // periodi chiusi senza aggiornamento
+    uint16_t ecu_id;        // ultima ECU che ha risposto (0 = nessuna)
+    uint32_t norm_period_ms; // periodo senza sottoscrizioni (dopo la discovery)
+    bool watched;           // richiesto da almeno una sottoscrizione
 } pid_job_t;
 
-/* Tabella PID secondo la tua specifica */
-static pid_job_t s_jobs[] = {
-    // ALTA 100ms
-    {0x0C, PID_PRIO_HIGH, 100, 0, 0, 0}, // rpm
-    {0x0D, PID_PRIO_HIGH, 100, 0, 0, 0}, // speed
-    {0x04, PID_PRIO_HIGH, 100, 0, 0, 0}, // load
-    {0x11, PID_PRIO_HIGH, 100, 0, 0, 0}, // throttle
-
-    // MEDIA 500ms
-    {0x0E, PID_PRIO_MED, 500, 0, 0, 0}, // timing
-    {0x10, PID_PRIO_MED, 500, 0, 0, 0}, // maf
-    {0x05, PID_PRIO_MED, 500, 0, 0, 0}, // coolant
-    {0x0F, PID_PRIO_MED, 500, 0, 0, 0}, // intake temp
-    {0x0B, PID_PRIO_MED, 500, 0, 0, 0}, // press_intake (MAP)
-    {0x33, PID_PRIO_MED, 500, 0, 0, 0}, // press_baro
-    {0x42, PID_PRIO_MED, 500, 0, 0, 0}, // batt
-
-    // BASSA 2000ms
-    {0x46, PID_PRIO_LOW, 2000, 0, 0, 0}, // temp_ambient
-    {0x2F, PID_PRIO_LOW, 2000, 0, 0, 0}, // fuel_lvl
-    {0x0A, PID_PRIO_LOW, 2000, 0, 0, 0}, // fuel_press
-    {0x06, PID_PRIO_LOW, 2000, 0, 0, 0}, // fuel_trim_s
-    {0x07, PID_PRIO_LOW, 2000, 0, 0, 0}, // fuel_trim_l
-    {0x21, PID_PRIO_LOW, 2000, 0, 0, 0}, // dist_mil
-    {0x01, PID_PRIO_LOW, 2000, 0, 0, 0}, // dtc
-};
+/* Job dello scheduler: le prime voci vengono dalla tabella dei PID
+   (obd_fields.c) al primo uso, le altre (pid 0 = libera) sono per
+   obd_data_add_job */
+static pid_job_t s_jobs[OBD_MAX_JOBS];
+
+static int s_njobs;           // voci usate di s_jobs (calcolato da jobs_init)
+static uint32_t s_demand_mpps; // domanda dei job attivi, millesimi di PID/s
+static bool s_polling;        // task RT avviato: s_jobs è suo
+
+/* Job di default dalla tabella dei PID, in ordine di priorità e poi di
+   campo. Al primo uso: obd_data_add_job può precedere obd_init() */
+static void jobs_init(void)
+{
+    if (s_njobs)
+        return;
+
+    for (int prio = PID_PRIO_HIGH; prio <= PID_PRIO_LOW; prio++)
+    {
+        for (int f = 0; f < OBD_FIELD_COUNT && s_njobs < OBD_MAX_JOBS; f++)
+        {
+            const obd_pid_desc_t *d = obd_field_desc((obd_field_t)f);
+            if (d->prio != prio || d->period_ms == 0)
+                continue;
+
+            pid_job_t *j = &s_jobs[s_njobs++];
+            j->pid = d->pid;
+            j->prio = (pid_prio_t)d->prio;
+            j->period_ms = d->period_ms;
+            j->base_period_ms = d->period_ms;
+            j->norm_period_ms = d->period_ms;
+            s_demand_mpps += 1000000U / d->period_ms;
+        }
+    }
+}
+
+/* -------------------------------------------------------
+ * Code a priorità dei job (min-heap di indici in s_jobs)
+ * ------------------------------------------------------- */
+typedef struct
+{
+    uint16_t idx[OBD_MAX_JOBS];
+    int n;
+    bool by_deadline; // false: per rilascio (attesa), true: per deadline (pronti)
+} job_heap_t;
+
+static job_heap_t s_wait = {.by_deadline = false};
+static job_heap_t s_ready = {.by_deadline = true};
+
+/* Confronti con wrap-around dei ms (uint32) */
+static inline bool time_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+static bool heap_less(const job_heap_t *h, int a, int b)
+{
+    const pid_job_t *x = &s_jobs[h->idx[a]];
+    const pid_job_t *y = &s_jobs[h->idx[b]];
+
+    if (!h->by_deadline)
+        return time_before(x->next_due_ms, y->next_due_ms);
+
+#if OBD_SCHED_RM
+    if (x->period_ms != y->period_ms)
+        return x->period_ms < y->period_ms;
+#endif
+    if (x->deadline_ms != y->deadline_ms)
+        return time_before(x->deadline_ms, y->deadline_ms);
+    return x->prio < y->prio;
+}
+
+static void heap_swap(job_heap_t *h, int a, int b)
+{
+    uint16_t t = h->idx[a];
+    h->idx[a] = h->idx[b];
+    h->idx[b] = t;
+}
+
+static void heap_push(job_heap_t *h, int job)
+{
+    int i = h->n++;
+    h->idx[i] = (uint16_t)job;
+
+    while (i > 0 && heap_less(h, i, (i - 1) / 2))
+    {
+        heap_swap(h, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static int heap_pop(job_heap_t *h)
+{
+    int top = h->idx[0];
+    int i = 0;
+
+    h->idx[0] = h->idx[--h->n];
+    while (1)
+    {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < h->n && heap_less(h, l, m))
+            m = l;
+        if (r < h->n && heap_less(h, r, m))
+            m = r;
+        if (m == i)
+            break;
+        heap_swap(h, i, m);
+        i = m;
+    }
+    return top;
+}
+
+static inline const pid_job_t *heap_top(const job_heap_t *h)
+{
+    return &s_jobs[h->idx[0]];
+}
 
 static inline uint32_t now_ms(void)
 {
     return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
 }
 
-/* Applica i bytes letti al struct dati */
-static void apply_pid_value(obd_full_data_t *d, uint8_t pid, const uint8_t b[4])
+/* Applica i bytes letti al struct dati; ritorna il campo aggiornato (-1 se nessuno) */
+static int apply_pid_value(obd_full_data_t *d, uint8_t pid, const uint8_t b[4])
 {
-    switch (pid)
+    int f = obd_field_for_pid(pid);
+    if (f < 0)
+        return -1;
+
+    d->v[f] = obd_field_decode((obd_field_t)f, b);
+    return f;
+}
+
+/* Campo f appena applicato: ricalcola i derivati che ne dipendono, con
+   lo stesso istante e la stessa generazione */
+static void apply_derived(obd_snapshot_t *s, int f, uint32_t t, uint32_t seq)
+{
+    uint32_t mask = obd_derived_update(&s->data, (obd_field_t)f, t);
+
+    for (; mask; mask &= mask - 1)
     {
-    case 0x0C: // RPM ((A*256)+B)/4
-        d->rpm = (uint16_t)(((uint16_t)b[0] << 8) | b[1]) / 4;
-        break;
+        int g = __builtin_ctz(mask);
+        s->field_ms[g] = t;
+        s->field_seq[g] = seq;
+    }
+}
+
+static inline bool job_isolated(int i)
+{
+    return s_jobs[i].fail_count >= OBD_ISOLATE_AFTER;
+}
 
-    case 0x0D: // Speed A
-        d->speed = b[0];
-        break;
+/* Raggruppa fino a OBD_MAX_PIDS_PER_REQ job in un'unica richiesta:
+   prima i job già rilasciati in ordine di deadline, poi (a riempimento)
+   quelli che verranno rilasciati entro OBD_BATCH_LOOKAHEAD_MS.
+   Almeno uno deve essere già rilasciato. I job che falliscono
+   ripetutamente viaggiano da soli (OBD_ISOLATE_AFTER).
+   Ritorna il numero di job selezionati. */
+static int pick_due_batch(uint32_t tnow, uint32_t lookahead, int idx[OBD_MAX_PIDS_PER_REQ])
+{
+    int aside[OBD_MAX_PIDS_PER_REQ];
+    int n = 0, na = 0;
 
-    case 0x04: // Load (A*100)/255
-        d->engine_load = (float)b[0] * 100.0f / 255.0f;
-        break;
+    // rilascio: dalla coda d'attesa a quella dei pronti
+    while (s_wait.n > 0 && !time_before(tnow, heap_top(&s_wait)->next_due_ms))
+        heap_push(&s_ready, heap_pop(&s_wait));
 
-    case 0x11: // Throttle (A*100)/255
-        d->throttle_pos = (float)b[0] * 100.0f / 255.0f;
-        break;
+    if (s_ready.n == 0)
+        return 0;
 
-    case 0x0E: // Timing (A/2)-64
-        d->timing_advance = ((float)b[0] / 2.0f) - 64.0f;
-        break;
+    idx[n++] = heap_pop(&s_ready);
+    if (job_isolated(idx[0]))
+        return 1;
 
-    case 0x10: // MAF ((A*256)+B)/100
-        d->maf_rate = (float)(((uint16_t)b[0] << 8) | b[1]) / 100.0f;
-        break;
+    while (n < OBD_MAX_PIDS_PER_REQ && s_ready.n > 0 && na < OBD_MAX_PIDS_PER_REQ)
+    {
+        int k = heap_pop(&s_ready);
+        if (job_isolated(k))
+            aside[na++] = k;
+        else
+            idx[n++] = k;
+    }
 
-    case 0x05: // Coolant A-40
-        d->coolant_temp = (int16_t)b[0] - 40;
-        break;
+    while (n < OBD_MAX_PIDS_PER_REQ && s_wait.n > 0 &&
+           !time_before(tnow + lookahead, heap_top(&s_wait)->next_due_ms))
+    {
+        int k = heap_pop(&s_wait);
+        if (job_isolated(k))
+        {
+            heap_push(&s_wait, k); // resta in testa: il riempimento finisce qui
+            break;
+        }
+        idx[n++] = k;
+    }
 
-    case 0x0F: // Intake temp A-40
-        d->intake_air_temp = (int16_t)b[0] - 40;
-        break;
+    // i job in isolamento restano pronti per le prossime richieste
+    for (int i = 0; i < na; i++)
+        heap_push(&s_ready, aside[i]);
 
-    case 0x0B: // MAP A
-        d->intake_pressure = b[0];
-        break;
+    return n;
+}
 
-    case 0x33: // Baro A
-        d->barometric_press = (float)b[0];
-        break;
+/* Aggiorna lo stato di un job dopo una richiesta e lo rimette in attesa */
+static void job_complete(int i, bool ok, uint32_t tnow)
+{
+    pid_job_t *j = &s_jobs[i];
 
-    case 0x42: // Battery ((A*256)+B)/1000
-        d->battery_voltage = (float)(((uint16_t)b[0] << 8) | b[1]) / 1000.0f;
-        break;
+    j->in_flight = false;
 
-    case 0x46: // Ambient A-40
-        d->ambient_temp = (int16_t)b[0] - 40;
-        break;
+    if (ok)
+    {
+        j->fail_count = 0;
+        j->updates++;
 
-    case 0x2F: // Fuel level (A*100)/255
-        d->fuel_level = (float)b[0] * 100.0f / 255.0f;
-        break;
+        // ogni periodo intero trascorso oltre la deadline è una deadline persa
+        if (time_before(j->deadline_ms, tnow))
+            j->misses += 1 + (tnow - j->deadline_ms) / j->period_ms;
 
-    case 0x0A: // Fuel pressure A*3 (kPa) (spesso non supportato)
-        d->fuel_pressure = (float)b[0] * 3.0f;
-        break;
+        // programma prossimo giro su base periodica (non “now+period”)
+        // per mantenere la frequenza stabile anche se siamo in ritardo;
+        // oltre un periodo di ritardo i rilasci persi si saltano (niente raffiche)
+        j->next_due_ms += j->period_ms;
+        if (time_before(j->next_due_ms + j->period_ms, tnow))
+            j->next_due_ms = tnow;
 
-    case 0x06: // Short trim (A-128)*100/128
-        d->fuel_trim_short = ((float)b[0] - 128.0f) * 100.0f / 128.0f;
-        break;
+        j->deadline_ms = j->next_due_ms + j->period_ms;
+        heap_push(&s_wait, i);
+        return;
+    }
 
-    case 0x07: // Long trim (A-128)*100/128
-        d->fuel_trim_long = ((float)b[0] - 128.0f) * 100.0f / 128.0f;
-        break;
+    // fallimento: la deadline resta quella del periodo non ancora servito,
+    // così il retry è più urgente dei job puntuali
 
-    case 0x21: // Distance with MIL (A*256)+B
-        d->distance_with_mil = (uint16_t)(((uint16_t)b[0] << 8) | b[1]);
-        break;
+    j->fail_count++;
 
-    case 0x01: // DTC count: A & 0x7F
-        d->dtc_count = (uint8_t)(b[0] & 0x7F);
-        break;
+    // Se fallisce, riprova presto ma non spammare:
+    // - piccolo retry (period/2) finché sotto soglia
+    // - poi backoff progressivo
+    if (j->fail_count < OBD_FAIL_THRESHOLD)
+    {
+        j->next_due_ms = tnow + (j->period_ms / 2);
+    }
+    else
+    {
+        if (j->fail_count == OBD_FAIL_THRESHOLD)
+            obd_metrics_pid_backoff(j->pid);
 
-    default:
-        break;
+        uint32_t backoff = OBD_FAIL_BACKOFF_MS;
+        // backoff cresce con fail_count (cap a 20s)
+        uint32_t extra = (uint32_t)(j->fail_count - OBD_FAIL_THRESHOLD) * 1000U;
+        if (extra > 18000U)
+            extra = 18000U;
+
+        j->next_due_ms = tnow + backoff + extra + j->period_ms;
     }
+    heap_push(&s_wait, i);
 }
 
-/* Scelta del prossimo job da eseguire:
-   - prende quello "due" (now >= next_due), non in backoff
-   - priorità: HIGH > MED > LOW
-   - a parità: quello più in ritardo (now - next_due più grande)
-*/
-static int pick_next_job(uint32_t tnow)
+/* -------------------------------------------------------
+ * Sottoscrizioni: banda del bus a ciò che qualcuno sta guardando
+ *
+ * Ogni client (id scelto dal chiamante, es. il socket della WebSocket)
+ * dichiara i PID che mostra e a che periodo. Con almeno una
+ * sottoscrizione attiva i PID osservati vanno al periodo più breve
+ * richiesto, gli altri scendono al keep-alive OBD_SUB_KEEPALIVE_MS;
+ * senza sottoscrizioni vale la tabella. I client scrivono s_subs sotto
+ * s_sub_lock, il task RT applica ai job a ogni cambio di generazione.
+ * ------------------------------------------------------- */
+typedef struct
 {
-    int best = -1;
-    int best_prio = 999;
-    int32_t best_lateness = -2147483647;
+    bool used;
+    int owner;
+    uint32_t expires_ms; // 0 = finché il client non la ritira
+    uint8_t n;
+    obd_sub_item_t items[OBD_SUB_MAX_PIDS];
+} sub_client_t;
 
-    for (int i = 0; i < (int)(sizeof(s_jobs) / sizeof(s_jobs[0])); i++)
+static sub_client_t s_subs[OBD_SUB_MAX_CLIENTS];
+static SemaphoreHandle_t s_sub_lock;
+static atomic_uint s_sub_gen;     // cambia a ogni modifica di s_subs
+
+// stato del task RT
+static uint32_t s_sub_applied;    // generazione già applicata ai job
+static uint32_t s_sub_expiry;     // prossima scadenza (0 = nessuna)
+static uint16_t s_sub_want[256];  // periodo richiesto per PID (0 = non osservato)
+static uint32_t s_sub_table[8];   // bit = PID richiesto al periodo di tabella
+static uint32_t s_sub_period[OBD_MAX_JOBS];
+
+static inline bool sub_pending(uint32_t tnow)
+{
+    return atomic_load(&s_sub_gen) != s_sub_applied ||
+           (s_sub_expiry != 0 && !time_before(tnow, s_sub_expiry));
+}
+
+/* Raccoglie le richieste valide in s_sub_want/s_sub_table, scarta le
+   scadute. Ritorna true se c'è almeno una sottoscrizione. */
+static bool sub_collect(uint32_t tnow)
+{
+    bool any = false;
+
+    memset(s_sub_want, 0, sizeof(s_sub_want));
+    memset(s_sub_table, 0, sizeof(s_sub_table));
+    s_sub_expiry = 0;
+
+    xSemaphoreTake(s_sub_lock, portMAX_DELAY);
+    s_sub_applied = atomic_load(&s_sub_gen);
+
+    for (int c = 0; c < OBD_SUB_MAX_CLIENTS; c++)
+    {
+        sub_client_t *sc = &s_subs[c];
+        if (!sc->used)
+            continue;
+
+        if (sc->expires_ms)
+        {
+            if (!time_before(tnow, sc->expires_ms))
+            {
+                ESP_LOGI(TAG, "Sottoscrizione del client %d scaduta", sc->owner);
+                sc->used = false;
+                continue;
+            }
+            if (!s_sub_expiry || time_before(sc->expires_ms, s_sub_expiry))
+                s_sub_expiry = sc->expires_ms;
+        }
+
+        any = true;
+        for (int k = 0; k < sc->n; k++)
+        {
+            uint8_t pid = sc->items[k].pid;
+            uint32_t p = sc->items[k].period_ms;
+
+            if (p == 0)
+            {
+                s_sub_table[pid >> 5] |= 1UL << (pid & 31);
+                continue;
+            }
+            if (p < OBD_MIN_PERIOD_MS)
+                p = OBD_MIN_PERIOD_MS;
+            if (p > OBD_SUB_KEEPALIVE_MS)
+                p = OBD_SUB_KEEPALIVE_MS;
+            if (s_sub_want[pid] == 0 || p < s_sub_want[pid])
+                s_sub_want[pid] = (uint16_t)p;
+        }
+    }
+
+    xSemaphoreGive(s_sub_lock);
+    return any;
+}
+
+/* Ricalcola i periodi dei job dalle sottoscrizioni (task RT). Se i PID
+   osservati superano la capacità rimasta dopo il keep-alive, i loro
+   periodi scalano tutti dello stesso fattore (come la discovery). */
+static void sub_apply(uint32_t tnow)
+{
+    bool any = sub_collect(tnow);
+    uint32_t watch_mpps = 0, keep_mpps = 0;
+    int nwatch = 0;
+
+    for (int i = 0; i < s_njobs; i++)
     {
         pid_job_t *j = &s_jobs[i];
+        uint8_t pid = j->pid;
+        bool table = (s_sub_table[pid >> 5] >> (pid & 31)) & 1U;
+        uint32_t p = j->norm_period_ms;
+
+        j->watched = any && (table || s_sub_want[pid] != 0);
+        if (j->watched)
+        {
+            if (s_sub_want[pid] != 0 && (!table || s_sub_want[pid] < p))
+                p = s_sub_want[pid];
+        }
+        else if (any && p < OBD_SUB_KEEPALIVE_MS)
+        {
+            p = OBD_SUB_KEEPALIVE_MS;
+        }
 
-        if (tnow < j->backoff_until)
+        s_sub_period[i] = p;
+        if (j->unsupported)
+            continue;
+        if (j->watched)
+        {
+            watch_mpps += 1000000U / p;
+            nwatch++;
+        }
+        else
+        {
+            keep_mpps += 1000000U / p;
+        }
+    }
+
+    // domanda dei PID osservati oltre il budget: rallentano insieme
+    uint32_t avail = OBD_ADMIT_CAPACITY_MPPS > keep_mpps ? OBD_ADMIT_CAPACITY_MPPS - keep_mpps : 0;
+    bool scale = watch_mpps > avail && avail > 0;
+
+    bool changed = false;
+    for (int i = 0; i < s_njobs; i++)
+    {
+        pid_job_t *j = &s_jobs[i];
+        uint32_t p = s_sub_period[i];
+
+        if (scale && j->watched)
+        {
+            p = (uint32_t)(((uint64_t)p * watch_mpps) / avail);
+            if (p < OBD_MIN_PERIOD_MS)
+                p = OBD_MIN_PERIOD_MS;
+        }
+        if (p == j->period_ms)
             continue;
-        if (tnow < j->next_due_ms)
+
+        bool faster = p < j->period_ms;
+        j->period_ms = p;
+        changed = true;
+        if (j->in_flight)
+            continue; // job_complete riparte dal nuovo periodo
+
+        // un PID appena osservato non aspetta il vecchio periodo lungo
+        // (ma un PID in backoff resta in backoff)
+        if (faster && j->fail_count == 0 && time_before(tnow + p, j->next_due_ms))
+            j->next_due_ms = tnow;
+        j->deadline_ms = j->next_due_ms + p;
+    }
+
+    if (!changed)
+        return;
+
+    // rilasci e deadline cambiati: heap ricostruiti da zero (evento raro)
+    s_wait.n = s_ready.n = 0;
+    for (int i = 0; i < s_njobs; i++)
+        if (!s_jobs[i].unsupported && !s_jobs[i].in_flight)
+            heap_push(&s_wait, i);
+
+    if (any)
+        ESP_LOGI(TAG, "Sottoscrizioni: %d PID osservati (%u mPID/s%s), resto a %ums",
+                 nwatch, (unsigned)watch_mpps, scale ? ", scalati" : "", (unsigned)OBD_SUB_KEEPALIVE_MS);
+    else
+        ESP_LOGI(TAG, "Nessuna sottoscrizione: periodi di tabella");
+}
+
+/* Richiesta multi-PID in volo: posseduta dal task RT finché non rientra
+   dalla coda dei completamenti */
+typedef struct
+{
+    bool busy;
+    int count;
+    int idx[OBD_MAX_PIDS_PER_REQ];
+    uint8_t pids[OBD_MAX_PIDS_PER_REQ];
+    uint8_t data[OBD_MAX_PIDS_PER_REQ][4];
+    uint32_t got_mask; // bit = posizione del PID nella richiesta
+    bool sent;         // trasmessa (altrimenti nessuna misura di ritmo)
+    uint32_t tx_ms;
+    int64_t tx_us;     // per la latenza richiesta -> risposta
+    uint32_t rx_ms;    // completamento (task RX)
+    int64_t rx_us;     // idem, per la latenza RX -> RT
+    obd_resp_status_t status;
+    uint32_t ecu_id;   // ECU che ha risposto
+} pid_batch_t;
+
+static pid_batch_t s_batches[OBD_MAX_INFLIGHT];
+static QueueHandle_t s_done_q;
+
+/* Callback per PID: gira nel task RX, copia soltanto i byte */
+static void on_pid_value(uint8_t pid, const uint8_t *data, uint8_t len, void *arg)
+{
+    pid_batch_t *bt = (pid_batch_t *)arg;
+
+    for (int i = 0; i < bt->count; i++)
+    {
+        if (bt->pids[i] != pid)
             continue;
 
-        int prio = (int)j->prio;
-        int32_t lateness = (int32_t)(tnow - j->next_due_ms);
+        memset(bt->data[i], 0, 4);
+        memcpy(bt->data[i], data, len > 4 ? 4 : len);
+        bt->got_mask |= 1UL << i;
+    }
+}
+
+/* Completamento richiesta: gira nel task RX, rimanda il batch al task RT */
+static void on_batch_done(const obd_resp_t *resp, void *arg)
+{
+    pid_batch_t *bt = (pid_batch_t *)arg;
+
+    if (resp->status == OBD_RESP_OK)
+        obd_parse_mode01(resp->data, resp->len, on_pid_value, bt);
+
+    bt->rx_ms = now_ms();
+    bt->rx_us = esp_timer_get_time();
+    bt->status = resp->status;
+    bt->ecu_id = resp->ecu_id;
+    xQueueSend(s_done_q, &bt, portMAX_DELAY);
+}
+
+/* Latenza tra il completamento nel task RX e la presa in carico nel
+   task RT: misura quanto il task RT aspetta la CPU (core conteso,
+   priorità più alte, ISR). Scrive solo il task RT; la finestra
+   (somma, massimo) si azzera quando un lettore la chiede. */
+static atomic_uint s_rt_batches;
+static atomic_uint s_rt_win_n, s_rt_win_sum_us, s_rt_win_max_us;
+
+static void rt_note_latency(const pid_batch_t *bt)
+{
+    int64_t d = esp_timer_get_time() - bt->rx_us;
+    unsigned us = d < 0 ? 0 : d > UINT32_MAX ? UINT32_MAX : (unsigned)d;
+
+    obd_metrics_rt_dispatch(us);
+    atomic_fetch_add_explicit(&s_rt_batches, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_rt_win_n, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_rt_win_sum_us, us, memory_order_relaxed);
+
+    unsigned max = atomic_load_explicit(&s_rt_win_max_us, memory_order_relaxed);
+    while (us > max &&
+           !atomic_compare_exchange_weak_explicit(&s_rt_win_max_us, &max, us,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+void obd_data_get_rt_stats(obd_rt_stats_t *out, bool reset)
+{
+    if (!out)
+        return;
+
+    unsigned n, sum;
 
-        if (prio < best_prio || (prio == best_prio && lateness > best_lateness))
+    out->batches = atomic_load_explicit(&s_rt_batches, memory_order_relaxed);
+    if (reset)
+    {
+        n = atomic_exchange_explicit(&s_rt_win_n, 0, memory_order_relaxed);
+        sum = atomic_exchange_explicit(&s_rt_win_sum_us, 0, memory_order_relaxed);
+        out->lat_max_us = atomic_exchange_explicit(&s_rt_win_max_us, 0, memory_order_relaxed);
+    }
+    else
+    {
+        n = atomic_load_explicit(&s_rt_win_n, memory_order_relaxed);
+        sum = atomic_load_explicit(&s_rt_win_sum_us, memory_order_relaxed);
+        out->lat_max_us = atomic_load_explicit(&s_rt_win_max_us, memory_order_relaxed);
+    }
+    out->window = n;
+    out->lat_avg_us = n ? sum / n : 0;
+}
+
+/* Misura per il controllore del ritmo. Un timeout di un job isolato è un
+   problema del PID, non del bus: non rallenta nessuno. Un timeout va
+   all'ECU che ha risposto per ultima a quei PID (0x7E8 se ignota). */
+static void pace_feedback(const pid_batch_t *bt, uint32_t tnow)
+{
+    if (!bt->sent)
+        return;
+
+    if (bt->status != OBD_RESP_TIMEOUT)
+    {
+        obd_pace_answer(bt->ecu_id, (uint32_t)(bt->rx_us - bt->tx_us), tnow);
+        return;
+    }
+
+    if (bt->count == 1 && job_isolated(bt->idx[0]))
+        return;
+
+    uint32_t ecu = 0x7E8;
+    for (int i = 0; i < bt->count; i++)
+        if (s_jobs[bt->idx[i]].ecu_id)
         {
-            best = i;
-            best_prio = prio;
-            best_lateness = lateness;
+            ecu = s_jobs[bt->idx[i]].ecu_id;
+            break;
+        }
+    obd_pace_timeout(ecu, tnow);
+    obd_metrics_ecu_timeout(ecu);
+}
+
+/* Latenza dei PID ricevuti (e dell'ECU), conteggio di quelli mancanti */
+static void batch_metrics(const pid_batch_t *bt)
+{
+    uint32_t us = (uint32_t)(bt->rx_us - bt->tx_us);
+
+    if (bt->got_mask)
+        obd_metrics_ecu_latency(bt->ecu_id, us);
+
+    for (int i = 0; i < bt->count; i++)
+    {
+        if (bt->got_mask & (1UL << i))
+            obd_metrics_pid_latency(bt->pids[i], us);
+        else
+            obd_metrics_pid_timeout(bt->pids[i]);
+    }
+}
+
+/* Applica i risultati di un batch rientrato; true se ha aggiornato dati.
+   La generazione dei campi aggiornati è quella della prossima pubblicazione. */
+static bool finish_batch(pid_batch_t *bt, obd_snapshot_t *local, uint32_t tnow)
+{
+    uint32_t next_seq = atomic_load_explicit(&s_seq, memory_order_relaxed) + 2;
+
+    pace_feedback(bt, tnow);
+    if (bt->sent)
+        batch_metrics(bt);
+
+    for (int i = 0; i < bt->count; i++)
+    {
+        pid_job_t *j = &s_jobs[bt->idx[i]];
+        bool ok = (bt->got_mask & (1UL << i)) != 0;
+
+        if (ok)
+        {
+            j->ecu_id = (uint16_t)bt->ecu_id;
+            int f = apply_pid_value(&local->data, j->pid, bt->data[i]);
+            if (f >= 0)
+            {
+                local->field_ms[f] = tnow;
+                local->field_seq[f] = next_seq;
+                obd_history_record((obd_field_t)f, tnow, &local->data);
+                apply_derived(local, f, tnow, next_seq);
+
+                // conteggio cambiato: la lista dei codici in cache è vecchia
+                if (f == OBD_F_DTC_COUNT)
+                    obd_dtc_note_count(bt->ecu_id, local->data.v[f]);
+            }
         }
+
+        job_complete(bt->idx[i], ok, tnow);
+    }
+
+    bt->busy = false;
+    return bt->got_mask != 0;
+}
+
+/* Ascoltatori delle pubblicazioni: registrati in fase di avvio
+   (da un solo task), mai rimossi */
+typedef struct
+{
+    obd_publish_cb_t cb;
+    void *ctx;
+} publish_listener_t;
+
+static publish_listener_t s_listeners[OBD_DATA_MAX_LISTENERS];
+static atomic_int s_listener_count;
+
+static void notify_listeners(uint32_t seq)
+{
+    int n = atomic_load_explicit(&s_listener_count, memory_order_acquire);
+    for (int i = 0; i < n; i++)
+        s_listeners[i].cb(seq, s_listeners[i].ctx);
+}
+
+bool obd_data_add_listener(obd_publish_cb_t cb, void *ctx)
+{
+    int i = atomic_load_explicit(&s_listener_count, memory_order_relaxed);
+
+    if (!cb || i >= OBD_DATA_MAX_LISTENERS)
+        return false;
+
+    s_listeners[i].cb = cb;
+    s_listeners[i].ctx = ctx;
+
+    // il task RT vede la nuova voce solo quando è completa
+    atomic_store_explicit(&s_listener_count, i + 1, memory_order_release);
+    return true;
+}
+
+/* Scrittura seqlock: mai bloccante (unico scrittore) */
+static void publish_snapshot(obd_snapshot_t *local)
+{
+    uint32_t seq = atomic_load_explicit(&s_seq, memory_order_relaxed);
+
+    local->seq = seq + 2;
+
+    atomic_store_explicit(&s_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    s_obd = *local;
+
+    atomic_store_explicit(&s_seq, seq + 2, memory_order_release);
+
+    notify_listeners(seq + 2);
+}
+
+/* Batch libero se le richieste in volo sono sotto il limite corrente */
+static pid_batch_t *alloc_batch(void)
+{
+    pid_batch_t *free_bt = NULL;
+    int busy = 0;
+
+    for (int i = 0; i < OBD_MAX_INFLIGHT; i++)
+    {
+        if (s_batches[i].busy)
+            busy++;
+        else if (!free_bt)
+            free_bt = &s_batches[i];
     }
-    return best;
+    return busy < obd_pace_inflight() ? free_bt : NULL;
 }
 
-/* Task real-time: esegue una richiesta ogni OBD_REQ_SPACING_MS
-   scegliendo sempre il prossimo PID "due" rispettando priorità e periodo.
+/* Task real-time: invia una richiesta al più ogni obd_pace_spacing() ms
+   scegliendo i prossimi PID "due" (fino a 6 per richiesta) per deadline,
+   con fino a obd_pace_inflight() richieste in volo.
+   Le risposte arrivano dal task RX tramite s_done_q: tutto lo stato dei
+   job resta di proprietà di questo task.
 */
 static void obd_rt_task(void *arg)
 {
     (void)arg;
 
-    // snapshot locale che aggiorniamo e poi pubblichiamo nel mutex
-    obd_full_data_t local;
+    // snapshot locale che aggiorniamo e poi pubblichiamo (seqlock)
+    obd_snapshot_t local;
     memset(&local, 0, sizeof(local));
 
     // inizializza scheduler: scagliono i next_due per evitare “burst”
     uint32_t t0 = now_ms();
-    for (int i = 0; i < (int)(sizeof(s_jobs) / sizeof(s_jobs[0])); i++)
+    s_wait.n = s_ready.n = 0;
+    for (int i = 0; i < s_njobs; i++)
     {
-        // distribuzione iniziale: offset semplice (i * 10ms) per spalmare
-        s_jobs[i].next_due_ms = t0 + (uint32_t)(i * 10);
-        s_jobs[i].fail_count = 0;
-        s_jobs[i].backoff_until = 0;
+        pid_job_t *j = &s_jobs[i];
+
+        // distribuzione iniziale: offset nel primo periodo per spalmare
+        j->next_due_ms = t0 + (uint32_t)(i * 10) % j->period_ms;
+        j->deadline_ms = j->next_due_ms + j->period_ms;
+        j->fail_count = 0;
+        j->in_flight = false;
+
+        if (!j->unsupported)
+            heap_push(&s_wait, i);
     }
 
-    ESP_LOGI(TAG, "OBD RT task started (spacing=%dms)", (int)OBD_REQ_SPACING_MS);
+    obd_pace_init(t0);
+
+    ESP_LOGI(TAG, "OBD RT task started (%s, %d job, spacing=%dms%s, inflight<=%d, carico %u/%u PID/s)",
+             OBD_SCHED_RM ? "RM" : "EDF", s_wait.n, (int)OBD_REQ_SPACING_MS,
+             OBD_PACE_ADAPTIVE ? " adattiva" : "", (int)OBD_MAX_INFLIGHT,
+             (unsigned)(s_demand_mpps / 1000U), (unsigned)(OBD_ADMIT_CAPACITY_MPPS / 1000U));
+
+    uint32_t last_tx = t0 - OBD_PACE_MAX_MS;
 
     while (1)
     {
         uint32_t tnow = now_ms();
-        int idx = pick_next_job(tnow);
+        bool updated = false;
+        pid_batch_t *bt;
 
-        if (idx < 0)
+        // 1. rientro delle richieste completate (o scadute)
+        while (xQueueReceive(s_done_q, &bt, 0) == pdTRUE)
         {
-            // Nulla due: dormi poco (granularità scheduler)
-            vTaskDelay(pdMS_TO_TICKS(5));
-            continue;
+            rt_note_latency(bt);
+            updated |= finish_batch(bt, &local, tnow);
         }
 
-        pid_job_t *j = &s_jobs[idx];
-        uint8_t b[4] = {0};
+        // pubblica una sola volta per giro
+        if (updated)
+            publish_snapshot(&local);
 
-        bool ok = obd_read_pid(j->pid, b);
+        // sottoscrizioni cambiate o scadute: nuovi periodi
+        if (sub_pending(tnow))
+            sub_apply(tnow);
 
-        if (ok)
-        {
-            j->fail_count = 0;
+        // 2. nuova richiesta se c'è spazio nella pipeline e nel budget bus
+        int idx[OBD_MAX_PIDS_PER_REQ];
+        int n = 0;
+        bt = NULL;
 
-            // aggiorna local e pubblica
-            apply_pid_value(&local, j->pid, b);
+        uint32_t spacing = obd_pace_spacing(tnow);
+        uint32_t lookahead = OBD_BATCH_LOOKAHEAD_MS ? OBD_BATCH_LOOKAHEAD_MS : spacing;
 
-            if (s_obd_mutex)
-            {
-                xSemaphoreTake(s_obd_mutex, portMAX_DELAY);
-                s_obd = local;
-                xSemaphoreGive(s_obd_mutex);
-            }
+        if ((uint32_t)(tnow - last_tx) >= spacing && (bt = alloc_batch()) != NULL)
+            n = pick_due_batch(tnow, lookahead, idx);
 
-            // programma prossimo giro su base periodica (non “now+period”)
-            // per mantenere la frequenza stabile anche se siamo in ritardo.
-            j->next_due_ms += j->period_ms;
-        }
-        else
+        if (n > 0)
         {
-            j->fail_count++;
-
-            // Se fallisce, riprova presto ma non spammare:
-            // - piccolo retry (period/2) finché sotto soglia
-            // - poi backoff progressivo
-            if (j->fail_count < OBD_FAIL_THRESHOLD)
+            bt->busy = true;
+            bt->count = n;
+            bt->got_mask = 0;
+            bt->sent = true;
+            bt->tx_ms = tnow;
+            bt->tx_us = esp_timer_get_time();
+            for (int i = 0; i < n; i++)
             {
-                j->next_due_ms = tnow + (j->period_ms / 2);
+                bt->idx[i] = idx[i];
+                bt->pids[i] = s_jobs[idx[i]].pid;
+                s_jobs[idx[i]].in_flight = true;
             }
-            else
+
+            last_tx = tnow;
+
+            if (!obd_request_submit(0x01, bt->pids, n, OBD_REQ_TIMEOUT_MS, on_batch_done, bt))
             {
-                uint32_t backoff = OBD_FAIL_BACKOFF_MS;
-                // backoff cresce con fail_count (cap a 20s)
-                uint32_t extra = (uint32_t)(j->fail_count - OBD_FAIL_THRESHOLD) * 1000U;
-                if (extra > 18000U)
-                    extra = 18000U;
-
-                j->backoff_until = tnow + backoff + extra;
-                j->next_due_ms = j->backoff_until + j->period_ms;
+                // TX fallita o motore saturo: conta come fail per tutti i PID
+                bt->got_mask = 0;
+                bt->sent = false;
+                finish_batch(bt, &local, tnow);
             }
+            continue;
         }
 
-        // una richiesta ogni spacing ms -> evita burst inutili
-        vTaskDelay(pdMS_TO_TICKS(OBD_REQ_SPACING_MS));
+        // 3. nulla da inviare: attendi un completamento (granularità scheduler,
+        //    ridotta se il prossimo slot di trasmissione è più vicino)
+        uint32_t wait_ms = 5;
+        uint32_t since_tx = tnow - last_tx;
+        if (since_tx < spacing && spacing - since_tx < wait_ms)
+            wait_ms = spacing - since_tx;
+
+        TickType_t wait = pdMS_TO_TICKS(wait_ms);
+        if (wait == 0)
+            wait = 1; // tick più lungo dell'attesa (es. 100 Hz): niente spin
+
+        if (xQueueReceive(s_done_q, &bt, wait) == pdTRUE)
+        {
+            rt_note_latency(bt);
+            if (finish_batch(bt, &local, now_ms()))
+                publish_snapshot(&local);
+        }
     }
 }
 
@@ -299,38 +943,326 @@ static void obd_rt_task(void *arg)
 
 void obd_data_init(void)
 {
+    jobs_init();
+    if (s_demand_mpps > OBD_ADMIT_CAPACITY_MPPS)
+        ESP_LOGW(TAG, "Tabella PID oltre il budget bus (%u > %u mPID/s): deadline non garantite",
+                 (unsigned)s_demand_mpps, (unsigned)OBD_ADMIT_CAPACITY_MPPS);
+
     memset(&s_obd, 0, sizeof(s_obd));
-    s_obd_mutex = xSemaphoreCreateMutex();
+    atomic_store(&s_seq, 0);
+    obd_history_init();
+    obd_derived_reset();
+    s_done_q = xQueueCreate(OBD_MAX_INFLIGHT, sizeof(pid_batch_t *));
+    s_sub_lock = xSemaphoreCreateMutex();
 }
 
 void obd_data_set(const obd_full_data_t *src)
 {
-    // mantenuta per compatibilità: se altrove vuoi “pushare” snapshot
-    if (!s_obd_mutex || !src)
+    // mantenuta per compatibilità: se altrove vuoi “pushare” snapshot.
+    // Il seqlock ammette un solo scrittore: non usarla col polling attivo.
+    if (!src)
         return;
 
-    xSemaphoreTake(s_obd_mutex, portMAX_DELAY);
-    s_obd = *src;
-    xSemaphoreGive(s_obd_mutex);
+    static obd_snapshot_t snap;
+    uint32_t t = now_ms();
+
+    snap.data = *src;
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+    {
+        snap.field_ms[f] = t;
+        snap.field_seq[f] = atomic_load_explicit(&s_seq, memory_order_relaxed) + 2;
+    }
+    publish_snapshot(&snap);
 }
 
-obd_full_data_t obd_get_all_data(void)
+typedef struct
 {
-    obd_full_data_t copy;
-    memset(&copy, 0, sizeof(copy));
+    obd_snapshot_t *snap;
+    uint32_t t;
+    uint32_t next_seq;
+    int fields;
+} ext_apply_t;
 
-    if (!s_obd_mutex)
-        return copy;
+static void on_ext_pid(uint8_t pid, const uint8_t *data, uint8_t len, void *arg)
+{
+    ext_apply_t *a = (ext_apply_t *)arg;
+    uint8_t b[4] = {0};
 
-    xSemaphoreTake(s_obd_mutex, portMAX_DELAY);
-    copy = s_obd;
-    xSemaphoreGive(s_obd_mutex);
-    return copy;
+    memcpy(b, data, len > 4 ? 4 : len);
+    int f = apply_pid_value(&a->snap->data, pid, b);
+    if (f < 0)
+        return;
+
+    a->snap->field_ms[f] = a->t;
+    a->snap->field_seq[f] = a->next_seq;
+    obd_history_record((obd_field_t)f, a->t, &a->snap->data);
+    apply_derived(a->snap, f, a->t, a->next_seq);
+    a->fields++;
+}
+
+int obd_data_apply_mode01(const uint8_t *data, int len)
+{
+    static obd_snapshot_t snap;
+    ext_apply_t a = {
+        .snap = &snap,
+        .t = now_ms(),
+        .next_seq = atomic_load_explicit(&s_seq, memory_order_relaxed) + 2,
+    };
+
+    obd_get_snapshot(&snap);
+    obd_parse_mode01(data, len, on_ext_pid, &a);
+    if (a.fields > 0)
+        publish_snapshot(&snap);
+    return a.fields;
+}
+
+/* Chiamata da obd_init() dopo la discovery, prima di avviare il polling.
+   La banda dei PID non supportati viene ridistribuita in proporzione:
+   tutti i periodi restanti scalano dello stesso fattore (domanda totale
+   in richieste/s invariata), con limite inferiore OBD_MIN_PERIOD_MS. */
+void obd_data_apply_pid_support(void)
+{
+    const int n = s_njobs;
+    uint32_t total = 0; // domanda in millesimi di PID/s
+    uint32_t kept = 0;
+    int disabled = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        pid_job_t *j = &s_jobs[i];
+        uint32_t demand = 1000000U / j->base_period_ms;
+
+        j->unsupported = !obd_pid_supported(j->pid);
+        total += demand;
+
+        if (j->unsupported)
+        {
+            disabled++;
+            ESP_LOGI(TAG, "PID 0x%02X non supportato: escluso dal polling", j->pid);
+        }
+        else
+        {
+            kept += demand;
+        }
+    }
+
+    s_demand_mpps = kept;
+    if (disabled == 0 || kept == 0)
+        return;
+
+    for (int i = 0; i < n; i++)
+    {
+        pid_job_t *j = &s_jobs[i];
+        if (j->unsupported)
+            continue;
+
+        uint32_t p = (uint32_t)(((uint64_t)j->base_period_ms * kept) / total);
+        j->period_ms = p < OBD_MIN_PERIOD_MS ? OBD_MIN_PERIOD_MS : p;
+        j->norm_period_ms = j->period_ms;
+    }
+
+    // la domanda resta ~kept (meno, se il limite inferiore è intervenuto)
+    s_demand_mpps = 0;
+    for (int i = 0; i < n; i++)
+        if (!s_jobs[i].unsupported)
+            s_demand_mpps += 1000000U / s_jobs[i].period_ms;
+
+    ESP_LOGI(TAG, "%d PID esclusi, periodi scalati a %u/1000",
+             disabled, (unsigned)((uint64_t)kept * 1000U / total));
+}
+
+/* Registra un job (o cambia il periodo di uno esistente) se il bus
+   può sostenerlo: solo prima dell'avvio del polling */
+bool obd_data_add_job(uint8_t pid, uint8_t prio, uint32_t period_ms)
+{
+    jobs_init();
+
+    if (s_polling || obd_pid_data_len(pid) == 0 || (pid & 0x1F) == 0 || prio > PID_PRIO_LOW)
+        return false;
+
+    if (period_ms < OBD_MIN_PERIOD_MS)
+    {
+        ESP_LOGW(TAG, "PID 0x%02X: periodo %ums sotto il minimo %ums", pid,
+                 (unsigned)period_ms, (unsigned)OBD_MIN_PERIOD_MS);
+        return false;
+    }
+
+    int i = 0;
+    while (i < s_njobs && s_jobs[i].pid != pid)
+        i++;
+    if (i == OBD_MAX_JOBS)
+        return false;
+
+    uint32_t old = i < s_njobs ? 1000000U / s_jobs[i].period_ms : 0;
+    uint32_t demand = s_demand_mpps - old + 1000000U / period_ms;
+
+    if (demand > OBD_ADMIT_CAPACITY_MPPS)
+    {
+        ESP_LOGW(TAG, "PID 0x%02X @%ums rifiutato: %u/%u mPID/s", pid, (unsigned)period_ms,
+                 (unsigned)demand, (unsigned)OBD_ADMIT_CAPACITY_MPPS);
+        return false;
+    }
+
+    if (i == s_njobs)
+        s_njobs++;
+
+    pid_job_t *j = &s_jobs[i];
+    j->pid = pid;
+    j->prio = (pid_prio_t)prio;
+    j->period_ms = period_ms;
+    j->base_period_ms = period_ms;
+    j->norm_period_ms = period_ms;
+    s_demand_mpps = demand;
+    return true;
+}
+
+bool obd_data_subscribe(int owner, const obd_sub_item_t *items, int n)
+{
+    if (n == 0)
+    {
+        obd_data_unsubscribe(owner);
+        return true;
+    }
+    if (!s_sub_lock || n < 0 || n > OBD_SUB_MAX_PIDS || owner == OBD_SUB_ALL)
+        return false;
+
+    xSemaphoreTake(s_sub_lock, portMAX_DELAY);
+
+    sub_client_t *sc = NULL;
+    for (int c = 0; c < OBD_SUB_MAX_CLIENTS; c++)
+    {
+        if (s_subs[c].used && s_subs[c].owner == owner)
+        {
+            sc = &s_subs[c];
+            break;
+        }
+        if (!s_subs[c].used && !sc)
+            sc = &s_subs[c];
+    }
+
+    if (sc)
+    {
+        sc->used = true;
+        sc->owner = owner;
+        sc->expires_ms = 0; // rinnovo: annulla un'eventuale grazia
+        sc->n = (uint8_t)n;
+        memcpy(sc->items, items, sizeof(items[0]) * (size_t)n);
+        atomic_fetch_add(&s_sub_gen, 1);
+    }
+
+    xSemaphoreGive(s_sub_lock);
+
+    if (!sc)
+        ESP_LOGW(TAG, "Sottoscrizione del client %d rifiutata: tabella piena", owner);
+    return sc != NULL;
+}
+
+void obd_data_unsubscribe(int owner)
+{
+    if (!s_sub_lock)
+        return;
+
+    xSemaphoreTake(s_sub_lock, portMAX_DELAY);
+    for (int c = 0; c < OBD_SUB_MAX_CLIENTS; c++)
+    {
+        if (s_subs[c].used && (owner == OBD_SUB_ALL || s_subs[c].owner == owner))
+        {
+            s_subs[c].used = false;
+            atomic_fetch_add(&s_sub_gen, 1);
+        }
+    }
+    xSemaphoreGive(s_sub_lock);
+}
+
+void obd_data_sub_grace(uint32_t grace_ms)
+{
+    if (!s_sub_lock)
+        return;
+
+    uint32_t t = now_ms() + grace_ms;
+    if (t == 0)
+        t = 1; // 0 = nessuna scadenza
+
+    xSemaphoreTake(s_sub_lock, portMAX_DELAY);
+    for (int c = 0; c < OBD_SUB_MAX_CLIENTS; c++)
+        if (s_subs[c].used && s_subs[c].expires_ms == 0)
+            s_subs[c].expires_ms = t;
+    atomic_fetch_add(&s_sub_gen, 1);
+    xSemaphoreGive(s_sub_lock);
+}
+
+int obd_data_get_jobs(obd_job_info_t *out, int max)
+{
+    uint32_t tnow = now_ms();
+    int n = 0;
+
+    for (int i = 0; i < s_njobs && n < max; i++)
+    {
+        const pid_job_t *j = &s_jobs[i];
+
+        out[n].pid = j->pid;
+        out[n].prio = (uint8_t)j->prio;
+        out[n].supported = !j->unsupported;
+        out[n].period_ms = j->period_ms;
+        out[n].base_period_ms = j->base_period_ms;
+        out[n].updates = j->updates;
+        out[n].deadline_misses = j->misses;
+        out[n].watched = j->watched;
+
+        // periodi già chiusi senza risposta (es. ECU muta): contati subito
+        if (s_polling && !j->unsupported && time_before(j->deadline_ms, tnow))
+            out[n].deadline_misses += 1 + (tnow - j->deadline_ms) / j->period_ms;
+        n++;
+    }
+    return n;
+}
+
+uint32_t obd_data_seq(void)
+{
+    return atomic_load_explicit(&s_seq, memory_order_acquire) & ~1U;
+}
+
+uint32_t obd_get_snapshot(obd_snapshot_t *out)
+{
+    uint32_t s1, s2;
+    int spins = 0;
+
+    do
+    {
+        s1 = atomic_load_explicit(&s_seq, memory_order_acquire);
+        if (s1 & 1U)
+        {
+            // scrittore a metà copia (es. preemptato dal task RX): cedi la CPU
+            if (++spins >= OBD_SNAPSHOT_SPIN)
+            {
+                vTaskDelay(1);
+                spins = 0;
+            }
+            continue;
+        }
+
+        *out = s_obd;
+
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&s_seq, memory_order_relaxed);
+    } while ((s1 & 1U) || s1 != s2);
+
+    return s1;
+}
+
+obd_full_data_t obd_get_all_data(void)
+{
+    obd_snapshot_t snap;
+    obd_get_snapshot(&snap);
+    return snap.data;
 }
 
 void obd_data_start_polling(void)
 {
-    // Task con priorità leggermente > web/task normali, ma < TWAI driver interno
+    // Priorità sopra web e task normali, sotto obd_rx (vedi app_tasks.h).
     // Stack: JSON e parsing non qui, quindi 4096 basta di solito.
-    xTaskCreate(obd_rt_task, "obd_rt", 4096, NULL, 6, NULL);
+    jobs_init();
+    s_polling = true;
+    xTaskCreatePinnedToCore(obd_rt_task, "obd_rt", APP_OBD_RT_STACK, NULL, APP_OBD_RT_PRIO, NULL,
+                            APP_CORE(APP_CORE_CAN));
 }
@@ -0,0 +1,322 @@
+#include "obd_derived.h"
+
+#include <string.h>
+
+/* Il frame di /data.bin e le maschere qui sotto hanno un bit per campo */
+_Static_assert(OBD_FIELD_COUNT <= 32, "campi oltre la bitmap a 32 bit");
+
+#define BIT(f) (1UL << (f))
+
+/* -------------------------------------------------------
+ * Integrazione a trapezi. Accumulatori in (unità del campo x ms) x 2:
+ * il mezzo del trapezio si divide solo nella conversione finale.
+ * ------------------------------------------------------- */
+typedef struct
+{
+    bool have;
+    int32_t v;
+    uint32_t t;
+    uint64_t acc2;
+} integ_t;
+
+/* Ritorna false se non c'era un campione precedente abbastanza vicino */
+static bool integ_step(integ_t *in, int32_t v, uint32_t t)
+{
+    uint32_t dt = t - in->t;
+    bool ok = in->have && dt <= OBD_DERIVED_MAX_GAP_MS;
+
+    if (ok)
+        in->acc2 += (uint64_t)(in->v + v) * dt;
+
+    in->have = true;
+    in->v = v;
+    in->t = t;
+    return ok;
+}
+
+/* -------------------------------------------------------
+ * Misure di accelerazione tra due velocità (lo = 0: da fermo).
+ * La velocità arriva a passi di 1 km/h ogni ~100 ms: interpolare tra
+ * due soli campioni sbaglia fino a 1 km/h / a (0.17 s a 6 km/h/s).
+ * Ogni soglia si attraversa quindi sulla retta t(v) ai minimi quadrati
+ * dei campioni entro FIT_KMH: da fermo quelli fino a FIT_KMH, per lo
+ * quelli tra lo - FIT_KMH e lo + FIT_KMH, per hi quelli da hi - FIT_KMH
+ * al primo oltre hi. Da fermo la retta ritrova l'istante della partenza
+ * anche prima dell'ultimo campione a 0.
+ * ------------------------------------------------------- */
+#define FIT_KMH 20
+
+/* Retta t(v) in mezzi km/h; t relativo a base per restare negli int64.
+   Il PID tronca: il campione v sta per il centro di [v, v + 1), senza
+   questo mezzo km/h ogni soglia cadrebbe in ritardo e il limite del
+   campione successivo la riporterebbe indietro. */
+typedef struct
+{
+    uint32_t base;
+    int64_t n, sv, st, svv, svt;
+} fit_t;
+
+static void fit_reset(fit_t *f, uint32_t base)
+{
+    memset(f, 0, sizeof(*f));
+    f->base = base;
+}
+
+static void fit_add(fit_t *f, uint32_t t, int32_t v)
+{
+    int64_t x = 2 * (int64_t)v + 1, y = (int64_t)(int32_t)(t - f->base);
+
+    f->n++;
+    f->sv += x;
+    f->st += y;
+    f->svv += x * x;
+    f->svt += x * y;
+}
+
+/* Istante in cui la retta vale v, limitato a [lo_t, hi_t] */
+static uint32_t fit_at(const fit_t *f, int32_t v, uint32_t lo_t, uint32_t hi_t)
+{
+    int64_t den = f->n * f->svv - f->sv * f->sv;
+    if (den <= 0)
+        return lo_t;
+
+    int64_t x = 2 * (int64_t)v;
+    int64_t t = f->base + (f->st * f->svv - f->sv * f->svt + x * (f->n * f->svt - f->sv * f->st)) / den;
+    if (t < (int64_t)lo_t)
+        return lo_t;
+    if (t > (int64_t)hi_t)
+        return hi_t;
+    return (uint32_t)t;
+}
+
+typedef enum
+{
+    RUN_IDLE = 0,
+    RUN_ARMED, // fermo: pronta a partire (solo lo = 0)
+    RUN_GOING,
+} run_state_t;
+
+typedef struct
+{
+    int32_t lo, hi;          // km/h
+    run_state_t state;
+    uint32_t t_start;        // ms
+    uint32_t cross0, cross1; // limiti di t_start: campioni a cavallo di lo
+                             // (da fermo: inizio sosta, primo in moto)
+    bool fit_lo_open;        // campioni ancora utili alla retta di lo
+    fit_t fit_lo, fit_hi;
+} accel_run_t;
+
+/* Nuovo campione di velocità; true se la misura si è chiusa in *out_ms */
+static bool run_step(accel_run_t *r, int32_t v0, uint32_t t0, int32_t v1, uint32_t t1,
+                     uint32_t *out_ms)
+{
+    if (t1 - t0 > OBD_DERIVED_MAX_GAP_MS)
+    {
+        // buco nei dati: non si sa cosa è successo nel mezzo
+        r->state = r->lo == 0 && v1 == 0 ? RUN_ARMED : RUN_IDLE;
+        r->cross0 = t1;
+        fit_reset(&r->fit_lo, t1);
+        return false;
+    }
+
+    if (r->lo == 0)
+    {
+        if (v1 == 0)
+        {
+            // la partenza può precedere di 1 km/h / a l'ultimo campione a 0:
+            // il limite basso è l'inizio della sosta
+            if (r->state != RUN_ARMED)
+                r->cross0 = t1;
+            r->state = RUN_ARMED;
+            return false;
+        }
+        if (r->state == RUN_ARMED)
+        {
+            r->state = RUN_GOING;
+            r->cross1 = t1;
+            r->fit_lo_open = true;
+            fit_reset(&r->fit_lo, t0);
+            fit_reset(&r->fit_hi, t0);
+        }
+    }
+    else if (r->state == RUN_IDLE)
+    {
+        // avvicinamento a lo: solo campioni in salita dentro la finestra
+        if (v1 < r->lo - FIT_KMH || v1 < v0)
+            fit_reset(&r->fit_lo, t1);
+        if (v0 < r->lo && v1 >= r->lo)
+        {
+            r->state = RUN_GOING;
+            r->cross0 = t0;
+            r->cross1 = t1;
+            r->fit_lo_open = true;
+            fit_reset(&r->fit_hi, t0);
+        }
+        else if (v1 >= r->lo - FIT_KMH && v1 < r->lo)
+        {
+            fit_add(&r->fit_lo, t1, v1);
+        }
+    }
+    else if (r->state == RUN_GOING && v1 < r->lo)
+    {
+        r->state = RUN_IDLE;
+        fit_reset(&r->fit_lo, t1);
+    }
+
+    if (r->state != RUN_GOING)
+        return false;
+
+    if (r->fit_lo_open)
+    {
+        r->fit_lo_open = v1 < r->lo + FIT_KMH;
+        if (r->fit_lo_open)
+        {
+            fit_add(&r->fit_lo, t1, v1);
+            r->t_start = fit_at(&r->fit_lo, r->lo, r->cross0, r->cross1);
+        }
+    }
+    if (v1 >= r->hi - FIT_KMH)
+        fit_add(&r->fit_hi, t1, v1);
+
+    if (v1 >= r->hi)
+    {
+        *out_ms = fit_at(&r->fit_hi, r->hi, t0, t1) - r->t_start;
+        // da fermo si riparte solo dopo essersi fermati di nuovo
+        r->state = RUN_IDLE;
+        fit_reset(&r->fit_lo, t1);
+        return true;
+    }
+    if (t1 - r->t_start > OBD_DERIVED_RUN_MAX_MS)
+        r->state = RUN_IDLE;
+    return false;
+}
+
+/* -------------------------------------------------------
+ * Stato (scrittore unico)
+ * ------------------------------------------------------- */
+static struct
+{
+    integ_t speed;    // km/h
+    integ_t rate;     // centesimi di L/h
+    accel_run_t run[2];
+} s;
+
+static const accel_run_t k_runs[2] = {
+    {.lo = 0, .hi = 100},
+    {.lo = 80, .hi = 120},
+};
+
+static const obd_field_t k_run_field[2] = {OBD_F_T_0_100, OBD_F_T_80_120};
+
+void obd_derived_reset(void)
+{
+    memset(&s, 0, sizeof(s));
+    memcpy(s.run, k_runs, sizeof(k_runs));
+}
+
+/* Carburante da MAF e AFR, corretto dai trim: centesimi di L/h.
+   L/h = maf[g/s] * 3600 / AFR / densità * (1 + trim%) */
+static int32_t fuel_rate(const obd_full_data_t *d)
+{
+    int64_t trim = 1000 + d->v[OBD_F_TRIM_SHORT] + d->v[OBD_F_TRIM_LONG]; // decimi di %
+    int64_t n = (int64_t)d->v[OBD_F_MAF] * 36000 * (trim > 0 ? trim : 0);
+
+    return (int32_t)(n / ((int64_t)OBD_DERIVED_AFR_X10 * OBD_DERIVED_FUEL_DENSITY * 1000));
+}
+
+/* Marcia dal rapporto velocità / giri, 0 se nessuna è abbastanza vicina */
+static int32_t gear(const obd_full_data_t *d)
+{
+    static const uint16_t k_ratio[] = OBD_DERIVED_GEAR_RATIOS;
+    int32_t rpm = d->v[OBD_F_RPM], kmh = d->v[OBD_F_SPEED];
+
+    if (kmh < OBD_DERIVED_MIN_KMH || rpm < 500)
+        return 0;
+
+    int32_t r = kmh * 10000 / rpm; // km/h a 1000 giri x10
+    int32_t best = 0, best_diff = INT32_MAX;
+
+    for (int i = 0; i < (int)(sizeof(k_ratio) / sizeof(k_ratio[0])); i++)
+    {
+        int32_t diff = r > k_ratio[i] ? r - k_ratio[i] : k_ratio[i] - r;
+        if (diff * 100 <= k_ratio[i] * OBD_DERIVED_GEAR_TOL_PCT && diff < best_diff)
+        {
+            best = i + 1;
+            best_diff = diff;
+        }
+    }
+    return best;
+}
+
+/* Consumo istantaneo e medio del viaggio (decimi di L/100km) */
+static void economy(obd_full_data_t *d)
+{
+    int32_t kmh = d->v[OBD_F_SPEED];
+    int32_t e = kmh >= OBD_DERIVED_MIN_KMH ? d->v[OBD_F_FUEL_RATE] * 10 / kmh : 0;
+
+    d->v[OBD_F_ECON] = e > 9999 ? 9999 : e;
+
+    // stessa scala ms negli accumulatori: L/100km = (cL/h) / (km/h);
+    // sotto i 100 m la media non dice niente
+    d->v[OBD_F_ECON_TRIP] = s.speed.acc2 >= 2ULL * 360000
+                                ? (int32_t)(s.rate.acc2 * 10 / s.speed.acc2)
+                                : 0;
+}
+
+uint32_t obd_derived_update(obd_full_data_t *d, obd_field_t f, uint32_t t_ms)
+{
+    uint32_t mask = 0;
+
+    switch (f)
+    {
+    case OBD_F_SPEED:
+    {
+        int32_t v0 = s.speed.v;
+        uint32_t t0 = s.speed.t;
+        bool had = s.speed.have;
+
+        // 0.01 km = 36000 km/h x ms
+        integ_step(&s.speed, d->v[OBD_F_SPEED], t_ms);
+        d->v[OBD_F_TRIP_DIST] = (int32_t)(s.speed.acc2 / (2 * 36000));
+
+        for (int i = 0; had && i < 2; i++)
+        {
+            uint32_t ms;
+            if (run_step(&s.run[i], v0, t0, d->v[OBD_F_SPEED], t_ms, &ms))
+            {
+                d->v[k_run_field[i]] = (int32_t)((ms + 5) / 10);
+                mask |= BIT(k_run_field[i]);
+            }
+        }
+
+        economy(d);
+        d->v[OBD_F_GEAR] = gear(d);
+        mask |= BIT(OBD_F_TRIP_DIST) | BIT(OBD_F_ECON) | BIT(OBD_F_ECON_TRIP) | BIT(OBD_F_GEAR);
+        break;
+    }
+
+    case OBD_F_RPM:
+        d->v[OBD_F_GEAR] = gear(d);
+        mask |= BIT(OBD_F_GEAR);
+        break;
+
+    case OBD_F_MAF:
+    case OBD_F_TRIM_SHORT:
+    case OBD_F_TRIM_LONG:
+        // 0.01 L = 3600000 cL/h x ms
+        d->v[OBD_F_FUEL_RATE] = fuel_rate(d);
+        integ_step(&s.rate, d->v[OBD_F_FUEL_RATE], t_ms);
+        d->v[OBD_F_TRIP_FUEL] = (int32_t)(s.rate.acc2 / (2 * 3600000));
+
+        economy(d);
+        mask |= BIT(OBD_F_FUEL_RATE) | BIT(OBD_F_TRIP_FUEL) | BIT(OBD_F_ECON) |
+                BIT(OBD_F_ECON_TRIP);
+        break;
+
+    default:
+        break;
+    }
+
+    return mask;
+}
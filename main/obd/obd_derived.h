@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "obd.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Segnali derivati, calcolati sul dispositivo a ogni valore decodificato
+       (stesso ritmo dei PID da cui dipendono) e pubblicati come campi dello
+       snapshot: consumo istantaneo e medio, distanza e carburante del
+       viaggio, marcia stimata, tempi 0-100 e 80-120 km/h.
+       Solo aritmetica intera; il viaggio inizia all'avvio. */
+
+#ifndef OBD_DERIVED_AFR_X10
+// Rapporto aria/carburante stechiometrico x10 (benzina 14.7, gasolio 14.5)
+#define OBD_DERIVED_AFR_X10 147
+#endif
+
+#ifndef OBD_DERIVED_FUEL_DENSITY
+// g/L (benzina 745, gasolio 832)
+#define OBD_DERIVED_FUEL_DENSITY 745
+#endif
+
+#ifndef OBD_DERIVED_MAX_GAP_MS
+// Oltre questo intervallo tra due campioni (timeout, backoff) non si
+// integra e le misure di accelerazione in corso si annullano
+#define OBD_DERIVED_MAX_GAP_MS 2000
+#endif
+
+#ifndef OBD_DERIVED_MIN_KMH
+// Sotto: consumo istantaneo e marcia a 0 (vale il consumo orario)
+#define OBD_DERIVED_MIN_KMH 5
+#endif
+
+#ifndef OBD_DERIVED_GEAR_RATIOS
+// km/h a 1000 giri x10, dalla prima marcia in su
+#define OBD_DERIVED_GEAR_RATIOS {75, 135, 200, 270, 335, 400}
+#endif
+
+#ifndef OBD_DERIVED_GEAR_TOL_PCT
+// Scarto massimo dal rapporto della marcia (oltre: frizione, folle)
+#define OBD_DERIVED_GEAR_TOL_PCT 8
+#endif
+
+#ifndef OBD_DERIVED_RUN_MAX_MS
+// Una misura 0-100 / 80-120 più lunga non è un'accelerazione
+#define OBD_DERIVED_RUN_MAX_MS 30000
+#endif
+
+    /* Azzera viaggio e misure in corso */
+    void obd_derived_reset(void);
+
+    /* Il campo f di d è appena stato aggiornato all'istante t_ms:
+       ricalcola in d i campi derivati che ne dipendono. Ritorna la
+       maschera (bit = obd_field_t) dei campi derivati aggiornati.
+       Scrittore unico, come lo snapshot. */
+    uint32_t obd_derived_update(obd_full_data_t *d, obd_field_t f, uint32_t t_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,247 @@
+#include "obd_dtc.h"
+#include "obd.h"
+#include "app_tasks.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "OBD_DTC";
+
+// Mode per tipo di lista (risposta = servizio + 0x40)
+static const uint8_t s_service[OBD_DTC_KIND_COUNT] = {
+    [OBD_DTC_STORED] = 0x03,
+    [OBD_DTC_PENDING] = 0x07,
+    [OBD_DTC_PERMANENT] = 0x0A,
+};
+
+/* -------------------------------------------------------
+ * Cache: scritta solo dal task DTC a lettura completata, letta dal web
+ * server. s_work è la lista in costruzione, riempita dal task RX
+ * (una sola lettura alla volta).
+ * ------------------------------------------------------- */
+static obd_dtc_list_t s_lists[OBD_DTC_KIND_COUNT];
+static obd_dtc_list_t s_work;
+static uint32_t s_gen, s_reads;
+static SemaphoreHandle_t s_lock;
+static SemaphoreHandle_t s_wake; // binario: più richieste = una lettura
+static SemaphoreHandle_t s_done; // fine raccolta di un servizio
+
+static atomic_uint s_requested;
+static atomic_uint s_served; // richieste coperte dall'ultima lettura avviata
+// ultimo conteggio del PID 0x01 per ECU (0x7E8..0x7EF), -1 = mai letto
+static atomic_int s_mil_count[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+void obd_dtc_format(uint16_t code, char out[6])
+{
+    static const char sys[4] = {'P', 'C', 'B', 'U'};
+
+    snprintf(out, 6, "%c%X%X%X%X", sys[code >> 14], (code >> 12) & 0x3, (code >> 8) & 0xF,
+             (code >> 4) & 0xF, code & 0xF);
+}
+
+/* Su CAN (ISO 15765-4) il primo byte è il numero di codici. Una risposta
+   più lunga del buffer ISO-TP arriva troncata: i codici mancanti restano
+   nel totale dichiarato. */
+int obd_dtc_parse(const uint8_t *data, int len, uint16_t ecu_id, obd_dtc_list_t *list)
+{
+    if (!data || len < 1)
+        return -1;
+
+    int count = data[0];
+    int found = 0;
+
+    list->total += (uint16_t)count;
+    for (int i = 0; i < count && 1 + 2 * i + 1 < len; i++)
+    {
+        uint16_t code = (uint16_t)((data[1 + 2 * i] << 8) | data[2 + 2 * i]);
+        if (code == 0)
+            continue; // riempimento
+
+        found++;
+        if (list->n < OBD_DTC_MAX)
+        {
+            list->code[list->n].ecu_id = ecu_id;
+            list->code[list->n].code = code;
+            list->n++;
+        }
+    }
+    return found;
+}
+
+/* Risposta di una ECU (task RX); alla scadenza la raccolta è chiusa */
+static void on_dtc_resp(const obd_resp_t *resp, void *arg)
+{
+    obd_dtc_list_t *list = (obd_dtc_list_t *)arg;
+
+    switch (resp->status)
+    {
+    case OBD_RESP_TIMEOUT:
+        xSemaphoreGive(s_done);
+        break;
+    case OBD_RESP_NEGATIVE:
+        list->negative++; // tipicamente 0x0A non supportato
+        break;
+    case OBD_RESP_OK:
+        list->ecus++;
+        if (obd_dtc_parse(resp->data, resp->len, (uint16_t)resp->ecu_id, list) < 0)
+            ESP_LOGW(TAG, "Risposta 0x%02X malformata da 0x%03X", (unsigned)resp->service + 0x40,
+                     (unsigned)resp->ecu_id);
+        break;
+    }
+}
+
+/* Un servizio verso tutte le ECU; true se almeno una ha risposto */
+static bool read_kind(obd_dtc_kind_t kind)
+{
+    memset(&s_work, 0, sizeof(s_work));
+
+    // slot del motore tutti occupati dallo scheduler: riprova a breve
+    bool sent = false;
+    for (int attempt = 0; attempt < 5 && !sent; attempt++)
+    {
+        sent = obd_request_broadcast(s_service[kind], NULL, 0, OBD_DTC_TIMEOUT_MS, on_dtc_resp,
+                                     &s_work);
+        if (!sent)
+            vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    if (!sent)
+    {
+        ESP_LOGW(TAG, "Mode %02X non inviato", (unsigned)s_service[kind]);
+        return false;
+    }
+
+    xSemaphoreTake(s_done, portMAX_DELAY);
+
+    // nessuna risposta (quadro spento): la lista precedente resta valida
+    if (s_work.ecus == 0 && s_work.negative == 0)
+        return false;
+
+    s_work.valid = true;
+    s_work.read_ms = now_ms();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_lists[kind] = s_work;
+    xSemaphoreGive(s_lock);
+    return true;
+}
+
+static void obd_dtc_task(void *arg)
+{
+    (void)arg;
+    uint32_t last = 0;
+
+    while (1)
+    {
+        xSemaphoreTake(s_wake, portMAX_DELAY);
+        if (atomic_load(&s_served) == atomic_load(&s_requested))
+            continue; // già coperta dalla lettura appena finita
+
+        uint32_t since = now_ms() - last;
+        if (s_reads > 0 && since < OBD_DTC_MIN_INTERVAL_MS)
+            vTaskDelay(pdMS_TO_TICKS(OBD_DTC_MIN_INTERVAL_MS - since));
+
+        // le richieste arrivate da qui in poi vedranno un'altra lettura
+        unsigned req = atomic_load(&s_requested);
+        int answered = 0;
+        for (int k = 0; k < OBD_DTC_KIND_COUNT; k++)
+            answered += read_kind((obd_dtc_kind_t)k);
+
+        last = now_ms();
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_reads++;
+        if (answered)
+            s_gen++;
+        xSemaphoreGive(s_lock);
+
+        atomic_store(&s_served, req);
+
+        ESP_LOGI(TAG, "Lettura DTC: memorizzati %u, in attesa %u, permanenti %u",
+                 (unsigned)s_lists[OBD_DTC_STORED].total, (unsigned)s_lists[OBD_DTC_PENDING].total,
+                 (unsigned)s_lists[OBD_DTC_PERMANENT].total);
+    }
+}
+
+void obd_dtc_start(void)
+{
+    if (s_wake)
+        return;
+
+    s_lock = xSemaphoreCreateMutex();
+    s_done = xSemaphoreCreateBinary();
+    s_wake = xSemaphoreCreateBinary();
+
+    xTaskCreatePinnedToCore(obd_dtc_task, "obd_dtc", APP_OBD_DTC_STACK, NULL, APP_OBD_DTC_PRIO, NULL,
+                            APP_CORE(APP_CORE_CAN));
+}
+
+void obd_dtc_request_refresh(void)
+{
+    if (!s_wake)
+        return; // task non avviato (es. replay sull'host)
+
+    atomic_fetch_add(&s_requested, 1);
+    xSemaphoreGive(s_wake);
+}
+
+void obd_dtc_note_count(uint32_t ecu_id, int32_t count)
+{
+    if (ecu_id < 0x7E8 || ecu_id > 0x7EF)
+        return;
+
+    if (atomic_exchange(&s_mil_count[ecu_id - 0x7E8], (int)count) != (int)count)
+        obd_dtc_request_refresh();
+}
+
+uint32_t obd_dtc_get(obd_dtc_kind_t kind, obd_dtc_list_t *out)
+{
+    if ((unsigned)kind >= OBD_DTC_KIND_COUNT || !out)
+        return 0;
+
+    if (!s_lock)
+    {
+        memset(out, 0, sizeof(*out));
+        return 0;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_lists[kind];
+    uint32_t gen = s_gen;
+    xSemaphoreGive(s_lock);
+    return gen;
+}
+
+void obd_dtc_get_info(obd_dtc_info_t *out)
+{
+    if (!out)
+        return;
+
+    memset(out, 0, sizeof(*out));
+    if (s_lock)
+    {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        out->gen = s_gen;
+        out->reads = s_reads;
+        xSemaphoreGive(s_lock);
+    }
+    out->requested = atomic_load(&s_requested);
+    out->busy = atomic_load(&s_served) != out->requested;
+    out->mil_count = -1;
+    for (int e = 0; e < 8; e++)
+    {
+        int c = atomic_load(&s_mil_count[e]);
+        if (c >= 0)
+            out->mil_count = (int16_t)((out->mil_count < 0 ? 0 : out->mil_count) + c);
+    }
+}
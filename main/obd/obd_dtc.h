@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Codici di errore (Mode 03 memorizzati, 07 in attesa, 0A permanenti)
+       letti da tutte le ECU e tenuti in cache. Una lettura parte solo se
+       il conteggio DTC del PID 0x01 cambia o se un client la chiede: le
+       consultazioni leggono la cache e non costano banda di polling. */
+
+#ifndef OBD_DTC_MAX
+// Codici tenuti per tipo (tutte le ECU insieme); gli altri sono contati
+#define OBD_DTC_MAX 32
+#endif
+
+#ifndef OBD_DTC_TIMEOUT_MS
+// Finestra di raccolta delle risposte di tutte le ECU per un servizio
+#define OBD_DTC_TIMEOUT_MS 300
+#endif
+
+#ifndef OBD_DTC_MIN_INTERVAL_MS
+// Distanza minima tra due letture: le richieste ravvicinate si fondono
+#define OBD_DTC_MIN_INTERVAL_MS 5000
+#endif
+
+    typedef enum
+    {
+        OBD_DTC_STORED = 0, // Mode 03
+        OBD_DTC_PENDING,    // Mode 07
+        OBD_DTC_PERMANENT,  // Mode 0A
+        OBD_DTC_KIND_COUNT
+    } obd_dtc_kind_t;
+
+    typedef struct
+    {
+        uint16_t ecu_id; // 0x7E8..0x7EF
+        uint16_t code;   // 2 byte SAE J2012 (vedi obd_dtc_format)
+    } obd_dtc_entry_t;
+
+    typedef struct
+    {
+        bool valid;        // almeno una lettura completata
+        uint32_t read_ms;  // fine dell'ultima lettura (ms dall'avvio)
+        uint8_t ecus;      // ECU che hanno risposto
+        uint8_t negative;  // ECU che hanno rifiutato il servizio
+        uint16_t total;    // codici dichiarati dalle ECU (anche oltre OBD_DTC_MAX)
+        uint16_t n;        // codici in code[]
+        obd_dtc_entry_t code[OBD_DTC_MAX];
+    } obd_dtc_list_t;
+
+    typedef struct
+    {
+        uint32_t gen;       // cresce a ogni lettura completata
+        uint32_t reads;     // letture eseguite
+        uint32_t requested; // richieste ricevute (conteggio cambiato o client)
+        bool busy;          // lettura in corso o in attesa
+        int16_t mil_count;  // somma degli ultimi conteggi PID 0x01 delle ECU (-1 = mai letto)
+    } obd_dtc_info_t;
+
+    /* Avvia il task delle letture (dopo obd_engine_start) */
+    void obd_dtc_start(void);
+
+    /* Chiede una lettura: ritorna subito, le richieste si fondono */
+    void obd_dtc_request_refresh(void);
+
+    /* Dallo scheduler: conteggio DTC del PID 0x01 ricevuto da ecu_id. Se
+       diverso dal precedente della stessa ECU (o il primo) chiede una
+       lettura. Non blocca. */
+    void obd_dtc_note_count(uint32_t ecu_id, int32_t count);
+
+    /* Copia coerente della lista di un tipo; ritorna la sua generazione */
+    uint32_t obd_dtc_get(obd_dtc_kind_t kind, obd_dtc_list_t *out);
+
+    void obd_dtc_get_info(obd_dtc_info_t *out);
+
+    /* "P0300": lettera di sistema + 4 cifre esadecimali (out >= 6 byte) */
+    void obd_dtc_format(uint16_t code, char out[6]);
+
+    /* Scompone la risposta di un servizio DTC (conteggio, poi 2 byte per
+       codice) accodando i codici diversi da 0 a list.
+       Ritorna i codici trovati, -1 se il payload è malformato. */
+    int obd_dtc_parse(const uint8_t *data, int len, uint16_t ecu_id, obd_dtc_list_t *list);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,98 @@
+#include "obd.h"
+
+#include <stddef.h>
+
+/* -------------------------------------------------------
+ * Tabella dei PID: per ogni campo pubblicato il PID sorgente, la
+ * decodifica intera verso il fixed-point (stessa risoluzione delle
+ * cifre decimali del JSON), chiave e unità, periodo e priorità di
+ * default. Per aggiungere un segnale: un valore in obd_field_t e una
+ * riga qui (più la classe di storico in obd_history.c). I campi
+ * derivati hanno solo chiave, unità e scala: li calcola obd_derived.c.
+ *
+ * Coefficienti: fixed = (raw * mul + add) / den, es. load
+ * (A*100/255 %, in decimi) = A*1000/255. L'offset sta nel numeratore
+ * perché l'arrotondamento dei negativi (trim) sia quello di lroundf.
+ * ------------------------------------------------------- */
+static const obd_pid_desc_t s_fields[OBD_FIELD_COUNT] = {
+    //                     pid   b  mask  trunc  mul   add      den  div  key             unit    ms    prio
+    [OBD_F_RPM]         = {0x0C, 2, 0,    true,  1,    0,       4,   1,   "rpm",          "rpm",  100,  0},
+    [OBD_F_SPEED]       = {0x0D, 1, 0,    false, 1,    0,       1,   1,   "speed",        "km/h", 100,  0},
+    [OBD_F_LOAD]        = {0x04, 1, 0,    false, 1000, 0,       255, 10,  "load",         "%",    100,  0},
+    [OBD_F_THROTTLE]    = {0x11, 1, 0,    false, 1000, 0,       255, 10,  "throttle",     "%",    100,  0},
+    [OBD_F_TIMING]      = {0x0E, 1, 0,    false, 5,    -640,    1,   10,  "timing",       "deg",  500,  1},
+    [OBD_F_COOLANT]     = {0x05, 1, 0,    false, 1,    -40,     1,   1,   "temp_coolant", "°C",   500,  1},
+    [OBD_F_INTAKE_TEMP] = {0x0F, 1, 0,    false, 1,    -40,     1,   1,   "temp_intake",  "°C",   500,  1},
+    [OBD_F_AMBIENT]     = {0x46, 1, 0,    false, 1,    -40,     1,   1,   "temp_ambient", "°C",   2000, 2},
+    [OBD_F_MAP]         = {0x0B, 1, 0,    false, 1,    0,       1,   1,   "press_intake", "kPa",  500,  1},
+    [OBD_F_BARO]        = {0x33, 1, 0,    false, 10,   0,       1,   10,  "press_baro",   "kPa",  500,  1},
+    [OBD_F_MAF]         = {0x10, 2, 0,    false, 1,    0,       1,   100, "maf",          "g/s",  500,  1},
+    [OBD_F_FUEL_LEVEL]  = {0x2F, 1, 0,    false, 1000, 0,       255, 10,  "fuel_lvl",     "%",    2000, 2},
+    [OBD_F_FUEL_PRESS]  = {0x0A, 1, 0,    false, 30,   0,       1,   10,  "fuel_press",   "kPa",  2000, 2},
+    [OBD_F_TRIM_SHORT]  = {0x06, 1, 0,    false, 1000, -128000, 128, 10,  "fuel_trim_s",  "%",    2000, 2},
+    [OBD_F_TRIM_LONG]   = {0x07, 1, 0,    false, 1000, -128000, 128, 10,  "fuel_trim_l",  "%",    2000, 2},
+    [OBD_F_BATTERY]     = {0x42, 2, 0,    false, 1,    0,       10,  100, "batt",         "V",    500,  1},
+    [OBD_F_DIST_MIL]    = {0x21, 2, 0,    false, 1,    0,       1,   1,   "dist_mil",     "km",   2000, 2},
+    [OBD_F_DTC_COUNT]   = {0x01, 1, 0x7F, false, 1,    0,       1,   1,   "dtc_count",    "",     2000, 2},
+    [OBD_F_FUEL_RATE]   = {0,    0, 0,    false, 0,    0,       0,   100, "fuel_rate",    "L/h",     0, 0},
+    [OBD_F_ECON]        = {0,    0, 0,    false, 0,    0,       0,   10,  "econ",         "L/100km", 0, 0},
+    [OBD_F_ECON_TRIP]   = {0,    0, 0,    false, 0,    0,       0,   10,  "econ_trip",    "L/100km", 0, 0},
+    [OBD_F_TRIP_DIST]   = {0,    0, 0,    false, 0,    0,       0,   100, "trip_dist",    "km",      0, 0},
+    [OBD_F_TRIP_FUEL]   = {0,    0, 0,    false, 0,    0,       0,   100, "trip_fuel",    "L",       0, 0},
+    [OBD_F_GEAR]        = {0,    0, 0,    false, 0,    0,       0,   1,   "gear",         "",        0, 0},
+    [OBD_F_T_0_100]     = {0,    0, 0,    false, 0,    0,       0,   100, "t_0_100",      "s",       0, 0},
+    [OBD_F_T_80_120]    = {0,    0, 0,    false, 0,    0,       0,   100, "t_80_120",     "s",       0, 0},
+};
+
+const obd_pid_desc_t *obd_field_desc(obd_field_t f)
+{
+    return (unsigned)f < OBD_FIELD_COUNT ? &s_fields[f] : NULL;
+}
+
+int32_t obd_field_decode(obd_field_t f, const uint8_t b[4])
+{
+    const obd_pid_desc_t *d = &s_fields[f];
+    int32_t raw = d->bytes == 2 ? (int32_t)(((uint32_t)b[0] << 8) | b[1])
+                                : (int32_t)(d->mask ? (b[0] & d->mask) : b[0]);
+    int32_t n = raw * d->mul + d->add;
+
+    if (d->den == 1)
+        return n;
+    if (d->trunc)
+        return n / d->den;
+    // arrotondamento a metà lontano da zero, come lroundf
+    return n >= 0 ? (n + d->den / 2) / d->den : -((-n + d->den / 2) / d->den);
+}
+
+int32_t obd_field_fixed(const obd_full_data_t *d, obd_field_t f)
+{
+    return (unsigned)f < OBD_FIELD_COUNT ? d->v[f] : 0;
+}
+
+float obd_field_value(const obd_full_data_t *d, obd_field_t f)
+{
+    return (unsigned)f < OBD_FIELD_COUNT ? (float)d->v[f] / (float)s_fields[f].div : 0.0f;
+}
+
+int obd_field_div(obd_field_t f)
+{
+    return (unsigned)f < OBD_FIELD_COUNT ? (int)s_fields[f].div : 1;
+}
+
+const char *obd_field_key(obd_field_t f)
+{
+    return (unsigned)f < OBD_FIELD_COUNT ? s_fields[f].key : "";
+}
+
+const char *obd_field_unit(obd_field_t f)
+{
+    return (unsigned)f < OBD_FIELD_COUNT ? s_fields[f].unit : "";
+}
+
+int obd_field_for_pid(uint8_t pid)
+{
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+        if (s_fields[f].bytes && s_fields[f].pid == pid)
+            return f;
+    return -1;
+}
@@ -0,0 +1,207 @@
+#include "obd_history.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+static const char *TAG = "OBD_HIST";
+
+/* -------------------------------------------------------
+ * Classe (dimensione ring) e riduzione di risoluzione per campo
+ * ------------------------------------------------------- */
+typedef enum
+{
+    HIST_HIGH = 0,
+    HIST_MED,
+    HIST_LOW,
+    HIST_NONE, // nessuno storico (campi derivati: /history va per PID)
+} hist_class_t;
+
+typedef struct
+{
+    hist_class_t cls;
+    int16_t reduce; // divisore extra rispetto a obd_field_fixed() per stare in 16 bit
+    bool u16;       // campo mai negativo: ring in uint16 (0..65535) invece di int16
+} hist_desc_t;
+
+static const hist_desc_t s_desc[OBD_FIELD_COUNT] = {
+    [OBD_F_RPM]         = {HIST_HIGH, 1},
+    [OBD_F_SPEED]       = {HIST_HIGH, 1},
+    [OBD_F_LOAD]        = {HIST_HIGH, 1},
+    [OBD_F_THROTTLE]    = {HIST_HIGH, 1},
+    [OBD_F_TIMING]      = {HIST_MED,  1},
+    [OBD_F_COOLANT]     = {HIST_MED,  1},
+    [OBD_F_INTAKE_TEMP] = {HIST_MED,  1},
+    [OBD_F_AMBIENT]     = {HIST_LOW,  1},
+    [OBD_F_MAP]         = {HIST_MED,  1},
+    [OBD_F_BARO]        = {HIST_MED,  1},
+    [OBD_F_MAF]         = {HIST_MED,  10},
+    [OBD_F_FUEL_LEVEL]  = {HIST_LOW,  1},
+    [OBD_F_FUEL_PRESS]  = {HIST_LOW,  1},
+    [OBD_F_TRIM_SHORT]  = {HIST_LOW,  1},
+    [OBD_F_TRIM_LONG]   = {HIST_LOW,  1},
+    [OBD_F_BATTERY]     = {HIST_MED,  1},
+    [OBD_F_DIST_MIL]    = {HIST_LOW,  1, true}, // 0..65535 km
+    [OBD_F_DTC_COUNT]   = {HIST_LOW,  1},
+    [OBD_F_FUEL_RATE]   = {HIST_NONE, 1},
+    [OBD_F_ECON]        = {HIST_NONE, 1},
+    [OBD_F_ECON_TRIP]   = {HIST_NONE, 1},
+    [OBD_F_TRIP_DIST]   = {HIST_NONE, 1},
+    [OBD_F_TRIP_FUEL]   = {HIST_NONE, 1},
+    [OBD_F_GEAR]        = {HIST_NONE, 1},
+    [OBD_F_T_0_100]     = {HIST_NONE, 1},
+    [OBD_F_T_80_120]    = {HIST_NONE, 1},
+};
+
+/* -------------------------------------------------------
+ * Ring per campo: t e v in array separati (6 byte/campione).
+ * written = campioni scritti in totale (cresce sempre).
+ * ------------------------------------------------------- */
+typedef struct
+{
+    uint32_t *t;
+    int16_t *v; // uint16 se s_desc[].u16
+    uint32_t cap;
+    atomic_uint written;
+} hist_ring_t;
+
+// campi per classe: obd_history_init() verifica che bastino per s_desc
+#define HIST_N_HIGH 4
+#define HIST_N_MED 7
+#define HIST_N_LOW 7
+
+static uint32_t s_t_high[HIST_N_HIGH][OBD_HIST_HIGH_SAMPLES];
+static int16_t s_v_high[HIST_N_HIGH][OBD_HIST_HIGH_SAMPLES];
+static uint32_t s_t_med[HIST_N_MED][OBD_HIST_MED_SAMPLES];
+static int16_t s_v_med[HIST_N_MED][OBD_HIST_MED_SAMPLES];
+static uint32_t s_t_low[HIST_N_LOW][OBD_HIST_LOW_SAMPLES];
+static int16_t s_v_low[HIST_N_LOW][OBD_HIST_LOW_SAMPLES];
+
+static hist_ring_t s_rings[OBD_FIELD_COUNT];
+
+void obd_history_init(void)
+{
+    static const int k_slots[HIST_NONE] = {HIST_N_HIGH, HIST_N_MED, HIST_N_LOW};
+    int used[HIST_NONE] = {0, 0, 0};
+
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+    {
+        hist_ring_t *r = &s_rings[f];
+        atomic_store(&r->written, 0);
+        if (s_desc[f].cls == HIST_NONE)
+            continue;
+
+        int k = used[s_desc[f].cls]++;
+        if (k >= k_slots[s_desc[f].cls])
+        {
+            // s_desc e HIST_N_* non corrispondono: oltre si scriverebbe fuori dagli array
+            ESP_LOGE(TAG, "Classe %d: più di %d campi, aggiornare HIST_N_*",
+                     (int)s_desc[f].cls, k_slots[s_desc[f].cls]);
+            abort();
+        }
+
+        switch (s_desc[f].cls)
+        {
+        case HIST_HIGH:
+            r->t = s_t_high[k];
+            r->v = s_v_high[k];
+            r->cap = OBD_HIST_HIGH_SAMPLES;
+            break;
+        case HIST_MED:
+            r->t = s_t_med[k];
+            r->v = s_v_med[k];
+            r->cap = OBD_HIST_MED_SAMPLES;
+            break;
+        default:
+            r->t = s_t_low[k];
+            r->v = s_v_low[k];
+            r->cap = OBD_HIST_LOW_SAMPLES;
+            break;
+        }
+    }
+
+    ESP_LOGI(TAG, "History: %u byte (%d/%d/%d campioni per classe)",
+             (unsigned)(sizeof(s_t_high) + sizeof(s_v_high) + sizeof(s_t_med) +
+                        sizeof(s_v_med) + sizeof(s_t_low) + sizeof(s_v_low)),
+             OBD_HIST_HIGH_SAMPLES, OBD_HIST_MED_SAMPLES, OBD_HIST_LOW_SAMPLES);
+}
+
+static int16_t field_fixed(obd_field_t f, const obd_full_data_t *d)
+{
+    int32_t v = obd_field_fixed(d, f) / s_desc[f].reduce;
+
+    if (s_desc[f].u16)
+        return (int16_t)(uint16_t)(v > 65535 ? 65535 : v < 0 ? 0 : v);
+    if (v > 32767)
+        return 32767;
+    if (v < -32768)
+        return -32768;
+    return (int16_t)v;
+}
+
+void obd_history_record(obd_field_t f, uint32_t t_ms, const obd_full_data_t *d)
+{
+    if ((unsigned)f >= OBD_FIELD_COUNT || s_rings[f].cap == 0)
+        return;
+
+    hist_ring_t *r = &s_rings[f];
+    uint32_t n = atomic_load_explicit(&r->written, memory_order_relaxed);
+    uint32_t i = n % r->cap;
+
+    r->t[i] = t_ms;
+    r->v[i] = field_fixed(f, d);
+
+    atomic_store_explicit(&r->written, n + 1, memory_order_release);
+}
+
+int obd_history_read(obd_field_t f, uint32_t since_ms, obd_hist_sample_t *out, int max)
+{
+    if ((unsigned)f >= OBD_FIELD_COUNT || s_rings[f].cap == 0 || max <= 0)
+        return 0;
+
+    hist_ring_t *r = &s_rings[f];
+    uint32_t end = atomic_load_explicit(&r->written, memory_order_acquire);
+    uint32_t begin = end > r->cap ? end - r->cap : 0;
+
+    // i tempi sono monotoni: ricerca binaria del primo campione > since
+    uint32_t lo = begin, hi = end;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ((int32_t)(r->t[mid % r->cap] - since_ms) > 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    int n = 0;
+    for (uint32_t k = lo; k < end && n < max; k++, n++)
+    {
+        out[n].t_ms = r->t[k % r->cap];
+        int16_t v = r->v[k % r->cap];
+        out[n].v = s_desc[f].u16 ? (int32_t)(uint16_t)v : v;
+    }
+
+    // scarta in testa ciò che lo scrittore ha sovrascritto nel frattempo
+    atomic_thread_fence(memory_order_acquire);
+    uint32_t end2 = atomic_load_explicit(&r->written, memory_order_relaxed);
+    uint32_t safe = end2 > r->cap ? end2 - r->cap : 0;
+
+    if (safe > lo)
+    {
+        uint32_t drop = safe - lo;
+        if (drop >= (uint32_t)n)
+            return 0;
+        memmove(out, out + drop, sizeof(*out) * (size_t)(n - (int)drop));
+        n -= (int)drop;
+    }
+
+    return n;
+}
+
+int obd_history_div(obd_field_t f)
+{
+    return (unsigned)f < OBD_FIELD_COUNT ? obd_field_div(f) / s_desc[f].reduce : 1;
+}
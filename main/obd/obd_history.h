@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "obd.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Campioni per campo, per classe di priorità (memoria fissa, statica).
+       Con i periodi di default: ~2 min (alta), ~5 min (media), ~10 min (bassa). */
+#ifndef OBD_HIST_HIGH_SAMPLES
+#define OBD_HIST_HIGH_SAMPLES 1200
+#endif
+#ifndef OBD_HIST_MED_SAMPLES
+#define OBD_HIST_MED_SAMPLES 600
+#endif
+#ifndef OBD_HIST_LOW_SAMPLES
+#define OBD_HIST_LOW_SAMPLES 300
+#endif
+
+    typedef struct
+    {
+        uint32_t t_ms; // istante (ms dall'avvio)
+        int32_t v;     // valore * div (vedi obd_history_div)
+    } obd_hist_sample_t;
+
+    void obd_history_init(void);
+
+    /* Scrittore unico (task RT): accoda il valore corrente del campo f */
+    void obd_history_record(obd_field_t f, uint32_t t_ms, const obd_full_data_t *d);
+
+    /* Copia fino a max campioni con t_ms > since_ms, dal più vecchio.
+       Non blocca mai lo scrittore: i campioni sovrascritti durante la
+       copia vengono scartati. */
+    int obd_history_read(obd_field_t f, uint32_t since_ms, obd_hist_sample_t *out, int max);
+
+    /* Divisore fixed-point dei campioni del campo (valore = v / div) */
+    int obd_history_div(obd_field_t f);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,345 @@
+#include "obd_metrics.h"
+#include "can_bus.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Limiti dei bucket (µs). Le risposte OBD vanno da pochi ms (gateway
+   veloce) al timeout di 100 ms; il dispatch RX -> RT e i tempi HTTP
+   sono ordini di grandezza sotto. */
+static const uint32_t k_le_obd[OBD_HIST_BUCKETS - 1] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000};
+static const uint32_t k_le_fast[OBD_HIST_BUCKETS - 1] = {
+    10, 20, 50, 100, 200, 500, 1000, 5000, 20000};
+static const uint32_t k_le_http[OBD_HIST_BUCKETS - 1] = {
+    100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000};
+
+/* -------------------------------------------------------
+ * Istogrammi
+ * ------------------------------------------------------- */
+void obd_hist_record(obd_hist_t *h, uint32_t us)
+{
+    int b = 0;
+    while (b < OBD_HIST_BUCKETS - 1 && us > h->le[b])
+        b++;
+
+    atomic_fetch_add_explicit(&h->count[b], 1, memory_order_relaxed);
+
+    // somma su due parole: il riporto va nella alta quando la bassa gira
+    unsigned old = atomic_fetch_add_explicit(&h->sum_lo, us, memory_order_relaxed);
+    if (old + us < old)
+        atomic_fetch_add_explicit(&h->sum_hi, 1, memory_order_relaxed);
+}
+
+void obd_hist_read(const obd_hist_t *h, obd_hist_snap_t *out)
+{
+    uint32_t acc = 0;
+    for (int b = 0; b < OBD_HIST_BUCKETS; b++)
+    {
+        acc += atomic_load_explicit(&h->count[b], memory_order_relaxed);
+        out->cum[b] = acc;
+    }
+    out->count = acc;
+
+    // riporto a cavallo della lettura: rilegge la parte alta
+    uint32_t hi, lo;
+    do
+    {
+        hi = atomic_load_explicit(&h->sum_hi, memory_order_relaxed);
+        lo = atomic_load_explicit(&h->sum_lo, memory_order_relaxed);
+    } while (hi != atomic_load_explicit(&h->sum_hi, memory_order_relaxed));
+    out->sum_us = ((uint64_t)hi << 32) | lo;
+}
+
+/* -------------------------------------------------------
+ * Metriche per PID: slot assegnato al primo evento. Gli eventi per PID
+ * arrivano solo dal task RT, quindi l'assegnazione non ha concorrenti;
+ * il release sullo slot rende visibile la voce ai lettori.
+ * ------------------------------------------------------- */
+typedef struct
+{
+    obd_hist_t latency;
+    atomic_uint timeouts;
+    atomic_uint backoffs;
+} pid_metrics_t;
+
+static pid_metrics_t s_pid[OBD_METRICS_MAX_PIDS] = {
+    [0 ... OBD_METRICS_MAX_PIDS - 1] = {.latency = OBD_HIST_INIT(k_le_obd)}};
+static atomic_uchar s_pid_slot[256]; // 0 = nessuno, altrimenti slot + 1
+static int s_npid;
+
+typedef struct
+{
+    obd_hist_t latency;
+    atomic_uint timeouts;
+} ecu_metrics_t;
+
+static ecu_metrics_t s_ecu[8] = { // 0x7E8..0x7EF
+    [0 ... 7] = {.latency = OBD_HIST_INIT(k_le_obd)}};
+
+static obd_hist_t s_rt_dispatch = OBD_HIST_INIT(k_le_fast);
+static obd_hist_t s_http[OBD_METRICS_HTTP_COUNT] = {
+    OBD_HIST_INIT(k_le_http), OBD_HIST_INIT(k_le_http), OBD_HIST_INIT(k_le_http)};
+static atomic_uint s_tx_fail;
+
+static const char *const k_http_names[OBD_METRICS_HTTP_COUNT] = {"/data", "/data.bin", "/ws"};
+
+static pid_metrics_t *pid_get(uint8_t pid)
+{
+    unsigned s = atomic_load_explicit(&s_pid_slot[pid], memory_order_acquire);
+    if (s)
+        return &s_pid[s - 1];
+
+    if (s_npid >= OBD_METRICS_MAX_PIDS)
+        return NULL;
+
+    s_npid++;
+    atomic_store_explicit(&s_pid_slot[pid], (unsigned char)s_npid, memory_order_release);
+    return &s_pid[s_npid - 1];
+}
+
+static ecu_metrics_t *ecu_get(uint32_t ecu_id)
+{
+    if (ecu_id < 0x7E8 || ecu_id > 0x7EF)
+        return NULL;
+
+    return &s_ecu[ecu_id - 0x7E8];
+}
+
+void obd_metrics_pid_latency(uint8_t pid, uint32_t us)
+{
+    pid_metrics_t *m = pid_get(pid);
+    if (m)
+        obd_hist_record(&m->latency, us);
+}
+
+void obd_metrics_pid_timeout(uint8_t pid)
+{
+    pid_metrics_t *m = pid_get(pid);
+    if (m)
+        atomic_fetch_add_explicit(&m->timeouts, 1, memory_order_relaxed);
+}
+
+void obd_metrics_pid_backoff(uint8_t pid)
+{
+    pid_metrics_t *m = pid_get(pid);
+    if (m)
+        atomic_fetch_add_explicit(&m->backoffs, 1, memory_order_relaxed);
+}
+
+void obd_metrics_ecu_latency(uint32_t ecu_id, uint32_t us)
+{
+    ecu_metrics_t *m = ecu_get(ecu_id);
+    if (m)
+        obd_hist_record(&m->latency, us);
+}
+
+void obd_metrics_ecu_timeout(uint32_t ecu_id)
+{
+    ecu_metrics_t *m = ecu_get(ecu_id);
+    if (m)
+        atomic_fetch_add_explicit(&m->timeouts, 1, memory_order_relaxed);
+}
+
+void obd_metrics_tx_fail(void)
+{
+    atomic_fetch_add_explicit(&s_tx_fail, 1, memory_order_relaxed);
+}
+
+void obd_metrics_rt_dispatch(uint32_t us)
+{
+    obd_hist_record(&s_rt_dispatch, us);
+}
+
+void obd_metrics_http_time(obd_metrics_http_t h, uint32_t us)
+{
+    if ((unsigned)h < OBD_METRICS_HTTP_COUNT)
+        obd_hist_record(&s_http[h], us);
+}
+
+/* -------------------------------------------------------
+ * Esportazione: righe accumulate in un blocco, emesso quando pieno
+ * ------------------------------------------------------- */
+typedef struct
+{
+    obd_metrics_emit_t emit;
+    void *ctx;
+    int len;
+    char buf[OBD_METRICS_CHUNK];
+} out_t;
+
+static void out_flush(out_t *o)
+{
+    if (o->len > 0)
+        o->emit(o->buf, o->len, o->ctx);
+    o->len = 0;
+}
+
+static void out_printf(out_t *o, const char *fmt, ...)
+{
+    char line[192];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+
+    if (n < 0)
+        return;
+    if (n >= (int)sizeof(line))
+        n = sizeof(line) - 1;
+
+    if (o->len + n > (int)sizeof(o->buf))
+        out_flush(o);
+    memcpy(o->buf + o->len, line, (size_t)n);
+    o->len += n;
+}
+
+static void out_family(out_t *o, const char *name, const char *type, const char *help)
+{
+    out_printf(o, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* µs in secondi senza float: 1500 -> "0.0015" */
+static const char *secs(char *b, size_t cap, uint64_t us)
+{
+    int n = snprintf(b, cap, "%llu.%06llu", (unsigned long long)(us / 1000000U),
+                     (unsigned long long)(us % 1000000U));
+    while (n > 2 && b[n - 1] == '0' && b[n - 2] != '.')
+        b[--n] = '\0';
+    return b;
+}
+
+/* labels: "pid=\"0x0C\"" oppure "" */
+static void out_hist(out_t *o, const char *name, const char *labels, const obd_hist_t *h)
+{
+    obd_hist_snap_t s;
+    char le[24];
+    const char *sep = labels[0] ? "," : "";
+
+    obd_hist_read(h, &s);
+
+    for (int b = 0; b < OBD_HIST_BUCKETS - 1; b++)
+        out_printf(o, "%s_bucket{%s%sle=\"%s\"} %lu\n", name, labels, sep,
+                   secs(le, sizeof(le), h->le[b]), (unsigned long)s.cum[b]);
+    out_printf(o, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, sep,
+               (unsigned long)s.count);
+    out_printf(o, "%s_sum%s%s%s %s\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+               secs(le, sizeof(le), s.sum_us));
+    out_printf(o, "%s_count%s%s%s %lu\n", name, labels[0] ? "{" : "", labels,
+               labels[0] ? "}" : "", (unsigned long)s.count);
+}
+
+/* ECU mai sentita (né risposte né timeout): non esportata */
+static bool ecu_seen(const ecu_metrics_t *m)
+{
+    if (atomic_load_explicit(&m->timeouts, memory_order_relaxed))
+        return true;
+    for (int b = 0; b < OBD_HIST_BUCKETS; b++)
+        if (atomic_load_explicit(&m->latency.count[b], memory_order_relaxed))
+            return true;
+    return false;
+}
+
+static pid_metrics_t *pid_find(int pid)
+{
+    unsigned s = atomic_load_explicit(&s_pid_slot[pid], memory_order_acquire);
+    return s ? &s_pid[s - 1] : NULL;
+}
+
+void obd_metrics_export(obd_metrics_emit_t emit, void *ctx)
+{
+    out_t o = {.emit = emit, .ctx = ctx};
+    char lab[32];
+
+    // ---- per PID ----
+    out_family(&o, "obd_pid_response_seconds", "histogram",
+               "Request to response time of answered Mode 01 PIDs");
+    for (int pid = 0; pid < 256; pid++)
+    {
+        pid_metrics_t *m = pid_find(pid);
+        if (!m)
+            continue;
+        snprintf(lab, sizeof(lab), "pid=\"0x%02X\"", pid);
+        out_hist(&o, "obd_pid_response_seconds", lab, &m->latency);
+    }
+
+    out_family(&o, "obd_pid_timeouts_total", "counter", "PIDs requested but not answered");
+    for (int pid = 0; pid < 256; pid++)
+    {
+        pid_metrics_t *m = pid_find(pid);
+        if (m)
+            out_printf(&o, "obd_pid_timeouts_total{pid=\"0x%02X\"} %u\n", pid,
+                       atomic_load_explicit(&m->timeouts, memory_order_relaxed));
+    }
+
+    out_family(&o, "obd_pid_backoff_total", "counter", "Times a PID entered failure backoff");
+    for (int pid = 0; pid < 256; pid++)
+    {
+        pid_metrics_t *m = pid_find(pid);
+        if (m)
+            out_printf(&o, "obd_pid_backoff_total{pid=\"0x%02X\"} %u\n", pid,
+                       atomic_load_explicit(&m->backoffs, memory_order_relaxed));
+    }
+
+    // ---- per ECU ----
+    out_family(&o, "obd_ecu_response_seconds", "histogram",
+               "Request to response time per responding ECU");
+    for (int e = 0; e < 8; e++)
+    {
+        if (!ecu_seen(&s_ecu[e]))
+            continue;
+        snprintf(lab, sizeof(lab), "ecu=\"0x%03X\"", 0x7E8 + e);
+        out_hist(&o, "obd_ecu_response_seconds", lab, &s_ecu[e].latency);
+    }
+
+    out_family(&o, "obd_ecu_timeouts_total", "counter", "Request timeouts attributed to an ECU");
+    for (int e = 0; e < 8; e++)
+    {
+        if (ecu_seen(&s_ecu[e]))
+            out_printf(&o, "obd_ecu_timeouts_total{ecu=\"0x%03X\"} %u\n", 0x7E8 + e,
+                       atomic_load_explicit(&s_ecu[e].timeouts, memory_order_relaxed));
+    }
+
+    // ---- scheduler e CAN ----
+    out_family(&o, "obd_rt_dispatch_seconds", "histogram",
+               "Delay from response completion in the RX task to the RT task");
+    out_hist(&o, "obd_rt_dispatch_seconds", "", &s_rt_dispatch);
+
+    out_family(&o, "obd_can_tx_failures_total", "counter", "Frames the CAN driver refused to send");
+    out_printf(&o, "obd_can_tx_failures_total %u\n",
+               atomic_load_explicit(&s_tx_fail, memory_order_relaxed));
+
+    twai_status_info_t tw;
+    if (can_bus_get_status(&tw) == ESP_OK)
+    {
+        out_family(&o, "twai_state", "gauge",
+                   "Controller state: 0 stopped, 1 running, 2 bus off, 3 recovering");
+        out_printf(&o, "twai_state %d\n", (int)tw.state);
+        out_family(&o, "twai_error_counter", "gauge", "TEC and REC of the controller");
+        out_printf(&o, "twai_error_counter{dir=\"tx\"} %lu\ntwai_error_counter{dir=\"rx\"} %lu\n",
+                   (unsigned long)tw.tx_error_counter, (unsigned long)tw.rx_error_counter);
+        out_family(&o, "twai_bus_errors_total", "counter", "Bus errors seen by the controller");
+        out_printf(&o, "twai_bus_errors_total %lu\n", (unsigned long)tw.bus_error_count);
+        out_family(&o, "twai_arbitration_lost_total", "counter", "Arbitration losses");
+        out_printf(&o, "twai_arbitration_lost_total %lu\n", (unsigned long)tw.arb_lost_count);
+        out_family(&o, "twai_rx_overruns_total", "counter", "Frames lost to RX FIFO overrun");
+        out_printf(&o, "twai_rx_overruns_total %lu\n", (unsigned long)tw.rx_overrun_count);
+        out_family(&o, "twai_rx_missed_total", "counter", "Frames lost to a full RX queue");
+        out_printf(&o, "twai_rx_missed_total %lu\n", (unsigned long)tw.rx_missed_count);
+        out_family(&o, "twai_tx_failed_total", "counter", "Transmissions that failed");
+        out_printf(&o, "twai_tx_failed_total %lu\n", (unsigned long)tw.tx_failed_count);
+    }
+
+    // ---- HTTP ----
+    out_family(&o, "http_request_duration_seconds", "histogram",
+               "Handler service time, request to last byte");
+    for (int h = 0; h < OBD_METRICS_HTTP_COUNT; h++)
+    {
+        snprintf(lab, sizeof(lab), "handler=\"%s\"", k_http_names[h]);
+        out_hist(&o, "http_request_duration_seconds", lab, &s_http[h]);
+    }
+
+    out_flush(&o);
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Metriche del percorso caldo: latenza richiesta -> risposta per PID
+       e per ECU in istogrammi a bucket fissi, timeout, ingressi in
+       backoff, TX fallite, tempi di servizio HTTP. Registrare costa
+       qualche confronto e due incrementi atomici: nessun lock, nessuna
+       allocazione, chiamabile da qualunque task. L'esportazione è testo
+       Prometheus (/metrics). */
+
+#ifndef OBD_METRICS_MAX_PIDS
+// PID con un proprio istogramma; gli altri finiscono solo nei totali per ECU
+#define OBD_METRICS_MAX_PIDS 32
+#endif
+
+    // limiti superiori dei bucket (µs) + il bucket oltre l'ultimo (+Inf)
+#define OBD_HIST_BUCKETS 10
+
+    typedef struct
+    {
+        const uint32_t *le;                   // OBD_HIST_BUCKETS - 1 limiti crescenti
+        atomic_uint count[OBD_HIST_BUCKETS];  // non cumulativi
+        atomic_uint sum_lo, sum_hi;           // somma in µs su 64 bit
+    } obd_hist_t;
+
+    /* Istogramma con i limiti dati (tabella statica, OBD_HIST_BUCKETS - 1 voci) */
+#define OBD_HIST_INIT(bounds) {.le = (bounds)}
+
+    void obd_hist_record(obd_hist_t *h, uint32_t us);
+
+    /* Copia: bucket cumulativi come in Prometheus, count = ultimo bucket */
+    typedef struct
+    {
+        uint32_t cum[OBD_HIST_BUCKETS];
+        uint32_t count;
+        uint64_t sum_us;
+    } obd_hist_snap_t;
+
+    void obd_hist_read(const obd_hist_t *h, obd_hist_snap_t *out);
+
+    /* ---- Eventi ---- */
+
+    /* Risposta con il PID: us dall'invio della richiesta */
+    void obd_metrics_pid_latency(uint8_t pid, uint32_t us);
+    /* PID richiesto e non ricevuto (timeout o risposta parziale) */
+    void obd_metrics_pid_timeout(uint8_t pid);
+    /* Il PID è entrato in backoff (fail consecutivi oltre la soglia) */
+    void obd_metrics_pid_backoff(uint8_t pid);
+
+    /* Risposta di ecu_id (0x7E8..0x7EF) a una richiesta Mode 01 */
+    void obd_metrics_ecu_latency(uint32_t ecu_id, uint32_t us);
+    void obd_metrics_ecu_timeout(uint32_t ecu_id);
+
+    /* can_bus_send fallita (richiesta o flow control) */
+    void obd_metrics_tx_fail(void);
+
+    /* Dal completamento nel task RX alla presa in carico nel task RT */
+    void obd_metrics_rt_dispatch(uint32_t us);
+
+    typedef enum
+    {
+        OBD_METRICS_HTTP_DATA = 0, // /data
+        OBD_METRICS_HTTP_DATA_BIN, // /data.bin
+        OBD_METRICS_HTTP_WS_PUSH,  // un invio dello stream /ws a tutti i client
+        OBD_METRICS_HTTP_COUNT
+    } obd_metrics_http_t;
+
+    /* Tempo di servizio di un handler, dalla richiesta all'ultimo byte */
+    void obd_metrics_http_time(obd_metrics_http_t h, uint32_t us);
+
+    /* ---- Esportazione ---- */
+
+    /* Riceve il testo a blocchi (mai più di OBD_METRICS_CHUNK byte) */
+    typedef void (*obd_metrics_emit_t)(const char *text, int len, void *ctx);
+
+#ifndef OBD_METRICS_CHUNK
+#define OBD_METRICS_CHUNK 1024
+#endif
+
+    /* Formato di esposizione testuale Prometheus 0.0.4, compresi i
+       contatori del driver TWAI */
+    void obd_metrics_export(obd_metrics_emit_t emit, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
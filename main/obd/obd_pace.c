@@ -0,0 +1,259 @@
+#include "obd_pace.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+
+static const char *TAG = "OBD_PACE";
+
+/* -------------------------------------------------------
+ * Stato per ECU: stima RTT (come TCP, EWMA 1/8) e controllore AIMD sul
+ * ritmo (richieste/s), non sulla spaziatura: lo stesso passo additivo
+ * vale qualche ms a ritmo lento e 1 ms a ritmo pieno, così il recupero
+ * dopo un dimezzamento dura pochi secondi anche partendo da 200 ms.
+ *  - risposta puntuale: ogni OBD_PACE_AI_EVERY, +OBD_PACE_AI_RATE req/s;
+ *    la pipeline cresce molto più piano, solo se è lei il collo di bottiglia
+ *  - risposta accodata (RTT >> minimo, con più richieste in volo): +1 ms e
+ *    una richiesta in volo in meno
+ *  - timeout con segni di congestione (coda o due di fila): ritmo dimezzato,
+ *    richieste in volo dimezzate
+ *  - timeout isolato con RTT pulite: perdita casuale, solo una in volo in meno
+ * ------------------------------------------------------- */
+typedef struct
+{
+    bool seen;
+    bool queued;       // l'ultima risposta era accodata
+    uint32_t last_ms;  // ultima risposta
+    uint32_t srtt_x8;  // RTT smussata * 8 (µs, come tutte le RTT)
+    uint32_t rtt_min;  // minimo sulla finestra precedente e su quella in corso
+    uint32_t rtt_min_win;
+    uint32_t win_ms;   // inizio della finestra in corso
+    uint32_t rtt_max;
+    uint32_t answers;
+    uint32_t timeouts;
+    uint16_t spacing;
+    uint8_t inflight;
+    uint8_t lost;      // timeout consecutivi senza risposte in mezzo
+    uint8_t streak;    // risposte puntuali dall'ultimo passo additivo
+    uint8_t depth_streak; // risposte puntuali dall'ultimo cambio di profondità
+} ecu_pace_t;
+
+static ecu_pace_t s_ecu[OBD_PACE_ECUS];
+
+// ritmo effettivo, ricalcolato a ogni evento
+static uint16_t s_spacing = OBD_REQ_SPACING_MS;
+static uint8_t s_inflight = OBD_MAX_INFLIGHT;
+static uint32_t s_recalc_ms;
+
+static int ecu_index(uint32_t ecu_id)
+{
+    if (ecu_id < 0x7E8 || ecu_id > 0x7EF)
+        return -1;
+    return (int)(ecu_id - 0x7E8);
+}
+
+static bool ecu_active(const ecu_pace_t *e, uint32_t now)
+{
+    return e->seen && (uint32_t)(now - e->last_ms) < OBD_PACE_ACTIVE_MS;
+}
+
+/* Vince l'ECU attiva più lenta; nessuna attiva = valori iniziali */
+static void recalc(uint32_t now)
+{
+    uint16_t spacing = 0;
+    uint8_t inflight = OBD_MAX_INFLIGHT;
+    bool any = false;
+
+    for (int i = 0; i < OBD_PACE_ECUS; i++)
+    {
+        const ecu_pace_t *e = &s_ecu[i];
+        if (!ecu_active(e, now))
+            continue;
+
+        any = true;
+        if (e->spacing > spacing)
+            spacing = e->spacing;
+        if (e->inflight < inflight)
+            inflight = e->inflight;
+    }
+
+    uint16_t old = s_spacing;
+    s_spacing = any ? spacing : OBD_REQ_SPACING_MS;
+    s_inflight = any ? inflight : OBD_MAX_INFLIGHT;
+    s_recalc_ms = now;
+
+    // solo i cambi importanti: il controllore si muove di 1 ms alla volta
+    if (s_spacing >= old * 2 || s_spacing * 2 <= old)
+        ESP_LOGI(TAG, "Ritmo %u -> %u ms, %u in volo", (unsigned)old, (unsigned)s_spacing,
+                 (unsigned)s_inflight);
+}
+
+void obd_pace_init(uint32_t now_ms)
+{
+    memset(s_ecu, 0, sizeof(s_ecu));
+    s_spacing = OBD_REQ_SPACING_MS;
+    s_inflight = OBD_MAX_INFLIGHT;
+    s_recalc_ms = now_ms;
+}
+
+#if OBD_PACE_ADAPTIVE
+/* Passo additivo sul ritmo: 1000/s -> 1000/s + OBD_PACE_AI_RATE, almeno 1 ms */
+static uint16_t spacing_faster(uint16_t spacing)
+{
+    uint32_t next = 1000U * spacing / (1000U + (uint32_t)OBD_PACE_AI_RATE * spacing);
+    if (next >= spacing)
+        next = spacing - 1U;
+    return next < OBD_PACE_MIN_MS ? OBD_PACE_MIN_MS : (uint16_t)next;
+}
+#endif
+
+static ecu_pace_t *ecu_get(uint32_t ecu_id, uint32_t now)
+{
+    int i = ecu_index(ecu_id);
+    if (i < 0)
+        return NULL;
+
+    ecu_pace_t *e = &s_ecu[i];
+    if (!e->seen)
+    {
+        e->seen = true;
+        e->spacing = OBD_REQ_SPACING_MS;
+        e->inflight = OBD_MAX_INFLIGHT;
+        e->last_ms = now;
+        e->win_ms = now;
+    }
+    return e;
+}
+
+void obd_pace_answer(uint32_t ecu_id, uint32_t rtt_us, uint32_t now_ms)
+{
+    ecu_pace_t *e = ecu_get(ecu_id, now_ms);
+    if (!e)
+        return;
+
+    // tetto a ~60 s: srtt_x8 resta nei 32 bit
+    uint32_t rtt = rtt_us > 60000000U ? 60000000U : rtt_us;
+
+    e->answers++;
+    e->last_ms = now_ms;
+    if (e->srtt_x8 == 0)
+        e->srtt_x8 = (uint32_t)rtt * 8U;
+    else
+        e->srtt_x8 += rtt - (e->srtt_x8 >> 3); // += (rtt - srtt) / 8, in unità /8
+    // minimo a finestra: un'ECU diventata lenta non sembra accodare per sempre
+    if ((uint32_t)(now_ms - e->win_ms) >= OBD_PACE_MIN_WINDOW_MS)
+    {
+        e->rtt_min = e->rtt_min_win;
+        e->rtt_min_win = 0;
+        e->win_ms = now_ms;
+    }
+    if (rtt == 0)
+        rtt = 1;
+    if (e->rtt_min_win == 0 || rtt < e->rtt_min_win)
+        e->rtt_min_win = rtt;
+    if (e->rtt_min == 0 || rtt < e->rtt_min)
+        e->rtt_min = rtt;
+    if (rtt > e->rtt_max)
+        e->rtt_max = rtt;
+
+    e->lost = 0;
+
+#if OBD_PACE_ADAPTIVE
+    // con una sola richiesta in volo non c'è coda nostra: l'ECU è solo lenta
+    if (s_inflight > 1 && rtt > 2U * e->rtt_min + OBD_PACE_QUEUE_SLACK_MS * 1000U)
+    {
+        // l'ECU accoda: rallenta di poco, prima che arrivino i timeout
+        e->queued = true;
+        e->streak = 0;
+        e->depth_streak = 0;
+        if (e->spacing < OBD_PACE_MAX_MS)
+            e->spacing++;
+        if (e->inflight > 1)
+            e->inflight--;
+    }
+    else
+    {
+        e->queued = false;
+        if (++e->streak >= OBD_PACE_AI_EVERY)
+        {
+            e->streak = 0;
+            e->spacing = spacing_faster(e->spacing);
+        }
+
+        // più richieste in volo solo se una RTT supera la finestra attuale
+        uint32_t srtt = e->srtt_x8 >> 3;
+        if (++e->depth_streak >= OBD_PACE_AI_EVERY * 8U)
+        {
+            e->depth_streak = 0;
+            if (e->inflight < OBD_MAX_INFLIGHT && srtt > 1000U * e->spacing * e->inflight)
+                e->inflight++;
+        }
+    }
+#endif
+
+    recalc(now_ms);
+}
+
+void obd_pace_timeout(uint32_t ecu_id, uint32_t now_ms)
+{
+    ecu_pace_t *e = ecu_get(ecu_id, now_ms);
+    if (!e)
+        return;
+
+    e->timeouts++;
+
+#if OBD_PACE_ADAPTIVE
+    e->streak = 0;
+    e->depth_streak = 0;
+    if (e->lost++ > 0 || e->queued)
+    {
+        e->spacing = e->spacing * 2U > OBD_PACE_MAX_MS ? OBD_PACE_MAX_MS : (uint16_t)(e->spacing * 2U);
+        e->inflight = e->inflight > 1 ? (uint8_t)(e->inflight / 2) : 1;
+        e->queued = false;
+    }
+    else if (e->inflight > 1)
+    {
+        e->inflight--;
+    }
+#endif
+
+    recalc(now_ms);
+}
+
+uint32_t obd_pace_spacing(uint32_t now_ms)
+{
+    // un'ECU sparita smette di frenare anche senza nuovi eventi
+    if ((uint32_t)(now_ms - s_recalc_ms) >= 1000U)
+        recalc(now_ms);
+    return s_spacing;
+}
+
+int obd_pace_inflight(void)
+{
+    return s_inflight;
+}
+
+void obd_pace_get(obd_pace_info_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->spacing_ms = s_spacing;
+    out->inflight = s_inflight;
+
+    for (int i = 0; i < OBD_PACE_ECUS; i++)
+    {
+        const ecu_pace_t *e = &s_ecu[i];
+        if (!e->seen)
+            continue;
+
+        obd_pace_ecu_t *o = &out->ecu[out->ecu_count++];
+        o->id = (uint16_t)(0x7E8 + i);
+        o->active = ecu_active(e, s_recalc_ms);
+        o->srtt_us = e->srtt_x8 >> 3;
+        o->rtt_min_us = e->rtt_min;
+        o->rtt_max_us = e->rtt_max;
+        o->answers = e->answers;
+        o->timeouts = e->timeouts;
+        o->spacing_ms = e->spacing;
+        o->inflight = e->inflight;
+    }
+}
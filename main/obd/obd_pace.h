@@ -0,0 +1,107 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Ritmo delle richieste dello scheduler, adattato a runtime (AIMD) sulla
+       latenza e sui timeout misurati per ECU. Le richieste Mode 01 sono
+       funzionali (0x7DF) e arrivano a tutte le ECU: vale il ritmo della più
+       lenta tra quelle che hanno risposto di recente. */
+
+#ifndef OBD_REQ_SPACING_MS
+// Spaziatura iniziale tra richieste e riferimento dell'admission control
+// (25ms ≈ 40 req/s); a runtime il controllore la porta a quella che le
+// ECU presenti reggono davvero.
+#define OBD_REQ_SPACING_MS 25
+#endif
+
+#ifndef OBD_MAX_INFLIGHT
+// Limite superiore delle richieste dello scheduler contemporaneamente in
+// attesa di risposta (profondità della pipeline)
+#define OBD_MAX_INFLIGHT 4
+#endif
+
+#ifndef OBD_PACE_ADAPTIVE
+// 0 = ritmo fisso OBD_REQ_SPACING_MS / OBD_MAX_INFLIGHT
+#define OBD_PACE_ADAPTIVE 1
+#endif
+
+#ifndef OBD_PACE_MIN_MS
+#define OBD_PACE_MIN_MS 4
+#endif
+
+#ifndef OBD_PACE_MAX_MS
+#define OBD_PACE_MAX_MS 200
+#endif
+
+#ifndef OBD_PACE_AI_EVERY
+// Risposte puntuali consecutive per ogni passo additivo; la profondità
+// della pipeline cresce ogni 8 passi
+#define OBD_PACE_AI_EVERY 4
+#endif
+
+#ifndef OBD_PACE_AI_RATE
+// Passo additivo in richieste/s (almeno 1 ms di spaziatura)
+#define OBD_PACE_AI_RATE 2
+#endif
+
+#ifndef OBD_PACE_QUEUE_SLACK_MS
+// RTT oltre 2 * minimo + slack = l'ECU sta accodando: +1 ms di spaziatura
+#define OBD_PACE_QUEUE_SLACK_MS 5
+#endif
+
+#ifndef OBD_PACE_MIN_WINDOW_MS
+// Finestra del minimo RTT (riferimento per riconoscere l'accodamento)
+#define OBD_PACE_MIN_WINDOW_MS 10000
+#endif
+
+#ifndef OBD_PACE_ACTIVE_MS
+// Un'ECU che non risponde da così tanto non frena più il ritmo
+#define OBD_PACE_ACTIVE_MS 5000
+#endif
+
+#define OBD_PACE_ECUS 8 // 0x7E8..0x7EF
+
+    typedef struct
+    {
+        uint16_t id;          // 0x7E8..0x7EF
+        bool active;          // ha risposto negli ultimi OBD_PACE_ACTIVE_MS
+        uint32_t srtt_us;     // RTT smussata (EWMA 1/8)
+        uint32_t rtt_min_us;
+        uint32_t rtt_max_us;
+        uint32_t answers;
+        uint32_t timeouts;
+        uint16_t spacing_ms;  // ritmo sostenibile da questa ECU
+        uint8_t inflight;
+    } obd_pace_ecu_t;
+
+    typedef struct
+    {
+        uint16_t spacing_ms; // in uso dallo scheduler
+        uint8_t inflight;
+        uint8_t ecu_count;   // voci valide in ecu[] (ECU mai sentite escluse)
+        obd_pace_ecu_t ecu[OBD_PACE_ECUS];
+    } obd_pace_info_t;
+
+    void obd_pace_init(uint32_t now_ms);
+
+    /* Scrittore unico (task RT). ecu = id di risposta 0x7E8..0x7EF.
+       RTT in µs (esp_timer): un'ECU da 3 ms misurata a tick da 10 ms
+       sembrerebbe accodare a ogni cambio di tick. */
+    void obd_pace_answer(uint32_t ecu_id, uint32_t rtt_us, uint32_t now_ms);
+    void obd_pace_timeout(uint32_t ecu_id, uint32_t now_ms);
+
+    /* Ritmo corrente: spaziatura minima tra richieste e richieste in volo */
+    uint32_t obd_pace_spacing(uint32_t now_ms);
+    int obd_pace_inflight(void);
+
+    /* Copia dello stato (per il web server; lettura senza lock) */
+    void obd_pace_get(obd_pace_info_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -247,19 +247,102 @@ document.addEventListener('DOMContentLoaded', function() {
         });
     }
 
+    // ============================================
+    // 2b. BACKFILL DALLO STORICO DEL DISPOSITIVO (/history)
+    // ============================================
+
+    // Chiave del grafico -> PID Mode 01 dello storico sul dispositivo
+    const historyPids = {
+        rpm: 0x0C, speed: 0x0D, coolant: 0x05, intake: 0x0F, ambient: 0x46,
+        manifoldPressure: 0x0B, baroPressure: 0x33, fuelPressure: 0x0A,
+        fuelLevel: 0x2F, shortTermFuelTrim: 0x06, longTermFuelTrim: 0x07,
+        batteryVoltage: 0x42, engineLoad: 0x04, throttlePosition: 0x11, maf: 0x10
+    };
+    let deviceOffset = null;  // Date.now() - orologio del dispositivo (ms)
+    let lastLiveTs = 0;       // timestamp dell'ultimo dato live ricevuto
+    let backfillBusy = false;
+
+    // Scarica lo storico e lo ricampiona sulla griglia del grafico
+    // (sample-and-hold): riempie i grafici all'apertura e dopo un buco di rete.
+    async function backfillHistory() {
+        if (backfillBusy) return;
+        backfillBusy = true;
+
+        try {
+            const span = dataPoints * updateInterval;
+
+            for (const [key, pid] of Object.entries(historyPids)) {
+                const since = deviceOffset === null ? 0 : Math.max(0, Date.now() - deviceOffset - span);
+                const res = await fetch(`/history?pid=${pid}&since=${since}`, { cache: 'no-store' });
+                if (!res.ok) continue;
+
+                const h = await res.json();
+                const end = Date.now();
+                deviceOffset = end - h.now;
+                if (!h.samples || h.samples.length === 0) continue;
+
+                const old = dataHistory[key] || [];
+                const grid = [];
+                let j = 0;
+                let cur = null;
+
+                for (let i = 0; i < dataPoints; i++) {
+                    const ts = end - (dataPoints - 1 - i) * updateInterval;
+                    while (j < h.samples.length && h.samples[j][0] + deviceOffset <= ts) {
+                        cur = h.samples[j][1] / h.div;
+                        j++;
+                    }
+                    const fallback = old[i] ? old[i].value : 0;
+                    grid.push({ timestamp: ts, value: cur !== null ? cur : fallback });
+                }
+                dataHistory[key] = grid;
+            }
+
+            renderAllCharts();
+            updateStatistics();
+        } catch (e) {
+            console.warn('Storico non disponibile:', e);
+        }
+
+        backfillBusy = false;
+    }
+
     // ============================================
     // 3. CORE LOOP
     // ============================================
 
+    let lastRenderAt = 0;
+    let lastPushAt = 0;
+
+    // Dati live in push (evento "obd-data" da script.js): un punto per
+    // updateInterval, il primo aggiornamento utile dopo lo scadere
+    function onLiveData() {
+        lastPushAt = Date.now();
+        if (lastPushAt - lastRenderAt >= updateInterval) updateCharts();
+    }
+
+    // Timer: avanza i grafici solo se non arrivano dati in push
+    // (simulazione o collegamento assente)
+    function onTimer() {
+        if (Date.now() - lastPushAt > 5 * updateInterval) updateCharts();
+    }
+
     async function updateCharts() {
         // Se il sistema non è pronto (2 secondi iniziali), non fare nulla. 
         // I grafici rimangono piatti come inizializzati da initEmptyHistory.
         if (!isSystemReady) return;
+        lastRenderAt = Date.now();
 
         // Recupera dati (Reali o Simulati Causali)
         const data = await fetchDataFromSource();
         if (!data) return;
 
+        // Dato live nuovo dopo più di 1s fermo: buco di rete, recupera dallo storico
+        if (isRealDataAvailable && data.timestamp !== lastLiveTs) {
+            if (lastLiveTs && data.timestamp - lastLiveTs > 1000) backfillHistory();
+            lastLiveTs = data.timestamp;
+        }
+
         // Aggiorna storico
         Object.keys(data).forEach(key => {
             if (key !== 'timestamp') {
@@ -391,6 +474,7 @@ document.addEventListener('DOMContentLoaded', function() {
                 dataPoints = Math.ceil(seconds * 1000 / updateInterval);
                 // Reset grafico per adattare asse X
                 initCharts(); 
+                if (isSystemReady) backfillHistory();
             });
         }
 
@@ -425,13 +509,15 @@ document.addEventListener('DOMContentLoaded', function() {
 
         // 2. Avvia il loop del timer immediatamente, MA...
         // ...dentro updateCharts() c'è il check su "isSystemReady"
-        setInterval(updateCharts, updateInterval);
+        window.addEventListener('obd-data', onLiveData);
+        setInterval(onTimer, updateInterval);
 
         // 3. Attendi 2 secondi prima di abilitare l'elaborazione dati
         console.log('⏳ Waiting 2 seconds for sensor warmup...');
         setTimeout(() => {
             isSystemReady = true;
             console.log('✅ System Ready - Starting Data Stream');
+            backfillHistory();
         }, 2000);
     }
 
@@ -0,0 +1,153 @@
+#include "obd_frame.h"
+
+#include <string.h>
+
+/* -------------------------------------------------------
+ * Varint (LEB128) e zigzag
+ * ------------------------------------------------------- */
+static size_t put_varint(uint8_t *p, uint32_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80)
+    {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static int get_varint(const uint8_t *buf, size_t len, size_t *pos, uint32_t *out)
+{
+    uint32_t v = 0;
+
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (*pos >= len)
+            return -1;
+
+        uint8_t b = buf[(*pos)++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            *out = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static inline uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/* -------------------------------------------------------
+ * Codifica
+ * ------------------------------------------------------- */
+void obd_frame_ctx_init(obd_frame_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static const int32_t *find_base(const obd_frame_ctx_t *ctx, uint32_t seq)
+{
+    if (seq == 0)
+        return NULL;
+
+    for (int i = 0; i < OBD_FRAME_HISTORY; i++)
+        if (ctx->seq[i] == seq)
+            return ctx->v[i];
+    return NULL;
+}
+
+int obd_frame_encode(obd_frame_ctx_t *ctx, const obd_full_data_t *d, uint32_t seq,
+                     uint32_t ack, uint8_t *out, size_t cap)
+{
+    if (cap < OBD_FRAME_MAX_LEN)
+        return -1;
+
+    int32_t cur[OBD_FIELD_COUNT];
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+        cur[f] = obd_field_fixed(d, (obd_field_t)f);
+
+    const int32_t *base = find_base(ctx, ack);
+    static const int32_t k_zero[OBD_FIELD_COUNT];
+
+    size_t n = 0;
+    out[n++] = OBD_FRAME_VERSION;
+    out[n++] = base ? OBD_FRAME_FLAG_DELTA : 0;
+    n += put_varint(&out[n], seq);
+    if (base)
+        n += put_varint(&out[n], ack);
+    else
+        base = k_zero;
+
+    uint32_t bitmap = 0;
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+        if (cur[f] != base[f])
+            bitmap |= 1UL << f;
+
+    n += put_varint(&out[n], bitmap);
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+        if (bitmap & (1UL << f))
+            n += put_varint(&out[n], zigzag((int32_t)((uint32_t)cur[f] - (uint32_t)base[f])));
+
+    // ricorda il frame inviato (una volta per generazione)
+    if (!find_base(ctx, seq))
+    {
+        ctx->seq[ctx->next] = seq;
+        memcpy(ctx->v[ctx->next], cur, sizeof(cur));
+        ctx->next = (ctx->next + 1) % OBD_FRAME_HISTORY;
+    }
+
+    return (int)n;
+}
+
+/* -------------------------------------------------------
+ * Decodifica
+ * ------------------------------------------------------- */
+int obd_frame_decode(const uint8_t *buf, size_t len, const int32_t base[OBD_FIELD_COUNT],
+                     uint32_t base_seq, int32_t out[OBD_FIELD_COUNT], uint32_t *seq)
+{
+    size_t pos = 2;
+    uint32_t ref = 0;
+    uint32_t bitmap;
+
+    if (len < 2 || buf[0] != OBD_FRAME_VERSION)
+        return -1;
+    if (get_varint(buf, len, &pos, seq) != 0)
+        return -1;
+
+    if (buf[1] & OBD_FRAME_FLAG_DELTA)
+    {
+        if (get_varint(buf, len, &pos, &ref) != 0 || ref != base_seq)
+            return -1;
+        memcpy(out, base, sizeof(int32_t) * OBD_FIELD_COUNT);
+    }
+    else
+    {
+        memset(out, 0, sizeof(int32_t) * OBD_FIELD_COUNT);
+    }
+
+    if (get_varint(buf, len, &pos, &bitmap) != 0)
+        return -1;
+
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+    {
+        if (!(bitmap & (1UL << f)))
+            continue;
+
+        uint32_t z;
+        if (get_varint(buf, len, &pos, &z) != 0)
+            return -1;
+        out[f] = (int32_t)((uint32_t)out[f] + (uint32_t)unzigzag(z));
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "obd.h"
+
+/* -------------------------------------------------------
+ * Frame binario di telemetria (/data.bin)
+ *
+ *   [0]      versione (OBD_FRAME_VERSION)
+ *   [1]      flag: bit0 = delta rispetto a base_seq
+ *   varint   seq       generazione dello snapshot
+ *   varint   base_seq  solo se delta
+ *   varint   bitmap    bit f = campo f presente (ordine di obd_field_t)
+ *   per ogni campo presente, in ordine crescente:
+ *   zigzag varint  fixed(f) - base(f)   (valore = fixed / obd_field_div)
+ *
+ * Frame completo: base = tutti zero, assenti = 0.
+ * Frame delta: assenti = invariati rispetto al frame base_seq, che il
+ * client ha confermato con ?ack=<seq>.
+ * ------------------------------------------------------- */
+#define OBD_FRAME_VERSION 1
+#define OBD_FRAME_FLAG_DELTA 0x01
+
+// 2 byte di intestazione + 3 varint uint32 + un varint per campo
+#define OBD_FRAME_MAX_LEN (2 + 3 * 5 + OBD_FIELD_COUNT * 5)
+
+#ifndef OBD_FRAME_HISTORY
+// Frame inviati ricordati come possibile base dei delta
+#define OBD_FRAME_HISTORY 16
+#endif
+
+typedef struct
+{
+    uint32_t seq[OBD_FRAME_HISTORY];
+    int32_t v[OBD_FRAME_HISTORY][OBD_FIELD_COUNT];
+    int next;
+} obd_frame_ctx_t;
+
+void obd_frame_ctx_init(obd_frame_ctx_t *ctx);
+
+/* Codifica d (generazione seq) come delta rispetto ad ack se è ancora in
+   ctx, altrimenti come frame completo. Ritorna i byte scritti, -1 se cap
+   non basta (OBD_FRAME_MAX_LEN basta sempre). */
+int obd_frame_encode(obd_frame_ctx_t *ctx, const obd_full_data_t *d, uint32_t seq,
+                     uint32_t ack, uint8_t *out, size_t cap);
+
+/* Decodifica (riferimento per i test host e per il decoder JS).
+   base/base_seq = ultimo frame decodificato. 0 se ok, -1 se non valido
+   o se è un delta su una base diversa. */
+int obd_frame_decode(const uint8_t *buf, size_t len, const int32_t base[OBD_FIELD_COUNT],
+                     uint32_t base_seq, int32_t out[OBD_FIELD_COUNT], uint32_t *seq);
@@ -0,0 +1,156 @@
+#include "obd_json.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <string.h>
+
+/* Cifre decimali di un divisore fixed-point (div = 10^n) */
+static int decimals(int32_t div)
+{
+    int n = 0;
+    for (; div > 1; div /= 10)
+        n++;
+    return n;
+}
+
+/* Fixed-point in decimale senza float né printf; ritorna i byte
+   scritti (al più 13: segno, 10 cifre, punto) */
+static int put_fixed(char *p, int32_t v, int dec)
+{
+    char tmp[12];
+    uint32_t a = v < 0 ? 0U - (uint32_t)v : (uint32_t)v;
+    int n = 0, len = 0;
+
+    do
+    {
+        tmp[n++] = (char)('0' + a % 10);
+        a /= 10;
+    } while (a || n <= dec);
+
+    if (v < 0)
+        p[len++] = '-';
+    while (n > 0)
+    {
+        if (n == dec)
+            p[len++] = '.';
+        p[len++] = tmp[--n];
+    }
+    return len;
+}
+
+int obd_json_format(char *resp, size_t cap, const obd_full_data_t *v)
+{
+    size_t len = 0;
+
+    for (int f = 0; f < OBD_FIELD_COUNT; f++)
+    {
+        const obd_pid_desc_t *d = obd_field_desc((obd_field_t)f);
+        size_t klen = strlen(d->key);
+
+        // {"key":  +  valore  +  '}' e terminatore
+        if (len + klen + 4 + 13 + 2 > cap)
+            return -1;
+
+        resp[len++] = f ? ',' : '{';
+        resp[len++] = '"';
+        memcpy(resp + len, d->key, klen);
+        len += klen;
+        resp[len++] = '"';
+        resp[len++] = ':';
+        len += (size_t)put_fixed(resp + len, v->v[f], decimals(d->div));
+    }
+
+    resp[len++] = '}';
+    resp[len] = '\0';
+    return (int)len;
+}
+
+/* ---- Payload condiviso ---- */
+
+typedef struct
+{
+    obd_json_payload_t p; // primo membro: put risale allo slot dal puntatore
+    int refs;
+} json_slot_t;
+
+static json_slot_t s_slots[OBD_JSON_SLOTS];
+static json_slot_t *s_cur; // ultima generazione codificata
+static SemaphoreHandle_t s_lock;
+static obd_json_stats_t s_stats;
+
+void obd_json_payload_init(void)
+{
+    if (!s_lock)
+        s_lock = xSemaphoreCreateMutex();
+}
+
+const obd_json_payload_t *obd_json_payload_get(void)
+{
+    static obd_snapshot_t snap; // solo sotto s_lock
+    uint32_t seq = obd_data_seq();
+    json_slot_t *s = NULL;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    if (s_cur && s_cur->p.seq == seq)
+    {
+        s = s_cur;
+    }
+    else
+    {
+        for (int i = 0; i < OBD_JSON_SLOTS && !s; i++)
+            if (s_slots[i].refs == 0)
+                s = &s_slots[i];
+
+        if (s)
+        {
+            // la codifica resta sotto lock: chi arriva intanto aspetta
+            // e riceve lo stesso buffer invece di ricodificare
+            s->p.seq = obd_get_snapshot(&snap);
+            s->p.len = obd_json_format(s->p.text, sizeof(s->p.text), &snap.data);
+            if (s->p.len < 0)
+            {
+                if (s == s_cur)
+                    s_cur = NULL;
+                s = NULL;
+            }
+            else
+            {
+                s_cur = s;
+                s_stats.builds++;
+            }
+        }
+        else if (s_cur)
+        {
+            // tutti gli slot in uso: meglio la generazione precedente
+            // che nessuna risposta
+            s = s_cur;
+            s_stats.stale++;
+        }
+    }
+
+    if (s)
+    {
+        s->refs++;
+        s_stats.served++;
+    }
+    xSemaphoreGive(s_lock);
+    return s ? &s->p : NULL;
+}
+
+void obd_json_payload_put(const obd_json_payload_t *p)
+{
+    if (!p)
+        return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    ((json_slot_t *)p)->refs--;
+    xSemaphoreGive(s_lock);
+}
+
+void obd_json_get_stats(obd_json_stats_t *out)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "obd.h"
+
+/* JSON di /data (anche stream /ws): chiavi coerenti con script.js.
+   Ritorna la lunghezza scritta, -1 se cap non basta. */
+int obd_json_format(char *resp, size_t cap, const obd_full_data_t *v);
+
+/* -------------------------------------------------------
+ * Payload condiviso: il JSON di ogni generazione dello snapshot è
+ * codificato una volta sola, alla prima richiesta che lo trova
+ * vecchio; /data e i client /ws ricevono tutti lo stesso buffer,
+ * senza copie. Un payload preso con obd_json_payload_get non cambia
+ * finché non viene reso con obd_json_payload_put.
+ * ------------------------------------------------------- */
+#ifndef OBD_JSON_MAX_LEN
+#define OBD_JSON_MAX_LEN 768
+#endif
+
+#ifndef OBD_JSON_SLOTS
+// Uno in uso da httpd, uno in viaggio verso lo stream /ws, uno libero
+// per la generazione successiva
+#define OBD_JSON_SLOTS 3
+#endif
+
+typedef struct
+{
+    uint32_t seq; // generazione dello snapshot codificato
+    int len;
+    char text[OBD_JSON_MAX_LEN];
+} obd_json_payload_t;
+
+typedef struct
+{
+    uint32_t builds; // codifiche eseguite
+    uint32_t served; // payload consegnati (codificati o già pronti)
+    uint32_t stale;  // consegnato il precedente: nessuno slot libero
+} obd_json_stats_t;
+
+void obd_json_payload_init(void);
+
+/* Payload dell'ultimo snapshot pubblicato, NULL se non codificabile.
+   Chiamabile da qualunque task; va sempre reso. */
+const obd_json_payload_t *obd_json_payload_get(void);
+void obd_json_payload_put(const obd_json_payload_t *p);
+
+void obd_json_get_stats(obd_json_stats_t *out);
@@ -6,7 +6,9 @@
 (() => {
   "use strict";
 
-  const POLL_MS = 100;
+  const POLL_MS = 100;          // solo fallback se /ws non è disponibile
+  const WS_RETRY_MS = 1000;
+  const DTC_POLL_MS = 10000;    // /dtc legge solo la cache del dispositivo
 
   // UI ranges (tuning)
   const RPM_MAX = 8000;
@@ -85,6 +87,9 @@
     throttleBar: $("throttle-bar"),
     paramTiming: $("param-timing"),
     paramMaf: $("param-maf"),
+    paramGear: $("param-gear"),
+    paramT0100: $("param-t-0-100"),
+    paramT80120: $("param-t-80-120"),
 
     // Fuel
     paramFuelLvl: $("param-fuel-lvl"),
@@ -94,6 +99,11 @@
     paramFuelPress: $("param-fuel-press"),
     paramFuelTrimS: $("param-fuel-trim-s"),
     paramFuelTrimL: $("param-fuel-trim-l"),
+    paramEcon: $("param-econ"),
+    paramFuelRate: $("param-fuel-rate"),
+    paramTripDist: $("param-trip-dist"),
+    paramTripFuel: $("param-trip-fuel"),
+    paramEconTrip: $("param-econ-trip"),
 
     // Environment
     ambientTemp: $("ambient-temp"),
@@ -193,8 +203,22 @@
     const baro = Number(pick(d, ["press_baro", "baro"], NaN));
     const distMil = Number(pick(d, ["dist_mil"], NaN));
 
+    // Derivati: calcolati dal dispositivo a ogni campione, non qui
+    const fuelRate = Number(pick(d, ["fuel_rate"], NaN));
+    const econ = Number(pick(d, ["econ"], NaN));
+    const econTrip = Number(pick(d, ["econ_trip"], NaN));
+    const tripDist = Number(pick(d, ["trip_dist"], NaN));
+    const tripFuel = Number(pick(d, ["trip_fuel"], NaN));
+    const gear = Number(pick(d, ["gear"], NaN));
+    const t0100 = Number(pick(d, ["t_0_100"], NaN));
+    const t80120 = Number(pick(d, ["t_80_120"], NaN));
+
     const dtcCount = Number(pick(d, ["dtc_count", "dtc"], 0));
-    const pendingDtc = Number(pick(d, ["pending_dtc", "dtc_pending"], 0));
+    const pendingDtc = Number(pick(d, ["pending_dtc", "dtc_pending"], dtcPending));
+    if (dtcCount !== lastDtcCount) {
+      lastDtcCount = dtcCount;
+      fetchDtc(); // il dispositivo rilegge i codici quando il conteggio cambia
+    }
 
     const uptimeS = Number(pick(d, ["uptime_s", "uptime"], NaN)) || (Date.now() - t0) / 1000;
 
@@ -310,6 +334,9 @@
 
     setText(ui.paramTiming, Number.isFinite(timing) ? `${timing.toFixed(1)}°` : "--");
     setText(ui.paramMaf, Number.isFinite(maf) ? `${maf.toFixed(2)} g/s` : "--");
+    setText(ui.paramGear, Number.isFinite(gear) ? (gear > 0 ? String(gear) : "N") : "--");
+    setText(ui.paramT0100, t0100 > 0 ? t0100.toFixed(2) : "--");
+    setText(ui.paramT80120, t80120 > 0 ? t80120.toFixed(2) : "--");
 
     // --- Fuel panel ---
     if (Number.isFinite(fuelLvl)) {
@@ -324,6 +351,12 @@
     setText(ui.paramFuelTrimS, Number.isFinite(stft) ? `${stft >= 0 ? "+" : ""}${stft.toFixed(1)}%` : "--");
     setText(ui.paramFuelTrimL, Number.isFinite(ltft) ? `${ltft >= 0 ? "+" : ""}${ltft.toFixed(1)}%` : "--");
 
+    setText(ui.paramEcon, Number.isFinite(econ) ? `${econ.toFixed(1)} L/100km` : "--");
+    setText(ui.paramFuelRate, Number.isFinite(fuelRate) ? fuelRate.toFixed(2) : "--");
+    setText(ui.paramTripDist, Number.isFinite(tripDist) ? `${tripDist.toFixed(2)} km` : "--");
+    setText(ui.paramTripFuel, Number.isFinite(tripFuel) ? tripFuel.toFixed(2) : "--");
+    setText(ui.paramEconTrip, econTrip > 0 ? econTrip.toFixed(1) : "--");
+
     const rangeKm = Number(pick(d, ["fuel_range_km", "fuel_range"], NaN));
     if (Number.isFinite(rangeKm)) setText(ui.fuelRange, fmtInt(rangeKm));
 
@@ -346,14 +379,108 @@
     }
 
     last = { rpm, speed };
+
+    // notifica push ai grafici (chart-script.js)
+    window.dispatchEvent(new CustomEvent("obd-data", { detail: latestBridgeData }));
+  }
+
+  // --- FRAME BINARIO (/data.bin) ---
+  // Formato in main/web/obd_frame.h: campi nell'ordine di obd_field_t,
+  // [chiave JSON, divisore fixed-point]. Delta rispetto al frame con ack.
+  const FRAME_VERSION = 1;
+  const FRAME_FIELDS = [
+    ["rpm", 1], ["speed", 1], ["load", 10], ["throttle", 10], ["timing", 10],
+    ["temp_coolant", 1], ["temp_intake", 1], ["temp_ambient", 1], ["press_intake", 1],
+    ["press_baro", 10], ["maf", 100], ["fuel_lvl", 10], ["fuel_press", 10],
+    ["fuel_trim_s", 10], ["fuel_trim_l", 10], ["batt", 100], ["dist_mil", 1], ["dtc_count", 1],
+    ["fuel_rate", 100], ["econ", 10], ["econ_trip", 10], ["trip_dist", 100], ["trip_fuel", 100],
+    ["gear", 1], ["t_0_100", 100], ["t_80_120", 100],
+  ];
+  let frameBase = { seq: 0, v: FRAME_FIELDS.map(() => 0) };
+  let useBinary = true;
+
+  function decodeFrame(buf) {
+    const b = new Uint8Array(buf);
+    let pos = 2;
+
+    const varint = () => {
+      let v = 0, mul = 1, x;
+      do {
+        if (pos >= b.length) throw new Error("frame troncato");
+        x = b[pos++];
+        v += (x & 0x7f) * mul;
+        mul *= 128;
+      } while (x & 0x80);
+      return v;
+    };
+
+    if (b.length < 2 || b[0] !== FRAME_VERSION) throw new Error(`versione frame ${b[0]}`);
+
+    const seq = varint();
+    let v;
+    if (b[1] & 0x01) {
+      if (varint() !== frameBase.seq) throw new Error("base del delta diversa");
+      v = frameBase.v.slice();
+    } else {
+      v = FRAME_FIELDS.map(() => 0);
+    }
+
+    const bitmap = varint();
+    for (let f = 0; f < FRAME_FIELDS.length; f++) {
+      if (!(bitmap & (1 << f))) continue;
+      const z = varint();
+      v[f] += z % 2 ? -(z + 1) / 2 : z / 2; // zigzag
+    }
+
+    frameBase = { seq, v };
+
+    const out = {};
+    FRAME_FIELDS.forEach(([key, div], f) => { out[key] = v[f] / div; });
+    return out;
+  }
+
+  async function fetchFrame() {
+    const res = await fetch(`/data.bin?ack=${frameBase.seq}`, { cache: "no-store" });
+    if (res.status === 404) {
+      useBinary = false; // firmware senza /data.bin
+      return fetchJson();
+    }
+    if (!res.ok) throw new Error(`HTTP ${res.status}`);
+    try {
+      return decodeFrame(await res.arrayBuffer());
+    } catch (err) {
+      frameBase = { seq: 0, v: FRAME_FIELDS.map(() => 0) }; // prossimo frame completo
+      throw err;
+    }
+  }
+
+  async function fetchJson() {
+    const res = await fetch("/data", { cache: "no-store" });
+    if (!res.ok) throw new Error(`HTTP ${res.status}`);
+    return res.json();
+  }
+
+  // --- CODICI DI ERRORE (/dtc) ---
+  // Il conteggio "pending" non è nel flusso dei PID: arriva dalla cache DTC.
+  let dtcPending = 0;
+  let lastDtcCount = null;
+
+  async function fetchDtc() {
+    try {
+      const res = await fetch("/dtc", { cache: "no-store" });
+      if (!res.ok) return;
+      const j = await res.json();
+      dtcPending = j.pending && j.pending.valid ? j.pending.total : 0;
+      setText(ui.pendingDtc, fmtInt(dtcPending, "0"));
+    } catch (err) {
+      console.error("Errore fetch DTC:", err);
+    }
   }
 
   async function pollOnce() {
     const start = performance.now();
     try {
-      const res = await fetch("/data", { cache: "no-store" });
-      if (!res.ok) throw new Error(`HTTP ${res.status}`);
-      const data = await res.json();
+      const data = useBinary ? await fetchFrame() : await fetchJson();
       const rtt = performance.now() - start;
       onData(data, rtt);
       setConnected(true);
@@ -363,6 +490,76 @@
     }
   }
 
+  // --- LIVE STREAM (/ws) ---
+  // Il dispositivo invia un messaggio per ogni nuovo aggiornamento dei PID.
+  // Se la WebSocket cade si torna al polling di /data finché non si riconnette.
+  let ws = null;
+  let pollTimer = null;
+  let lastMsgAt = 0;
+
+  // PID mostrati dalla pagina (<body data-obd-sub="0c=100 0d 05">, periodo
+  // in ms, omesso = di tabella): il dispositivo li interroga più spesso e
+  // rallenta gli altri. Una scheda nascosta non guarda niente.
+  function sendSubscription() {
+    if (!ws || ws.readyState !== WebSocket.OPEN) return;
+    const sub = document.body.dataset.obdSub;
+    if (sub === undefined) return;
+    ws.send(document.hidden ? "sub" : `sub ${sub}`);
+  }
+
+  document.addEventListener("visibilitychange", sendSubscription);
+
+  function startPolling() {
+    if (!pollTimer) pollTimer = setInterval(pollOnce, POLL_MS);
+  }
+
+  function stopPolling() {
+    if (pollTimer) {
+      clearInterval(pollTimer);
+      pollTimer = null;
+    }
+  }
+
+  function connectStream() {
+    if (!("WebSocket" in window)) {
+      startPolling();
+      return;
+    }
+
+    ws = new WebSocket(`ws://${location.host}/ws`);
+
+    ws.onopen = () => {
+      stopPolling();
+      setConnected(true);
+      sendSubscription();
+    };
+
+    ws.onmessage = (ev) => {
+      const now = performance.now();
+      // intervallo tra due aggiornamenti: età massima del dato mostrato
+      const gap = lastMsgAt ? now - lastMsgAt : NaN;
+      lastMsgAt = now;
+      try {
+        const msg = JSON.parse(ev.data);
+        // un client ha lasciato l'AP: chi è ancora qui rinnova
+        if (msg.resub) {
+          sendSubscription();
+          return;
+        }
+        onData(msg, gap);
+      } catch (err) {
+        console.error("Messaggio WS non valido:", err);
+      }
+    };
+
+    ws.onclose = () => {
+      ws = null;
+      lastMsgAt = 0;
+      startPolling();
+      setTimeout(connectStream, WS_RETRY_MS);
+    };
+  }
+
   // --- EXPOSE BRIDGE FUNCTION ---
   // Rende disponibili i dati a chart-script.js
   window.getOBDChartData = () => {
@@ -379,6 +576,7 @@ window.getOBDDataBridge = () => {
 
   document.addEventListener("DOMContentLoaded", () => {
     pollOnce();
-    setInterval(pollOnce, POLL_MS);
+    connectStream();
+    setInterval(fetchDtc, DTC_POLL_MS);
   });
 })();
@@ -0,0 +1,26 @@
+#include "web_assets.h"
+
+#include <string.h>
+
+/* Stesso hash di tools/gen_web_assets.py */
+static uint32_t path_hash(const char *p, size_t len, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (uint8_t)p[i]) * 16777619u;
+    return h;
+}
+
+const web_asset_t *web_asset_find(const char *path, size_t len)
+{
+    uint8_t i = web_assets_slots[path_hash(path, len, web_assets_seed) & web_assets_mask];
+
+    if (i >= web_assets_count)
+        return NULL;
+
+    const web_asset_t *a = &web_assets[i];
+    if (strncmp(a->path, path, len) != 0 || a->path[len] != '\0')
+        return NULL;
+    return a;
+}
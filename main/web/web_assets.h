@@ -0,0 +1,28 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Asset web embeddati: tabella generata a build time da
+   tools/gen_web_assets.py a partire dal contenuto di main/web */
+typedef struct
+{
+    const char *path;     // URI esatto, es. "/js/chart-script.js"
+    const char *mime;
+    const uint8_t *start; // blob embeddato (compresso se gzip)
+    const uint8_t *end;
+    const char *etag;     // "xxxxxxxx": FNV-1a del blob
+    bool gzip;            // Content-Encoding: gzip
+    bool long_cache;      // librerie e font: cache lunga lato browser
+} web_asset_t;
+
+/* Ricerca esatta in tempo costante (hash perfetto); path non terminato
+   (es. URI senza query string). NULL se assente. */
+const web_asset_t *web_asset_find(const char *path, size_t len);
+
+/* Tabella generata (ordinata per path) */
+extern const web_asset_t web_assets[];
+extern const uint16_t web_assets_count;
+extern const uint32_t web_assets_seed;
+extern const uint32_t web_assets_mask;
+extern const uint8_t web_assets_slots[];
@@ -1,98 +1,45 @@
 #include "web_server.h"
 #include "obd.h"
+#include "obd_dtc.h"
+#include "obd_history.h"
+#include "obd_pace.h"
+#include "obd_metrics.h"
+#include "obd_json.h"
+#include "obd_frame.h"
+#include "web_assets.h"
+#include "can_capture.h"
+#include "can_trace.h"
+#include "can_bus.h"
+#include "obd_log.h"
+#include "app_tasks.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 static const char *TAG = "WEB_SERVER";
 
-/* =======================================================
- * 1. DEFINIZIONE DATI E BLOBS
- * ======================================================= */
-typedef struct {
-    const uint8_t *start;
-    const uint8_t *end;
-} blob_t;
-
-/* Macro per dichiarare i file binari caricati dal CMake */
-#define DECL_FILE(name)                                                           \
-    extern const uint8_t _binary_##name##_start[] asm("_binary_" #name "_start"); \
-    extern const uint8_t _binary_##name##_end[]   asm("_binary_" #name "_end")
-
-DECL_FILE(index_html);
-DECL_FILE(graph_html);
-DECL_FILE(errors_html);
-DECL_FILE(diagnostics_html);
-DECL_FILE(script_js);
-DECL_FILE(style_css);
-DECL_FILE(chart_script_js);
-DECL_FILE(animations_js);
-DECL_FILE(diagnostics_script_js);
-DECL_FILE(chart_js);
-DECL_FILE(luxox_js);
-DECL_FILE(Inter_Bold_woff2);
-DECL_FILE(Inter_Regular_woff2);
-DECL_FILE(all_min_css);
-DECL_FILE(fa_solid_900_woff2);
-DECL_FILE(fa_regular_400_woff2);
-DECL_FILE(fa_brands_400_woff2);
-
 /* =======================================================
  * 2. ENDPOINT DATI JSON (/data)
  *    (chiavi coerenti con script.js “robusto”)
+ *    Payload condiviso con lo stream /ws: codificato una volta per
+ *    generazione dello snapshot, qualunque sia il numero di client
  * ======================================================= */
-obd_full_data_t d;
 static esp_err_t data_handler(httpd_req_t *req)
 {
-    d = obd_get_all_data();
-
-    char resp[768];
-    int len = snprintf(resp, sizeof(resp),
-        "{"
-        "\"rpm\":%u,"
-        "\"speed\":%u,"
-        "\"load\":%.1f,"
-        "\"throttle\":%.1f,"
-        "\"timing\":%.1f,"
-        "\"maf\":%.2f,"
-        "\"temp_coolant\":%d,"
-        "\"temp_intake\":%d,"
-        "\"temp_ambient\":%d,"
-        "\"press_intake\":%u,"
-        "\"press_baro\":%.1f,"
-        "\"fuel_lvl\":%.1f,"
-        "\"fuel_press\":%.1f,"
-        "\"fuel_trim_s\":%.1f,"
-        "\"fuel_trim_l\":%.1f,"
-        "\"batt\":%.2f,"
-        "\"dist_mil\":%u,"
-        "\"dtc_count\":%u,"
-        "\"pending_dtc\":%u"
-        "}",
-        (unsigned)d.rpm,
-        (unsigned)d.speed,
-        d.engine_load,
-        d.throttle_pos,
-        d.timing_advance,
-        d.maf_rate,
-        (int)d.coolant_temp,
-        (int)d.intake_air_temp,
-        (int)d.ambient_temp,
-        (unsigned)d.intake_pressure,
-        d.barometric_press,
-        d.fuel_level,
-        d.fuel_pressure,
-        d.fuel_trim_short,
-        d.fuel_trim_long,
-        d.battery_voltage,
-        (unsigned)d.distance_with_mil,
-        (unsigned)d.dtc_count,
-        0u // se non hai pending nel struct, lascia 0
-    );
-
-    if (len < 0 || len >= (int)sizeof(resp)) {
-        ESP_LOGE(TAG, "JSON overflow (len=%d)", len);
+    int64_t t0 = esp_timer_get_time();
+    const obd_json_payload_t *p = obd_json_payload_get();
+
+    if (!p) {
+        ESP_LOGE(TAG, "JSON overflow");
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "JSON too large");
         return ESP_FAIL;
     }
@@ -102,107 +49,993 @@ static esp_err_t data_handler(httpd_req_t *req)
     httpd_resp_set_hdr(req, "Pragma", "no-cache");
     httpd_resp_set_hdr(req, "Expires", "0");
 
-    return httpd_resp_send(req, resp, len);
+    esp_err_t ret = httpd_resp_send(req, p->text, p->len);
+    obd_json_payload_put(p);
+    obd_metrics_http_time(OBD_METRICS_HTTP_DATA, (uint32_t)(esp_timer_get_time() - t0));
+    return ret;
+}
+
+/* =======================================================
+ * 2a. ENDPOINT DATI BINARIO (/data.bin?ack=<seq>)
+ *     formato in obd_frame.h; delta rispetto all'ultimo frame
+ *     decodificato dal client (ack), altrimenti frame completo
+ * ======================================================= */
+static obd_frame_ctx_t s_frame_ctx; // solo task di httpd
+
+static esp_err_t data_bin_handler(httpd_req_t *req)
+{
+    static obd_snapshot_t snap;
+    int64_t t0 = esp_timer_get_time();
+    uint8_t frame[OBD_FRAME_MAX_LEN];
+    char query[32];
+    char param[12];
+    uint32_t ack = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "ack", param, sizeof(param)) == ESP_OK)
+        ack = (uint32_t)strtoul(param, NULL, 10);
+
+    uint32_t seq = obd_get_snapshot(&snap);
+
+    int len = obd_frame_encode(&s_frame_ctx, &snap.data, seq, ack, frame, sizeof(frame));
+    if (len < 0)
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "frame");
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    esp_err_t ret = httpd_resp_send(req, (const char *)frame, len);
+    obd_metrics_http_time(OBD_METRICS_HTTP_DATA_BIN, (uint32_t)(esp_timer_get_time() - t0));
+    return ret;
+}
+
+/* =======================================================
+ * 2b. ENDPOINT DISCOVERY PID (/pids)
+ *     bitmap per ECU + stato dei job dello scheduler + ritmo adattivo
+ * ======================================================= */
+static esp_err_t pids_handler(httpd_req_t *req)
+{
+    obd_pid_map_t map;
+    char buf[256];
+    int len;
+
+    // fino a OBD_MAX_JOBS voci: fuori dallo stack del task httpd
+    obd_job_info_t *jobs = malloc(sizeof(obd_job_info_t) * OBD_MAX_JOBS);
+    if (!jobs)
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+
+    obd_get_pid_map(&map);
+    int njobs = obd_data_get_jobs(jobs, OBD_MAX_JOBS);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    len = snprintf(buf, sizeof(buf), "{\"discovered\":%s,\"ecus\":[", map.done ? "true" : "false");
+    httpd_resp_send_chunk(req, buf, len);
+
+    for (int e = 0; e < map.ecu_count; e++) {
+        len = snprintf(buf, sizeof(buf), "%s{\"id\":\"0x%03X\",\"bitmap\":[",
+                       e ? "," : "", (unsigned)map.ecu[e].id);
+        httpd_resp_send_chunk(req, buf, len);
+
+        for (int k = 0; k < 8; k++) {
+            len = snprintf(buf, sizeof(buf), "%s\"%08lX\"", k ? "," : "",
+                           (unsigned long)map.ecu[e].bitmap[k]);
+            httpd_resp_send_chunk(req, buf, len);
+        }
+        httpd_resp_send_chunk(req, "]}", 2);
+    }
+
+    httpd_resp_send_chunk(req, "],\"jobs\":[", 10);
+
+    for (int i = 0; i < njobs; i++) {
+        int f = obd_field_for_pid(jobs[i].pid);
+        len = snprintf(buf, sizeof(buf),
+                       "%s{\"pid\":%u,\"key\":\"%s\",\"unit\":\"%s\",\"prio\":%u,\"supported\":%s,"
+                       "\"period_ms\":%u,\"base_period_ms\":%u,"
+                       "\"updates\":%lu,\"misses\":%lu,\"watched\":%s}",
+                       i ? "," : "", (unsigned)jobs[i].pid,
+                       f >= 0 ? obd_field_key((obd_field_t)f) : "",
+                       f >= 0 ? obd_field_unit((obd_field_t)f) : "", (unsigned)jobs[i].prio,
+                       jobs[i].supported ? "true" : "false",
+                       (unsigned)jobs[i].period_ms, (unsigned)jobs[i].base_period_ms,
+                       (unsigned long)jobs[i].updates, (unsigned long)jobs[i].deadline_misses,
+                       jobs[i].watched ? "true" : "false");
+        httpd_resp_send_chunk(req, buf, len);
+    }
+    free(jobs);
+
+    obd_pace_info_t pace;
+    obd_pace_get(&pace);
+
+    len = snprintf(buf, sizeof(buf), "],\"pace\":{\"spacing_ms\":%u,\"inflight\":%u,\"ecus\":[",
+                   (unsigned)pace.spacing_ms, (unsigned)pace.inflight);
+    httpd_resp_send_chunk(req, buf, len);
+
+    for (int e = 0; e < pace.ecu_count; e++) {
+        const obd_pace_ecu_t *pe = &pace.ecu[e];
+        len = snprintf(buf, sizeof(buf),
+                       "%s{\"id\":\"0x%03X\",\"active\":%s,\"srtt_us\":%lu,\"rtt_min_us\":%lu,"
+                       "\"rtt_max_us\":%lu,\"answers\":%lu,\"timeouts\":%lu,\"spacing_ms\":%u,\"inflight\":%u}",
+                       e ? "," : "", (unsigned)pe->id, pe->active ? "true" : "false",
+                       (unsigned long)pe->srtt_us, (unsigned long)pe->rtt_min_us,
+                       (unsigned long)pe->rtt_max_us,
+                       (unsigned long)pe->answers, (unsigned long)pe->timeouts,
+                       (unsigned)pe->spacing_ms, (unsigned)pe->inflight);
+        httpd_resp_send_chunk(req, buf, len);
+    }
+
+    httpd_resp_send_chunk(req, "]}}", 3);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* =======================================================
+ * 2c. ENDPOINT STORICO (/history?pid=0x0C&since=<ms>)
+ *     t in ms dall'avvio (relativi a "now"), v fixed-point: valore = v / div
+ * ======================================================= */
+#define HISTORY_CHUNK 32
+
+static esp_err_t history_handler(httpd_req_t *req)
+{
+    char query[64];
+    char param[16];
+    long pid = -1;
+    uint32_t since = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "pid", param, sizeof(param)) == ESP_OK)
+            pid = strtol(param, NULL, 0);
+        if (httpd_query_key_value(query, "since", param, sizeof(param)) == ESP_OK)
+            since = (uint32_t)strtoul(param, NULL, 0);
+    }
+
+    int f = (pid >= 0 && pid <= 0xFF) ? obd_field_for_pid((uint8_t)pid) : -1;
+    if (f < 0)
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "pid sconosciuto");
+
+    obd_hist_sample_t samples[HISTORY_CHUNK];
+    char buf[HISTORY_CHUNK * 26 + 8];
+    int len;
+    bool first = true;
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    len = snprintf(buf, sizeof(buf), "{\"pid\":%ld,\"key\":\"%s\",\"div\":%d,\"now\":%lu,\"samples\":[",
+                   pid, obd_field_key((obd_field_t)f), obd_history_div((obd_field_t)f),
+                   (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS));
+    httpd_resp_send_chunk(req, buf, len);
+
+    // a blocchi: il cursore avanza sull'ultimo istante inviato
+    while (1) {
+        int n = obd_history_read((obd_field_t)f, since, samples, HISTORY_CHUNK);
+        if (n <= 0)
+            break;
+
+        len = 0;
+        for (int i = 0; i < n; i++) {
+            len += snprintf(buf + len, sizeof(buf) - len, "%s[%lu,%ld]", first ? "" : ",",
+                            (unsigned long)samples[i].t_ms, (long)samples[i].v);
+            first = false;
+        }
+        if (httpd_resp_send_chunk(req, buf, len) != ESP_OK)
+            return ESP_FAIL;
+
+        since = samples[n - 1].t_ms;
+        if (n < HISTORY_CHUNK)
+            break;
+    }
+
+    httpd_resp_send_chunk(req, "]}", 2);
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 /* =======================================================
- * 3. LOGICA DI SELEZIONE FILE (BLOB)
+ * 2d. STREAM LIVE (/ws, WebSocket)
+ *     Un invio per ogni nuova pubblicazione del task RT (al più uno
+ *     ogni WS_PUSH_MIN_MS), stesso payload di /data: il buffer
+ *     passa alla work queue di httpd senza copie e torna alla cache
+ *     a invio finito.
+ *     La lista dei client è toccata solo dal task di httpd (handler e
+ *     work queue): nessun lock.
+ *
+ *     Dal client: "sub 0c=100 0d 05=1000" = PID mostrati dalla pagina
+ *     (periodo in ms, omesso = di tabella), "sub" da solo la ritira.
+ *     La sottoscrizione vive quanto il socket; quando una stazione
+ *     lascia l'AP i client rimasti ricevono {"resub":true} e hanno
+ *     WS_RESUB_GRACE_MS per rinnovarla, le altre scadono.
  * ======================================================= */
-static blob_t get_blob_for_uri(const char *uri, const char **mime_out)
+#ifndef WS_PUSH_MIN_MS
+#define WS_PUSH_MIN_MS 50
+#endif
+#define WS_MAX_CLIENTS 4
+
+#ifndef WS_RESUB_GRACE_MS
+#define WS_RESUB_GRACE_MS 3000
+#endif
+
+static httpd_handle_t s_server;
+static int s_ws_fds[WS_MAX_CLIENTS];
+static volatile int s_ws_count;
+static volatile bool s_ws_new_client;   // invia subito lo stato corrente
+static SemaphoreHandle_t s_ws_wake;
+static SemaphoreHandle_t s_ws_idle;     // un invio in coda alla volta: lo rende ws_send_all
+
+static void ws_remove(int i)
+{
+    obd_data_unsubscribe(s_ws_fds[i]);
+    s_ws_fds[i] = s_ws_fds[--s_ws_count];
+}
+
+static void ws_forget(int fd)
+{
+    for (int i = 0; i < s_ws_count; i++) {
+        if (s_ws_fds[i] == fd) {
+            ws_remove(i);
+            return;
+        }
+    }
+}
+
+/* "sub 0c=100 0d 05=1000": PID esadecimale, periodo opzionale in ms */
+static int ws_parse_sub(const char *s, obd_sub_item_t *items, int max)
+{
+    int n = 0;
+
+    while (*s) {
+        char *end;
+        while (*s == ' ' || *s == ',')
+            s++;
+        if (!*s)
+            break;
+
+        unsigned long pid = strtoul(s, &end, 16);
+        if (end == s || pid == 0 || pid > 0xFF || n >= max)
+            return -1;
+        s = end;
+
+        unsigned long period = 0;
+        if (*s == '=') {
+            period = strtoul(s + 1, &end, 10);
+            if (end == s + 1 || period > 0xFFFF)
+                return -1;
+            s = end;
+        }
+
+        items[n].pid = (uint8_t)pid;
+        items[n].period_ms = (uint16_t)period;
+        n++;
+    }
+    return n;
+}
+
+/* Gira nel task di httpd: chiede ai client rimasti di rinnovare */
+static void ws_send_resub(void *arg)
+{
+    (void)arg;
+    static const char msg[] = "{\"resub\":true}";
+
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)msg,
+        .len = sizeof(msg) - 1,
+    };
+
+    for (int i = 0; i < s_ws_count;) {
+        int fd = s_ws_fds[i];
+        if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+            httpd_ws_send_frame_async(s_server, fd, &frame) != ESP_OK) {
+            ESP_LOGI(TAG, "WS client %d rimosso", fd);
+            ws_remove(i);
+            continue;
+        }
+        i++;
+    }
+}
+
+/* Gira nel task degli eventi WiFi */
+void web_server_client_left(int remaining)
+{
+    if (remaining <= 0 || !s_server) {
+        obd_data_unsubscribe(OBD_SUB_ALL);
+        return;
+    }
+
+    obd_data_sub_grace(WS_RESUB_GRACE_MS);
+    httpd_queue_work(s_server, ws_send_resub, NULL);
+}
+
+/* Gira nel task di httpd; arg = payload da rendere alla fine */
+static void ws_send_all(void *arg)
+{
+    const obd_json_payload_t *p = arg;
+    int64_t t0 = esp_timer_get_time();
+
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)p->text,
+        .len = (size_t)p->len,
+    };
+
+    for (int i = 0; i < s_ws_count;) {
+        int fd = s_ws_fds[i];
+        if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+            httpd_ws_send_frame_async(s_server, fd, &frame) != ESP_OK) {
+            ESP_LOGI(TAG, "WS client %d rimosso", fd);
+            ws_remove(i);
+            continue;
+        }
+        i++;
+    }
+
+    obd_json_payload_put(p);
+    obd_metrics_http_time(OBD_METRICS_HTTP_WS_PUSH, (uint32_t)(esp_timer_get_time() - t0));
+    xSemaphoreGive(s_ws_idle);
+}
+
+/* Gira nel task RT: solo segnalazione */
+static void ws_on_publish(uint32_t seq, void *ctx)
+{
+    (void)seq;
+    (void)ctx;
+    xSemaphoreGive(s_ws_wake);
+}
+
+static void ws_push_task(void *arg)
+{
+    (void)arg;
+    uint32_t last_seq = 0;
+
+    while (1) {
+        xSemaphoreTake(s_ws_wake, portMAX_DELAY);
+        if (s_ws_count == 0)
+            continue;
+
+        // invio precedente ancora in corso (client lento): si dorme finché
+        // httpd non ha finito, niente code di frame vecchi
+        xSemaphoreTake(s_ws_idle, portMAX_DELAY);
+
+        const obd_json_payload_t *p = NULL;
+        if (obd_data_seq() != last_seq || s_ws_new_client)
+            p = obd_json_payload_get();
+        if (!p) {
+            xSemaphoreGive(s_ws_idle);
+            continue;
+        }
+        last_seq = p->seq;
+        s_ws_new_client = false;
+
+        if (httpd_queue_work(s_server, ws_send_all, (void *)p) != ESP_OK) {
+            obd_json_payload_put(p);
+            xSemaphoreGive(s_ws_idle);
+        }
+
+        // le pubblicazioni arrivate nel frattempo restano segnalate:
+        // al risveglio si invia subito l'ultima
+        vTaskDelay(pdMS_TO_TICKS(WS_PUSH_MIN_MS));
+    }
+}
+
+static esp_err_t ws_handler(httpd_req_t *req)
 {
-    *mime_out = "text/plain";
+    int fd = httpd_req_to_sockfd(req);
+
+    // handshake completato: registra il client
+    if (req->method == HTTP_GET) {
+        for (int i = 0; i < s_ws_count; i++)
+            if (s_ws_fds[i] == fd)
+                return ESP_OK;
+
+        if (s_ws_count >= WS_MAX_CLIENTS) {
+            ESP_LOGW(TAG, "WS: troppi client");
+            return ESP_FAIL;
+        }
 
-    // --- PAGINE HTML ---
-    if (strcmp(uri, "/") == 0 || strcmp(uri, "/index.html") == 0) {
-        *mime_out = "text/html";
-        return (blob_t){_binary_index_html_start, _binary_index_html_end};
+        s_ws_fds[s_ws_count++] = fd;
+        s_ws_new_client = true;
+        xSemaphoreGive(s_ws_wake);
+        ESP_LOGI(TAG, "WS client %d connesso (%d)", fd, s_ws_count);
+        return ESP_OK;
     }
-    if (strstr(uri, "/graph.html")) {
-        *mime_out = "text/html";
-        return (blob_t){_binary_graph_html_start, _binary_graph_html_end};
+
+    // frame dal client: solo il comando "sub" (vedi sopra)
+    uint8_t buf[8 * OBD_SUB_MAX_PIDS + 8];
+    httpd_ws_frame_t frame = {0};
+
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK)
+        return err;
+
+    if (frame.len >= sizeof(buf)) {
+        // payload non letto: resterebbe nel socket e il prossimo header
+        // verrebbe cercato al suo interno. Chiusura 1009 e sessione chiusa.
+        static const uint8_t too_big[] = {1009 >> 8, 1009 & 0xFF, 't', 'o', 'o', ' ', 'b', 'i', 'g'};
+        httpd_ws_frame_t bye = {
+            .final = true,
+            .type = HTTPD_WS_TYPE_CLOSE,
+            .payload = (uint8_t *)too_big,
+            .len = sizeof(too_big),
+        };
+
+        ESP_LOGW(TAG, "WS client %d: frame di %u byte oltre %u, chiuso", fd, (unsigned)frame.len,
+                 (unsigned)(sizeof(buf) - 1));
+        httpd_ws_send_frame(req, &bye);
+        ws_forget(fd);
+        return ESP_FAIL;
+    }
+
+    if (frame.len > 0) {
+        frame.payload = buf;
+        err = httpd_ws_recv_frame(req, &frame, sizeof(buf) - 1);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    if (frame.type == HTTPD_WS_TYPE_TEXT && frame.payload && frame.len >= 3 &&
+        memcmp(buf, "sub", 3) == 0) {
+        obd_sub_item_t items[OBD_SUB_MAX_PIDS];
+        buf[frame.len] = '\0';
+
+        int n = ws_parse_sub((const char *)buf + 3, items, OBD_SUB_MAX_PIDS);
+        if (n < 0)
+            ESP_LOGW(TAG, "WS client %d: sottoscrizione non valida", fd);
+        else
+            obd_data_subscribe(fd, items, n);
+    }
+
+    if (frame.type == HTTPD_WS_TYPE_CLOSE)
+        ws_forget(fd);
+    return ESP_OK;
+}
+
+/* =======================================================
+ * 2e. CATTURA PASSIVA (/can)
+ *     statistiche per ID e segnali decodificati (APP_CAN_LISTEN_ONLY);
+ *     ?set=nome:id:start:len:le|be:u|s:scale:offset aggiunge o
+ *     sostituisce un segnale, ?del=nome lo rimuove (salvati in NVS);
+ *     ?trace=candump|asc[&since=<cursore>] scarica il ring come traccia
+ * ======================================================= */
+#define TRACE_BATCH 16
+
+/* Traccia testuale del ring fino alla testa vista all'inizio della
+   richiesta. X-Trace-Next è il cursore da passare come since alla
+   richiesta successiva (download incrementale senza duplicati). */
+static esp_err_t can_trace_send(httpd_req_t *req, can_trace_fmt_t fmt, uint32_t cursor)
+{
+    can_frame_rec_t rec[TRACE_BATCH];
+    char buf[TRACE_BATCH * CAN_TRACE_LINE_MAX];
+    char hdr_next[12], hdr_lost[12];
+    can_capture_status_t st;
+    uint32_t lost = 0;
+    int len;
+
+    can_capture_status(&st);
+    uint32_t stop = st.frames;
+    if (stop - cursor > CAN_CAPTURE_RING)
+        lost = stop - CAN_CAPTURE_RING - cursor; // già sovrascritti
+
+    snprintf(hdr_next, sizeof(hdr_next), "%lu", (unsigned long)stop);
+    snprintf(hdr_lost, sizeof(hdr_lost), "%lu", (unsigned long)lost);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+    httpd_resp_set_hdr(req, "X-Trace-Next", hdr_next);
+    httpd_resp_set_hdr(req, "X-Trace-Lost", hdr_lost);
+
+    len = can_trace_header(fmt, buf, sizeof(buf));
+    if (len > 0 && httpd_resp_send_chunk(req, buf, len) != ESP_OK)
+        return ESP_FAIL;
+
+    while (cursor != stop) {
+        uint32_t before = lost;
+        uint32_t want = stop - cursor;
+        int n = can_capture_read(&cursor, rec, want < TRACE_BATCH ? (int)want : TRACE_BATCH, &lost);
+        if (n == 0 && lost == before)
+            break;
+
+        // il ring tiene 32 bit di µs: si riportano all'orologio a 64 bit
+        int64_t now64 = esp_timer_get_time();
+        uint32_t now32 = (uint32_t)now64;
+
+        len = 0;
+        if (lost != before)
+            len += snprintf(buf, sizeof(buf), "%s %lu frame persi\n",
+                            fmt == CAN_TRACE_ASC ? "//" : "#", (unsigned long)(lost - before));
+        for (int i = 0; i < n; i++)
+            len += can_trace_format(fmt, &rec[i], (uint64_t)(now64 - (uint32_t)(now32 - rec[i].t_us)),
+                                    buf + len, sizeof(buf) - (size_t)len);
+        if (httpd_resp_send_chunk(req, buf, len) != ESP_OK)
+            return ESP_FAIL;
     }
-    if (strstr(uri, "/errors.html")) {
-        *mime_out = "text/html";
-        return (blob_t){_binary_errors_html_start, _binary_errors_html_end};
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t can_handler(httpd_req_t *req)
+{
+    char query[128];
+    char param[96];
+    char buf[192];
+    int len;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "set", param, sizeof(param)) == ESP_OK) {
+            can_signal_def_t def;
+            if (!can_signal_parse(param, &def) || !can_signal_set(&def))
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "segnale non valido");
+        }
+        if (httpd_query_key_value(query, "del", param, sizeof(param)) == ESP_OK &&
+            !can_signal_del(param))
+            return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "segnale sconosciuto");
+        if (httpd_query_key_value(query, "trace", param, sizeof(param)) == ESP_OK) {
+            can_trace_fmt_t fmt;
+            char since[12];
+            if (!can_trace_fmt_parse(param, &fmt))
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "formato: candump|asc");
+            uint32_t cursor = 0;
+            if (httpd_query_key_value(query, "since", since, sizeof(since)) == ESP_OK)
+                cursor = (uint32_t)strtoul(since, NULL, 10);
+            return can_trace_send(req, fmt, cursor);
+        }
     }
-    if (strstr(uri, "/diagnostics.html")) {
-        *mime_out = "text/html";
-        return (blob_t){_binary_diagnostics_html_start, _binary_diagnostics_html_end};
+
+    // fino a CAN_CAPTURE_MAX_IDS voci: fuori dallo stack del task httpd
+    can_id_stats_t *ids = malloc(sizeof(can_id_stats_t) * CAN_CAPTURE_MAX_IDS);
+    if (!ids)
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+
+    can_capture_status_t st;
+    can_capture_status(&st);
+    int nids = can_capture_get_ids(ids, CAN_CAPTURE_MAX_IDS);
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    len = snprintf(buf, sizeof(buf),
+                   "{\"running\":%s,\"frames\":%lu,\"ids_dropped\":%lu,\"rx_errors\":%lu,\"ids\":[",
+                   st.running ? "true" : "false", (unsigned long)st.frames,
+                   (unsigned long)st.ids_dropped, (unsigned long)st.rx_errors);
+    httpd_resp_send_chunk(req, buf, len);
+
+    for (int i = 0; i < nids; i++) {
+        const can_id_stats_t *c = &ids[i];
+        uint32_t span_us = c->last_us - c->first_us;
+        char hex[17];
+
+        for (int k = 0; k < c->dlc; k++)
+            snprintf(hex + 2 * k, 3, "%02X", c->data[k]);
+        hex[2 * c->dlc] = '\0';
+
+        len = snprintf(buf, sizeof(buf),
+                       "%s{\"id\":\"0x%0*lX\",\"ext\":%s,\"count\":%lu,\"period_ms\":%.2f,"
+                       "\"dlc\":%u,\"data\":\"%s\",\"changes_per_s\":%.1f,\"age_ms\":%lu}",
+                       i ? "," : "", (c->flags & CAN_REC_EXT) ? 8 : 3, (unsigned long)c->id,
+                       (c->flags & CAN_REC_EXT) ? "true" : "false", (unsigned long)c->count,
+                       c->period_us / 1000.0, (unsigned)c->dlc, hex,
+                       span_us ? c->changes * 1e6 / span_us : 0.0,
+                       (unsigned long)((now_us - c->last_us) / 1000));
+        httpd_resp_send_chunk(req, buf, len);
     }
+    free(ids);
 
-    // --- JAVASCRIPT ---
-    if (strstr(uri, "/script.js")) {
-        *mime_out = "application/javascript";
-        return (blob_t){_binary_script_js_start, _binary_script_js_end};
+    httpd_resp_send_chunk(req, "],\"signals\":[", 13);
+
+    can_signal_info_t sig[CAN_SIGNALS_MAX];
+    int nsig = can_signal_get(sig, CAN_SIGNALS_MAX);
+
+    for (int i = 0; i < nsig; i++) {
+        const can_signal_def_t *d = &sig[i].def;
+        len = snprintf(buf, sizeof(buf),
+                       "%s{\"name\":\"%s\",\"def\":\"%s:%0*lX:%u:%u:%s:%s:%g:%g\",\"value\":%g,"
+                       "\"count\":%lu,\"age_ms\":%ld}",
+                       i ? "," : "", d->name, d->name, d->ext ? 8 : 3, (unsigned long)d->id,
+                       (unsigned)d->start, (unsigned)d->len, d->big_endian ? "be" : "le",
+                       d->is_signed ? "s" : "u", d->scale, d->offset, sig[i].value,
+                       (unsigned long)sig[i].count,
+                       sig[i].t_us ? (long)((now_us - sig[i].t_us) / 1000) : -1L);
+        httpd_resp_send_chunk(req, buf, len);
     }
-    if (strstr(uri, "/chart-script.js")) {
-        *mime_out = "application/javascript";
-        return (blob_t){_binary_chart_script_js_start, _binary_chart_script_js_end};
+
+    httpd_resp_send_chunk(req, "]}", 2);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* =======================================================
+ * 2f. REGISTRO DI SESSIONE (/log)
+ *     /log[?since=<seq>]: segmenti (header + payload) dal più vecchio,
+ *     solo quelli con seq > since; /log?stats=1: banda e usura
+ * ======================================================= */
+#define FLASH_ENDURANCE 100000.0 // cicli di erase per settore
+
+static esp_err_t log_stats(httpd_req_t *req)
+{
+    obd_log_stats_t st;
+    char buf[512];
+
+    obd_log_get_stats(&st);
+    double s = st.uptime_ms ? st.uptime_ms / 1000.0 : 1.0;
+    double sector_h = st.sectors ? st.segments * 3600.0 / s / st.sectors : 0.0;
+
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"active\":%s,\"boot\":%lu,\"sectors\":%lu,\"segment_bytes\":%d,"
+                       "\"oldest_seq\":%lu,\"newest_seq\":%lu,\"records\":%lu,\"pending\":%lu,"
+                       "\"segments\":%lu,\"overwritten\":%lu,\"write_errors\":%lu,"
+                       "\"payload_bytes_per_s\":%.1f,\"flash_bytes_per_s\":%.1f,"
+                       "\"write_ms_avg\":%.1f,\"write_ms_max\":%lu,"
+                       "\"erases_per_h\":%.1f,\"erases_per_sector_per_h\":%.3f,\"life_years\":%.1f}",
+                       st.active ? "true" : "false", (unsigned long)st.boot,
+                       (unsigned long)st.sectors, OBD_LOG_SEGMENT, (unsigned long)st.oldest_seq,
+                       (unsigned long)st.newest_seq, (unsigned long)st.records,
+                       (unsigned long)st.pending, (unsigned long)st.segments,
+                       (unsigned long)st.overwritten, (unsigned long)st.write_errors,
+                       st.payload_bytes / s, st.segments * (double)OBD_LOG_SEGMENT / s,
+                       st.segments ? (double)st.write_ms_total / st.segments : 0.0,
+                       (unsigned long)st.write_ms_max, st.segments * 3600.0 / s, sector_h,
+                       sector_h > 0 ? FLASH_ENDURANCE / sector_h / 8760.0 : 0.0);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+    return httpd_resp_send(req, buf, len);
+}
+
+static esp_err_t log_handler(httpd_req_t *req)
+{
+    char query[48];
+    char param[16];
+    uint32_t since = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "stats", param, sizeof(param)) == ESP_OK)
+            return log_stats(req);
+        if (httpd_query_key_value(query, "since", param, sizeof(param)) == ESP_OK)
+            since = (uint32_t)strtoul(param, NULL, 0);
     }
-    if (strstr(uri, "/animations.js")) {
-        *mime_out = "application/javascript";
-        return (blob_t){_binary_animations_js_start, _binary_animations_js_end};
+
+    // un settore alla volta: fuori dallo stack del task httpd
+    uint8_t *seg = malloc(OBD_LOG_SEGMENT);
+    if (!seg)
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"obd_log.bin\"");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    int len;
+    for (int i = 0; (len = obd_log_read_segment(i, seg, OBD_LOG_SEGMENT)) >= 0; i++) {
+        if (len == 0 || ((const obd_log_seg_hdr_t *)seg)->seq <= since)
+            continue;
+        if (httpd_resp_send_chunk(req, (const char *)seg, len) != ESP_OK) {
+            free(seg);
+            return ESP_FAIL;
+        }
     }
-    if (strstr(uri, "/diagnostics-script.js")) {
-        *mime_out = "application/javascript";
-        return (blob_t){_binary_diagnostics_script_js_start, _binary_diagnostics_script_js_end};
+    free(seg);
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* =======================================================
+ * 2g. CODICI DI ERRORE (/dtc[?refresh=1])
+ *     Sempre dalla cache: refresh=1 chiede una nuova lettura e risponde
+ *     subito con "busy":true; il client ripete finché gen non cambia.
+ * ======================================================= */
+static const char *const k_dtc_kinds[OBD_DTC_KIND_COUNT] = {"stored", "pending", "permanent"};
+
+static esp_err_t dtc_handler(httpd_req_t *req)
+{
+    char query[32];
+    char param[8];
+    char buf[160];
+    char code[6];
+    int len;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "refresh", param, sizeof(param)) == ESP_OK &&
+        atoi(param) != 0)
+        obd_dtc_request_refresh();
+
+    obd_dtc_info_t info;
+    obd_dtc_get_info(&info);
+    uint32_t now = (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    len = snprintf(buf, sizeof(buf), "{\"gen\":%lu,\"reads\":%lu,\"busy\":%s,\"mil_count\":%d",
+                   (unsigned long)info.gen, (unsigned long)info.reads,
+                   info.busy ? "true" : "false", (int)info.mil_count);
+    httpd_resp_send_chunk(req, buf, len);
+
+    obd_dtc_list_t list;
+    for (int k = 0; k < OBD_DTC_KIND_COUNT; k++) {
+        obd_dtc_get((obd_dtc_kind_t)k, &list);
+
+        len = snprintf(buf, sizeof(buf),
+                       ",\"%s\":{\"valid\":%s,\"age_ms\":%ld,\"ecus\":%u,\"negative\":%u,"
+                       "\"total\":%u,\"codes\":[",
+                       k_dtc_kinds[k], list.valid ? "true" : "false",
+                       list.valid ? (long)(now - list.read_ms) : -1L, (unsigned)list.ecus,
+                       (unsigned)list.negative, (unsigned)list.total);
+        httpd_resp_send_chunk(req, buf, len);
+
+        for (int i = 0; i < list.n; i++) {
+            obd_dtc_format(list.code[i].code, code);
+            len = snprintf(buf, sizeof(buf), "%s{\"code\":\"%s\",\"ecu\":\"0x%03X\"}",
+                           i ? "," : "", code, (unsigned)list.code[i].ecu_id);
+            httpd_resp_send_chunk(req, buf, len);
+        }
+        httpd_resp_send_chunk(req, "]}", 2);
     }
-    if (strstr(uri, "/chart.js")) {
-        *mime_out = "application/javascript";
-        return (blob_t){_binary_chart_js_start, _binary_chart_js_end};
+
+    httpd_resp_send_chunk(req, "}", 1);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* =======================================================
+ * 2h. STATO DEL SISTEMA (/stats)
+ *     Task (priorità, core, stack minimo libero, quota CPU), heap,
+ *     contatori TWAI e latenza RX -> RT dello scheduler OBD.
+ *     Quota CPU e latenza sono sulla finestra dalla richiesta
+ *     precedente: interrogando a ritmo fisso si vede l'effetto del
+ *     carico web. La CPU è in % di un core (IDLE0/IDLE1 = tempo libero).
+ *     Le voci dei task servono CONFIG_FREERTOS_USE_TRACE_FACILITY e
+ *     CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS (sdkconfig.defaults).
+ * ======================================================= */
+#ifndef STATS_MAX_TASKS
+#define STATS_MAX_TASKS 32
+#endif
+
+static const char *const k_twai_states[] = {"stopped", "running", "bus_off", "recovering"};
+
+#if configUSE_TRACE_FACILITY
+// finestra precedente: solo task di httpd
+static struct {
+    TaskHandle_t handle;
+    uint32_t runtime;
+} s_prev_tasks[STATS_MAX_TASKS];
+static int s_prev_ntasks;
+static uint32_t s_prev_total;
+
+static uint32_t prev_runtime(TaskHandle_t h, bool *found)
+{
+    for (int i = 0; i < s_prev_ntasks; i++) {
+        if (s_prev_tasks[i].handle == h) {
+            *found = true;
+            return s_prev_tasks[i].runtime;
+        }
     }
-    if (strstr(uri, "/luxox.js")) {
-        *mime_out = "application/javascript";
-        return (blob_t){_binary_luxox_js_start, _binary_luxox_js_end};
+    *found = false;
+    return 0;
+}
+
+static void stats_send_tasks(httpd_req_t *req)
+{
+    char buf[160];
+    int len;
+    uint32_t total = 0;
+
+    TaskStatus_t *st = malloc(sizeof(TaskStatus_t) * STATS_MAX_TASKS);
+    if (!st) {
+        httpd_resp_send_chunk(req, ",\"tasks\":null", 13);
+        return;
     }
 
-    // --- CSS ---
-    if (strstr(uri, "/style.css")) {
-        *mime_out = "text/css";
-        return (blob_t){_binary_style_css_start, _binary_style_css_end};
+    int n = (int)uxTaskGetSystemState(st, STATS_MAX_TASKS, &total);
+    // contatori a 32 bit: la differenza regge un giro del timer
+    uint32_t window = total - s_prev_total;
+
+    len = snprintf(buf, sizeof(buf), ",\"window_ms\":%lu,\"tasks\":[",
+                   (unsigned long)(s_prev_ntasks ? window / 1000 : total / 1000));
+    httpd_resp_send_chunk(req, buf, len);
+
+    for (int i = 0; i < n; i++) {
+        int core = -1;
+#if configTASKLIST_INCLUDE_COREID
+        if (st[i].xCoreID != tskNO_AFFINITY)
+            core = (int)st[i].xCoreID;
+#endif
+        // task nato nella finestra: la sua quota parte da 0
+        bool found;
+        uint32_t prev = prev_runtime(st[i].xHandle, &found);
+        uint32_t busy = (uint32_t)st[i].ulRunTimeCounter - prev;
+        uint32_t span = s_prev_ntasks && found ? window : total;
+
+        len = snprintf(buf, sizeof(buf),
+                       "%s{\"name\":\"%s\",\"prio\":%u,\"core\":%d,\"stack_free_min\":%lu,"
+                       "\"cpu\":%.1f}",
+                       i ? "," : "", st[i].pcTaskName, (unsigned)st[i].uxCurrentPriority, core,
+                       (unsigned long)st[i].usStackHighWaterMark,
+                       span ? busy * 100.0 / span : 0.0);
+        httpd_resp_send_chunk(req, buf, len);
     }
-    if (strstr(uri, "all.min.css")) {
-        *mime_out = "text/css";
-        return (blob_t){_binary_all_min_css_start, _binary_all_min_css_end};
+    httpd_resp_send_chunk(req, "]", 1);
+
+    s_prev_ntasks = 0;
+    for (int i = 0; i < n && i < STATS_MAX_TASKS; i++) {
+        s_prev_tasks[i].handle = st[i].xHandle;
+        s_prev_tasks[i].runtime = (uint32_t)st[i].ulRunTimeCounter;
+        s_prev_ntasks++;
     }
+    s_prev_total = total;
+    free(st);
+}
+#endif
+
+static esp_err_t stats_handler(httpd_req_t *req)
+{
+    char buf[320];
+    int len;
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    len = snprintf(buf, sizeof(buf),
+                   "{\"uptime_ms\":%lld,\"cores\":%d,\"pinning\":%s,"
+                   "\"heap\":{\"free\":%lu,\"min_free\":%lu,\"largest\":%lu}",
+                   (long long)(esp_timer_get_time() / 1000), (int)portNUM_PROCESSORS,
+                   APP_TASK_PINNING && portNUM_PROCESSORS > 1 ? "true" : "false",
+                   (unsigned long)esp_get_free_heap_size(),
+                   (unsigned long)esp_get_minimum_free_heap_size(),
+                   (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    httpd_resp_send_chunk(req, buf, len);
 
-    // --- FONTS (WOFF2) ---
-    if (strstr(uri, ".woff2")) {
-        *mime_out = "font/woff2";
-        if (strstr(uri, "Inter-Bold"))
-            return (blob_t){_binary_Inter_Bold_woff2_start, _binary_Inter_Bold_woff2_end};
-        if (strstr(uri, "Inter-Regular"))
-            return (blob_t){_binary_Inter_Regular_woff2_start, _binary_Inter_Regular_woff2_end};
-        if (strstr(uri, "fa-solid-900"))
-            return (blob_t){_binary_fa_solid_900_woff2_start, _binary_fa_solid_900_woff2_end};
-        if (strstr(uri, "fa-regular-400"))
-            return (blob_t){_binary_fa_regular_400_woff2_start, _binary_fa_regular_400_woff2_end};
-        if (strstr(uri, "fa-brands-400"))
-            return (blob_t){_binary_fa_brands_400_woff2_start, _binary_fa_brands_400_woff2_end};
+#if configUSE_TRACE_FACILITY
+    stats_send_tasks(req);
+#else
+    httpd_resp_send_chunk(req, ",\"tasks\":null", 13);
+#endif
+
+    twai_status_info_t tw;
+    if (can_bus_get_status(&tw) == ESP_OK) {
+        len = snprintf(buf, sizeof(buf),
+                       ",\"twai\":{\"state\":\"%s\",\"bitrate\":%lu,\"tx_queued\":%lu,"
+                       "\"rx_queued\":%lu,\"tx_err\":%lu,\"rx_err\":%lu,\"tx_failed\":%lu,"
+                       "\"rx_missed\":%lu,\"rx_overrun\":%lu,\"arb_lost\":%lu,\"bus_error\":%lu}",
+                       (unsigned)tw.state < 4 ? k_twai_states[tw.state] : "?",
+                       (unsigned long)can_bus_bitrate(), (unsigned long)tw.msgs_to_tx,
+                       (unsigned long)tw.msgs_to_rx, (unsigned long)tw.tx_error_counter,
+                       (unsigned long)tw.rx_error_counter, (unsigned long)tw.tx_failed_count,
+                       (unsigned long)tw.rx_missed_count, (unsigned long)tw.rx_overrun_count,
+                       (unsigned long)tw.arb_lost_count, (unsigned long)tw.bus_error_count);
+    } else {
+        len = snprintf(buf, sizeof(buf), ",\"twai\":null");
     }
+    httpd_resp_send_chunk(req, buf, len);
+
+    obd_rt_stats_t rt;
+    obd_json_stats_t js;
+    obd_data_get_rt_stats(&rt, true);
+    obd_json_get_stats(&js);
+    len = snprintf(buf, sizeof(buf),
+                   ",\"obd_rt\":{\"batches\":%lu,\"window\":%lu,\"lat_avg_us\":%lu,"
+                   "\"lat_max_us\":%lu},\"json\":{\"builds\":%lu,\"served\":%lu,"
+                   "\"stale\":%lu}}",
+                   (unsigned long)rt.batches, (unsigned long)rt.window,
+                   (unsigned long)rt.lat_avg_us, (unsigned long)rt.lat_max_us,
+                   (unsigned long)js.builds, (unsigned long)js.served,
+                   (unsigned long)js.stale);
+    httpd_resp_send_chunk(req, buf, len);
 
-    *mime_out = NULL;
-    return (blob_t){NULL, NULL};
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 /* =======================================================
- * 4. HANDLER FILE STATICI
+ * 2i. METRICHE (/metrics)
+ *     Formato testuale Prometheus: istogrammi di latenza per PID e per
+ *     ECU, timeout, backoff, TX fallite, contatori TWAI, tempi di
+ *     servizio di /data, /data.bin e /ws (obd_metrics.h).
  * ======================================================= */
+static void metrics_emit(const char *text, int len, void *ctx)
+{
+    httpd_resp_send_chunk((httpd_req_t *)ctx, text, len);
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "text/plain; version=0.0.4; charset=utf-8");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    obd_metrics_export(metrics_emit, req);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* =======================================================
+ * 3. HANDLER FILE STATICI
+ *    Tabella generata a build time (web_assets.h): ricerca esatta
+ *    in tempo costante. ETag = FNV-1a del blob calcolato dal build,
+ *    304 se il client ha già quella versione.
+ *    Gli asset compressi esistono solo in gzip: a chi non lo accetta
+ *    406. Vary su tutte le risposte, così una cache intermedia non
+ *    serve i byte compressi a un client che non li ha chiesti.
+ * ======================================================= */
+#define CACHE_LONG "public, max-age=2592000" // 30 giorni: librerie e font
+#define CACHE_REVALIDATE "no-cache"          // sempre rivalidato via ETag
+
+static bool etag_matches(httpd_req_t *req, const char *etag)
+{
+    char hdr[96];
+    size_t n = httpd_req_get_hdr_value_len(req, "If-None-Match");
+
+    if (n == 0 || n >= sizeof(hdr))
+        return false;
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", hdr, sizeof(hdr)) != ESP_OK)
+        return false;
+    return strstr(hdr, etag) != NULL || strcmp(hdr, "*") == 0;
+}
+
+/* Accept-Encoding contiene gzip (o *) con q diverso da 0 */
+static bool accepts_gzip(httpd_req_t *req)
+{
+    char hdr[128];
+    size_t n = httpd_req_get_hdr_value_len(req, "Accept-Encoding");
+
+    if (n == 0 || n >= sizeof(hdr))
+        return false;
+    if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", hdr, sizeof(hdr)) != ESP_OK)
+        return false;
+
+    char *save = NULL;
+    for (char *tok = strtok_r(hdr, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        tok += strspn(tok, " \t");
+        size_t len = strcspn(tok, " \t;");
+        if (!(len == 4 && strncasecmp(tok, "gzip", 4) == 0) && !(len == 1 && tok[0] == '*'))
+            continue;
+
+        // "gzip;q=0" (anche 0.0, 0.00...) vuol dire rifiutato
+        const char *q = strstr(tok, "q=");
+        if (q == NULL)
+            return true;
+        q += 2;
+        if (*q != '0')
+            return true;
+        for (q++; *q == '.' || *q == '0'; q++)
+            ;
+        if (*q >= '1' && *q <= '9')
+            return true;
+    }
+    return false;
+}
+
 static esp_err_t static_handler(httpd_req_t *req)
 {
-    const char *mime = NULL;
-    blob_t b = get_blob_for_uri(req->uri, &mime);
+    // percorso senza query string; "/" è la home
+    const char *uri = req->uri;
+    size_t n = strcspn(uri, "?#");
+    if (n == 1) {
+        uri = "/index.html";
+        n = strlen(uri);
+    }
 
-    if (b.start == NULL || mime == NULL) {
+    const web_asset_t *a = web_asset_find(uri, n);
+    if (a == NULL) {
         ESP_LOGW(TAG, "File non trovato: %s", req->uri);
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not Found");
         return ESP_OK;
     }
 
-    size_t len = (size_t)(b.end - b.start);
+    size_t len = (size_t)(a->end - a->start);
+
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
 
-    httpd_resp_set_type(req, mime);
+    if (a->gzip && !accepts_gzip(req)) {
+        httpd_resp_set_status(req, "406 Not Acceptable");
+        httpd_resp_set_type(req, "text/plain");
+        return httpd_resp_sendstr(req, "gzip required");
+    }
 
+    httpd_resp_set_hdr(req, "ETag", a->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", a->long_cache ? CACHE_LONG : CACHE_REVALIDATE);
+
+    if (etag_matches(req, a->etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, a->mime);
+    if (a->gzip)
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
 
     // Chunked per file grandi (>4KB) per evitare mismatch/instabilità
     if (len > 4096) {
@@ -210,7 +1043,7 @@ static esp_err_t static_handler(httpd_req_t *req)
         size_t off = 0;
         while (off < len) {
             size_t to_send = (len - off) > CHUNK ? CHUNK : (len - off);
-            esp_err_t ret = httpd_resp_send_chunk(req, (const char *)b.start + off, to_send);
+            esp_err_t ret = httpd_resp_send_chunk(req, (const char *)a->start + off, to_send);
             if (ret != ESP_OK) {
                 ESP_LOGW(TAG, "Chunk send failed (%d) uri=%s", (int)ret, req->uri);
                 return ret;
@@ -220,35 +1053,22 @@ static esp_err_t static_handler(httpd_req_t *req)
         return httpd_resp_send_chunk(req, NULL, 0);
     }
 
-    return httpd_resp_send(req, (const char *)b.start, len);
+    return httpd_resp_send(req, (const char *)a->start, len);
 }
-/*===================================================
-                RPM TO LCD
-==================================================*/
-
-unsigned get_rpm(void)
-{
-    return (unsigned)d.rpm;
-}
-int get_temp(void)
-{
-    return (int)d.coolant_temp;
-}
-float get_battery(void)
-{
-    return (float)d.battery_voltage;
-}
-
-
 /* =======================================================
- * 5. AVVIO SERVER 
+ * 4. AVVIO SERVER 
  * ======================================================= */
 void web_server_start(void)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.stack_size = 10240;
+    config.stack_size = APP_HTTPD_STACK;
+    config.task_priority = APP_HTTPD_PRIO;
+    config.core_id = APP_CORE(APP_CORE_NET);
+    config.max_uri_handlers = 12; // default 8: già tutti usati
     config.uri_match_fn = httpd_uri_match_wildcard;
 
+    obd_json_payload_init(); // prima degli handler che la usano
+
     httpd_handle_t server = NULL;
     if (httpd_start(&server, &config) != ESP_OK) {
         ESP_LOGE(TAG, "Errore avvio server");
@@ -263,6 +1083,79 @@ void web_server_start(void)
     };
     httpd_register_uri_handler(server, &data_uri);
 
+    httpd_uri_t data_bin_uri = {
+        .uri = "/data.bin",
+        .method = HTTP_GET,
+        .handler = data_bin_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &data_bin_uri);
+
+    httpd_uri_t pids_uri = {
+        .uri = "/pids",
+        .method = HTTP_GET,
+        .handler = pids_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &pids_uri);
+
+    httpd_uri_t history_uri = {
+        .uri = "/history",
+        .method = HTTP_GET,
+        .handler = history_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &history_uri);
+
+    httpd_uri_t ws_uri = {
+        .uri = "/ws",
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .user_ctx = NULL,
+        .is_websocket = true
+    };
+    httpd_register_uri_handler(server, &ws_uri);
+
+    httpd_uri_t can_uri = {
+        .uri = "/can",
+        .method = HTTP_GET,
+        .handler = can_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &can_uri);
+
+    httpd_uri_t log_uri = {
+        .uri = "/log",
+        .method = HTTP_GET,
+        .handler = log_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &log_uri);
+
+    httpd_uri_t dtc_uri = {
+        .uri = "/dtc",
+        .method = HTTP_GET,
+        .handler = dtc_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &dtc_uri);
+
+    httpd_uri_t stats_uri = {
+        .uri = "/stats",
+        .method = HTTP_GET,
+        .handler = stats_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &stats_uri);
+
+    httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &metrics_uri);
+
     httpd_uri_t static_uri = {
         .uri = "/*",
         .method = HTTP_GET,
@@ -271,5 +1164,14 @@ void web_server_start(void)
     };
     httpd_register_uri_handler(server, &static_uri);
 
+    s_server = server;
+    obd_frame_ctx_init(&s_frame_ctx);
+    s_ws_wake = xSemaphoreCreateBinary();
+    s_ws_idle = xSemaphoreCreateBinary();
+    xSemaphoreGive(s_ws_idle);
+    obd_data_add_listener(ws_on_publish, NULL);
+    xTaskCreatePinnedToCore(ws_push_task, "ws_push", APP_WS_PUSH_STACK, NULL, APP_WS_PUSH_PRIO, NULL,
+                            APP_CORE(APP_CORE_NET));
+
     ESP_LOGI(TAG, "Web Server avviato correttamente");
 }
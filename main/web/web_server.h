@@ -1,6 +1,7 @@
 #pragma once
 void web_server_start(void);
-unsigned get_rpm(void);
-int get_temp(void);
-float get_battery(void);
+
+/* Una stazione ha lasciato l'AP (remaining = stazioni ancora connesse):
+   le sottoscrizioni dei client spariti vengono ritirate */
+void web_server_client_left(int remaining);
 
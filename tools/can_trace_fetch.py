@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""Scarica di continuo la traccia CAN del dispositivo in un file.
+
+uso: can_trace_fetch.py [-f candump|asc] [-i secondi] [host] <uscita>
+
+Interroga /can?trace=<formato>&since=<cursore> e accoda le righe nuove;
+il cursore successivo arriva nell'header X-Trace-Next, i frame sovrascritti
+nel ring prima del download in X-Trace-Lost. Con il polling di default
+(1 s) il ring da 512 frame regge circa 500 frame/s: il traffico del
+polling OBD ne produce un centinaio. Ctrl-C per terminare.
+Il file si rigioca sull'host con obd_replay.
+"""
+import argparse
+import sys
+import time
+import urllib.request
+
+
+def main():
+    ap = argparse.ArgumentParser(usage=__doc__)
+    ap.add_argument("-f", "--format", choices=("candump", "asc"), default="candump")
+    ap.add_argument("-i", "--interval", type=float, default=1.0)
+    ap.add_argument("host", nargs="?", default="192.168.4.1")
+    ap.add_argument("output")
+    args = ap.parse_args()
+
+    cursor = None
+    frames = lost = 0
+    header = False
+
+    with open(args.output, "w") as out:
+        try:
+            while True:
+                url = "http://%s/can?trace=%s" % (args.host, args.format)
+                if cursor is not None:
+                    url += "&since=%d" % cursor
+
+                with urllib.request.urlopen(url, timeout=10) as resp:
+                    body = resp.read().decode("ascii", "replace")
+                    cursor = int(resp.headers.get("X-Trace-Next", cursor or 0))
+                    lost += int(resp.headers.get("X-Trace-Lost", 0))
+
+                lines = body.splitlines(keepends=True)
+                if header:
+                    # l'intestazione ASC solo in testa al file
+                    lines = [l for l in lines if not l[:1].isalpha()]
+                header = True
+                for line in lines:
+                    out.write(line)
+                    if line[:1] == "(" or line[:1].isdigit() or line[:1] == " ":
+                        frames += 1
+                out.flush()
+
+                sys.stderr.write("\r%d frame, %d persi" % (frames, lost))
+                time.sleep(args.interval)
+        except KeyboardInterrupt:
+            pass
+
+    sys.stderr.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Genera la tabella degli asset web embeddati (web_assets_table.c).
+
+uso: gen_web_assets.py <lista.txt> <uscita.c>
+
+<lista.txt>: una riga per asset, "<percorso relativo a web/>\\t<blob>",
+dove <blob> è il file effettivamente embeddato (.gz se compresso a build
+time). Il simbolo _binary_*_start/_end deriva dal nome del blob come in
+target_add_binary_data (string(MAKE_C_IDENTIFIER)).
+
+La tabella è indicizzata da un hash perfetto (FNV-1a con seed scelto qui,
+maschera potenza di due): web_asset_find() fa un solo hash e un solo
+confronto esatto, indipendentemente dal numero di asset.
+"""
+import os
+import re
+import sys
+
+MIME = {
+    ".html": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".txt": "text/plain",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+    ".woff2": "font/woff2",
+}
+
+# Cartelle con contenuti di terze parti: cache lunga lato browser
+LONG_CACHE_DIRS = ("lib/", "fonts/")
+
+FNV_OFFSET = 2166136261
+FNV_PRIME = 16777619
+
+
+def fnv1a(data, seed=0):
+    h = FNV_OFFSET ^ seed
+    for b in data:
+        h = ((h ^ b) * FNV_PRIME) & 0xFFFFFFFF
+    return h
+
+
+def c_identifier(name):
+    ident = re.sub(r"[^A-Za-z0-9_]", "_", name)
+    return "_" + ident if ident[0].isdigit() else ident
+
+
+def find_seed(paths, mask):
+    for seed in range(1, 1 << 20):
+        slots = {fnv1a(p.encode(), seed) & mask for p in paths}
+        if len(slots) == len(paths):
+            return seed
+    sys.exit("gen_web_assets: nessun seed senza collisioni")
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+
+    assets = []
+    symbols = set()
+    with open(sys.argv[1]) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            rel, blob = line.split("\t")
+            ext = os.path.splitext(rel)[1].lower()
+            if ext not in MIME:
+                sys.exit(f"gen_web_assets: tipo MIME sconosciuto per {rel}")
+
+            sym = c_identifier(os.path.basename(blob))
+            if sym in symbols:
+                sys.exit(f"gen_web_assets: simbolo duplicato {sym} ({rel})")
+            symbols.add(sym)
+
+            with open(blob, "rb") as b:
+                etag = fnv1a(b.read())
+
+            assets.append({
+                "path": "/" + rel,
+                "mime": MIME[ext],
+                "sym": sym,
+                "gzip": blob.endswith(".gz"),
+                "long_cache": rel.startswith(LONG_CACHE_DIRS),
+                "etag": etag,
+            })
+
+    if len(assets) > 0xFE:
+        sys.exit("gen_web_assets: troppi asset per slot a 8 bit")
+
+    assets.sort(key=lambda a: a["path"])
+    paths = [a["path"] for a in assets]
+
+    size = 1
+    while size < 2 * max(len(assets), 1):
+        size <<= 1
+    mask = size - 1
+    seed = find_seed(paths, mask)
+
+    slots = [0xFF] * size
+    for i, p in enumerate(paths):
+        slots[fnv1a(p.encode(), seed) & mask] = i
+
+    out = []
+    out.append("/* Generato da tools/gen_web_assets.py: non modificare */")
+    out.append('#include "web_assets.h"')
+    out.append("")
+    for a in assets:
+        s = a["sym"]
+        out.append(f'extern const uint8_t _binary_{s}_start[] asm("_binary_{s}_start");')
+        out.append(f'extern const uint8_t _binary_{s}_end[] asm("_binary_{s}_end");')
+    out.append("")
+    out.append("const web_asset_t web_assets[] = {")
+    for a in assets:
+        s = a["sym"]
+        out.append(f'    {{"{a["path"]}", "{a["mime"]}", _binary_{s}_start, _binary_{s}_end, '
+                   f'"\\"{a["etag"]:08x}\\"", {str(a["gzip"]).lower()}, '
+                   f'{str(a["long_cache"]).lower()}}},')
+    out.append("};")
+    out.append(f"const uint16_t web_assets_count = {len(assets)};")
+    out.append("")
+    out.append(f"const uint32_t web_assets_seed = {seed}u;")
+    out.append(f"const uint32_t web_assets_mask = {mask}u;")
+    out.append(f"const uint8_t web_assets_slots[{size}] = {{")
+    for i in range(0, size, 16):
+        out.append("    " + ", ".join(f"0x{v:02X}" for v in slots[i:i + 16]) + ",")
+    out.append("};")
+
+    with open(sys.argv[2], "w") as f:
+        f.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,27 @@
+#!/usr/bin/env python3
+"""Comprime un asset web per l'embed nel firmware.
+
+uso: gzip_asset.py <ingresso> <uscita.gz>
+
+Output deterministico (mtime=0, nessun nome file nell'header): a parità
+di sorgente il blob, e quindi l'ETag calcolato dal firmware, non cambia.
+"""
+import gzip
+import sys
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+
+    src, dst = sys.argv[1], sys.argv[2]
+    with open(src, "rb") as f:
+        data = f.read()
+
+    packed = gzip.compress(data, compresslevel=9, mtime=0)
+    with open(dst, "wb") as f:
+        f.write(packed)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Interroga /stats a ritmo fisso e stampa carico dei task e latenza OBD.
+
+uso: stats_watch.py [-i secondi] [-t task,...] [-c csv] [host]
+
+Ogni riga copre la finestra dalla richiesta precedente: latenza RX -> RT
+dello scheduler OBD (media e massimo), quota CPU dei task scelti (in % di
+un core), heap libero e contatori d'errore TWAI. Per vedere l'effetto del
+carico web: lanciarlo, aprire più pagine della dashboard e confrontare
+una build con APP_TASK_PINNING=0. Ctrl-C per terminare.
+"""
+import argparse
+import json
+import sys
+import time
+import urllib.request
+
+DEFAULT_TASKS = "obd_rt,obd_rx,httpd,ws_push,IDLE0,IDLE1"
+
+
+def main():
+    ap = argparse.ArgumentParser(usage=__doc__)
+    ap.add_argument("-i", "--interval", type=float, default=2.0)
+    ap.add_argument("-t", "--tasks", default=DEFAULT_TASKS)
+    ap.add_argument("-c", "--csv")
+    ap.add_argument("host", nargs="?", default="192.168.4.1")
+    args = ap.parse_args()
+
+    names = [n for n in args.tasks.split(",") if n]
+    url = "http://%s/stats" % args.host
+    csv = open(args.csv, "w") if args.csv else None
+
+    cols = ["t_s", "lat_avg_us", "lat_max_us", "heap_free", "rx_missed", "bus_error"] + names
+    if csv:
+        csv.write(",".join(cols) + "\n")
+    print(" ".join("%10s" % c[:10] for c in cols))
+
+    # la prima risposta copre tutto dall'avvio: apre solo la finestra
+    urllib.request.urlopen(url, timeout=10).read()
+    t0 = time.time()
+
+    try:
+        while True:
+            time.sleep(args.interval)
+            with urllib.request.urlopen(url, timeout=10) as resp:
+                st = json.load(resp)
+
+            cpu = {t["name"]: t["cpu"] for t in st.get("tasks") or []}
+            twai = st.get("twai") or {}
+            row = [
+                "%.1f" % (time.time() - t0),
+                str(st["obd_rt"]["lat_avg_us"]),
+                str(st["obd_rt"]["lat_max_us"]),
+                str(st["heap"]["free"]),
+                str(twai.get("rx_missed", "")),
+                str(twai.get("bus_error", "")),
+            ] + ["%.1f" % cpu[n] if n in cpu else "-" for n in names]
+
+            print(" ".join("%10s" % v for v in row))
+            if csv:
+                csv.write(",".join(row) + "\n")
+                csv.flush()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if csv:
+            csv.close()
+
+    sys.stderr.write("\n")
+
+
+if __name__ == "__main__":
+    main()